@@ -1,7 +1,7 @@
 /* Copyright 2019 LoBo
  * 
  * K210 Bootloader stage_1
- * ver. 1.4.1, 01/2020
+ * ver. 1.5.1, 02/2020
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -39,6 +39,7 @@
 #include "fpioa.h"
 #include "gpiohs.h"
 #include "sha256.h"
+#include "lz4_image.h"
 #include "encoding.h"
 #include "config.h"
 
@@ -116,9 +117,19 @@ static uint32_t crc32;
 
 static uint8_t app_hash[SHA256_HASH_LEN] = {0};
 static uint8_t hash[SHA256_HASH_LEN] = {0};
-static uint8_t buffer[1024] = {0};
+static uint8_t buffer[LZ4_IMAGE_BLOCK_MAX] __attribute__((aligned(4))) = {0};
 static sha256_context_t context;
 
+static uint32_t app_lz4_size = 0;   // uncompressed size of the compressed application, 0 if not compressed
+static uint32_t loaded_address = 0; // Flash address of the application already loaded to SRAM
+static volatile uint32_t dummy = 0;
+
+// boot stages timing, CPU cycles since reset
+static uint64_t boot_start = 0;
+static uint64_t check_time = 0;
+static uint64_t load_start = 0;
+static uint64_t load_time = 0;
+
 static uint32_t boot_pin = 1;
 static int char_in = 0;
 static uint32_t print_enabled = 1;
@@ -126,6 +137,12 @@ static uint32_t print_enabled = 1;
 static uint32_t core0_sync = 0;
 static uint32_t core1_sync = 0;
 
+// CRC32 (0xEDB88320) lookup table for 4-bit CRC calculation
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
 
 // Printing messages if interactive mode is enabled
 // K210 ROM code is used for printing
@@ -141,6 +158,13 @@ static uint32_t core1_sync = 0;
 
 // ==== Local functions ===
 
+// Convert CPU cycles to microseconds
+//-------------------------------------------
+static uint32_t cycles2us(uint64_t cycles)
+{
+    return (uint32_t)(cycles / (DEFAULT_CPU_CLOCK / 1000000UL));
+}
+
 /*
  * Get uint32_t value from Flash
  * 8-bit Flash pionter is used,
@@ -180,62 +204,177 @@ static void get_params(uint32_t i)
 }
 
 /*
- * Check the application's SHA256 hash
- * The hash is 32 bytes long and written after the application's code
- * by Kflash or other application
+ * Load the application to SRAM, check its SHA256 hash if requested
+ * Flash is read 32 bits at a time, the words are fed to the SHA256 engine
+ * which calculates the hash while the code is copied to SRAM,
+ * so the application is read from Flash only once.
+ * The 5-byte prefix is hashed but not copied, the code is shifted
+ * into word aligned position while copying
  */
-//--------------------------
-static uint32_t app_sha256()
+//---------------------------------------------
+static uint32_t app_load(uint32_t check_hash)
 {
-    int size = cfg_size+5;
-    int sz;
-    sha256_init(&context, size);
-    uint32_t idx = 0;
-
-    while (size > 0) {
-        sz = (size >= 1024) ? 1024 : size;
-        for (int n=0; n<sz; n++) {
-            buffer[n] = app_flash_ptr[cfg_address + idx + n];
+    volatile uint32_t *flash_wptr = (volatile uint32_t *)(app_flash_ptr + cfg_address);
+    uint32_t *sram_wptr = (uint32_t *)app_sram_ptr;
+    uint32_t *wbuffer = (uint32_t *)buffer;
+    uint32_t size = cfg_size + 5;                   // hashed size
+    uint32_t nwords = ((cfg_size + 3) / 4) + 2;     // Flash words containing the code
+    uint32_t k = 0, n, sz, prev = 0;
+
+    loaded_address = 0;
+    if (check_hash) sha256_init(&context, size);
+
+    dummy = flash_wptr[0]; // dummy read needed to switch to 32bit XiP read
+    while (k < nwords) {
+        sz = nwords - k;
+        if (sz > (LZ4_IMAGE_BLOCK_SIZE/4)) sz = LZ4_IMAGE_BLOCK_SIZE/4;
+        for (n=0; n<sz; n++) {
+            wbuffer[n] = flash_wptr[k + n];
+        }
+        if ((check_hash) && ((k*4) < size)) {
+            n = size - (k*4);
+            sha256_update(&context, buffer, (n > (sz*4)) ? (sz*4) : n);
+        }
+        // SRAM word 'j' holds the Flash bytes '4*j+5' ~ '4*j+8'
+        for (n=0; n<sz; n++, k++) {
+            if (k >= 2) sram_wptr[k-2] = (prev >> 8) | (wbuffer[n] << 24);
+            prev = wbuffer[n];
+        }
+    }
+    dummy = app_flash_ptr[cfg_address]; // dummy read needed to switch to 8bit XiP read
+
+    if (check_hash) {
+        sha256_final(&context, hash);
+        // get the application's SHA256 hash
+        for (n=0; n<SHA256_HASH_LEN; n++) {
+            app_hash[n] = app_flash_ptr[cfg_address + size + n];
+        }
+        for (n=0; n<SHA256_HASH_LEN; n++) {
+            if (hash[n] != app_hash[n]) {
+                LOG("SHA256 error, ");
+                return 0;
+            }
         }
-        sha256_update(&context, buffer, sz);
-        idx += sz;
-        size -= sz;
     }
+    loaded_address = cfg_address;
+    return 1;
+}
 
-    sha256_final(&context, hash);
+/*
+ * Check if the current application is LZ4 compressed
+ * Returns the uncompressed application size or 0 if not compressed
+ */
+//------------------------------
+static uint32_t app_lz4_check()
+{
+    if (cfg_size < (LZ4_IMAGE_HDR_SIZE + 4)) return 0;
+    if (flash2uint32(cfg_address+5) != LZ4_IMAGE_MAGIC) return 0;
+    if (app_flash_ptr[cfg_address+5+8] != LZ4_IMAGE_BLOCK_LOG2) return 0;
+    uint32_t sz = flash2uint32(cfg_address+5+4);
+    if ((sz < MIN_APP_FLASH_SIZE) || (sz > MAX_APP_FLASH_SIZE)) return 0;
+    return sz;
+}
 
-    // get the application's SHA256 hash
-    offset = cfg_address + cfg_size + 5;
-    for (int n=0; n<SHA256_HASH_LEN; n++) {
-        app_hash[n] = app_flash_ptr[offset + n];
+/*
+ * Load the LZ4 compressed application to SRAM
+ * The compressed blocks are read from Flash 32 bits at a time,
+ * hashed (if requested) and decompressed directly to SRAM in one pass.
+ * The uncompressed data are never read back from Flash, about a half of the Flash reads is saved
+ */
+//-------------------------------------------------
+static uint32_t app_lz4_load(uint32_t check_hash)
+{
+    volatile uint32_t *flash_wptr = (volatile uint32_t *)(app_flash_ptr + cfg_address);
+    uint32_t *wbuffer = (uint32_t *)buffer;
+    uint32_t idx, blk, len, n;
+    uint32_t out = 0;
+    uint32_t size = cfg_size + 5;
+
+    loaded_address = 0;
+    idx = LZ4_IMAGE_HDR_SIZE + 5;   // the first block is word aligned
+    if (check_hash) {
+        sha256_init(&context, size);
+        for (n=0; n<idx; n++) {
+            buffer[n] = app_flash_ptr[cfg_address + n];
+        }
+        sha256_update(&context, buffer, idx);
     }
 
-    for (idx=0; idx<SHA256_HASH_LEN; idx++) {
-        if (hash[idx] != app_hash[idx]) {
-            LOG("SHA256 error, ");
-            return 0;
+    dummy = flash_wptr[0]; // dummy read needed to switch to 32bit XiP read
+    while (idx < size) {
+        blk = flash_wptr[idx/4];
+        len = LZ4_IMAGE_BLOCK_PADDED(blk);
+        if ((len > LZ4_IMAGE_BLOCK_MAX) || ((idx + len) > size)) break;
+        for (n=0; n<(len/4); n++) {
+            wbuffer[n] = flash_wptr[(idx/4) + n];
+        }
+        if (check_hash) sha256_update(&context, buffer, len);
+
+        n = app_lz4_size - out;
+        if (n > LZ4_IMAGE_BLOCK_SIZE) n = LZ4_IMAGE_BLOCK_SIZE;
+        if (blk & LZ4_IMAGE_BLOCK_RAW) {
+            if ((blk & LZ4_IMAGE_BLOCK_LEN) != n) break;
+            for (uint32_t i=0; i<n; i++) {
+                app_sram_ptr[out + i] = buffer[4 + i];
+            }
+        }
+        else if (lz4_image_block_decode(buffer+4, blk & LZ4_IMAGE_BLOCK_LEN, app_sram_ptr + out, n, app_sram_ptr) != 0) break;
+        out += n;
+        idx += len;
+    }
+    dummy = app_flash_ptr[cfg_address]; // dummy read needed to switch to 8bit XiP read
+    if ((idx != size) || (out != app_lz4_size)) {
+        LOG("LZ4 error, ");
+        return 0;
+    }
+
+    if (check_hash) {
+        sha256_final(&context, hash);
+        // get the application's SHA256 hash
+        for (n=0; n<SHA256_HASH_LEN; n++) {
+            app_hash[n] = app_flash_ptr[cfg_address + size + n];
+        }
+        for (n=0; n<SHA256_HASH_LEN; n++) {
+            if (hash[n] != app_hash[n]) {
+                LOG("SHA256 error, ");
+                return 0;
+            }
         }
     }
+    loaded_address = cfg_address;
     return 1;
 }
 
 /*
  * Check the current application CRC32 value
+ * Flash is read 32 bits at a time, CRC is calculated 4 bits at a time
  */
 //-------------------------
 static uint32_t app_crc32()
 {
+    volatile uint32_t *flash_wptr = (volatile uint32_t *)(app_flash_ptr + cfg_address);
+    uint32_t *wbuffer = (uint32_t *)buffer;
     uint32_t crc = 0xFFFFFFFF;
-    uint32_t byte, mask;
-    // Read from flash and update CRC32 value
-    for (uint32_t n = 5; n < (cfg_size+5); n++) {
-        byte = app_flash_ptr[cfg_address + n];
-        crc = crc ^ byte;
-        for (uint32_t j = 0; j < 8; j++) {
-            mask = -(crc & 1);
-            crc = (crc >> 1) ^ (0xEDB88320 & mask);
+    uint32_t size = cfg_size + 5;
+    uint32_t idx = 0, n, sz;
+
+    dummy = flash_wptr[0]; // dummy read needed to switch to 32bit XiP read
+    while (idx < size) {
+        sz = size - idx;
+        if (sz > LZ4_IMAGE_BLOCK_SIZE) sz = LZ4_IMAGE_BLOCK_SIZE;
+        for (n=0; n<((sz+3)/4); n++) {
+            wbuffer[n] = flash_wptr[(idx/4) + n];
         }
+        // Update CRC32 value, the 5-byte prefix is not included
+        for (n = (idx == 0) ? 5 : 0; n < sz; n++) {
+            crc ^= buffer[n];
+            crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+            crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+        }
+        idx += sz;
     }
+    dummy = app_flash_ptr[cfg_address]; // dummy read needed to switch to 8bit XiP read
+
     crc32 = ~crc;
     if (crc32 != cfg_crc) {
         LOG("CRC32 error, ");
@@ -263,9 +402,15 @@ static uint32_t app_check()
         cfg_size = sz;
     }
 
+    app_lz4_size = app_lz4_check();
+    if (app_lz4_size) {
+        LOG("LZ4 %u, ", app_lz4_size);
+    }
     if (cfg_magic & CFG_APP_FLAG_SHA256) {
         // SHA256 check was requested, check flash data
-        return app_sha256();
+        // the application is loaded to SRAM while checking
+        if (app_lz4_size) return app_lz4_load(1);
+        return app_load(1);
     }
     if (cfg_magic & CFG_APP_FLAG_CRC32) {
         // CRC check was requested, check flash data
@@ -338,6 +483,8 @@ int main(void)
         asm("nop");
     }
 
+    boot_start = read_cycle();
+
     // === Printing and Flash XiP mode were initialized in stage_0 ===
 
     // Check if interractive mode can be enabled
@@ -365,7 +512,7 @@ int main(void)
         }
     }
 
-    LOG("\nK210 bootloader by LoBo v.1.4.3\n\n");
+    LOG("\nK210 bootloader by LoBo v.1.5.1\n\n");
 
     LOG("* Find applications in MAIN parameters\n");
 
@@ -433,6 +580,7 @@ check_cfg:
     }
 
     // check if any valid application was found
+    check_time = read_cycle();
     for (i = 0; i < BOOT_CONFIG_ITEMS; i++) {
         if (available_apps[i]) break;
     }
@@ -507,7 +655,11 @@ check_cfg:
             cfg_size = app_size;
             cfg_address = app_flash_start;
             // Check default application
-            if (app_sha256()) key = 0;
+            app_lz4_size = app_lz4_check();
+            if (app_lz4_size) {
+                if (app_lz4_load(1)) key = 0;
+            }
+            else if (app_load(1)) key = 0;
         }
         if (key) {
             // Check failed
@@ -529,12 +681,31 @@ check_cfg:
     }
     #endif
     LOG("* Loading app from flash at 0x%08X (%u B)\n", app_flash_start, app_size);
-
-    for (i=0; i < app_size; i++) {
-        app_sram_ptr[i] = app_flash_ptr[app_flash_start+i+5];
+    load_start = read_cycle();
+
+    cfg_address = app_flash_start;
+    cfg_size = app_size;
+    app_lz4_size = app_lz4_check();
+    // The application may already be loaded while checking its hash
+    if (loaded_address != app_flash_start) {
+        if (app_lz4_size) {
+            if (app_lz4_load(0) == 0) {
+                print_enabled = 1;
+                LOG("\n* Application decompression failed!\n");
+                LOG("* SYSTEM HALTED\n");
+                while (1) {
+                    asm ("nop");
+                }
+            }
+        }
+        else app_load(0);
     }
+    load_time = read_cycle();
 
     // === Start the application ===
+    LOG("* Boot times [us]: stage_0 %u, check %u, load %u, total %u\n",
+        cycles2us(boot_start), cycles2us(check_time - boot_start),
+        cycles2us(load_time - load_start), cycles2us(load_time));
     LOG("* Starting at 0x%08X ...\n\n", app_start);
     usleep(1000);
 
@@ -79,6 +79,25 @@ void sha256_update(sha256_context_t *context, const void *input, size_t input_le
     size_t bytes_to_copy;
     uint32_t i;
 
+    /* Word aligned data is written directly to the SHA256 fifo, 64 bytes at a time */
+    if((context->buffer_len == 0) && (((uintptr_t)data & 3) == 0))
+    {
+        const uint32_t *words = (const uint32_t *)data;
+        while(input_len >= SHA256_BLOCK_LEN)
+        {
+            for(i = 0; i < 16; i++)
+            {
+                while(sha256->sha_function_reg_1.fifo_in_full)
+                    ;
+                sha256->sha_data_in1 = words[i];
+            }
+            words += 16;
+            context->total_len += SHA256_BLOCK_LEN * 8L;
+            input_len -= SHA256_BLOCK_LEN;
+        }
+        data = (const uint8_t *)words;
+    }
+
     while(input_len)
     {
         buffer_bytes_left = SHA256_BLOCK_LEN - context->buffer_len;
@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+'''
+Decoder for the MicroPython K210 deferred (binary) log entries
+
+In 'machine.LOG_STREAM' mode the log entries are sent as text lines
+starting with '#L' followed by the base64 encoded binary entry.
+The format strings are not sent, only their addresses, the strings
+are read from the firmware ELF file ('MicroPython' in the build directory).
+
+Usage:
+  Decode the captured terminal output, other lines are passed unchanged:
+    ./logdecode.py MicroPython terminal.log
+    ./MPyTerm.py ... | ./logdecode.py MicroPython
+  Decode the raw content of 'machine.logbuffer()' saved to file:
+    ./logdecode.py MicroPython --raw logbuffer.bin
+'''
+
+import sys
+import argparse
+import struct
+import binascii
+
+LOG_MARKER = '#L'
+ENTRY_HEADER_SIZE = 8
+ENTRY_TRUNCATED = 0x01
+SHF_ALLOC = 0x02
+
+LOG_COLORS = {
+    'E': '\033[31m',
+    'e': '\033[31;1m',
+    'W': '\033[33m',
+    'I': '\033[32m',
+    'Q': '\033[35;1m',
+    'Y': '\033[33;1m',
+}
+LOG_RESET_COLOR = '\033[0m'
+
+#==============
+class ElfStrings:
+    ''' Read zero terminated strings from the allocated sections of 64-bit ELF file '''
+
+    #---------------------------
+    def __init__(self, filename):
+        with open(filename, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 2:
+            raise ValueError("Not a 64-bit ELF file: {}".format(filename))
+        endian = '<' if self.data[5] == 1 else '>'
+        e_shoff, = struct.unpack_from(endian + 'Q', self.data, 0x28)
+        e_shentsize, e_shnum = struct.unpack_from(endian + 'HH', self.data, 0x3a)
+        self.sections = []
+        for i in range(e_shnum):
+            sh = struct.unpack_from(endian + 'IIQQQQIIQQ', self.data, e_shoff + i * e_shentsize)
+            sh_type, sh_flags, sh_addr, sh_offset, sh_size = sh[1], sh[2], sh[3], sh[4], sh[5]
+            # skip sections without file content (SHT_NOBITS)
+            if (sh_flags & SHF_ALLOC) and sh_type != 8 and sh_size > 0:
+                self.sections.append((sh_addr, sh_offset, sh_size))
+        self.cache = {}
+
+    #----------------------
+    def string(self, addr):
+        if addr in self.cache:
+            return self.cache[addr]
+        for sh_addr, sh_offset, sh_size in self.sections:
+            # the format addresses are recorded as 32-bit values
+            start = sh_addr & 0xFFFFFFFF
+            if start <= addr < start + sh_size:
+                offset = sh_offset + addr - start
+                end = self.data.find(b'\0', offset, sh_offset + sh_size)
+                if end < 0:
+                    end = sh_offset + sh_size
+                s = self.data[offset:end].decode('utf-8', 'replace')
+                self.cache[addr] = s
+                return s
+        return None
+
+
+#-----------------------------
+def parse_format(fmt):
+    '''
+    Split the printf format string into literal text and conversions
+    Returns the list of (text, None) or (conversion, args) items,
+    args is the list of argument types used by the conversion
+    '''
+    items = []
+    i = 0
+    text = ''
+    while i < len(fmt):
+        c = fmt[i]
+        if c != '%':
+            text += c
+            i += 1
+            continue
+        if fmt[i+1:i+2] == '%':
+            text += '%'
+            i += 2
+            continue
+        if text:
+            items.append((text, None))
+            text = ''
+        start = i
+        i += 1
+        args = []
+        spec = '%'
+        while i < len(fmt) and fmt[i] in '-+ #0':
+            spec += fmt[i]
+            i += 1
+        if fmt[i:i+1] == '*':
+            args.append('i')
+            spec += '*'
+            i += 1
+        while i < len(fmt) and fmt[i].isdigit():
+            spec += fmt[i]
+            i += 1
+        if fmt[i:i+1] == '.':
+            spec += '.'
+            i += 1
+            if fmt[i:i+1] == '*':
+                args.append('i')
+                spec += '*'
+                i += 1
+            while i < len(fmt) and fmt[i].isdigit():
+                spec += fmt[i]
+                i += 1
+        is_long = False
+        while i < len(fmt) and fmt[i] in 'hlLzjtq':
+            if fmt[i] != 'h':
+                is_long = True
+            i += 1
+        conv = fmt[i:i+1]
+        i += 1
+        if conv in ('d', 'i'):
+            args.append('q' if is_long else 'i')
+            spec += 'd'
+        elif conv in ('u', 'x', 'X', 'o'):
+            args.append('Q' if is_long else 'I')
+            spec += 'd' if conv == 'u' else conv
+        elif conv == 'c':
+            args.append('Q' if is_long else 'I')
+            spec += 'c'
+        elif conv == 'p':
+            args.append('Q')
+            spec = '0x%x'
+        elif conv == 's':
+            args.append('s')
+            spec += 's'
+        elif conv in ('f', 'F', 'e', 'E', 'g', 'G'):
+            args.append('d')
+            spec += conv
+        elif conv in ('a', 'A'):
+            args.append('d')
+            spec = 'hex'
+        elif conv == 'n':
+            args = None
+            spec = ''
+        else:
+            # unknown conversion, the device stops recording the arguments here
+            items.append((fmt[start:], 'stop'))
+            return items
+        items.append((spec, args))
+    if text:
+        items.append((text, None))
+    return items
+
+
+#----------------------------------
+def decode_entry(entry, strings):
+    ''' Decode one binary log entry, returns (time_us, core, text) '''
+    size, core, flags, fmt_addr = struct.unpack_from('<HBBI', entry, 0)
+    fmt = strings.string(fmt_addr)
+    if fmt is None:
+        return (0, core, "? (core {}) unknown format address 0x{:08x}, entry: {}".format(core, fmt_addr, binascii.hexlify(entry[:size]).decode()))
+
+    pos = ENTRY_HEADER_SIZE
+    out = ''
+    time_us = 0
+    first = True
+    stopped = False
+    for spec, args in parse_format(fmt):
+        if args is None:
+            out += spec
+            continue
+        if stopped or args == 'stop':
+            stopped = True
+            out += spec if args == 'stop' else '<?>'
+            continue
+        values = []
+        for a in args:
+            if a == 's':
+                if pos >= size:
+                    break
+                n = entry[pos]
+                values.append(entry[pos+1:pos+1+n].decode('utf-8', 'replace'))
+                pos += 1 + n
+            else:
+                n = struct.calcsize(a)
+                if pos + n > size:
+                    break
+                values.append(struct.unpack_from('<' + a, entry, pos)[0])
+                pos += n
+        if len(values) < len(args):
+            # the entry was truncated on the device
+            stopped = True
+            out += '<?>'
+            continue
+        if first:
+            time_us = values[0]
+            first = False
+        if spec == 'hex':
+            out += float.hex(values[-1])
+        elif spec.endswith('c'):
+            out += spec % (chr(values[-1] & 0xFF),)
+        else:
+            out += spec % tuple(values)
+    if flags & ENTRY_TRUNCATED and not stopped:
+        out = out.rstrip('\r\n') + ' <truncated>\r\n'
+    return (time_us, core, out)
+
+
+#------------------------------------
+def colorize(text, use_color):
+    if use_color and text[:1] in LOG_COLORS:
+        return LOG_COLORS[text[0]] + text.rstrip('\r\n') + LOG_RESET_COLOR + '\n'
+    return text.rstrip('\r\n') + '\n'
+
+
+#------------------------------------
+def decode_stream(fin, fout, strings, use_color):
+    for line in fin:
+        s = line.strip()
+        if s.startswith(LOG_MARKER):
+            try:
+                entry = binascii.a2b_base64(s[len(LOG_MARKER):])
+                _, _, text = decode_entry(entry, strings)
+            except (binascii.Error, struct.error, ValueError, IndexError, TypeError) as e:
+                text = "? bad log entry ({}): {}\n".format(e, s)
+            fout.write(colorize(text, use_color))
+        else:
+            fout.write(line)
+        fout.flush()
+
+
+#------------------------------------
+def decode_raw(data, fout, strings, use_color):
+    entries = []
+    pos = 0
+    while pos + ENTRY_HEADER_SIZE <= len(data):
+        size, = struct.unpack_from('<H', data, pos)
+        if size < ENTRY_HEADER_SIZE or pos + size > len(data):
+            break
+        entries.append(decode_entry(data[pos:pos+size], strings))
+        pos += size
+    # merge the entries of both processors
+    entries.sort(key=lambda e: e[0])
+    for _, _, text in entries:
+        fout.write(colorize(text, use_color))
+
+
+#=========
+def main():
+    parser = argparse.ArgumentParser(description='Decode MicroPython K210 deferred log entries')
+    parser.add_argument('elf', help='firmware ELF file (MicroPython)')
+    parser.add_argument('input', nargs='?', help='input file, stdin if not given')
+    parser.add_argument('--raw', action='store_true', help="input is raw content of 'machine.logbuffer()'")
+    parser.add_argument('--color', action='store_true', help='colorize the log messages')
+    args = parser.parse_args()
+
+    strings = ElfStrings(args.elf)
+    if args.raw:
+        if args.input:
+            with open(args.input, 'rb') as f:
+                data = f.read()
+        else:
+            data = sys.stdin.buffer.read()
+        decode_raw(data, sys.stdout, strings, args.color)
+    else:
+        if args.input:
+            with open(args.input, 'r', errors='replace') as f:
+                decode_stream(f, sys.stdout, strings, args.color)
+        else:
+            decode_stream(sys.stdin, sys.stdout, strings, args.color)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
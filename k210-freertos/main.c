@@ -55,6 +55,7 @@
 #if MICROPY_PY_THREAD
 #include "mpthreadport.h"
 #include "py/mpthread.h"
+#include "ipcjob.h"
 #endif
 
 //*****bsp****
@@ -179,6 +180,11 @@ static void mp_task_proc0(void *pvParameter)
         mp_stack_set_top((void *)pxTaskGetStackEnd(NULL));
         mp_stack_set_limit((size_t)(pxTaskGetStackEnd(NULL) - pxTaskGetStackStart(NULL) - MICROPY_TASK_STACK_RESERVED));
 
+        #if MICROPY_PY_PROFILER
+        mp_profiler_reset();
+        #endif
+        ipcjob_reset();
+        machine_hw_spi_queue_reset();
         #if MICROPY_ENABLE_GC
         // ** Initialize MicroPython heap
         gc_init(mp_heap, mp_heap + mpy_config.config.heap_size1);
@@ -268,6 +274,10 @@ static void mp_task_proc1(void *pvParameter)
         mp_stack_set_top((void *)pxTaskGetStackEnd(NULL));
         mp_stack_set_limit((size_t)(pxTaskGetStackEnd(NULL) - pxTaskGetStackStart(NULL) - MICROPY_TASK_STACK_RESERVED));
 
+        #if MICROPY_PY_PROFILER
+        mp_profiler_reset();
+        #endif
+        machine_hw_spi_queue_reset();
         #if MICROPY_ENABLE_GC
         // ** Initialize MicroPython heap
         gc_init(mp_heap2, mp_heap2 + mpy_config.config.heap_size2);
@@ -345,6 +355,19 @@ static void mp_task_proc1(void *pvParameter)
                                 }
                                 // ====================================================================================
 
+                                xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+                                task_ipc.busy = false;
+                                xSemaphoreGive(inter_proc_mutex);
+                                msg_processed = true;
+                            }
+                            else if (msg.intdata == THREAD_IPC_TYPE_JOB) {
+                                // Execute the job submitted by the main instance
+                                xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+                                task_ipc.busy = true;
+                                xSemaphoreGive(inter_proc_mutex);
+
+                                ipcjob_execute(msg.strdata, msg.strlen);
+
                                 xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
                                 task_ipc.busy = false;
                                 xSemaphoreGive(inter_proc_mutex);
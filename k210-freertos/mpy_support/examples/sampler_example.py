@@ -0,0 +1,26 @@
+# Background 1 kHz sampling of the MPU6050 accelerometer and gyroscope
+# The sensor is read by the sampler task, MicroPython only drains the ring buffer
+
+import machine, ustruct, utime
+
+i2c = machine.I2C(0, sda=24, scl=25, freq=400000)
+i2c.writeto_mem(0x68, 0x6B, b'\x00')   # wake up the sensor
+
+# read 14 bytes (accel, temperature, gyro) from register 0x3B
+txn = i2c.compile([(0x68, 0x3B, 14)])
+smp = machine.Sampler(0, i2c, txn, period=1000, size=512)
+
+rec_size, data_offset, data_len = smp.record()
+buf = bytearray(rec_size * 100)
+
+def process(n):
+    for i in range(n):
+        ts = ustruct.unpack_from('<I', buf, i * rec_size)[0]
+        ax, ay, az, t, gx, gy, gz = ustruct.unpack_from('>7h', buf, i * rec_size + data_offset)
+        # ... use the sample
+
+while True:
+    utime.sleep_ms(50)
+    n = smp.readinto(buf)
+    process(n)
+    samples, overruns, errors, missed = smp.stats()
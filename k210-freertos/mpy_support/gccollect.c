@@ -94,6 +94,9 @@ static void gc_collect_inner(int level)
 //-------------------
 void gc_collect(void)
 {
+    #if MICROPY_PY_THREAD_STATS
+    uint64_t start = mp_hal_ticks_us();
+    #endif
     // start the GC
     gc_collect_start();
 
@@ -107,5 +110,9 @@ void gc_collect(void)
 #endif
     // end the GC
     gc_collect_end();
+    #if MICROPY_PY_THREAD_STATS
+    MP_STATE_THREAD(stats.gc_count)++;
+    MP_STATE_THREAD(stats.gc_us) += mp_hal_ticks_us() - start;
+    #endif
 }
 
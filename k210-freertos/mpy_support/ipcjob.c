@@ -0,0 +1,768 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Work queue between two MicroPython instances
+ *
+ * The main instance submits the jobs: the name of the function and its arguments,
+ * serialized in compact binary format, are sent to the 2nd instance which executes
+ * the function from the worker module ('ipcworker' by default) and returns the result
+ * serialized in the same format. The result is received through the 'Future' object.
+ *
+ * The writable buffer objects (bytearray, array, memoryview, ...) are not copied,
+ * only their address and size are sent, the 2nd instance accesses them as memoryview.
+ * Buffers from the main instance's heap are kept alive until the job is done (also if the Future
+ * is collected before), they are referenced from the main instance's root pointers;
+ * the buffers outside of both heaps (for example 'machine.rambuf') can be used freely.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "py/runtime.h"
+#include "py/objstr.h"
+#include "py/objlist.h"
+#include "py/objarray.h"
+#include "py/binary.h"
+#include "py/builtin.h"
+#include "py/mperrno.h"
+#include "py/mpthread.h"
+#include "mphalport.h"
+#include "mpthreadport.h"
+#include "modmachine.h"
+#include "ipcjob.h"
+
+#if MICROPY_PY_THREAD
+
+// Job slot states
+#define IPC_JOB_FREE            0
+#define IPC_JOB_QUEUED          1
+#define IPC_JOB_RUNNING         2
+#define IPC_JOB_DONE            3
+
+#define IPC_JOB_WAIT_TICKS      10  // maximal wait for the job result before the pending exceptions are checked
+
+// Serialized object tags
+#define IPC_TAG_NONE            'N'
+#define IPC_TAG_TRUE            'T'
+#define IPC_TAG_FALSE           'F'
+#define IPC_TAG_INT             'i'
+#define IPC_TAG_FLOAT           'f'
+#define IPC_TAG_STR             's'
+#define IPC_TAG_BYTES           'b'
+#define IPC_TAG_BUFREF          'r'
+#define IPC_TAG_TUPLE           't'
+#define IPC_TAG_LIST            'l'
+#define IPC_TAG_DICT            'd'
+#define IPC_TAG_RESULT          'R'
+#define IPC_TAG_ERROR           'E'
+
+#define IPC_MAX_DEPTH           8
+#define IPC_REQ_HEADER_SIZE     5   // job id (uint32) + slot (uint8)
+
+typedef struct _ipc_job_t {
+    volatile uint8_t    state;
+    bool                abandoned;  // Future was collected before the job was done
+    bool                cancelled;  // main instance was reset, the job is not executed
+    uint32_t            id;
+    uint8_t             *result;    // serialized result, allocated from FreeRTOS heap
+    uint32_t            result_len;
+} ipc_job_t;
+
+typedef struct _ipc_enc_t {
+    vstr_t      *vstr;
+    mp_obj_t    refs;               // list of referenced buffer objects (main instance)
+    bool        worker;
+} ipc_enc_t;
+
+typedef struct _ipc_dec_t {
+    const uint8_t   *p;
+    const uint8_t   *end;
+    mp_obj_t        refs;
+} ipc_dec_t;
+
+typedef struct _ipc_future_obj_t {
+    mp_obj_base_t   base;
+    uint32_t        id;
+    uint8_t         slot;
+    bool            done;
+    bool            error;
+    mp_obj_t        refs;
+    mp_obj_t        value;
+} ipc_future_obj_t;
+
+// The job slots are shared by both instances, access is protected by 'inter_proc_mutex'
+static ipc_job_t ipc_jobs[IPC_JOB_MAX_JOBS] = { 0 };
+// Given by the worker when the job is finished
+static SemaphoreHandle_t ipc_job_sem[IPC_JOB_MAX_JOBS] = { NULL };
+static StaticSemaphore_t ipc_job_sem_buf[IPC_JOB_MAX_JOBS];
+static uint32_t ipc_job_id = 0;
+// Not a qstr, each instance has its own dynamic qstr pool
+static char ipc_worker_module[32] = "ipcworker";
+
+const mp_obj_type_t ipc_future_type;
+
+
+// ==== Serialization =======================================================
+
+//--------------------------------------------------
+static void _enc_uint(vstr_t *vstr, uint64_t val, int size)
+{
+    char *p = vstr_add_len(vstr, size);
+    for (int i = 0; i < size; i++) {
+        p[i] = (val >> (i * 8)) & 0xFF;
+    }
+}
+
+//---------------------------------------------------------------------------------------
+static void _enc_data(vstr_t *vstr, char tag, const void *data, size_t len)
+{
+    vstr_add_byte(vstr, tag);
+    _enc_uint(vstr, len, 4);
+    vstr_add_strn(vstr, (const char *)data, len);
+}
+
+//-------------------------------------------------------------------
+static bool _in_own_heap(void *ptr)
+{
+    return ((byte *)ptr >= MP_STATE_MEM(gc_pool_start)) && ((byte *)ptr < MP_STATE_MEM(gc_pool_end));
+}
+
+//-------------------------------------------------------------------
+static void _encode(ipc_enc_t *enc, mp_obj_t obj, int depth)
+{
+    vstr_t *vstr = enc->vstr;
+    if (depth > IPC_MAX_DEPTH) {
+        mp_raise_ValueError("IPC object nesting too deep");
+    }
+
+    if (obj == mp_const_none) vstr_add_byte(vstr, IPC_TAG_NONE);
+    else if (obj == mp_const_true) vstr_add_byte(vstr, IPC_TAG_TRUE);
+    else if (obj == mp_const_false) vstr_add_byte(vstr, IPC_TAG_FALSE);
+    else if (mp_obj_is_int(obj)) {
+        vstr_add_byte(vstr, IPC_TAG_INT);
+        _enc_uint(vstr, (uint64_t)mp_obj_int_get_checked(obj), 8);
+    }
+    else if (mp_obj_is_float(obj)) {
+        double f = mp_obj_get_float(obj);
+        uint64_t u;
+        memcpy(&u, &f, 8);
+        vstr_add_byte(vstr, IPC_TAG_FLOAT);
+        _enc_uint(vstr, u, 8);
+    }
+    else if (mp_obj_is_str(obj)) {
+        size_t len;
+        const char *s = mp_obj_str_get_data(obj, &len);
+        _enc_data(vstr, IPC_TAG_STR, s, len);
+    }
+    else if (mp_obj_is_type(obj, &mp_type_bytes)) {
+        size_t len;
+        const char *s = mp_obj_str_get_data(obj, &len);
+        _enc_data(vstr, IPC_TAG_BYTES, s, len);
+    }
+    else if (mp_obj_is_type(obj, &mp_type_tuple) || mp_obj_is_type(obj, &mp_type_list)) {
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_get_array(obj, &n, &items);
+        vstr_add_byte(vstr, (mp_obj_is_type(obj, &mp_type_tuple)) ? IPC_TAG_TUPLE : IPC_TAG_LIST);
+        _enc_uint(vstr, n, 4);
+        for (size_t i = 0; i < n; i++) {
+            _encode(enc, items[i], depth + 1);
+        }
+    }
+    else if (mp_obj_is_type(obj, &mp_type_dict)) {
+        mp_map_t *map = mp_obj_dict_get_map(obj);
+        vstr_add_byte(vstr, IPC_TAG_DICT);
+        _enc_uint(vstr, map->used, 4);
+        for (size_t i = 0; i < map->alloc; i++) {
+            if (mp_map_slot_is_filled(map, i)) {
+                _encode(enc, map->table[i].key, depth + 1);
+                _encode(enc, map->table[i].value, depth + 1);
+            }
+        }
+    }
+    else {
+        mp_buffer_info_t bufinfo;
+        if (mp_get_buffer(obj, &bufinfo, MP_BUFFER_WRITE)) {
+            if ((enc->worker) && (_in_own_heap(bufinfo.buf))) {
+                // the worker's heap objects can be collected, the data must be copied
+                _enc_data(vstr, IPC_TAG_BYTES, bufinfo.buf, bufinfo.len);
+                return;
+            }
+            // pass by reference, the data are not copied
+            vstr_add_byte(vstr, IPC_TAG_BUFREF);
+            vstr_add_byte(vstr, (bufinfo.typecode == BYTEARRAY_TYPECODE) ? 'B' : bufinfo.typecode);
+            _enc_uint(vstr, (uintptr_t)bufinfo.buf, 8);
+            _enc_uint(vstr, bufinfo.len, 4);
+            if ((enc->refs != MP_OBJ_NULL) && (_in_own_heap(bufinfo.buf))) mp_obj_list_append(enc->refs, obj);
+        }
+        else if (mp_get_buffer(obj, &bufinfo, MP_BUFFER_READ)) {
+            _enc_data(vstr, IPC_TAG_BYTES, bufinfo.buf, bufinfo.len);
+        }
+        else {
+            mp_raise_msg_varg(&mp_type_TypeError, "can't pass '%s' object to IPC job", mp_obj_get_type_str(obj));
+        }
+    }
+}
+
+//----------------------------------------------------------
+static const uint8_t *_dec_need(ipc_dec_t *dec, size_t len)
+{
+    if ((size_t)(dec->end - dec->p) < len) {
+        mp_raise_ValueError("Corrupted IPC job data");
+    }
+    const uint8_t *p = dec->p;
+    dec->p += len;
+    return p;
+}
+
+//----------------------------------------------------
+static uint64_t _dec_uint(ipc_dec_t *dec, int size)
+{
+    const uint8_t *p = _dec_need(dec, size);
+    uint64_t val = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+//------------------------------------------------------
+static mp_obj_t _dec_bufref(ipc_dec_t *dec)
+{
+    char typecode = *_dec_need(dec, 1);
+    void *addr = (void *)(uintptr_t)_dec_uint(dec, 8);
+    size_t len = _dec_uint(dec, 4);
+
+    if (dec->refs != MP_OBJ_NULL) {
+        // the buffer passed with the job request is returned, return the original object
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_list_get(dec->refs, &n, &items);
+        for (size_t i = 0; i < n; i++) {
+            mp_buffer_info_t bufinfo;
+            mp_get_buffer_raise(items[i], &bufinfo, MP_BUFFER_READ);
+            if ((bufinfo.buf == addr) && (bufinfo.len == len)) return items[i];
+        }
+    }
+    size_t itemsize = mp_binary_get_size('@', typecode, NULL);
+    if (itemsize == 0) itemsize = 1;
+    return mp_obj_new_memoryview(typecode | MP_OBJ_ARRAY_TYPECODE_FLAG_RW, len / itemsize, addr);
+}
+
+//------------------------------------------------------
+static mp_obj_t _decode(ipc_dec_t *dec, int depth)
+{
+    if (depth > IPC_MAX_DEPTH) {
+        mp_raise_ValueError("Corrupted IPC job data");
+    }
+    char tag = *_dec_need(dec, 1);
+    switch (tag) {
+        case IPC_TAG_NONE:
+            return mp_const_none;
+        case IPC_TAG_TRUE:
+            return mp_const_true;
+        case IPC_TAG_FALSE:
+            return mp_const_false;
+        case IPC_TAG_INT:
+            return mp_obj_new_int_from_ll((long long)_dec_uint(dec, 8));
+        case IPC_TAG_FLOAT: {
+            uint64_t u = _dec_uint(dec, 8);
+            double f;
+            memcpy(&f, &u, 8);
+            return mp_obj_new_float(f);
+        }
+        case IPC_TAG_STR:
+        case IPC_TAG_BYTES: {
+            size_t len = _dec_uint(dec, 4);
+            const char *data = (const char *)_dec_need(dec, len);
+            return (tag == IPC_TAG_STR) ? mp_obj_new_str(data, len) : mp_obj_new_bytes((const byte *)data, len);
+        }
+        case IPC_TAG_BUFREF:
+            return _dec_bufref(dec);
+        case IPC_TAG_TUPLE:
+        case IPC_TAG_LIST: {
+            size_t n = _dec_uint(dec, 4);
+            mp_obj_t res = (tag == IPC_TAG_TUPLE) ? mp_obj_new_tuple(n, NULL) : mp_obj_new_list(n, NULL);
+            mp_obj_t *items;
+            mp_obj_get_array_fixed_n(res, n, &items);
+            for (size_t i = 0; i < n; i++) {
+                items[i] = _decode(dec, depth + 1);
+            }
+            return res;
+        }
+        case IPC_TAG_DICT: {
+            size_t n = _dec_uint(dec, 4);
+            mp_obj_t res = mp_obj_new_dict(n);
+            for (size_t i = 0; i < n; i++) {
+                mp_obj_t key = _decode(dec, depth + 1);
+                mp_obj_dict_store(res, key, _decode(dec, depth + 1));
+            }
+            return res;
+        }
+        default:
+            mp_raise_ValueError("Corrupted IPC job data");
+    }
+    return mp_const_none;
+}
+
+
+// ==== Worker (2nd MicroPython instance) ===================================
+
+// Serialize the exception raised by the job
+// Returns false if the error could not be serialized (no memory)
+//------------------------------------------------------------------
+static bool _encode_error(vstr_t *vstr, mp_obj_t exc)
+{
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        vstr->len = 0;
+        vstr_add_byte(vstr, IPC_TAG_ERROR);
+        const char *name = qstr_str(mp_obj_get_type(exc)->name);
+        _enc_data(vstr, IPC_TAG_STR, name, strlen(name));
+
+        vstr_t msg;
+        mp_print_t print;
+        vstr_init_print(&msg, 32, &print);
+        mp_obj_print_helper(&print, exc, PRINT_STR);
+        _enc_data(vstr, IPC_TAG_STR, msg.buf, msg.len);
+        vstr_clear(&msg);
+        nlr_pop();
+        return true;
+    }
+    return false;
+}
+
+// Executed from the 2nd instance's main loop, the request is freed by the caller
+//======================================================
+void ipcjob_execute(const uint8_t *req, size_t len)
+{
+    if (len < IPC_REQ_HEADER_SIZE) return;
+    ipc_dec_t dec = { .p = req, .end = req + len, .refs = MP_OBJ_NULL };
+    uint32_t id = _dec_uint(&dec, 4);
+    uint8_t slot = _dec_uint(&dec, 1);
+    if (slot >= IPC_JOB_MAX_JOBS) return;
+
+    // the job is not executed if the main instance was reset after it was submitted
+    ipc_job_t *job = &ipc_jobs[slot];
+    xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+    bool run = (job->id == id) && (job->state == IPC_JOB_QUEUED);
+    if ((run) && (job->cancelled)) {
+        job->state = IPC_JOB_FREE;
+        run = false;
+    }
+    if (run) job->state = IPC_JOB_RUNNING;
+    xSemaphoreGive(inter_proc_mutex);
+    if (!run) return;
+
+    vstr_t res;
+    vstr_init(&res, 64);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t name = _decode(&dec, 0);
+        mp_obj_t args = _decode(&dec, 0);
+        mp_obj_t kwargs = _decode(&dec, 0);
+
+        mp_obj_t module = mp_import_name(qstr_from_str(ipc_worker_module), mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+        size_t name_len;
+        const char *name_str = mp_obj_str_get_data(name, &name_len);
+        mp_obj_t func = mp_load_attr(module, qstr_from_strn(name_str, name_len));
+
+        // positional arguments followed by the keyword arguments
+        size_t n_args;
+        mp_obj_t *items;
+        mp_obj_tuple_get(args, &n_args, &items);
+        mp_map_t *kw = (kwargs != mp_const_none) ? mp_obj_dict_get_map(kwargs) : NULL;
+        size_t n_kw = (kw) ? kw->used : 0;
+        mp_obj_t *call_args = m_new(mp_obj_t, n_args + (2 * n_kw));
+        memcpy(call_args, items, n_args * sizeof(mp_obj_t));
+        size_t idx = n_args;
+        for (size_t i = 0; (kw) && (i < kw->alloc); i++) {
+            if (mp_map_slot_is_filled(kw, i)) {
+                call_args[idx++] = kw->table[i].key;
+                call_args[idx++] = kw->table[i].value;
+            }
+        }
+        mp_obj_t result = mp_call_function_n_kw(func, n_args, n_kw, call_args);
+        m_del(mp_obj_t, call_args, n_args + (2 * n_kw));
+
+        ipc_enc_t enc = { .vstr = &res, .refs = MP_OBJ_NULL, .worker = true };
+        vstr_add_byte(&res, IPC_TAG_RESULT);
+        _encode(&enc, result, 0);
+        nlr_pop();
+    }
+    else if (!_encode_error(&res, MP_OBJ_FROM_PTR(nlr.ret_val))) {
+        // no result, MemoryError is raised by the Future
+        res.len = 0;
+    }
+
+    uint8_t *result = (res.len) ? pvPortMalloc(res.len) : NULL;
+    if (result) memcpy(result, res.buf, res.len);
+    xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+    if ((job->cancelled) && (MP_STATE_VM(mp_pending_exception) == MP_OBJ_FROM_PTR(&MP_STATE_VM(mp_kbd_exception)))) {
+        // the interrupt requested by the main instance's reset arrived after the job has finished
+        MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
+    }
+    if ((job->abandoned) || (job->cancelled)) job->state = IPC_JOB_FREE;
+    else {
+        job->result = result;
+        job->result_len = (result) ? res.len : 0;
+        job->state = IPC_JOB_DONE;
+        result = NULL;
+    }
+    xSemaphoreGive(inter_proc_mutex);
+    if (ipc_job_sem[slot]) xSemaphoreGive(ipc_job_sem[slot]);
+    if (result) vPortFree(result);
+    vstr_clear(&res);
+}
+
+
+// ==== Main instance =======================================================
+
+// Release the referenced buffers of the finished jobs
+// Must be called with 'inter_proc_mutex' taken
+//-------------------------------
+static void _release_refs(void)
+{
+    for (int i = 0; i < IPC_JOB_MAX_JOBS; i++) {
+        if (ipc_jobs[i].state == IPC_JOB_FREE) MP_STATE_PORT(ipc_job_refs)[i] = MP_OBJ_NULL;
+    }
+}
+
+// Raise KeyboardInterrupt in the 2nd instance executing the job
+//---------------------------------
+static void _interrupt_worker(void)
+{
+    mp_state_ctx2.vm.mp_pending_exception = MP_OBJ_FROM_PTR(&mp_state_ctx2.vm.mp_kbd_exception);
+    #if MICROPY_ENABLE_SCHEDULER
+    if (mp_state_ctx2.vm.sched_state == MP_SCHED_IDLE) {
+        mp_state_ctx2.vm.sched_state = MP_SCHED_PENDING;
+    }
+    #endif
+}
+
+// Called on the main instance's (soft) reset, before the heap is initialized
+// The worker must not access the buffers in the main instance's heap after it is reinitialized:
+// the finished results are freed, the queued jobs are cancelled (the worker frees their slots)
+// and the running job is interrupted; the referenced buffers stay rooted until it is finished
+//=====================
+void ipcjob_reset(void)
+{
+    if ((mpy_config.config.use_two_main_tasks) && (inter_proc_mutex)) {
+        bool running;
+        do {
+            running = false;
+            xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+            for (int i = 0; i < IPC_JOB_MAX_JOBS; i++) {
+                ipc_job_t *job = &ipc_jobs[i];
+                if (job->state == IPC_JOB_DONE) {
+                    if (job->result) vPortFree(job->result);
+                    job->result = NULL;
+                    job->state = IPC_JOB_FREE;
+                }
+                else if (job->state != IPC_JOB_FREE) {
+                    if ((!job->cancelled) && (job->state == IPC_JOB_RUNNING)) _interrupt_worker();
+                    job->cancelled = true;
+                    if (job->state == IPC_JOB_RUNNING) running = true;
+                }
+            }
+            xSemaphoreGive(inter_proc_mutex);
+            if (running) vTaskDelay(1);
+        } while (running);
+    }
+    memset(MP_STATE_PORT(ipc_job_refs), 0, sizeof(MP_STATE_PORT(ipc_job_refs)));
+}
+
+//-------------------------------
+static void _check_two_instances()
+{
+    if (!mpy_config.config.use_two_main_tasks) {
+        mp_raise_NotImplementedError("Not available in single MicroPython instance mode");
+    }
+}
+
+// Get the result of the finished job, returns false if the job is not finished
+//-----------------------------------------------------------
+static bool _future_get(ipc_future_obj_t *self)
+{
+    if (self->done) return true;
+
+    uint8_t *result = NULL;
+    uint32_t result_len = 0;
+    xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+    ipc_job_t *job = &ipc_jobs[self->slot];
+    if ((job->id != self->id) || (job->state != IPC_JOB_DONE)) {
+        xSemaphoreGive(inter_proc_mutex);
+        return false;
+    }
+    result = job->result;
+    result_len = job->result_len;
+    job->result = NULL;
+    job->state = IPC_JOB_FREE;
+    _release_refs();
+    xSemaphoreGive(inter_proc_mutex);
+
+    self->done = true;
+    if (result == NULL) {
+        self->error = true;
+        self->value = mp_obj_new_exception_msg(&mp_type_MemoryError, "IPC result buffer");
+        return true;
+    }
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        ipc_dec_t dec = { .p = result + 1, .end = result + result_len, .refs = self->refs };
+        if (result[0] == IPC_TAG_RESULT) {
+            self->value = _decode(&dec, 0);
+        }
+        else {
+            // error, the exception of the same type is raised if it is a builtin exception
+            mp_obj_t name = _decode(&dec, 0);
+            mp_obj_t msg = _decode(&dec, 0);
+            const mp_obj_type_t *exc_type = &mp_type_RuntimeError;
+            size_t len;
+            const char *name_str = mp_obj_str_get_data(name, &len);
+            qstr q = qstr_find_strn(name_str, len);
+            if (q != MP_QSTR_NULL) {
+                mp_map_elem_t *elem = mp_map_lookup((mp_map_t *)&mp_module_builtins_globals.map, MP_OBJ_NEW_QSTR(q), MP_MAP_LOOKUP);
+                if ((elem) && (mp_obj_is_type(elem->value, &mp_type_type)) &&
+                        (mp_obj_is_subclass_fast(elem->value, MP_OBJ_FROM_PTR(&mp_type_BaseException)))) {
+                    exc_type = MP_OBJ_TO_PTR(elem->value);
+                }
+            }
+            self->error = true;
+            self->value = mp_obj_new_exception_args(exc_type, 1, &msg);
+        }
+        nlr_pop();
+    }
+    else {
+        self->error = true;
+        self->value = MP_OBJ_FROM_PTR(nlr.ret_val);
+    }
+    vPortFree(result);
+    // the referenced buffers are not needed anymore
+    self->refs = mp_const_none;
+    return true;
+}
+
+// Submit the job to the 2nd MicroPython instance
+// _thread.ipc_submit(func_name, *args, **kwargs) -> Future
+//------------------------------------------------------------------------------------
+STATIC mp_obj_t ipcjob_submit(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    _check_two_instances();
+    if (uxPortGetProcessorId() != MAIN_TASK_PROC) {
+        mp_raise_msg(&mp_type_OSError, "Jobs can only be submitted from the main instance");
+    }
+    mp_obj_str_get_str(args[0]);
+
+    ipc_future_obj_t *future = m_new_obj_with_finaliser(ipc_future_obj_t);
+    future->base.type = &ipc_future_type;
+    future->done = false;
+    future->error = false;
+    future->value = mp_const_none;
+    future->refs = mp_obj_new_list(0, NULL);
+
+    // serialize the request, the header is set after the job slot is reserved
+    vstr_t req;
+    vstr_init(&req, 64);
+    vstr_add_len(&req, IPC_REQ_HEADER_SIZE);
+    ipc_enc_t enc = { .vstr = &req, .refs = future->refs, .worker = false };
+    _encode(&enc, args[0], 0);
+    _encode(&enc, mp_obj_new_tuple(n_args - 1, args + 1), 0);
+    if (kw_args->used) {
+        vstr_add_byte(&req, IPC_TAG_DICT);
+        _enc_uint(&req, kw_args->used, 4);
+        for (size_t i = 0; i < kw_args->alloc; i++) {
+            if (mp_map_slot_is_filled(kw_args, i)) {
+                _encode(&enc, kw_args->table[i].key, 1);
+                _encode(&enc, kw_args->table[i].value, 1);
+            }
+        }
+    }
+    else vstr_add_byte(&req, IPC_TAG_NONE);
+
+    int slot = -1;
+    xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+    _release_refs();
+    for (int i = 0; i < IPC_JOB_MAX_JOBS; i++) {
+        if (ipc_jobs[i].state == IPC_JOB_FREE) {
+            slot = i;
+            ipc_jobs[i].state = IPC_JOB_QUEUED;
+            ipc_jobs[i].abandoned = false;
+            ipc_jobs[i].cancelled = false;
+            ipc_jobs[i].id = ++ipc_job_id;
+            ipc_jobs[i].result = NULL;
+            future->id = ipc_jobs[i].id;
+            // the buffers stay referenced until the job is finished, even if the Future is collected
+            MP_STATE_PORT(ipc_job_refs)[i] = future->refs;
+            break;
+        }
+    }
+    xSemaphoreGive(inter_proc_mutex);
+    if (slot < 0) {
+        vstr_clear(&req);
+        future->done = true;
+        mp_raise_msg(&mp_type_OSError, "No free IPC job slot");
+    }
+    future->slot = slot;
+    if (ipc_job_sem[slot] == NULL) ipc_job_sem[slot] = xSemaphoreCreateBinaryStatic(&ipc_job_sem_buf[slot]);
+    // not taken completion signal of the previous job in the slot
+    xSemaphoreTake(ipc_job_sem[slot], 0);
+    for (int i = 0; i < 4; i++) {
+        req.buf[i] = (future->id >> (i * 8)) & 0xFF;
+    }
+    req.buf[4] = slot;
+
+    int res = mp_thread_sendmsg_to_mpy2(THREAD_MSG_TYPE_STRING, THREAD_IPC_TYPE_JOB, (uint8_t *)req.buf, req.len);
+    vstr_clear(&req);
+    if (!res) {
+        xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+        ipc_jobs[slot].state = IPC_JOB_FREE;
+        _release_refs();
+        xSemaphoreGive(inter_proc_mutex);
+        future->done = true;
+        mp_raise_msg(&mp_type_OSError, "IPC queue full");
+    }
+    return MP_OBJ_FROM_PTR(future);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(ipcjob_submit_obj, 1, ipcjob_submit);
+
+// Set or get the name of the module from which the 2nd instance executes the jobs
+//--------------------------------------------------------------------
+STATIC mp_obj_t ipcjob_worker(size_t n_args, const mp_obj_t *args)
+{
+    _check_two_instances();
+    if (n_args > 0) {
+        size_t len;
+        const char *name = mp_obj_str_get_data(args[0], &len);
+        if ((len == 0) || (len >= sizeof(ipc_worker_module))) {
+            mp_raise_ValueError("Invalid module name");
+        }
+        xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+        memcpy(ipc_worker_module, name, len);
+        ipc_worker_module[len] = '\0';
+        xSemaphoreGive(inter_proc_mutex);
+    }
+    return mp_obj_new_str(ipc_worker_module, strlen(ipc_worker_module));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ipcjob_worker_obj, 0, 1, ipcjob_worker);
+
+
+// ==== Future object =======================================================
+
+//-----------------------------------------------------
+STATIC mp_obj_t ipc_future_done(mp_obj_t self_in)
+{
+    ipc_future_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_bool(_future_get(self));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ipc_future_done_obj, ipc_future_done);
+
+// Wait for the job result, timeout in ms, -1 waits forever
+//-----------------------------------------------------------------------
+STATIC mp_obj_t ipc_future_result(size_t n_args, const mp_obj_t *args)
+{
+    ipc_future_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t timeout = (n_args > 1) ? mp_obj_get_int(args[1]) : -1;
+    uint64_t wait_end = mp_hal_ticks_ms() + timeout;
+
+    while (!_future_get(self)) {
+        uint64_t now = mp_hal_ticks_ms();
+        if ((timeout >= 0) && (now >= wait_end)) {
+            mp_raise_OSError(MP_ETIMEDOUT);
+        }
+        // wait for the worker's signal, the pending exceptions are checked at least every IPC_JOB_WAIT_TICKS
+        TickType_t ticks = IPC_JOB_WAIT_TICKS;
+        if (timeout >= 0) {
+            TickType_t left = ((wait_end - now) / portTICK_PERIOD_MS) + 1;
+            if (left < ticks) ticks = left;
+        }
+        MP_THREAD_GIL_EXIT();
+        xSemaphoreTake(ipc_job_sem[self->slot], ticks);
+        MP_THREAD_GIL_ENTER();
+        mp_handle_pending();
+    }
+    if (self->error) nlr_raise(self->value);
+    return self->value;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ipc_future_result_obj, 1, 2, ipc_future_result);
+
+//----------------------------------------------------
+STATIC mp_obj_t ipc_future_del(mp_obj_t self_in)
+{
+    ipc_future_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->done) return mp_const_none;
+
+    uint8_t *result = NULL;
+    xSemaphoreTake(inter_proc_mutex, portMAX_DELAY);
+    ipc_job_t *job = &ipc_jobs[self->slot];
+    if (job->id == self->id) {
+        if (job->state == IPC_JOB_DONE) {
+            result = job->result;
+            job->result = NULL;
+            job->state = IPC_JOB_FREE;
+            _release_refs();
+        }
+        // the referenced buffers are kept by the root pointer until the worker finishes the job
+        else if (job->state != IPC_JOB_FREE) job->abandoned = true;
+    }
+    xSemaphoreGive(inter_proc_mutex);
+    if (result) vPortFree(result);
+    self->done = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(ipc_future_del_obj, ipc_future_del);
+
+//-----------------------------------------------------------------------------------------
+STATIC void ipc_future_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    ipc_future_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "Future(id=%u, %s)", self->id, (self->done) ? ((self->error) ? "error" : "done") : "pending");
+}
+
+//=========================================================
+STATIC const mp_rom_map_elem_t ipc_future_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),     MP_ROM_PTR(&ipc_future_del_obj) },
+    { MP_ROM_QSTR(MP_QSTR_done),        MP_ROM_PTR(&ipc_future_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_result),      MP_ROM_PTR(&ipc_future_result_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(ipc_future_locals_dict, ipc_future_locals_dict_table);
+
+//=========================================
+const mp_obj_type_t ipc_future_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Future,
+    .print = ipc_future_print,
+    .locals_dict = (mp_obj_dict_t*)&ipc_future_locals_dict,
+};
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef IPCJOB_H
+#define IPCJOB_H
+
+#include "py/obj.h"
+
+#define IPC_JOB_MAX_JOBS        MICRO_PY_IPC_JOB_MAX_JOBS
+
+// Execute the job request received by the 2nd MicroPython instance
+void ipcjob_execute(const uint8_t *req, size_t len);
+// Cancel the jobs and release the referenced buffers on main instance's (soft) reset
+void ipcjob_reset(void);
+
+MP_DECLARE_CONST_FUN_OBJ_KW(ipcjob_submit_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(ipcjob_worker_obj);
+
+#endif
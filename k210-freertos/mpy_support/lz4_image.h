@@ -0,0 +1,132 @@
+/*
+ * LZ4 compressed application images
+ * Keep in sync with Kboot/src/bootloader_hi/include/lz4_image.h
+ *
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * LZ4 compressed application image
+ * --------------------------------
+ * The compressed image is stored in Flash in the same format as the plain one:
+ * 5-byte prefix (AES flag, code size), code, 32-byte SHA256 hash, the hash is calculated over the compressed code.
+ * The compressed code starts with the image header followed by the LZ4 compressed blocks.
+ *
+ * | ------------------------------------------------------------------------------ |
+ * | Offset | Length | Comment                                                      |
+ * | ------------------------------------------------------------------------------ |
+ * |  0     |  4     | Magic 'KLZ4'                                                 |
+ * |  4     |  4     | Uncompressed application size                                |
+ * |  8     |  1     | log2 of the uncompressed block size (12, 4096 bytes)         |
+ * |  9     |  2     | Reserved, 0                                                  |
+ * | 11     | ...    | Blocks                                                       |
+ * | ------------------------------------------------------------------------------ |
+ *
+ * With the 5-byte prefix, the first block starts at 16-byte offset from the application start,
+ * every block is padded to 4-byte boundary, so all blocks can be read from Flash 32 bits at a time.
+ *
+ * Each block starts with 32-bit block header: bits 0~23: data length, bit 31: block is stored uncompressed.
+ * All blocks except the last one uncompress to the block size.
+ * Compressed blocks are standard LZ4 blocks, matches may reference the data of the previous blocks
+ * (up to 64KB back), the previous blocks are always present in the output buffer.
+ */
+
+#ifndef _LZ4_IMAGE_H_
+#define _LZ4_IMAGE_H_
+
+#include <stdint.h>
+
+#define LZ4_IMAGE_MAGIC         0x345A4C4B  // 'KLZ4'
+#define LZ4_IMAGE_HDR_SIZE      11
+#define LZ4_IMAGE_BLOCK_LOG2    12
+#define LZ4_IMAGE_BLOCK_SIZE    (1 << LZ4_IMAGE_BLOCK_LOG2)
+#define LZ4_IMAGE_BLOCK_RAW     0x80000000
+#define LZ4_IMAGE_BLOCK_LEN     0x00FFFFFF
+#define LZ4_IMAGE_BLOCK_MAX     (LZ4_IMAGE_BLOCK_SIZE + 4)  // maximal block length, including block header
+
+// Padded block length, including the block header
+#define LZ4_IMAGE_BLOCK_PADDED(hdr) ((((hdr) & LZ4_IMAGE_BLOCK_LEN) + 4 + 3) & ~3)
+
+/*
+ * Decompress one block to 'dst', exactly 'dst_len' bytes must be produced
+ * 'out_start' is the start of the output buffer, matches can't reference data before it
+ * Returns 0 on success, -1 on corrupted data
+ */
+//-------------------------------------------------------------------------------------------------------------------------
+static inline int lz4_image_block_decode(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len, const uint8_t *out_start)
+{
+    const uint8_t *src_end = src + src_len;
+    uint8_t *dst_end = dst + dst_len;
+    uint32_t len, offset;
+    uint8_t token, b;
+
+    while (src < src_end) {
+        token = *src++;
+        // literals
+        len = token >> 4;
+        if (len == 15) {
+            do {
+                if (src >= src_end) return -1;
+                b = *src++;
+                len += b;
+            } while (b == 255);
+        }
+        if ((len > (uint32_t)(src_end - src)) || (len > (uint32_t)(dst_end - dst))) return -1;
+        while (len--) *dst++ = *src++;
+        if (src == src_end) break; // the last sequence has literals only
+
+        // match
+        if ((src_end - src) < 2) return -1;
+        offset = src[0] | (src[1] << 8);
+        src += 2;
+        if ((offset == 0) || (offset > (uint32_t)(dst - out_start))) return -1;
+        len = (token & 0x0F) + 4;
+        if ((token & 0x0F) == 15) {
+            do {
+                if (src >= src_end) return -1;
+                b = *src++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (uint32_t)(dst_end - dst)) return -1;
+        const uint8_t *match = dst - offset;
+        if (offset >= 4) {
+            // non overlapping 4-byte chunks
+            while (len >= 4) {
+                dst[0] = match[0];
+                dst[1] = match[1];
+                dst[2] = match[2];
+                dst[3] = match[3];
+                dst += 4;
+                match += 4;
+                len -= 4;
+            }
+        }
+        while (len--) *dst++ = *match++;
+    }
+    return (dst == dst_end) ? 0 : -1;
+}
+
+#endif
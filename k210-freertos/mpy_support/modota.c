@@ -108,6 +108,9 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
 #include "w25qxx.h"
 #include "spi.h"
 #include "syslog.h"
@@ -116,7 +119,10 @@
 #include "py/runtime.h"
 #include "extmod/vfs.h"
 #include "py/stream.h"
+#include "py/objtype.h"
 #include "modota.h"
+#include "ota_patch.h"
+#include "lz4_image.h"
 
 uint8_t config_sector[BOOT_CONFIG_SECTOR_SIZE];
 uint8_t config_loaded = 0;
@@ -460,12 +466,101 @@ uint32_t get_fw_flash_size(uint32_t address)
     return app_size;
 }
 
+// Get the uncompressed size of the LZ4 compressed firmware at Flash address, 0 if not compressed
+//--------------------------------------------
+uint32_t get_fw_lz4_size(uint32_t address)
+{
+    uint8_t hdr[LZ4_IMAGE_HDR_SIZE+5];
+    if (w25qxx_read_data(address, hdr, sizeof(hdr)) != W25QXX_OK) return 0;
+    uint32_t magic, size;
+    memcpy(&magic, hdr+5, 4);
+    memcpy(&size, hdr+9, 4);
+    if ((magic != LZ4_IMAGE_MAGIC) || (hdr[13] != LZ4_IMAGE_BLOCK_LOG2)) return 0;
+    return size;
+}
+
+// Get the installed Kboot version from its boot message ("K210 bootloader by LoBo v.1.5.1")
+// Returns the version as 0xMMmmpp or 0 if not found
+//-------------------------------
+static uint32_t kboot_version(void)
+{
+    static const char marker[] = "bootloader by LoBo v.";
+    const uint32_t mlen = sizeof(marker) - 1;
+    uint8_t *buf = pvPortMalloc(KBOOT_HI_SIZE);
+    uint32_t version = 0;
+
+    if (buf == NULL) return 0;
+    if (w25qxx_read_data(KBOOT_HI_ADDR, buf, KBOOT_HI_SIZE) == W25QXX_OK) {
+        for (uint32_t i = 0; i < (KBOOT_HI_SIZE - mlen - 6); i++) {
+            if (memcmp(buf + i, marker, mlen) != 0) continue;
+            unsigned int major = 0, minor = 0, patch = 0;
+            char ver[12] = {0};
+            memcpy(ver, buf + i + mlen, sizeof(ver) - 1);
+            if (sscanf(ver, "%u.%u.%u", &major, &minor, &patch) >= 2) {
+                version = ((major & 0xFF) << 16) | ((minor & 0xFF) << 8) | (patch & 0xFF);
+            }
+            break;
+        }
+    }
+    vPortFree(buf);
+    return version;
+}
+
+// Kboot versions older than 1.5.0 can't boot LZ4 compressed firmware, returns false for such firmware
+//-------------------------------------------
+static bool lz4_kboot_check(uint32_t address)
+{
+    if (get_fw_lz4_size(address) == 0) return true;
+    uint32_t version = kboot_version();
+    if (version >= KBOOT_LZ4_VERSION) return true;
+    LOGE(TAG, "LZ4 compressed firmware needs Kboot v.1.5.0 or newer (found %06X)", version);
+    return false;
+}
+
+// Get the 32-bit value at offset 4 of the LZ4 compressed firmware code from its first block
+//-----------------------------------------------------------
+static bool lz4_fw_app_id(uint32_t address, uint32_t *id)
+{
+    uint32_t size = get_fw_lz4_size(address);
+    uint8_t *blk = pvPortMalloc(LZ4_IMAGE_BLOCK_MAX + LZ4_IMAGE_BLOCK_SIZE);
+    if (blk == NULL) return false;
+    uint8_t *out = blk + LZ4_IMAGE_BLOCK_MAX;
+    uint32_t n = (size > LZ4_IMAGE_BLOCK_SIZE) ? LZ4_IMAGE_BLOCK_SIZE : size;
+    uint32_t blk_hdr;
+    bool res = false;
+
+    if (w25qxx_read_data(address+LZ4_IMAGE_HDR_SIZE+5, blk, LZ4_IMAGE_BLOCK_MAX) == W25QXX_OK) {
+        memcpy(&blk_hdr, blk, 4);
+        if (blk_hdr & LZ4_IMAGE_BLOCK_RAW) {
+            memcpy(out, blk+4, n);
+            res = ((blk_hdr & LZ4_IMAGE_BLOCK_LEN) == n);
+        }
+        else if (LZ4_IMAGE_BLOCK_PADDED(blk_hdr) <= LZ4_IMAGE_BLOCK_MAX) {
+            res = (lz4_image_block_decode(blk+4, blk_hdr & LZ4_IMAGE_BLOCK_LEN, out, n, out) == 0);
+        }
+    }
+    if ((res) && (n >= 8)) memcpy(id, out+4, 4);
+    else res = false;
+    vPortFree(blk);
+    return res;
+}
+
 //-----------------------------------
 bool check_deadbeef(uint32_t address)
 {
-    w25qxx_enable_xip_mode();
-    uint32_t id = flash2uint32(address+9);
-    w25qxx_disable_xip_mode();
+    uint32_t id = 0;
+    if (get_fw_lz4_size(address) > 0) {
+        // compressed firmware
+        if (!lz4_fw_app_id(address, &id)) {
+            LOGD(TAG, "LZ4 compressed firmware error");
+            return false;
+        }
+    }
+    else {
+        w25qxx_enable_xip_mode();
+        id = flash2uint32(address+9);
+        w25qxx_disable_xip_mode();
+    }
     if (id != K210_APP_ID) {
         LOGD(TAG, "App ID wrong (%08X)", id);
         return false;
@@ -511,6 +606,7 @@ static uint8_t check_entry(ota_entry_t *entry, char *status)
         }
     }
     if (status) strcat(status, "[Check OK] ");
+    if ((status) && (get_fw_lz4_size(entry->address) > 0)) strcat(status, "[LZ4] ");
     if (!check_deadbeef(entry->address)) {
         stat |= 16;
         if (status) strcat(status, "[Not K210 app] ");
@@ -569,6 +665,20 @@ static bool firmware_copy(uint32_t src, uint32_t dest, uint32_t size, bool progr
     return true;
 }
 
+// Read 'len' bytes from the file, a single stream read can return less
+// Returns the number of bytes read, less than 'len' only on error or end of file
+//-------------------------------------------------------------------
+static uint32_t fw_file_read(mp_obj_t ffd, uint8_t *buf, uint32_t len)
+{
+    uint32_t total = 0;
+    while (total < len) {
+        ssize_t rd = mp_stream_posix_read((void *)ffd, buf + total, len - total);
+        if (rd <= 0) break;
+        total += rd;
+    }
+    return total;
+}
+
 // Write the firmware from file to Flash
 // We assume that the destination address is aligned to 4K
 //-----------------------------------------------------------------------------------
@@ -599,7 +709,7 @@ static bool firmware_write(mp_obj_t ffd, uint32_t dest, uint32_t size, bool prog
             buffer[0] = 0;
             *(uint32_t *)(buffer+1) = size;
             sz = w25qxx_FLASH_SECTOR_SIZE - 5;
-            rd = mp_stream_posix_read((void *)ffd, buffer+5, sz);
+            rd = fw_file_read(ffd, buffer+5, sz);
             f = (rd == sz);
             to_read -= sz;
             if (f) sha256_hard_update(&context, buffer, sz+5);
@@ -607,7 +717,7 @@ static bool firmware_write(mp_obj_t ffd, uint32_t dest, uint32_t size, bool prog
         else {
             sz = (to_read > w25qxx_FLASH_SECTOR_SIZE) ? w25qxx_FLASH_SECTOR_SIZE : to_read;
             if (sz < w25qxx_FLASH_SECTOR_SIZE) memset(buffer, 0xFF, w25qxx_FLASH_SECTOR_SIZE);
-            rd = mp_stream_posix_read((void *)ffd, buffer, sz);
+            rd = fw_file_read(ffd, buffer, sz);
             f = (rd == sz);
             if (f) {
                 sha256_hard_update(&context, buffer, sz);
@@ -659,6 +769,452 @@ static bool firmware_write(mp_obj_t ffd, uint32_t dest, uint32_t size, bool prog
     return f;
 }
 
+typedef struct _fw_patch_ctx_t {
+    mp_obj_t ffd;
+    uint32_t old_address;
+    uint32_t dest;
+    uint32_t total_sectors;
+    sha256_hard_context_t context;
+    bool progress;
+} fw_patch_ctx_t;
+
+//---------------------------------------------------------------------
+static int patch_read_patch(void *ctx, uint8_t *buf, uint32_t len)
+{
+    fw_patch_ctx_t *pctx = (fw_patch_ctx_t *)ctx;
+    return fw_file_read(pctx->ffd, buf, len);
+}
+
+//-----------------------------------------------------------------------------------
+static int patch_read_old(void *ctx, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    fw_patch_ctx_t *pctx = (fw_patch_ctx_t *)ctx;
+    return (w25qxx_read_data(pctx->old_address + offset, buf, len) == W25QXX_OK) ? 0 : -1;
+}
+
+// Sectors identical to the Flash content are not erased nor programmed by 'w25qxx_write_data()'
+//-----------------------------------------------------------------------------------------
+static int patch_write_sector(void *ctx, uint32_t offset, const uint8_t *buf, uint32_t len)
+{
+    fw_patch_ctx_t *pctx = (fw_patch_ctx_t *)ctx;
+    if (w25qxx_write_data(pctx->dest + offset, (uint8_t *)buf, len) != W25QXX_OK) {
+        LOGD(TAG, "FW patch: write error at %u", offset);
+        return -1;
+    }
+    if (pctx->progress) {
+        float prog = ((float)(offset/len + 1) / (float)pctx->total_sectors) * 100.0;
+        mp_printf(&mp_plat_print, "%08X: %.2f%%  \r", offset, prog);
+    }
+    mp_hal_wdt_reset();
+    return 0;
+}
+
+//--------------------------------------------------------------------------
+static void patch_hash_update(void *ctx, const uint8_t *buf, uint32_t len)
+{
+    fw_patch_ctx_t *pctx = (fw_patch_ctx_t *)ctx;
+    sha256_hard_update(&pctx->context, buf, len);
+}
+
+// Reconstruct the new firmware from the firmware at 'src' and the patch file
+// The new firmware is hashed while being written, the SHA256 hash is written only if it matches the patch header
+// We assume that the destination address is aligned to 4K
+//------------------------------------------------------------------------------------------------------------------
+static int firmware_patch(mp_obj_t ffd, ota_patch_header_t *hdr, uint32_t src, uint32_t dest, bool progress)
+{
+    uint8_t buffer[w25qxx_FLASH_SECTOR_SIZE];
+    uint8_t fwhash[SHA256_HASH_LEN];
+    fw_patch_ctx_t pctx;
+    ota_patch_io_t io = {
+        .read_patch = patch_read_patch,
+        .read_old = patch_read_old,
+        .write_sector = patch_write_sector,
+        .hash_update = patch_hash_update,
+        .ctx = &pctx,
+    };
+    ota_patch_t patch;
+
+    pctx.ffd = ffd;
+    pctx.old_address = src;
+    pctx.dest = dest;
+    pctx.progress = progress;
+    pctx.total_sectors = (hdr->new_size + 37 + w25qxx_FLASH_SECTOR_SIZE - 1) / w25qxx_FLASH_SECTOR_SIZE;
+    LOGD(TAG, "Firmware patch: %08X -> %08X, size=%u -> %u", src, dest, hdr->old_size, hdr->new_size);
+
+    sha256_hard_init(&pctx.context, hdr->new_size+5); // init sha256 calculation
+    bool curr_spi_check = w25qxx_spi_check;
+    w25qxx_spi_check = true;
+
+    ota_patch_init(&patch, &io, hdr, buffer, w25qxx_FLASH_SECTOR_SIZE);
+    int res = ota_patch_apply(&patch);
+    if (res == OTA_PATCH_OK) {
+        sha256_hard_final(&pctx.context, fwhash);
+        res = ota_patch_finish(&patch, hdr, fwhash);
+    }
+
+    w25qxx_spi_check = curr_spi_check;
+    if (progress) {
+        mp_printf(&mp_plat_print, "\r\n%s\r\n", (res == OTA_PATCH_OK) ? "Finished" : "Failed");
+    }
+    if (res != OTA_PATCH_OK) {
+        LOGD(TAG, "FW patch: error %d at %u", res, patch.out_pos);
+    }
+    return res;
+}
+
+
+// ==== Firmware write from stream ====
+// Two sector buffers are used: while one sector is programmed to Flash by the writer task,
+// the next one is received from the stream and hashed with the hardware SHA256
+
+#define OTA_STREAM_TASK_STACK   1024    // in StackType_t units
+
+typedef struct _stream_sector_t {
+    uint8_t  *buf;          // NULL terminates the writer task
+    uint32_t address;
+} stream_sector_t;
+
+typedef struct _stream_writer_t {
+    QueueHandle_t todo;
+    QueueHandle_t done;
+    TaskHandle_t  task;
+    bool          pending;
+} stream_writer_t;
+
+// Interrupted transfer, can be resumed from the last written and verified sector
+typedef struct _stream_resume_t {
+    uint32_t address;
+    uint32_t size;
+    uint32_t sectors;       // written sectors
+    uint32_t crc;           // CRC32 of the written sectors
+    bool     has_sha;
+    uint8_t  sha[SHA256_HASH_LEN];
+} stream_resume_t;
+
+static stream_resume_t stream_resume = {0};
+
+//----------------------------------------------------
+static void stream_writer_task(void *pvParameters)
+{
+    stream_writer_t *wr = (stream_writer_t *)pvParameters;
+    stream_sector_t sect;
+    int res;
+
+    while (1) {
+        if (xQueueReceive(wr->todo, &sect, portMAX_DELAY) != pdTRUE) continue;
+        if (sect.buf == NULL) break;
+        res = (w25qxx_write_data(sect.address, sect.buf, w25qxx_FLASH_SECTOR_SIZE) == W25QXX_OK) ? 0 : -1;
+        xQueueSend(wr->done, &res, portMAX_DELAY);
+    }
+    res = 0;
+    xQueueSend(wr->done, &res, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+// Wait for the sector being written, returns false on write error
+//---------------------------------------------------
+static bool stream_writer_wait(stream_writer_t *wr)
+{
+    int res = 0;
+    if (!wr->pending) return true;
+    while (xQueueReceive(wr->done, &res, 100 / portTICK_PERIOD_MS) != pdTRUE) {
+        mp_hal_wdt_reset();
+    }
+    wr->pending = false;
+    return (res == 0);
+}
+
+// Pass the sector buffer to the writer task, the previous sector must be written first
+//------------------------------------------------------------------------------------
+static bool stream_writer_submit(stream_writer_t *wr, uint8_t *buf, uint32_t address)
+{
+    if (!stream_writer_wait(wr)) return false;
+    stream_sector_t sect = { .buf = buf, .address = address };
+    xQueueSend(wr->todo, &sect, portMAX_DELAY);
+    wr->pending = true;
+    return true;
+}
+
+//-------------------------------------------------
+static bool stream_writer_start(stream_writer_t *wr)
+{
+    memset(wr, 0, sizeof(stream_writer_t));
+    wr->todo = xQueueCreate(1, sizeof(stream_sector_t));
+    wr->done = xQueueCreate(1, sizeof(int));
+    if ((wr->todo) && (wr->done)) {
+        BaseType_t res = xTaskCreate(
+            stream_writer_task,         // function entry
+            "ota_writer",               // task name
+            OTA_STREAM_TASK_STACK,      // stack_deepth
+            (void *)wr,                 // function argument
+            MICROPY_TASK_PRIORITY+1,    // task priority
+            &wr->task);                 // task handle
+        if (res == pdPASS) return true;
+    }
+    if (wr->todo) vQueueDelete(wr->todo);
+    if (wr->done) vQueueDelete(wr->done);
+    return false;
+}
+
+// Wait for the last sector and terminate the writer task
+//-------------------------------------------------
+static bool stream_writer_stop(stream_writer_t *wr)
+{
+    bool res = stream_writer_wait(wr);
+    stream_sector_t sect = { .buf = NULL, .address = 0 };
+    xQueueSend(wr->todo, &sect, portMAX_DELAY);
+    wr->pending = true;
+    stream_writer_wait(wr);
+    vQueueDelete(wr->todo);
+    vQueueDelete(wr->done);
+    return res;
+}
+
+//-------------------------------------------------------------------
+static uint32_t stream_crc32(uint32_t crc, uint8_t *buf, uint32_t len)
+{
+    for (uint32_t n=0; n<len; n++) {
+        crc = (crc >> 8) ^ Crc32LookupTable[(crc & 0xFF) ^ buf[n]];
+    }
+    return crc;
+}
+
+/*
+ * Read from the stream, returns the number of bytes read, less than requested if the connection is dropped
+ * Streams implemented in C are read directly,
+ * for Python objects 'readinto' or 'read' method is called.
+ * As the Python code may be executed from Flash (XIP), the writer task must be idle at that time.
+ */
+//----------------------------------------------------------------------------------------------------------
+static uint32_t stream_read(mp_obj_t stream, stream_writer_t *wr, uint8_t *buf, uint32_t len, bool *wr_error)
+{
+    const mp_obj_type_t *type = mp_obj_get_type(stream);
+    const mp_stream_p_t *stream_p = (const mp_stream_p_t *)type->protocol;
+    uint32_t rd = 0;
+
+    if ((mp_obj_is_native_type(type)) && (stream_p) && (stream_p->read)) {
+        int errcode = 0;
+        rd = mp_stream_rw(stream, buf, len, &errcode, MP_STREAM_RW_READ);
+        if (errcode != 0) LOGD(TAG, "FW stream: read error %d", errcode);
+        return rd;
+    }
+
+    if (!stream_writer_wait(wr)) {
+        *wr_error = true;
+        return 0;
+    }
+    mp_obj_t dest[3];
+    mp_load_method_maybe(stream, MP_QSTR_readinto, dest);
+    if (dest[0] != MP_OBJ_NULL) {
+        while (rd < len) {
+            dest[2] = mp_obj_new_bytearray_by_ref(len - rd, buf + rd);
+            mp_obj_t ret = mp_call_method_n_kw(1, 0, dest);
+            if ((ret == mp_const_none) || (mp_obj_get_int(ret) <= 0)) break;
+            rd += mp_obj_get_int(ret);
+            mp_load_method(stream, MP_QSTR_readinto, dest);
+        }
+        return rd;
+    }
+    while (rd < len) {
+        mp_load_method(stream, MP_QSTR_read, dest);
+        dest[2] = mp_obj_new_int(len - rd);
+        mp_obj_t ret = mp_call_method_n_kw(1, 0, dest);
+        if (ret == mp_const_none) break;
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(ret, &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len == 0) break;
+        if (bufinfo.len > (len - rd)) bufinfo.len = len - rd;
+        memcpy(buf + rd, bufinfo.buf, bufinfo.len);
+        rd += bufinfo.len;
+    }
+    return rd;
+}
+
+typedef struct _stream_state_t {
+    mp_obj_t stream;
+    stream_writer_t wr;
+    sha256_hard_context_t context;
+    uint8_t  *buf[2];
+    uint32_t dest;
+    uint32_t total;         // prefix + firmware code size
+    uint32_t pos;           // received bytes, including the prefix
+    uint32_t sector;        // sectors passed to the writer task
+    uint32_t fill;          // bytes in the current sector buffer
+    uint32_t crc;           // CRC32 of the sectors passed to the writer task
+    int      cur;           // current sector buffer
+    bool     wr_error;
+    bool     progress;
+} stream_state_t;
+
+// Receive the sectors until all data are received or the connection is dropped
+//-------------------------------------------------
+static void stream_receive(stream_state_t *st)
+{
+    while ((st->pos < st->total) && (!st->wr_error)) {
+        uint32_t n = w25qxx_FLASH_SECTOR_SIZE - st->fill;
+        if (n > (st->total - st->pos)) n = st->total - st->pos;
+        uint32_t rd = stream_read(st->stream, &st->wr, st->buf[st->cur] + st->fill, n, &st->wr_error);
+        st->fill += rd;
+        st->pos += rd;
+        if (rd < n) break;
+        if (st->fill == w25qxx_FLASH_SECTOR_SIZE) {
+            // Sector received, hash it while the previous sector is being written, and pass it to the writer task
+            sha256_hard_update(&st->context, st->buf[st->cur], w25qxx_FLASH_SECTOR_SIZE);
+            if (!stream_writer_submit(&st->wr, st->buf[st->cur], st->dest + (st->sector * w25qxx_FLASH_SECTOR_SIZE))) {
+                st->wr_error = true;
+                break;
+            }
+            st->crc = stream_crc32(st->crc, st->buf[st->cur], w25qxx_FLASH_SECTOR_SIZE);
+            st->sector++;
+            st->cur ^= 1;
+            st->fill = 0;
+            if (st->progress) {
+                mp_printf(&mp_plat_print, "%08X: %.2f%%  \r", (st->sector-1) * w25qxx_FLASH_SECTOR_SIZE, ((float)st->pos / (float)st->total) * 100.0);
+            }
+        }
+        mp_hal_wdt_reset();
+    }
+}
+
+// Hash the last sector and append the SHA256 hash, 'false' on hash mismatch or write error
+//-----------------------------------------------------------------------
+static bool stream_finish(stream_state_t *st, const uint8_t *sha)
+{
+    uint8_t fwhash[SHA256_HASH_LEN];
+    uint8_t *buf = st->buf[st->cur];
+
+    sha256_hard_update(&st->context, buf, st->fill);
+    sha256_hard_final(&st->context, fwhash);
+    if ((sha) && (memcmp(fwhash, sha, SHA256_HASH_LEN) != 0)) {
+        LOGD(TAG, "FW stream: SHA256 hash mismatch");
+        return false;
+    }
+
+    uint32_t n = w25qxx_FLASH_SECTOR_SIZE - st->fill;
+    if (n > SHA256_HASH_LEN) n = SHA256_HASH_LEN;
+    memcpy(buf + st->fill, fwhash, n);
+    memset(buf + st->fill + n, 0xFF, w25qxx_FLASH_SECTOR_SIZE - st->fill - n);
+    if (!stream_writer_submit(&st->wr, buf, st->dest + (st->sector * w25qxx_FLASH_SECTOR_SIZE))) return false;
+    if (n < SHA256_HASH_LEN) {
+        // The hash does not fit into the last sector
+        st->sector++;
+        st->cur ^= 1;
+        buf = st->buf[st->cur];
+        memcpy(buf, fwhash + n, SHA256_HASH_LEN - n);
+        memset(buf + SHA256_HASH_LEN - n, 0xFF, w25qxx_FLASH_SECTOR_SIZE - (SHA256_HASH_LEN - n));
+        if (!stream_writer_submit(&st->wr, buf, st->dest + (st->sector * w25qxx_FLASH_SECTOR_SIZE))) return false;
+    }
+    return stream_writer_wait(&st->wr);
+}
+
+/*
+ * Write the firmware received from the stream to Flash
+ * If the connection is dropped, all received complete sectors are written and the resume information is saved,
+ * the received part of the last sector is dropped.
+ * Returns the number of firmware bytes written, 'size' if the complete firmware is written and verified
+ * We assume that the destination address is aligned to 4K
+ */
+//---------------------------------------------------------------------------------------------------------
+static uint32_t firmware_stream(mp_obj_t stream, uint32_t dest, uint32_t size, const uint8_t *sha, bool resume, bool progress)
+{
+    stream_state_t st;
+    memset(&st, 0, sizeof(stream_state_t));
+    st.stream = stream;
+    st.dest = dest;
+    st.total = size + 5;
+    st.crc = 0xFFFFFFFF;
+    st.progress = progress;
+
+    uint8_t *buffers = pvPortMalloc(w25qxx_FLASH_SECTOR_SIZE*2);
+    if (buffers == NULL) {
+        mp_raise_msg(&mp_type_OSError, "Error allocating sector buffers");
+    }
+    st.buf[0] = buffers;
+    st.buf[1] = buffers + w25qxx_FLASH_SECTOR_SIZE;
+
+    sha256_hard_init(&st.context, st.total);
+    bool curr_spi_check = w25qxx_spi_check;
+    w25qxx_spi_check = true;
+
+    if (resume) {
+        // Restore the hash from the sectors already written and check they are not changed
+        for (st.sector=0; st.sector<stream_resume.sectors; st.sector++) {
+            if (w25qxx_read_data(dest + (st.sector * w25qxx_FLASH_SECTOR_SIZE), st.buf[0], w25qxx_FLASH_SECTOR_SIZE) != W25QXX_OK) break;
+            sha256_hard_update(&st.context, st.buf[0], w25qxx_FLASH_SECTOR_SIZE);
+            st.crc = stream_crc32(st.crc, st.buf[0], w25qxx_FLASH_SECTOR_SIZE);
+            mp_hal_wdt_reset();
+        }
+        if ((st.sector != stream_resume.sectors) || (st.crc != stream_resume.crc)) {
+            w25qxx_spi_check = curr_spi_check;
+            vPortFree(buffers);
+            memset(&stream_resume, 0, sizeof(stream_resume_t));
+            mp_raise_msg(&mp_type_OSError, "Written data changed, transfer can't be resumed");
+        }
+        st.pos = st.sector * w25qxx_FLASH_SECTOR_SIZE;
+        LOGD(TAG, "FW stream: resume at sector %u", st.sector);
+    }
+    else {
+        memset(&stream_resume, 0, sizeof(stream_resume_t));
+        stream_resume.address = dest;
+        stream_resume.size = size;
+        if (sha) {
+            stream_resume.has_sha = true;
+            memcpy(stream_resume.sha, sha, SHA256_HASH_LEN);
+        }
+    }
+    if (st.sector == 0) {
+        // The 5-byte prefix: AES flag, code size
+        st.buf[0][0] = 0;
+        memcpy(st.buf[0]+1, &size, 4);
+        st.fill = 5;
+        st.pos = 5;
+    }
+
+    if (!stream_writer_start(&st.wr)) {
+        w25qxx_spi_check = curr_spi_check;
+        vPortFree(buffers);
+        mp_raise_msg(&mp_type_OSError, "Error starting writer task");
+    }
+
+    nlr_buf_t nlr;
+    mp_obj_base_t *exc = NULL;
+    if (nlr_push(&nlr) == 0) {
+        stream_receive(&st);
+        nlr_pop();
+    }
+    else {
+        // Exception raised by the Python stream object, OSError is handled as dropped connection
+        exc = (mp_obj_base_t *)nlr.ret_val;
+        if (mp_obj_is_subclass_fast(MP_OBJ_FROM_PTR(exc->type), MP_OBJ_FROM_PTR(&mp_type_OSError))) exc = NULL;
+    }
+
+    uint32_t written = 0;
+    bool complete = (st.pos == st.total);
+    if ((complete) && (!st.wr_error)) {
+        if (!stream_finish(&st, sha)) st.wr_error = true;
+    }
+    if (!stream_writer_stop(&st.wr)) st.wr_error = true;
+    w25qxx_spi_check = curr_spi_check;
+    vPortFree(buffers);
+
+    if ((complete) || (st.wr_error)) memset(&stream_resume, 0, sizeof(stream_resume_t));
+    else {
+        stream_resume.sectors = st.sector;
+        stream_resume.crc = st.crc;
+        written = (st.sector > 0) ? ((st.sector * w25qxx_FLASH_SECTOR_SIZE) - 5) : 0;
+    }
+    if (progress) mp_printf(&mp_plat_print, "\r\n%s\r\n", (st.wr_error) ? "Failed" : ((complete) ? "Finished" : "Interrupted"));
+
+    if (exc) nlr_jump(exc);
+    if (st.wr_error) {
+        mp_raise_msg(&mp_type_OSError, (complete) ? "Error writing firmware or hash mismatch." : "Error writing firmware.");
+    }
+    if ((complete) && (!check_app_sha256(dest))) {
+        mp_raise_msg(&mp_type_OSError, "Firmware hash check failed.");
+    }
+    return (complete) ? size : written;
+}
+
 // Get the 1st active firmware from the main config sector
 //---------------------
 int config_get_active()
@@ -705,6 +1261,7 @@ static bool config_set_active(uint8_t n_entry)
                         LOGW(TAG, "Found config entry, but check failed [%s]", status);
                         break;
                     }
+                    if (!lz4_kboot_check(entry->address)) break;
                     entry->id_flags |= CFG_APP_FLAG_ACTIVE;
                     f = true;
                     LOGD(TAG, "Config entry #%d set active", i);
@@ -998,6 +1555,9 @@ STATIC mp_obj_t mod_ota_fw_fromfile(size_t n_args, const mp_obj_t *pos_args, mp_
     LOGD(TAG, "Firmware write: %d: 0x%08X, size=%u", dest, dest_address, fsize);
     if (firmware_write(dest_file, dest_address, fsize, args[ARG_progress].u_bool)) {
         mp_stream_close(dest_file);
+        if (!lz4_kboot_check(dest_address)) {
+            mp_raise_ValueError("LZ4 compressed firmware needs Kboot v.1.5.0 or newer");
+        }
         // Set the destination entry data
         ota_entry_t *dest_entry = (ota_entry_t *)(config_sector + (dest*BOOT_CONFIG_ITEM_SIZE));
         dest_entry->id_flags = (uint32_t)(MAGIC_ID + CFG_APP_FLAG_SHA256 + ((args[ARG_active].u_bool) ? CFG_APP_FLAG_ACTIVE : 0));
@@ -1022,6 +1582,270 @@ STATIC mp_obj_t mod_ota_fw_fromfile(size_t n_args, const mp_obj_t *pos_args, mp_
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ota_fw_fromfile_obj, 3, mod_ota_fw_fromfile);
 
+/*
+ * Write the firmware received from any readable stream (socket, ssl socket, file or Python object with 'readinto' or 'read' method)
+ * No file system space is needed, the firmware is written directly to the destination Flash area.
+ * Returns the number of firmware bytes written and verified, the boot entry is created only when it equals 'size'.
+ * If the connection was dropped, the function can be called again with 'resume=True' and the stream
+ * positioned at the returned offset (for example using HTTP 'Range: bytes=<offset>-' header).
+ */
+//------------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_ota_fw_fromstream(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_dest, ARG_address, ARG_stream, ARG_size, ARG_sha, ARG_name, ARG_active, ARG_progress, ARG_resume };
+    const mp_arg_t allowed_args[] = {
+       { MP_QSTR_dest,       MP_ARG_REQUIRED | MP_ARG_INT,  { .u_int = 0 } },
+       { MP_QSTR_address,    MP_ARG_REQUIRED | MP_ARG_INT,  { .u_int = 0 } },
+       { MP_QSTR_stream,     MP_ARG_REQUIRED | MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+       { MP_QSTR_size,       MP_ARG_REQUIRED | MP_ARG_INT,  { .u_int = 0 } },
+       { MP_QSTR_sha,                          MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+       { MP_QSTR_name,                         MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+       { MP_QSTR_active,                       MP_ARG_BOOL, { .u_bool = false } },
+       { MP_QSTR_progress,                     MP_ARG_BOOL, { .u_bool = false } },
+       { MP_QSTR_resume,                       MP_ARG_BOOL, { .u_bool = false } },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // Read the main config sector and backup it
+    if (!backup_boot_sector()) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "Error reading config sector"));
+    }
+
+    uint32_t active_address, active_end_address, active_size, dest_end_address;
+    ota_entry_t *active_entry = NULL;
+    uint32_t dest_address = (uint32_t)args[ARG_address].u_int & 0xFFFFF000;
+    int dest = args[ARG_dest].u_int;
+    if ((dest < 0) || (dest > (BOOT_CONFIG_ITEMS-1))) {
+        mp_raise_ValueError("Wrong OTA destination index");
+    }
+    int fsize = args[ARG_size].u_int;
+    if (fsize < (512*1024)) {
+        mp_raise_ValueError("Wrong firmware size");
+    }
+
+    // Expected SHA256 hash of the prefix and firmware code, as bytes or hex string
+    uint8_t sha[SHA256_HASH_LEN];
+    uint8_t *psha = NULL;
+    if (args[ARG_sha].u_obj != mp_const_none) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[ARG_sha].u_obj, &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len == SHA256_HASH_LEN) memcpy(sha, bufinfo.buf, SHA256_HASH_LEN);
+        else if (bufinfo.len == (SHA256_HASH_LEN*2)) {
+            const char *hex = (const char *)bufinfo.buf;
+            for (int i=0; i<(SHA256_HASH_LEN*2); i++) {
+                char c = unichar_tolower(hex[i]);
+                if (!unichar_isxdigit(c)) mp_raise_ValueError("Wrong SHA256 hash");
+                uint8_t v = (c <= '9') ? (c - '0') : (c - 'a' + 10);
+                if (i & 1) sha[i/2] |= v;
+                else sha[i/2] = v << 4;
+            }
+        }
+        else mp_raise_ValueError("Wrong SHA256 hash");
+        psha = sha;
+    }
+
+    char entry_name[BOOT_ENTRY_NAME_LEN] = {'\0'};
+    if (mp_obj_is_str(args[ARG_name].u_obj)) {
+        char *ename = (char *)mp_obj_str_get_str(args[ARG_name].u_obj);
+        snprintf(entry_name, BOOT_ENTRY_NAME_LEN, "%s", ename);
+    }
+    else sprintf(entry_name, "MicroPython");
+
+    // Get current firmware information
+    ota_entry_t default_entry = {0};
+    default_entry.id_flags = (uint32_t)(MAGIC_ID + CFG_APP_FLAG_ACTIVE + CFG_APP_FLAG_SHA256);
+    default_entry.address = DEFAULT_APP_ADDRESS;
+    default_entry.size = get_fw_flash_size(DEFAULT_APP_ADDRESS);
+    sprintf(default_entry.name, "MicroPython");
+
+    int src = config_get_active();
+    if (src == dest) {
+        mp_raise_ValueError("Source and destination equal!");
+    }
+
+    if (src >= 0) active_entry = (ota_entry_t *)(config_sector + (src*BOOT_CONFIG_ITEM_SIZE));
+    else active_entry = &default_entry;
+    active_address = active_entry->address;
+    active_size = get_fw_flash_size(active_entry->address);
+    active_end_address = ((active_address + active_size) & 0xFFFFF000) + 0x1000;
+
+    dest_end_address = ((dest_address + fsize + 37) & 0xFFFFF000) + 0x1000;
+
+    // Check if valid destination Flash area is selected
+    if ( ((dest_address >= MICRO_PY_FLASHFS_START_ADDRESS) || (dest_end_address >= MICRO_PY_FLASHFS_START_ADDRESS)) ||
+         ((dest_address < DEFAULT_APP_ADDRESS) || (dest_end_address < DEFAULT_APP_ADDRESS)) ||
+         ((dest_address >= active_address) && (dest_address <= active_end_address)) ||
+         ((dest_end_address >= active_address) && (dest_end_address <= active_end_address)) ) {
+        mp_raise_ValueError("Wrong destination address!");
+    }
+
+    bool resume = args[ARG_resume].u_bool;
+    if (resume) {
+        if ((stream_resume.address != dest_address) || (stream_resume.size != (uint32_t)fsize) ||
+            (stream_resume.has_sha != (psha != NULL)) || ((psha) && (memcmp(stream_resume.sha, psha, SHA256_HASH_LEN) != 0))) {
+            mp_raise_ValueError("No matching interrupted transfer");
+        }
+    }
+
+    // Write the firmware from stream
+    LOGD(TAG, "Firmware stream: %d: 0x%08X, size=%u", dest, dest_address, fsize);
+    uint32_t written = firmware_stream(args[ARG_stream].u_obj, dest_address, fsize, psha, resume, args[ARG_progress].u_bool);
+    if (written == (uint32_t)fsize) {
+        if (!lz4_kboot_check(dest_address)) {
+            mp_raise_ValueError("LZ4 compressed firmware needs Kboot v.1.5.0 or newer");
+        }
+        // Set the destination entry data
+        ota_entry_t *dest_entry = (ota_entry_t *)(config_sector + (dest*BOOT_CONFIG_ITEM_SIZE));
+        dest_entry->id_flags = (uint32_t)(MAGIC_ID + CFG_APP_FLAG_SHA256 + ((args[ARG_active].u_bool) ? CFG_APP_FLAG_ACTIVE : 0));
+        dest_entry->address = dest_address;
+        dest_entry->size = fsize;
+        dest_entry->crc32 = 0;
+        memcpy(dest_entry->name, entry_name, BOOT_ENTRY_NAME_LEN);
+        LOGD(TAG, "Adding boot entry #%d: %08X, %08X, %u", dest, dest_entry->id_flags, dest_entry->address, dest_entry->size);
+
+        // Save modified boot sector
+        if (!write_boot_sector()) {
+            mp_raise_msg(&mp_type_OSError, "Error saving config sector.");
+        }
+        LOGD(TAG, "Boot entry #%d saved.", dest);
+    }
+
+    return mp_obj_new_int_from_uint(written);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ota_fw_fromstream_obj, 4, mod_ota_fw_fromstream);
+
+/*
+ * Create the new firmware from the active firmware and the patch file created by 'mkotapatch'
+ * Only the patch has to be transfered to the board, the active firmware must be the one the patch was created from
+ */
+//----------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_ota_patch(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_dest, ARG_address, ARG_file, ARG_name, ARG_active, ARG_progress };
+    const mp_arg_t allowed_args[] = {
+       { MP_QSTR_dest,       MP_ARG_REQUIRED | MP_ARG_INT,  { .u_int = 0 } },
+       { MP_QSTR_address,    MP_ARG_REQUIRED | MP_ARG_INT,  { .u_int = 0 } },
+       { MP_QSTR_file,       MP_ARG_REQUIRED | MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+       { MP_QSTR_name,                         MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+       { MP_QSTR_active,                       MP_ARG_BOOL, { .u_bool = false } },
+       { MP_QSTR_progress,                     MP_ARG_BOOL, { .u_bool = false } },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // Read the main config sector and backup it
+    if (!backup_boot_sector()) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "Error reading config sector"));
+    }
+
+    uint32_t active_address, active_end_address, dest_end_address;
+    ota_entry_t *active_entry = NULL;
+    uint32_t dest_address = (uint32_t)args[ARG_address].u_int & 0xFFFFF000;
+    int dest = args[ARG_dest].u_int;
+    if ((dest < 0) || (dest > (BOOT_CONFIG_ITEMS-1))) {
+        mp_raise_ValueError("Wrong OTA destination index");
+    }
+
+    char entry_name[BOOT_ENTRY_NAME_LEN] = {'\0'};
+    if (mp_obj_is_str(args[ARG_name].u_obj)) {
+        char *ename = (char *)mp_obj_str_get_str(args[ARG_name].u_obj);
+        snprintf(entry_name, BOOT_ENTRY_NAME_LEN, "%s", ename);
+    }
+    else sprintf(entry_name, "MicroPython");
+
+    if (!mp_obj_is_str(args[ARG_file].u_obj)) {
+        mp_raise_ValueError("File name not provided");
+    }
+
+    // Get current firmware information
+    ota_entry_t default_entry = {0};
+    default_entry.id_flags = (uint32_t)(MAGIC_ID + CFG_APP_FLAG_ACTIVE + CFG_APP_FLAG_SHA256);
+    default_entry.address = DEFAULT_APP_ADDRESS;
+    default_entry.size = get_fw_flash_size(DEFAULT_APP_ADDRESS);
+    sprintf(default_entry.name, "MicroPython");
+
+    int src = config_get_active();
+    if (src == dest) {
+        mp_raise_ValueError("Source and destination equal!");
+    }
+
+    if (src >= 0) active_entry = (ota_entry_t *)(config_sector + (src*BOOT_CONFIG_ITEM_SIZE));
+    else active_entry = &default_entry;
+    active_address = active_entry->address;
+
+    const char *fname = mp_obj_str_get_str(args[ARG_file].u_obj);
+    mp_obj_t fargs[2];
+    fargs[0] = mp_obj_new_str(fname, strlen(fname));
+    fargs[1] = mp_obj_new_str("rb", 2);
+    mp_obj_t patch_file = mp_vfs_open(2, fargs, (mp_map_t*)&mp_const_empty_map);
+    if (!patch_file) {
+        mp_raise_msg(&mp_type_OSError, "Error opening patch file");
+    }
+
+    // Read the patch header and check if it matches the active firmware
+    ota_patch_header_t hdr;
+    ota_patch_io_t hdr_io = { .read_patch = patch_read_patch };
+    fw_patch_ctx_t hdr_ctx = { .ffd = patch_file };
+    hdr_io.ctx = &hdr_ctx;
+    if (ota_patch_read_header(&hdr_io, &hdr) != OTA_PATCH_OK) {
+        mp_stream_close(patch_file);
+        mp_raise_ValueError("Not a firmware patch file");
+    }
+
+    uint8_t hash[SHA256_HASH_LEN];
+    uint8_t app_hash[SHA256_HASH_LEN];
+    calc_app_sha256(active_address, hash, app_hash);
+    if ((flash2uint32(active_address+1) != hdr.old_size) ||
+        (memcmp(hash, app_hash, SHA256_HASH_LEN) != 0) || (memcmp(app_hash, hdr.old_sha, SHA256_HASH_LEN) != 0)) {
+        mp_stream_close(patch_file);
+        mp_raise_ValueError("Patch does not match the active firmware");
+    }
+
+    active_end_address = ((active_address + get_fw_flash_size(active_address)) & 0xFFFFF000) + 0x1000;
+    dest_end_address = ((dest_address + hdr.new_size + 37) & 0xFFFFF000) + 0x1000;
+
+    // Check if valid destination Flash area is selected
+    if ( ((dest_address >= MICRO_PY_FLASHFS_START_ADDRESS) || (dest_end_address >= MICRO_PY_FLASHFS_START_ADDRESS)) ||
+         ((dest_address < DEFAULT_APP_ADDRESS) || (dest_end_address < DEFAULT_APP_ADDRESS)) ||
+         ((dest_address >= active_address) && (dest_address <= active_end_address)) ||
+         ((dest_end_address >= active_address) && (dest_end_address <= active_end_address)) ) {
+        mp_stream_close(patch_file);
+        mp_raise_ValueError("Wrong destination address!");
+    }
+
+    // Create the new firmware
+    int res = firmware_patch(patch_file, &hdr, active_address, dest_address, args[ARG_progress].u_bool);
+    mp_stream_close(patch_file);
+    if ((res != OTA_PATCH_OK) || (!check_app_sha256(dest_address))) {
+        if (res == OTA_PATCH_ERR_HASH) mp_raise_msg(&mp_type_OSError, "Patched firmware hash mismatch.");
+        mp_raise_msg(&mp_type_OSError, "Error while patching firmware.");
+    }
+    if (!lz4_kboot_check(dest_address)) {
+        mp_raise_ValueError("LZ4 compressed firmware needs Kboot v.1.5.0 or newer");
+    }
+
+    // Set the destination entry data
+    ota_entry_t *dest_entry = (ota_entry_t *)(config_sector + (dest*BOOT_CONFIG_ITEM_SIZE));
+    dest_entry->id_flags = (uint32_t)(MAGIC_ID + CFG_APP_FLAG_SHA256 + ((args[ARG_active].u_bool) ? CFG_APP_FLAG_ACTIVE : 0));
+    dest_entry->address = dest_address;
+    dest_entry->size = hdr.new_size;
+    dest_entry->crc32 = 0;
+    memcpy(dest_entry->name, entry_name, BOOT_ENTRY_NAME_LEN);
+    LOGD(TAG, "Adding boot entry #%d: %08X, %08X, %u", dest, dest_entry->id_flags, dest_entry->address, dest_entry->size);
+
+    // Save modified boot sector
+    if (!write_boot_sector()) {
+        mp_raise_msg(&mp_type_OSError, "Error saving config sector.");
+    }
+    LOGD(TAG, "Boot entry #%d saved.", dest);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_ota_patch_obj, 3, mod_ota_patch);
+
 //--------------------------------------------------
 STATIC mp_obj_t mod_ota_setactive(mp_obj_t entry_in)
 {
@@ -1059,6 +1883,8 @@ STATIC const mp_map_elem_t ota_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_list),            MP_ROM_PTR(&mod_ota_list_obj) },
     { MP_ROM_QSTR(MP_QSTR_clone),           MP_ROM_PTR(&mod_ota_clone_obj) },
     { MP_ROM_QSTR(MP_QSTR_write),           MP_ROM_PTR(&mod_ota_fw_fromfile_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fw_fromstream),   MP_ROM_PTR(&mod_ota_fw_fromstream_obj) },
+    { MP_ROM_QSTR(MP_QSTR_patch),           MP_ROM_PTR(&mod_ota_patch_obj) },
     { MP_ROM_QSTR(MP_QSTR_setActive),       MP_ROM_PTR(&mod_ota_setactive_obj) },
     { MP_ROM_QSTR(MP_QSTR_setInteractive),  MP_ROM_PTR(&mod_ota_setInteractive_obj) },
 };
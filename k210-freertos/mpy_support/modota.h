@@ -41,6 +41,10 @@
 #define CFG_APP_FLAG_SHA256     0x00000004
 #define CFG_APP_FLAG_SIZE       0x00000008
 
+#define KBOOT_HI_ADDR           0x00001000  // Kboot stage_1 in flash at 4K
+#define KBOOT_HI_SIZE           0x00003000
+#define KBOOT_LZ4_VERSION       0x010500    // first Kboot version loading LZ4 compressed applications
+
 #define K210_APP_ID             0xDEADBEEF
 #define DEFAULT_APP_ADDRESS     0x00010000
 #define BOOT_ENTRY_NAME_LEN     16
@@ -71,3 +75,4 @@ bool calc_set_app_sha256(uint32_t address);
 bool check_app_sha256(uint32_t address);
 void calc_app_sha256(uint32_t address, uint8_t *hash, uint8_t *app_hash);
 uint32_t get_fw_flash_size(uint32_t address);
+uint32_t get_fw_lz4_size(uint32_t address);
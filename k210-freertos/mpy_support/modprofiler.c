@@ -0,0 +1,450 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Statistical sampling profiler for Python code
+ *
+ * The hardware timer interrupt marks a sample as pending for each MicroPython instance.
+ * The running interpreter takes the sample at the next VM hook check (backward jump, call return, ...),
+ * walks its chain of active bytecode frames and stores the function names, source files
+ * and line numbers into the instance's ring buffer.
+ * Timer ticks which occur while the interpreter is not executing bytecode (native code,
+ * waiting for the GIL, sleeping) are added as the weight of the next sample, so the
+ * samples represent the wall time spent in each Python line.
+ *
+ * The ISR does not touch the interpreter state, the frames are only accessed from the
+ * thread executing them. The ring buffer has a single producer (the instance's VM) and a single consumer (dump()).
+ *
+ * The ring buffers are kept after stop() until the next start().
+ * The recorded names point to the instance's qstr pools, which are freed on the instance's soft reset,
+ * so the samples are discarded on soft reset (the main instance's reset also stops the profiler).
+ *
+ * Ring record: 8-byte header (record size, depth, weight) followed by 'depth' frames, leaf frame first
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/bc.h"
+#include "py/objfun.h"
+#include "py/objstr.h"
+#include "py/stream.h"
+#include "py/mphal.h"
+#include "mpthreadport.h"
+#include "modmachine.h"
+
+#if MICROPY_PY_PROFILER
+
+#define PROFILER_MAX_DEPTH          16
+#define PROFILER_MIN_RATE           10          // minimal sampling rate in Hz
+#define PROFILER_MAX_RATE           5000        // maximal sampling rate in Hz
+#define PROFILER_MIN_SIZE           1024        // minimal ring buffer size in bytes
+#define PROFILER_MAX_SIZE           (256*1024)  // maximal ring buffer size in bytes
+#define PROFILER_WRAP_MARKER        0xFF        // record depth marking the wrap to the ring buffer start
+
+typedef struct _prof_frame_t {
+    const char  *file;
+    const char  *name;
+    uint32_t    line;
+    uint32_t    dummy;
+} prof_frame_t;
+
+typedef struct _prof_rec_t {
+    uint16_t    size;               // record size in bytes, including the header
+    uint8_t     depth;              // number of frames
+    uint8_t     truncated;          // the stack was deeper than PROFILER_MAX_DEPTH
+    uint32_t    weight;             // number of timer ticks represented by the sample
+    prof_frame_t frames[];
+} prof_rec_t;
+
+typedef struct _prof_ring_t {
+    uint8_t             *buf;
+    uint32_t            size;       // ring buffer size, multiple of 8
+    volatile uint32_t   head;       // bytes written (by the VM)
+    volatile uint32_t   tail;       // bytes read (by dump)
+    volatile uint32_t   ticks;      // timer ticks not yet sampled
+    uint32_t            samples;    // number of samples recorded
+    uint32_t            dropped;    // number of samples dropped, ring buffer full
+    volatile uint32_t   discard;    // the samples written before this position are discarded (soft reset)
+} prof_ring_t;
+
+// Bit mask of the processors (MicroPython instances) with the pending sample, checked in VM hook
+volatile uint32_t mp_profiler_pending = 0;
+
+static prof_ring_t prof_ring[2] = { 0 };
+static int8_t prof_timer = -1;
+static handle_t prof_timer_handle = 0;
+static uint32_t prof_rate = 0;
+static uint32_t prof_ninst = 1;
+static uint64_t prof_start_time = 0;
+static uint64_t prof_run_time = 0;
+
+const mp_obj_module_t mp_module_profiler;
+
+
+//-----------------------------------------
+static void profiler_isr(void *userdata)
+{
+    for (int i = 0; i < prof_ninst; i++) {
+        if (prof_ring[i].buf == NULL) continue;
+        __atomic_fetch_add(&prof_ring[i].ticks, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&mp_profiler_pending, 1 << i, __ATOMIC_RELAXED);
+    }
+}
+
+// Function name, source file and line of the code state's current instruction
+//------------------------------------------------------------------------------------------------
+static void profiler_frame_info(const mp_code_state_t *code_state, const byte *cur_ip, prof_frame_t *frame)
+{
+    const byte *ip = code_state->fun_bc->bytecode;
+    MP_BC_PRELUDE_SIG_DECODE(ip);
+    MP_BC_PRELUDE_SIZE_DECODE(ip);
+    (void)n_state; (void)n_exc_stack; (void)scope_flags;
+    (void)n_pos_args; (void)n_kwonly_args; (void)n_def_pos_args;
+    const byte *bytecode_start = ip + n_info + n_cell;
+    #if !MICROPY_PERSISTENT_CODE
+    bytecode_start = MP_ALIGN(bytecode_start, sizeof(mp_uint_t));
+    #endif
+    #if MICROPY_PERSISTENT_CODE
+    qstr block_name = ip[0] | (ip[1] << 8);
+    qstr source_file = ip[2] | (ip[3] << 8);
+    ip += 4;
+    #else
+    qstr block_name = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip);
+    qstr source_file = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip);
+    #endif
+    size_t bc = (cur_ip > bytecode_start) ? (cur_ip - bytecode_start - 1) : 0;
+    // the qstr strings are not freed until the instance's soft reset, see mp_profiler_reset()
+    frame->name = qstr_str(block_name);
+    frame->file = qstr_str(source_file);
+    frame->line = mp_bytecode_get_source_line(ip, bc);
+}
+
+// The frames of a service task executing Python callbacks with its parent's state can be interleaved
+// with the parent's frames, the frame chain is only followed while it points to valid code states
+//-------------------------------------------------------------
+static bool profiler_frame_valid(const mp_code_state_t *cs)
+{
+    uintptr_t ram_start = K210_SRAM_START_ADDRESS;
+    uintptr_t ram_end = (uintptr_t)&_ram_end;
+    if ((((uintptr_t)cs & 7) != 0) || ((uintptr_t)cs < ram_start) || ((uintptr_t)cs >= ram_end)) return false;
+    const mp_obj_fun_bc_t *fun_bc = cs->fun_bc;
+    if ((((uintptr_t)fun_bc & 7) != 0) || ((uintptr_t)fun_bc < ram_start) || ((uintptr_t)fun_bc >= ram_end)) return false;
+    return (fun_bc->base.type == &mp_type_fun_bc);
+}
+
+// Called from VM hook when the sample is pending, records the active frames
+//================================================================================
+void mp_profiler_sample(const struct _mp_code_state_t *code_state, const unsigned char *ip)
+{
+    int proc = uxPortGetProcessorId();
+    uint32_t mask = 1 << proc;
+    if ((mp_profiler_pending & mask) == 0) return;
+    __atomic_fetch_and(&mp_profiler_pending, ~mask, __ATOMIC_RELAXED);
+
+    prof_ring_t *ring = &prof_ring[proc];
+    uint32_t weight = __atomic_exchange_n(&ring->ticks, 0, __ATOMIC_RELAXED);
+    if ((weight == 0) || (ring->buf == NULL)) return;
+
+    int depth = 0;
+    bool truncated = false;
+    for (const mp_code_state_t *cs = code_state; (cs != NULL) && (profiler_frame_valid(cs)); cs = cs->prev_state) {
+        if (depth == PROFILER_MAX_DEPTH) {
+            truncated = true;
+            break;
+        }
+        depth++;
+    }
+    if (depth == 0) return;
+
+    uint32_t rec_size = sizeof(prof_rec_t) + (depth * sizeof(prof_frame_t));
+    uint32_t pos = ring->head % ring->size;
+    uint32_t skip = 0;
+    if ((ring->size - pos) < rec_size) skip = ring->size - pos;
+    if (((ring->head - ring->tail) + skip + rec_size) > ring->size) {
+        ring->dropped++;
+        return;
+    }
+    if (skip) {
+        ((prof_rec_t *)(ring->buf + pos))->depth = PROFILER_WRAP_MARKER;
+        pos = 0;
+    }
+
+    prof_rec_t *rec = (prof_rec_t *)(ring->buf + pos);
+    rec->size = rec_size;
+    rec->depth = depth;
+    rec->truncated = truncated;
+    rec->weight = weight;
+    const mp_code_state_t *cs = code_state;
+    for (int i = 0; i < depth; i++) {
+        profiler_frame_info(cs, (i == 0) ? ip : cs->ip, &rec->frames[i]);
+        cs = cs->prev_state;
+    }
+    ring->samples++;
+    // record must be complete before it is seen by dump()
+    __sync_synchronize();
+    ring->head += skip + rec_size;
+}
+
+//---------------------------
+static void profiler_stop_timer()
+{
+    if (prof_timer_handle) {
+        timer_set_on_tick(prof_timer_handle, NULL, NULL);
+        timer_set_enable(prof_timer_handle, false);
+        io_close(prof_timer_handle);
+        prof_timer_handle = 0;
+        prof_run_time += mp_hal_ticks_us() - prof_start_time;
+    }
+    if (prof_timer >= 0) {
+        mpy_timers_used[prof_timer] = NULL;
+        prof_timer = -1;
+    }
+    mp_profiler_pending = 0;
+    // let the sample possibly being recorded by the other instance finish
+    vTaskDelay(2 / portTICK_PERIOD_MS);
+}
+
+//------------------------------
+static void profiler_free_buffers()
+{
+    for (int i = 0; i < 2; i++) {
+        if (prof_ring[i].buf) vPortFree(prof_ring[i].buf);
+        memset(&prof_ring[i], 0, sizeof(prof_ring_t));
+    }
+}
+
+// Called on MicroPython instance's soft reset, before the heap is initialized
+//==========================
+void mp_profiler_reset(void)
+{
+    int proc = uxPortGetProcessorId();
+    if (proc == MAIN_TASK_PROC) {
+        // the main instance is the only consumer, the buffers can be freed
+        if (prof_timer_handle) profiler_stop_timer();
+        profiler_free_buffers();
+    }
+    else prof_ring[proc].discard = prof_ring[proc].head;
+}
+
+/*
+ * profiler.start(rate=500, *, timer=11, size=16384)
+ *   rate:   sampling rate in Hz
+ *   timer:  hardware timer number used (0~11)
+ *   size:   ring buffer size in bytes, for each MicroPython instance
+ * The samples recorded before are discarded
+ */
+//-----------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_profiler_start(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_rate, ARG_timer, ARG_size };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_rate,     MP_ARG_INT, {.u_int = 500} },
+        { MP_QSTR_timer,    MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 11} },
+        { MP_QSTR_size,     MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 16384} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (prof_timer_handle) {
+        mp_raise_msg(&mp_type_OSError, "Profiler already running");
+    }
+    int tmr = args[ARG_timer].u_int;
+    if ((tmr < 0) || (tmr >= TIMER_MAX_TIMERS)) {
+        mp_raise_ValueError("Only timers 0~11 can be used.");
+    }
+    if (mpy_timers_used[tmr] != NULL) {
+        mp_raise_ValueError("Timer already used.");
+    }
+    if ((args[ARG_rate].u_int < PROFILER_MIN_RATE) || (args[ARG_rate].u_int > PROFILER_MAX_RATE)) {
+        mp_raise_ValueError("Rate out of range (10 ~ 5000 Hz)");
+    }
+    if ((args[ARG_size].u_int < PROFILER_MIN_SIZE) || (args[ARG_size].u_int > PROFILER_MAX_SIZE)) {
+        mp_raise_ValueError("Size out of range (1024 ~ 262144)");
+    }
+
+    profiler_free_buffers();
+    prof_ninst = (mpy_config.config.use_two_main_tasks) ? 2 : 1;
+    for (int i = 0; i < prof_ninst; i++) {
+        prof_ring[i].size = args[ARG_size].u_int & ~7;
+        prof_ring[i].buf = pvPortMalloc(prof_ring[i].size);
+        if (prof_ring[i].buf == NULL) {
+            profiler_free_buffers();
+            mp_raise_msg(&mp_type_MemoryError, "Error allocating profiler buffer");
+        }
+    }
+
+    char timer_dev[16];
+    sprintf(timer_dev, "/dev/timer%d", tmr);
+    prof_timer_handle = io_open(timer_dev);
+    if (prof_timer_handle == 0) {
+        profiler_free_buffers();
+        mp_raise_ValueError("Error opening timer device");
+    }
+    prof_timer = tmr;
+    mpy_timers_used[tmr] = (void *)&mp_module_profiler;
+    prof_rate = args[ARG_rate].u_int;
+    prof_run_time = 0;
+    prof_start_time = mp_hal_ticks_us();
+    timer_set_interval(prof_timer_handle, 1000000000 / prof_rate);
+    timer_set_on_tick(prof_timer_handle, profiler_isr, NULL);
+    timer_set_enable(prof_timer_handle, true);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_profiler_start_obj, 0, mod_profiler_start);
+
+// Stop sampling, the recorded samples are kept until dumped
+//----------------------------------
+STATIC mp_obj_t mod_profiler_stop()
+{
+    profiler_stop_timer();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_profiler_stop_obj, mod_profiler_stop);
+
+// Collapsed stack of the record, root frame first
+//----------------------------------------------------------------------
+static void profiler_stack_key(vstr_t *vstr, const prof_rec_t *rec, int inst)
+{
+    vstr_reset(vstr);
+    if (prof_ninst > 1) vstr_printf(vstr, "mpy%d;", inst + 1);
+    if (rec->truncated) vstr_add_str(vstr, "...;");
+    for (int i = rec->depth - 1; i >= 0; i--) {
+        const prof_frame_t *frame = &rec->frames[i];
+        vstr_printf(vstr, "%s (%s:%u)", frame->name, frame->file, frame->line);
+        if (i > 0) vstr_add_byte(vstr, ';');
+    }
+}
+
+/*
+ * profiler.dump([stream])
+ * Consume the recorded samples and write them in collapsed stack format
+ * ('frame;frame;frame count' lines) to the stream (file) or print them if no stream is given.
+ * The output can be used directly by flamegraph tools.
+ * Returns the number of timer ticks written
+ */
+//-------------------------------------------------------------------
+STATIC mp_obj_t mod_profiler_dump(size_t n_args, const mp_obj_t *args)
+{
+    mp_obj_t stream = (n_args > 0) ? args[0] : mp_const_none;
+    const mp_stream_p_t *stream_p = NULL;
+    if (stream != mp_const_none) stream_p = mp_get_stream_raise(stream, MP_STREAM_OP_WRITE);
+
+    // aggregate the samples with the same stack
+    mp_obj_t counts = mp_obj_new_dict(0);
+    vstr_t key;
+    vstr_init(&key, 128);
+    uint32_t total = 0;
+    for (int inst = 0; inst < prof_ninst; inst++) {
+        prof_ring_t *ring = &prof_ring[inst];
+        if (ring->buf == NULL) continue;
+        // skip the samples recorded before the instance's soft reset
+        uint32_t discard = ring->discard;
+        if ((int32_t)(discard - ring->tail) > 0) ring->tail = discard;
+        while (ring->tail != ring->head) {
+            uint32_t pos = ring->tail % ring->size;
+            prof_rec_t *rec = (prof_rec_t *)(ring->buf + pos);
+            if (((ring->size - pos) < sizeof(prof_rec_t)) || (rec->depth == PROFILER_WRAP_MARKER)) {
+                ring->tail += ring->size - pos;
+                continue;
+            }
+            profiler_stack_key(&key, rec, inst);
+            mp_obj_t k = mp_obj_new_str(key.buf, key.len);
+            mp_map_elem_t *elem = mp_map_lookup(mp_obj_dict_get_map(counts), k, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+            mp_int_t n = (elem->value == MP_OBJ_NULL) ? 0 : MP_OBJ_SMALL_INT_VALUE(elem->value);
+            elem->value = MP_OBJ_NEW_SMALL_INT(n + rec->weight);
+            total += rec->weight;
+            ring->tail += rec->size;
+        }
+    }
+
+    mp_map_t *map = mp_obj_dict_get_map(counts);
+    for (size_t i = 0; i < map->alloc; i++) {
+        if (!mp_map_slot_is_filled(map, i)) continue;
+        size_t len;
+        const char *stack = mp_obj_str_get_data(map->table[i].key, &len);
+        vstr_reset(&key);
+        vstr_add_strn(&key, stack, len);
+        vstr_printf(&key, " %d\n", MP_OBJ_SMALL_INT_VALUE(map->table[i].value));
+        if (stream_p) {
+            int errcode;
+            mp_stream_rw(stream, key.buf, key.len, &errcode, MP_STREAM_RW_WRITE);
+            if (errcode) {
+                vstr_clear(&key);
+                mp_raise_OSError(errcode);
+            }
+        }
+        else mp_printf(&mp_plat_print, "%.*s", key.len, key.buf);
+    }
+    vstr_clear(&key);
+    return mp_obj_new_int_from_uint(total);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_profiler_dump_obj, 0, 1, mod_profiler_dump);
+
+// Returns (running, rate, run_time_us, samples, dropped)
+//-----------------------------------
+STATIC mp_obj_t mod_profiler_status()
+{
+    uint32_t samples = 0, dropped = 0;
+    for (int i = 0; i < prof_ninst; i++) {
+        samples += prof_ring[i].samples;
+        dropped += prof_ring[i].dropped;
+    }
+    uint64_t run_time = prof_run_time;
+    if (prof_timer_handle) run_time += mp_hal_ticks_us() - prof_start_time;
+
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_bool(prof_timer_handle != 0);
+    tuple[1] = mp_obj_new_int(prof_rate);
+    tuple[2] = mp_obj_new_int_from_ull(run_time);
+    tuple[3] = mp_obj_new_int_from_uint(samples);
+    tuple[4] = mp_obj_new_int_from_uint(dropped);
+    return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_profiler_status_obj, mod_profiler_status);
+
+
+//===========================================================
+STATIC const mp_rom_map_elem_t profiler_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__),    MP_ROM_QSTR(MP_QSTR_profiler) },
+
+    { MP_ROM_QSTR(MP_QSTR_start),       MP_ROM_PTR(&mod_profiler_start_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop),        MP_ROM_PTR(&mod_profiler_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dump),        MP_ROM_PTR(&mod_profiler_dump_obj) },
+    { MP_ROM_QSTR(MP_QSTR_status),      MP_ROM_PTR(&mod_profiler_status_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(profiler_module_globals, profiler_module_globals_table);
+
+//===========================================
+const mp_obj_module_t mp_module_profiler = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&profiler_module_globals,
+};
+
+#endif
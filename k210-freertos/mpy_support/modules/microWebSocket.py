@@ -6,7 +6,7 @@ Copyright © 2019 LoBo (https://github.com/loboris/MicroPython_K210_LoBo)
 
 from   uhashlib import sha1
 from   binascii import b2a_base64
-from   ustruct  import pack
+from   network  import WebSocket
 import _thread
 import time
 import gc
@@ -19,27 +19,17 @@ class MicroWebSocket :
 
     _handshakeSign = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 
-    _opContFrame   = 0x0
-    _opTextFrame   = 0x1
-    _opBinFrame    = 0x2
-    _opCloseFrame  = 0x8
-    _opPingFrame   = 0x9
-    _opPongFrame   = 0xA
-    
-    _msgTypeText   = 1
-    _msgTypeBin    = 2
-
     # ============================================================================
     # ===( Utils  )===============================================================
     # ============================================================================
 
     @staticmethod
-    def _tryAllocByteArray(size) :
+    def _tryAllocWebSocket(socket, maxRecvLen) :
         for x in range(10) :
             try :
                 gc.collect()
-                return bytearray(size)
-            except :
+                return WebSocket(socket, True, maxmsg=maxRecvLen)
+            except MemoryError :
                 pass
         return None
 
@@ -73,11 +63,8 @@ class MicroWebSocket :
         self._debug             = debug
 
         if self._handshake(httpResponse) :
-            self._ctrlBuf = MicroWebSocket._tryAllocByteArray(0x7D)
-            self._msgBuf  = MicroWebSocket._tryAllocByteArray(maxRecvLen)
-            if self._ctrlBuf and self._msgBuf :
-                self._msgType = None
-                self._msgLen  = 0
+            self._ws = MicroWebSocket._tryAllocWebSocket(socket, maxRecvLen)
+            if self._ws :
                 if threaded :
                     th = MicroWebSocket._tryStartThread(self._wsProcess, (acceptCallback, ), stackSize)
                     if th:
@@ -135,125 +122,44 @@ class MicroWebSocket :
     # ----------------------------------------------------------------------------
 
     def _receiveFrame(self) :
+        # framing, unmasking and fragmentation are handled by 'network.WebSocket'
         try :
-            b = self._socket.read(2)
-            if not b or len(b) != 2 :
-                return False
-
-            fin    = b[0] & 0x80 > 0
-            opcode = b[0] & 0x0F
-            masked = b[1] & 0x80 > 0
-            length = b[1] & 0x7F
-
-            if opcode == self._opContFrame and not self._msgType :
-                return False
-            elif opcode == self._opTextFrame :
-                self._msgType = self._msgTypeText
-            elif opcode == self._opBinFrame :
-                self._msgType = self._msgTypeBin
-
-            if length == 0x7E :
-                b = self._socket.read(2)
-                if not b or len(b) != 2 :
-                    return False
-                length = (b[0] << 8) + b[1]
-            elif length == 0x7F :
-                return False
-
-            mask = self._socket.read(4) if masked else None
-            if masked and (not mask or len(mask) != 4) :
-                return False
-
-            if opcode == self._opContFrame or \
-               opcode == self._opTextFrame or \
-               opcode == self._opBinFrame :
-
-                if length > 0 :
-                    buf = memoryview(self._msgBuf)[self._msgLen:]
-                    if length > len(buf) :
-                        return False
-                    x = self._socket.readinto(buf[0:length])
-                    if x != length :
-                        return False
-                    if masked :
-                        for i in range(length) :
-                            idx = self._msgLen + i
-                            self._msgBuf[idx] ^= mask[i%4]
-                    self._msgLen += length
-                    if fin :
-                        b = bytes(memoryview(self._msgBuf)[:self._msgLen])
-                        if self._msgType == self._msgTypeText :
-                            if self.RecvTextCallback :
-                                try :
-                                    self.RecvTextCallback(self, b.decode())
-                                except Exception as ex :
-                                    print("MicroWebSocket : Error on recv text callback (%s)." % str(ex))
-                        else :
-                            if self.RecvBinaryCallback :
-                                try :
-                                    self.RecvBinaryCallback(self, b)
-                                except Exception as ex :
-                                    print("MicroWebSocket : Error on recv binary callback (%s)." % str(ex))
-                        self._msgType = None
-                        self._msgLen  = 0
-                else :
-                    return False
-
-            elif opcode == self._opPingFrame :
-
-                if length > len(self._ctrlBuf) :
-                    return False
-                if length > 0 :
-                    x = self._socket.readinto(self._ctrlBuf[0:length])
-                    if x != length :
-                        return False
-                    pingData = memoryview(self._ctrlBuf)[:length]
-                else :
-                    pingData = None
-                self._sendFrame(self._opPongFrame, pingData)
-
-            elif opcode == self._opCloseFrame :
-                self.Close()
-
+            msg = self._ws.recv(1000)
         except :
             return False
-
-        return True
-
-    # ----------------------------------------------------------------------------
-
-    def _sendFrame(self, opcode, data=None, fin=True) :
-        if not self._closed and opcode >= 0x00 and opcode <= 0x0F :
-            dataLen = 0 if not data else len(data)
-            if dataLen <= 0xFFFF :
-                if self._debug:
-                    print("    [{}] [WS SendFrame] Socket write: {}, {} [{}]".format(time.ticks_ms(), opcode, dataLen, data))
-                b1 = (0x80 | opcode) if fin else opcode
-                b2 = 0x7E if dataLen >= 0x7E else dataLen
+        if msg is None :
+            return not self._ws.closed()
+        if isinstance(msg, str) :
+            if self.RecvTextCallback :
                 try :
-                    if self._socket.sendall(pack('>BB', b1, b2)) == 2 :
-                        if dataLen > 0 :
-                            if dataLen >= 0x7E :
-                                self._socket.sendall(pack('>H', dataLen))
-                            ret = self._socket.write(data) == dataLen
-                        else :
-                            ret = True
-                        #if self._socket is not self._socket :
-                        #    self._socket.flush()   # CPython needs flush to continue protocol
-                        return ret
-                except :
-                    pass
-        return False
+                    self.RecvTextCallback(self, msg)
+                except Exception as ex :
+                    print("MicroWebSocket : Error on recv text callback (%s)." % str(ex))
+        elif self.RecvBinaryCallback :
+            try :
+                self.RecvBinaryCallback(self, msg)
+            except Exception as ex :
+                print("MicroWebSocket : Error on recv binary callback (%s)." % str(ex))
+        return True
 
     # ----------------------------------------------------------------------------
 
     def SendText(self, msg) :
-        return self._sendFrame(self._opTextFrame, msg.encode())
+        if self._closed :
+            return False
+        if self._debug:
+            print("    [{}] [WS Send] text: {}".format(time.ticks_ms(), len(msg)))
+        return self._ws.send(msg)
 
     # ----------------------------------------------------------------------------
 
     def SendBinary(self, data) :
-        return self._sendFrame(self._opBinFrame, data)
+        if self._closed :
+            return False
+        if self._debug:
+            print("    [{}] [WS Send] binary: {}".format(time.ticks_ms(), len(data)))
+        # the data (bytes, bytearray, memoryview) are sent without copying
+        return self._ws.send(data, True)
 
     # ----------------------------------------------------------------------------
 
@@ -270,11 +176,10 @@ class MicroWebSocket :
     def Close(self) :
         if not self._closed :
             try :
-                self._sendFrame(self._opCloseFrame)
-                self._socket.close()
-                self._closed = True
+                self._ws.close()
             except :
                 pass
+            self._closed = True
 
     # ============================================================================
     # ============================================================================
@@ -252,7 +252,27 @@ extern uint32_t _ram_end;
 #define MICRO_PY_FLASH_USER_VAR_START           (MICRO_PY_FLASH_CONFIG_START + MICRO_PY_FLASH_CONFIG_SIZE)
 #define MICRO_PY_FLASH_USER_VAR_SIZE            (16*1024)
 
+// Read-only image partition, accessed in place through the XIP window (uos.mmap)
+#ifndef CONFIG_MICRO_PY_FLASH_IMAGE_SIZE
+#define CONFIG_MICRO_PY_FLASH_IMAGE_SIZE        (0)
+#endif
+#define MICRO_PY_FLASH_IMAGE_START              ((MICRO_PY_FLASH_USER_VAR_START + MICRO_PY_FLASH_USER_VAR_SIZE + 0xFFFF) & ~0xFFFF)
+#define MICRO_PY_FLASH_IMAGE_SIZE               (CONFIG_MICRO_PY_FLASH_IMAGE_SIZE*1024)
+
+// Modules frozen to Flash at run time, bytecode is executed in place through the XIP window (uos.mpy_freeze)
+#ifndef CONFIG_MICRO_PY_FLASH_FROZEN_SIZE
+#define CONFIG_MICRO_PY_FLASH_FROZEN_SIZE       (0)
+#endif
+#define MICRO_PY_FLASH_FROZEN_START             ((MICRO_PY_FLASH_IMAGE_START + MICRO_PY_FLASH_IMAGE_SIZE + 0xFFFF) & ~0xFFFF)
+#define MICRO_PY_FLASH_FROZEN_SIZE              (CONFIG_MICRO_PY_FLASH_FROZEN_SIZE*1024)
+
+#if MICRO_PY_FLASH_FROZEN_SIZE > 0
+#define MICRO_PY_FLASH_USED_END                 (MICRO_PY_FLASH_FROZEN_START + MICRO_PY_FLASH_FROZEN_SIZE)
+#elif MICRO_PY_FLASH_IMAGE_SIZE > 0
+#define MICRO_PY_FLASH_USED_END                 (MICRO_PY_FLASH_IMAGE_START + MICRO_PY_FLASH_IMAGE_SIZE)
+#else
 #define MICRO_PY_FLASH_USED_END                 (MICRO_PY_FLASH_USER_VAR_START + MICRO_PY_FLASH_USER_VAR_SIZE)
+#endif
 
 #if (MICRO_PY_FLASH_USED_END > MICRO_PY_FLASH_SIZE)
 #error "Misconfigured Flash sizes"
@@ -287,6 +307,10 @@ extern uint32_t _ram_end;
 #define MICROPY_PY_THREAD_GIL                   (1)  // !DO NOT CHANGE!
 // How many bytecodes are executed before the threads are switched
 #define MICROPY_PY_THREAD_GIL_VM_DIVISOR        (CONFIG_MICROPY_PY_THREAD_GIL_VM_DIVISOR)
+// GIL is handed off to the highest priority waiting thread, see mpthreadport.c
+#define MICROPY_PY_THREAD_GIL_HANDOFF           (1)
+// Collect per-thread GIL, allocation and GC statistics
+#define MICROPY_PY_THREAD_STATS                 (1)
 //---------------------------------------------------------------------
 
 #define MICRO_PY_DEFAULT_CPU_CLOCK              (400000000)                        // default cpu clock in Hz
@@ -302,10 +326,20 @@ extern uint32_t _ram_end;
 #endif
 
 #define USE_MICROPY_VM_HOOK_LOOP                (1)
+// Sampling profiler, the samples are taken in VM hook
+#define MICROPY_PY_PROFILER                     (USE_MICROPY_VM_HOOK_LOOP)
 #if USE_MICROPY_VM_HOOK_LOOP
 extern void vm_loop_hook();
+#if MICROPY_PY_PROFILER
+struct _mp_code_state_t;
+extern volatile uint32_t mp_profiler_pending;
+void mp_profiler_sample(const struct _mp_code_state_t *code_state, const unsigned char *ip);
+void mp_profiler_reset(void);
+#define MICROPY_VM_HOOK_LOOP                    vm_loop_hook(); if (mp_profiler_pending) mp_profiler_sample(code_state, ip);
+#else
 #define MICROPY_VM_HOOK_LOOP                    vm_loop_hook();
 #endif
+#endif
 
 // === stack entries are 64-bit, stack size in bytes is 8*MICROPY_THREAD_STACK_SIZE ===
 #define MICROPY_THREAD_STACK_SIZE               (2048) // default thread stack size in STACK UNITS (8 bytes)
@@ -313,6 +347,8 @@ extern void vm_loop_hook();
 
 // === Buffer size for UART used as RELP standard input/output ===
 #define MICRO_PY_UARTHS_BUFFER_SIZE             (1280)
+// === Buffer size for REPL and log output, must be power of 2 ===
+#define MICRO_PY_UARTHS_TX_BUFFER_SIZE          (4096)
 
 // object representation and NLR handling
 
@@ -446,6 +482,7 @@ extern const struct _mp_print_t mp_debug_print;
 #define MICROPY_PY_GC                           (1)
 #define MICROPY_MODULE_FROZEN_STR               (0)
 #define MICROPY_MODULE_FROZEN_MPY               (1)
+#define MICROPY_MODULE_FROZEN_MPY_EXTRA         (MICRO_PY_FLASH_FROZEN_SIZE > 0)
 #define MICROPY_LONGINT_IMPL                    (MICROPY_LONGINT_IMPL_MPZ) //(MICROPY_LONGINT_IMPL_LONGLONG)
 
 //-----------------------------
@@ -574,6 +611,11 @@ extern const struct _mp_print_t mp_debug_print;
 #else
 #define MICROPY_PY_USE_REQUESTS                 (0)
 #endif
+#ifdef CONFIG_MICROPY_PY_USE_HTTPSERVER
+#define MICROPY_PY_USE_HTTPSERVER               (1)
+#else
+#define MICROPY_PY_USE_HTTPSERVER               (0)
+#endif
 #endif
 
 #ifdef CONFIG_MICROPY_USE_DISPLAY
@@ -765,6 +807,13 @@ extern const struct _mp_obj_module_t mp_test_module;
 #define BUILTIN_MODULE_TEST
 #endif
 
+#if MICROPY_PY_PROFILER
+extern const struct _mp_obj_module_t mp_module_profiler;
+#define BUILTIN_MODULE_PROFILER { MP_OBJ_NEW_QSTR(MP_QSTR_profiler), (mp_obj_t)&mp_module_profiler },
+#else
+#define BUILTIN_MODULE_PROFILER
+#endif
+
 #if MICROPY_PY_USE_OTA
 extern const struct _mp_obj_module_t ota_module;
 #define BUILTIN_MODULE_OTA { MP_OBJ_NEW_QSTR(MP_QSTR_ota), (mp_obj_t)&ota_module },
@@ -794,6 +843,7 @@ extern const struct _mp_obj_module_t ota_module;
     BUILTIN_MODULE_SQLITE \
     BUILTIN_MODULE_TEST \
     BUILTIN_MODULE_OTA \
+    BUILTIN_MODULE_PROFILER \
 
 /*
 #define MICROPY_PORT_BUILTIN_MODULE_WEAK_LINKS \
@@ -810,7 +860,17 @@ extern const struct _mp_obj_module_t ota_module;
 
 #define MP_STATE_PORT MP_STATE_VM
 
+#if MICROPY_MODULE_FROZEN_MPY_EXTRA
+// Modules frozen to Flash must be linked before any run time qstr is created
+void flash_frozen_init(void);
+#define MICROPY_PORT_INIT_FUNC              flash_frozen_init()
+#endif
+
+#define MICRO_PY_IPC_JOB_MAX_JOBS               (8)
+
 #define MICROPY_PORT_ROOT_POINTERS \
-    const char *readline_hist[32];
+    const char *readline_hist[32]; \
+    mp_obj_t ipc_job_refs[MICRO_PY_IPC_JOB_MAX_JOBS]; \
+    mp_obj_t spi_queue_objs;
 
 #endif
@@ -62,6 +62,7 @@ static volatile uarths_t *const uarths = (volatile uarths_t *)UARTHS_BASE_ADDR;
 static volatile bool mp_hall_kbd_irq = false;
 static QueueSetMemberHandle_t inter_proc_semaphore = NULL;
 static uint8_t stdin_ringbuf_array[MICRO_PY_UARTHS_BUFFER_SIZE];
+static uint8_t stdout_buffer_array[MICRO_PY_UARTHS_TX_BUFFER_SIZE];
 
 ringbuf_t stdin_ringbuf = {stdin_ringbuf_array, sizeof(stdin_ringbuf_array), 0, 0};
 mp_obj_t main_task_callback = mp_const_none;
@@ -212,6 +213,10 @@ static void on_irq_haluart_recv(void *userdata)
     BaseType_t xHigherPriorityTaskWoken;
     uint8_t c;
     uarths_rxdata_t recv;
+
+    // Send the buffered stdout data
+    uarths_tx_irq();
+
     recv = uarths->rxdata;
     if (!recv.empty) {
         c = (int)recv.data;
@@ -266,6 +271,9 @@ static void on_irq_haluart_recv2(void *userdata)
 //----------------------------------------------------------------
 void mp_hal_uarths_setirqhandle(void *irq_handler, void *userdata)
 {
+    // Send the buffered stdout data, other handlers (block transfers) use direct output
+    uarths_set_tx_buffer(NULL, 0);
+
     pic_set_irq_enable(IRQN_UARTHS_INTERRUPT, 0);
     uarths->rxctrl.rxcnt = 0;
     uarths->ie.txwm = 0;
@@ -278,6 +286,9 @@ void mp_hal_uarths_setirqhandle(void *irq_handler, void *userdata)
         pic_set_irq_handler(IRQN_UARTHS_INTERRUPT, irq_handler, userdata);
         pic_set_irq_priority(IRQN_UARTHS_INTERRUPT, 1);
         pic_set_irq_enable(IRQN_UARTHS_INTERRUPT, 1);
+        if (irq_handler == on_irq_haluart_recv) {
+            uarths_set_tx_buffer(stdout_buffer_array, sizeof(stdout_buffer_array));
+        }
     }
 }
 
@@ -462,9 +473,9 @@ int mp_hal_stdin_rx_chr(void)
         }
 
         // Process received character, if any
-        uarths->ie.rxwm = 0;
+        uarths_set_rx_irq(0);
         c = ringbuf_get(&stdin_ringbuf);
-        uarths->ie.rxwm = 1;
+        uarths_set_rx_irq(1);
         if (c < 0) {
             // no character in ring buffer
             // wait max 10 ms for character
@@ -472,9 +483,9 @@ int mp_hal_stdin_rx_chr(void)
             if ( xSemaphoreTake( mp_hal_uart_semaphore, 10 / portTICK_PERIOD_MS ) == pdTRUE ) {
                 // received
                 MP_THREAD_GIL_ENTER();
-                uarths->ie.rxwm = 0;
+                uarths_set_rx_irq(0);
                 c = ringbuf_get(&stdin_ringbuf);
-                uarths->ie.rxwm = 1;
+                uarths_set_rx_irq(1);
             }
             else {
                 // not received
@@ -540,16 +551,24 @@ void mp_hal_stdout_tx_strn(const char *str, size_t len)
         return;
     }
 
-    // Only release the GIL if many characters are being sent
-    bool release_gil = len > 20;
-    if (release_gil) {
-        MP_THREAD_GIL_EXIT();
-    }
+    // The data are put into the stdout buffer and sent by the UARTHS interrupt,
+    // the GIL is only released if we have to wait for room in the buffer
+    bool release_gil = false;
     if (syslog_mutex) {
         xSemaphoreTake(syslog_mutex, 100 / portTICK_RATE_MS);
     }
-    for (uint32_t i = 0; i < len; ++i) {
-        uarths_write_byte(str[i]);
+    size_t sent = uarths_write((const uint8_t *)str, len);
+    while (sent < len) {
+        if (uarths_tx_policy == UARTHS_TX_DROP) {
+            uarths_tx_dropped += len - sent;
+            break;
+        }
+        if (!release_gil) {
+            MP_THREAD_GIL_EXIT();
+            release_gil = true;
+        }
+        vTaskDelay(1);
+        sent += uarths_write((const uint8_t *)str + sent, len - sent);
     }
     if (syslog_mutex) {
         xSemaphoreGive(syslog_mutex);
@@ -630,17 +649,17 @@ int32_t mp_hal_receive_byte(uint8_t *c, uint32_t timeout)
 {
     int cc = -1;
 
-    uarths->ie.rxwm = 0;
+    uarths_set_rx_irq(0);
     cc = ringbuf_get(&stdin_ringbuf);
-    uarths->ie.rxwm = 1;
+    uarths_set_rx_irq(1);
     if (cc < 0) {
         // no character in ring buffer
         // wait max 'timeout' ms for character
         if ( xSemaphoreTake( mp_hal_uart_semaphore, timeout / portTICK_PERIOD_MS ) == pdTRUE ) {
             // received
-            uarths->ie.rxwm = 0;
+            uarths_set_rx_irq(0);
             cc = ringbuf_get(&stdin_ringbuf);
-            uarths->ie.rxwm = 1;
+            uarths_set_rx_irq(1);
         }
     }
     if (cc >= 0) {
@@ -655,12 +674,12 @@ void mp_hal_purge_uart_buffer()
 {
     int cc = -1;
 
-    uarths->ie.rxwm = 0;
+    uarths_set_rx_irq(0);
     cc = ringbuf_get(&stdin_ringbuf);
     while (cc >= 0) {
         cc = ringbuf_get(&stdin_ringbuf);
     }
-    uarths->ie.rxwm = 1;
+    uarths_set_rx_irq(1);
 }
 
 //------------------------------------------------
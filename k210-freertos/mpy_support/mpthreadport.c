@@ -46,6 +46,7 @@
 #include "modmachine.h"
 #include "gccollect.h"
 #include "py/pystack.h"
+#include "w25qxx.h"
 
 TaskHandle_t MainTaskHandle = NULL;
 TaskHandle_t MainTaskHandle2 = NULL;
@@ -69,6 +70,9 @@ thread_t thread_entry2;
 mp_state_ctx_t mp_state_ctx2 = { 0 };
 
 extern void mp_thread_entry(void *args_in);
+#if MICROPY_PY_THREAD_GIL
+static int _flash_lock_hook(int event, int arg);
+#endif
 
 
 // === Initialize the main MicroPython thread ===
@@ -133,6 +137,9 @@ void mp_thread_preinit(void *stack, uint32_t stack_len, void *pystack, int pysta
         else MainTaskHandle2 = thread->id;
     }
     else MainTaskHandle = thread->id;
+    #if MICROPY_PY_THREAD_GIL
+    w25qxx_lock_hook = _flash_lock_hook;
+    #endif
 }
 
 //--------------------------------
@@ -495,6 +502,356 @@ void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex) {
     taskYIELD();
 }
 
+#if MICROPY_PY_THREAD_STATS
+// Histogram bucket for the time in us, bucket 'n' holds the times < 4^(n+2) us
+//-----------------------------------------------
+static inline int _stats_bucket(uint64_t time_us)
+{
+    int bucket = ((63 - __builtin_clzll(time_us | 1)) >> 1) - 1;
+    if (bucket < 0) return 0;
+    if (bucket >= THREAD_STATS_HIST_SIZE) return THREAD_STATS_HIST_SIZE - 1;
+    return bucket;
+}
+#endif
+
+#if MICROPY_PY_THREAD_GIL_HANDOFF
+/*
+ * GIL with direct hand-off
+ *
+ * The GIL is a binary semaphore, the waiting tasks are also registered in the GIL's waiters table.
+ * On release, the GIL is handed off to the highest priority waiter (the first one registered
+ * if more waiters have the same priority), any other task taking the semaphore before it
+ * gives it back, unless it has higher priority than the selected waiter.
+ * Suspended waiters are not selected and the hand-off expires after MP_THREAD_GIL_HANDOFF_US,
+ * so the GIL can't stay reserved for a task which does not run.
+ * The GIL owner checks (every MICROPY_PY_THREAD_GIL_VM_DIVISOR bytecodes) if it should release the GIL:
+ * immediately if a higher priority task waits, after holding it for 'gil_hold_us' otherwise.
+ * With priority inheritance enabled, the owner runs with the priority of the highest priority
+ * waiter, so it can not be kept from releasing the GIL by the medium priority tasks.
+ *
+ * The table is shared by the tasks running on both processors, it is protected by a spin lock
+ */
+typedef struct _mp_thread_gil_t {
+    volatile uint8_t    lock;
+    TaskHandle_t        owner;
+    UBaseType_t         owner_prio;     // owner's priority when it acquired the GIL
+    UBaseType_t         boost_prio;     // priority inherited from a waiter, 0 if not boosted
+    TaskHandle_t        handoff;        // waiter selected on the last release
+    UBaseType_t         handoff_prio;
+    uint64_t            handoff_at;     // time of the hand-off in us
+    uint64_t            taken_at;       // time of the last acquire in us
+    volatile int        nwaiters;
+    volatile UBaseType_t waiter_max;    // highest priority of the waiters
+    TaskHandle_t        waiter[MP_THREAD_GIL_MAX_WAITERS];
+    UBaseType_t         waiter_prio[MP_THREAD_GIL_MAX_WAITERS];
+} mp_thread_gil_t;
+
+static mp_thread_gil_t thread_gil[2] = { 0 };
+static uint32_t gil_hold_us = MP_THREAD_GIL_HOLD_US;
+static bool gil_inherit = true;
+
+//----------------------------------------------------------
+static inline mp_thread_gil_t *_gil_get(mp_state_ctx_t *state)
+{
+    // each instance has its own GIL
+    if ((mp_state_ctx2.vm.gil_mutex.handle != NULL) && (state->vm.gil_mutex.handle == mp_state_ctx2.vm.gil_mutex.handle)) {
+        return &thread_gil[1];
+    }
+    return &thread_gil[0];
+}
+
+//-----------------------------------------------
+static inline void _gil_lock(mp_thread_gil_t *gil)
+{
+    taskENTER_CRITICAL();
+    while (__atomic_test_and_set(&gil->lock, __ATOMIC_ACQUIRE)) {
+        ;
+    }
+}
+
+//-------------------------------------------------
+static inline void _gil_unlock(mp_thread_gil_t *gil)
+{
+    __atomic_clear(&gil->lock, __ATOMIC_RELEASE);
+    taskEXIT_CRITICAL();
+}
+
+// Returns the waiter's index in the waiters table or -1, GIL lock must be held
+//---------------------------------------------------------------------
+static int _gil_find_waiter(mp_thread_gil_t *gil, TaskHandle_t task)
+{
+    for (int i = 0; i < gil->nwaiters; i++) {
+        if (gil->waiter[i] == task) return i;
+    }
+    return -1;
+}
+
+//-------------------------------------------------------------------------
+static void _gil_remove_waiter(mp_thread_gil_t *gil, TaskHandle_t task)
+{
+    int idx = _gil_find_waiter(gil, task);
+    if (idx < 0) return;
+    gil->nwaiters--;
+    for (int i = idx; i < gil->nwaiters; i++) {
+        gil->waiter[i] = gil->waiter[i+1];
+        gil->waiter_prio[i] = gil->waiter_prio[i+1];
+    }
+    gil->waiter_max = 0;
+    for (int i = 0; i < gil->nwaiters; i++) {
+        if (gil->waiter_prio[i] > gil->waiter_max) gil->waiter_max = gil->waiter_prio[i];
+    }
+}
+
+// Check if the GIL is still reserved for the selected waiter, GIL lock must be held
+//--------------------------------------------------
+static bool _gil_handoff_valid(mp_thread_gil_t *gil)
+{
+    if (gil->handoff == NULL) return false;
+    if (_gil_find_waiter(gil, gil->handoff) < 0) return false;
+    if ((mp_hal_ticks_us() - gil->handoff_at) > MP_THREAD_GIL_HANDOFF_US) return false;
+    return (eTaskGetState(gil->handoff) != eSuspended);
+}
+
+// Remove the task from the waiters of both GILs, called when the task is suspended
+//-----------------------------------------------
+static void _gil_forget_waiter(TaskHandle_t task)
+{
+    for (int i = 0; i < 2; i++) {
+        mp_thread_gil_t *gil = &thread_gil[i];
+        _gil_lock(gil);
+        _gil_remove_waiter(gil, task);
+        if (gil->handoff == task) gil->handoff = NULL;
+        _gil_unlock(gil);
+    }
+}
+
+// Create the GIL, called from mp_init()
+//===================================================
+void mp_thread_gil_init(mp_thread_mutex_t *gil_mutex)
+{
+    gil_mutex->handle = xSemaphoreCreateBinaryStatic(&gil_mutex->buffer);
+    xSemaphoreGive(gil_mutex->handle);
+    mp_thread_gil_t *gil = (gil_mutex == &mp_state_ctx2.vm.gil_mutex) ? &thread_gil[1] : &thread_gil[0];
+    memset(gil, 0, sizeof(mp_thread_gil_t));
+}
+
+// Set the GIL hand-off policy (negative arguments are not changed)
+// Returns the current hold time and priority inheritance setting
+//===================================================================
+uint32_t mp_thread_gil_policy(int32_t hold_us, int inherit, bool *inherit_out)
+{
+    if (hold_us >= 0) gil_hold_us = hold_us;
+    if (inherit >= 0) gil_inherit = (inherit != 0);
+    if (inherit_out) *inherit_out = gil_inherit;
+    return gil_hold_us;
+}
+
+//---------------------------------------------------------------
+static void _gil_acquire(mp_state_ctx_t *state, mp_thread_gil_t *gil)
+{
+    SemaphoreHandle_t handle = state->vm.gil_mutex.handle;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    UBaseType_t prio = uxTaskPriorityGet(NULL);
+    bool registered = false;
+
+    for (;;) {
+        // bounded wait, the task re-registers after each timeout
+        // (it is removed from the waiters if suspended, or was not registered if the table was full)
+        if (xSemaphoreTake(handle, (registered) ? 1 : 0) == pdTRUE) {
+            _gil_lock(gil);
+            if ((gil->handoff == self) || (prio > gil->handoff_prio) || (!_gil_handoff_valid(gil))) {
+                // the GIL is ours
+                gil->handoff = NULL;
+                _gil_remove_waiter(gil, self);
+                gil->owner = self;
+                gil->owner_prio = prio;
+                gil->boost_prio = 0;
+                gil->taken_at = mp_hal_ticks_us();
+                _gil_unlock(gil);
+                break;
+            }
+            _gil_unlock(gil);
+            // handed off to another task, give it back and block for a tick,
+            // the tasks with the same priority must not spin on the semaphore
+            xSemaphoreGive(handle);
+            vTaskDelay(1);
+        }
+        _gil_lock(gil);
+        // (re)register, the waiter is removed from the table if the task was suspended
+        if ((_gil_find_waiter(gil, self) < 0) && (gil->nwaiters < MP_THREAD_GIL_MAX_WAITERS)) {
+            gil->waiter[gil->nwaiters] = self;
+            gil->waiter_prio[gil->nwaiters] = prio;
+            gil->nwaiters++;
+            if (prio > gil->waiter_max) gil->waiter_max = prio;
+        }
+        // priority inheritance, the owner runs at the waiter's priority until it releases the GIL
+        // set while the GIL lock is held, the owner can't release the GIL and restore its priority before
+        if ((gil_inherit) && (gil->owner) && (prio > gil->owner_prio) && (prio > gil->boost_prio)) {
+            gil->boost_prio = prio;
+            vTaskPrioritySet(gil->owner, prio);
+        }
+        _gil_unlock(gil);
+        registered = true;
+    }
+}
+
+//---------------------------------------------------------------
+static void _gil_release(mp_state_ctx_t *state, mp_thread_gil_t *gil)
+{
+    _gil_lock(gil);
+    bool boosted = (gil->boost_prio != 0);
+    UBaseType_t owner_prio = gil->owner_prio;
+    gil->owner = NULL;
+    gil->boost_prio = 0;
+    gil->handoff = NULL;
+    gil->handoff_prio = 0;
+    gil->handoff_at = mp_hal_ticks_us();
+    // hand off to the highest priority waiter, first registered if more have the same priority
+    // the suspended waiters are skipped, they could not take the GIL
+    for (int i = 0; i < gil->nwaiters; i++) {
+        if (eTaskGetState(gil->waiter[i]) == eSuspended) continue;
+        if ((gil->handoff == NULL) || (gil->waiter_prio[i] > gil->handoff_prio)) {
+            gil->handoff = gil->waiter[i];
+            gil->handoff_prio = gil->waiter_prio[i];
+        }
+    }
+    _gil_unlock(gil);
+
+    if (boosted) vTaskPrioritySet(NULL, owner_prio);
+    xSemaphoreGive(state->vm.gil_mutex.handle);
+    taskYIELD();
+}
+
+// Called from the VM while holding the GIL,
+// hands the GIL off if a higher priority task waits or the hold time has expired
+// The GIL is released after the hold time also if no waiter is registered, a task
+// can wait for the GIL without being registered (waiters table full)
+//===========================
+void mp_thread_gil_yield(void)
+{
+    mp_state_ctx_t *state = mp_get_state();
+    mp_thread_gil_t *gil = _gil_get(state);
+    if ((gil->waiter_max <= gil->owner_prio) && ((mp_hal_ticks_us() - gil->taken_at) < gil_hold_us)) return;
+
+    mp_thread_gil_exit();
+    mp_thread_gil_enter();
+}
+#endif
+
+#if MICROPY_PY_THREAD_STATS || MICROPY_PY_THREAD_GIL_HANDOFF
+// Acquire the GIL and update the thread's wait statistics
+//----------------------------
+void mp_thread_gil_enter(void)
+{
+    mp_state_ctx_t *state = mp_get_state();
+    #if MICROPY_PY_THREAD_STATS
+    uint64_t start = mp_hal_ticks_us();
+    #endif
+
+    #if MICROPY_PY_THREAD_GIL_HANDOFF
+    _gil_acquire(state, _gil_get(state));
+    #else
+    mp_thread_mutex_lock(&state->vm.gil_mutex, 1);
+    #endif
+
+    #if MICROPY_PY_THREAD_STATS
+    mp_thread_stats_t *stats = &state->thread.stats;
+    uint64_t now = mp_hal_ticks_us();
+    stats->gil_wait_us += now - start;
+    stats->gil_wait_hist[_stats_bucket(now - start)]++;
+    stats->gil_count++;
+    stats->gil_taken = now;
+    #endif
+}
+
+// Update the thread's hold statistics and release the GIL
+//---------------------------
+void mp_thread_gil_exit(void)
+{
+    mp_state_ctx_t *state = mp_get_state();
+    #if MICROPY_PY_THREAD_STATS
+    mp_thread_stats_t *stats = &state->thread.stats;
+    uint64_t held = mp_hal_ticks_us() - stats->gil_taken;
+    stats->gil_hold_us += held;
+    stats->gil_hold_hist[_stats_bucket(held)]++;
+    #endif
+
+    #if MICROPY_PY_THREAD_GIL_HANDOFF
+    _gil_release(state, _gil_get(state));
+    #else
+    mp_thread_mutex_unlock(&state->vm.gil_mutex);
+    #endif
+}
+#endif
+
+#if MICROPY_PY_THREAD_GIL
+// Returns true if the current task holds the instance's GIL
+//-------------------------------------------------
+static bool _gil_owned(mp_state_ctx_t *state)
+{
+    #if MICROPY_PY_THREAD_GIL_HANDOFF
+    return (_gil_get(state)->owner == xTaskGetCurrentTaskHandle());
+    #else
+    // MicroPython tasks call the flash driver while holding their instance's GIL
+    return (mp_get_state() == state);
+    #endif
+}
+
+/*
+ * Flash driver lock hook
+ *
+ * While the flash is used by another task, the waiting task releases its instance's GIL,
+ * the flash owner may need it.
+ * While the XIP mode is suspended (flash erase/program/read commands), the GILs of all instances
+ * not owned by the flash owner are held, so no Python code on any processor can read the XIP mapped
+ * data (flash image memoryviews, frozen bytecode). Returns the mask of the taken GILs.
+ */
+//-----------------------------------------------
+static int _flash_lock_hook(int event, int arg)
+{
+    mp_state_ctx_t *states[2] = { &mp_state_ctx, &mp_state_ctx2 };
+    int res = 0;
+
+    switch (event) {
+        case W25QXX_HOOK_WAIT_START: {
+            mp_state_ctx_t *state = mp_get_state();
+            if ((state) && (state->vm.gil_mutex.handle) && (_gil_owned(state))) {
+                MP_THREAD_GIL_EXIT();
+                res = 1;
+            }
+            break;
+        }
+        case W25QXX_HOOK_WAIT_END:
+            if (arg) MP_THREAD_GIL_ENTER();
+            break;
+        case W25QXX_HOOK_XIP_OFF:
+            for (int i = 0; i < 2; i++) {
+                if ((states[i]->vm.gil_mutex.handle == NULL) || (_gil_owned(states[i]))) continue;
+                #if MICROPY_PY_THREAD_GIL_HANDOFF
+                _gil_acquire(states[i], _gil_get(states[i]));
+                #else
+                mp_thread_mutex_lock(&states[i]->vm.gil_mutex, 1);
+                #endif
+                res |= (1 << i);
+            }
+            break;
+        case W25QXX_HOOK_XIP_ON:
+            for (int i = 1; i >= 0; i--) {
+                if ((arg & (1 << i)) == 0) continue;
+                #if MICROPY_PY_THREAD_GIL_HANDOFF
+                _gil_release(states[i], _gil_get(states[i]));
+                #else
+                mp_thread_mutex_unlock(&states[i]->vm.gil_mutex);
+                #endif
+            }
+            break;
+        default:
+            break;
+    }
+    return res;
+}
+#endif
+
 //--------------------------------------
 void mp_thread_allowsuspend(int allow) {
     mp_lock_thread_mutex();
@@ -521,6 +878,10 @@ int mp_thread_suspend(TaskHandle_t id) {
         	if ((th->allow_suspend) && (th->suspended == 0) && (th->waiting == 0)) {
         		th->suspended = 1;
         		vTaskSuspend(th->id);
+                #if MICROPY_PY_THREAD_GIL_HANDOFF
+                // the suspended task must not be selected to take the GIL
+                _gil_forget_waiter(th->id);
+                #endif
         		res = 1;
         	}
             break;
@@ -594,6 +955,9 @@ int mp_thread_suspend_others() {
         else if ((th->allow_suspend) && (th->suspended == 0) && (th->waiting == 0)) {
             th->suspended = 1;
             vTaskSuspend(th->id);
+            #if MICROPY_PY_THREAD_GIL_HANDOFF
+            _gil_forget_waiter(th->id);
+            #endif
             res++;
         }
     }
@@ -1011,7 +1375,7 @@ int mp_thread_list(thread_list_t *list)
         mp_state_ctx_t *state;
 		for (thread_t *th = thread; th != NULL; th = th->next) {
             state = (mp_state_ctx_t *)pvTaskGetThreadLocalStoragePointer(th->id, THREAD_LSP_STATE);
-			thr = list->threads + (sizeof(threadlistitem_t) * nth);
+			thr = list->threads + nth;
 
 			thr->id = (uint64_t)th->id;
 			sprintf(thr->name, "%s", th->name);
@@ -1034,6 +1398,9 @@ int mp_thread_list(thread_list_t *list)
 			thr->priority = th->priority;
 			thr->proc = xTaskGetProcessor((TaskHandle_t)th->id);
 			thr->current = (th->id == xTaskGetCurrentTaskHandle());
+            #if MICROPY_PY_THREAD_STATS
+            memcpy(&thr->stats, &state->thread.stats, sizeof(mp_thread_stats_t));
+            #endif
 			nth++;
 			if (nth > num) break;
 		}
@@ -1047,6 +1414,24 @@ int mp_thread_list(thread_list_t *list)
     return num;
 }
 
+#if MICROPY_PY_THREAD_STATS
+// Clear the statistics of all threads of this MicroPython instance
+//--------------------------
+void mp_thread_stats_reset()
+{
+    mp_lock_thread_mutex();
+    for (thread_t *th = thread; th != NULL; th = th->next) {
+        mp_state_ctx_t *state = (mp_state_ctx_t *)pvTaskGetThreadLocalStoragePointer(th->id, THREAD_LSP_STATE);
+        if (state == NULL) continue;
+        // keep the time of the last GIL acquire, the current holder releases it later
+        uint64_t gil_taken = state->thread.stats.gil_taken;
+        memset(&state->thread.stats, 0, sizeof(mp_thread_stats_t));
+        state->thread.stats.gil_taken = gil_taken;
+    }
+    mp_unlock_thread_mutex();
+}
+#endif
+
 //------------------------------------------
 int mp_thread_mainAcceptMsg(int8_t accept) {
 	int res = main_accept_msg;
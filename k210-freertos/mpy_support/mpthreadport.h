@@ -62,6 +62,10 @@
 #define MP_THREAD_PRIORITY                  MICROPY_TASK_PRIORITY
 #define MP_THREAD_MAX_PRIORITY              (configMAX_PRIORITIES-1)
 
+#define MP_THREAD_GIL_HOLD_US               10000     // default maximal GIL hold time if other threads are waiting
+#define MP_THREAD_GIL_MAX_WAITERS           16
+#define MP_THREAD_GIL_HANDOFF_US            20000     // maximal time the GIL is reserved for the selected waiter
+
 #define MP_THREAD_MIN_SERVICE_STACK_SIZE    (2*1024)  // in stack_type units (64-bits)
 
 #define MP_THREAD_MIN_STACK_SIZE			1024      // in stack_type units (64-bits)
@@ -77,6 +81,7 @@
 #define THREAD_QUEUE_MAX_ITEMS		        8
 
 #define THREAD_IPC_TYPE_EXECUTE             1
+#define THREAD_IPC_TYPE_JOB                 2
 #define THREAD_IPC_TYPE_TERMINATE           0xA55A
 
 #define SYS_TASK_NOTIFY_SUSPEND             1ULL
@@ -85,6 +90,22 @@
 #define SYS_TASK_NOTIFY_RESUME_OTHERS       4ULL
 
 
+// Thread statistics, the histogram bucket 'n' counts the times shorter than 4^(n+2) us
+#define THREAD_STATS_HIST_SIZE              8
+
+typedef struct _mp_thread_stats_t {
+    uint64_t gil_wait_us;               // total time waiting for the GIL
+    uint64_t gil_hold_us;               // total time holding the GIL
+    uint64_t gil_taken;                 // time of the last GIL acquire
+    uint32_t gil_count;                 // number of GIL acquires
+    uint32_t gil_wait_hist[THREAD_STATS_HIST_SIZE];
+    uint32_t gil_hold_hist[THREAD_STATS_HIST_SIZE];
+    uint64_t alloc_bytes;               // bytes allocated from the MicroPython heap
+    uint32_t alloc_count;               // number of allocations
+    uint32_t gc_count;                  // number of garbage collections run by the thread
+    uint64_t gc_us;                     // total garbage collection time
+} __attribute__((aligned(8))) mp_thread_stats_t;
+
 typedef struct _mp_thread_mutex_t {
     SemaphoreHandle_t handle;
     StaticSemaphore_t buffer;
@@ -133,6 +154,9 @@ typedef struct _thread_listitem_t {
     uint32_t pystack_len;
     uint32_t pystack_used;
     int priority;
+    #if MICROPY_PY_THREAD_STATS
+    mp_thread_stats_t stats;
+    #endif
 } __attribute__((aligned(8))) threadlistitem_t;
 
 typedef struct _thread_list_t {
@@ -173,6 +197,15 @@ void mp_thread_mutex_init(mp_thread_mutex_t *mutex);
 
 int mp_thread_mutex_lock(mp_thread_mutex_t *mutex, int wait);
 void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex);
+#if MICROPY_PY_THREAD_STATS || MICROPY_PY_THREAD_GIL_HANDOFF
+void mp_thread_gil_enter(void);
+void mp_thread_gil_exit(void);
+#endif
+#if MICROPY_PY_THREAD_GIL_HANDOFF
+void mp_thread_gil_init(mp_thread_mutex_t *gil_mutex);
+void mp_thread_gil_yield(void);
+uint32_t mp_thread_gil_policy(int32_t hold_us, int inherit, bool *inherit_out);
+#endif
 bool mp_thread_locked();
 
 thread_t *mp_thread_get_th_from_id(TaskHandle_t id);
@@ -209,6 +242,9 @@ int mp_thread_getSelfname(char *name);
 int mp_thread_getname(TaskHandle_t id, char *name);
 
 int mp_thread_list(thread_list_t *list);
+#if MICROPY_PY_THREAD_STATS
+void mp_thread_stats_reset();
+#endif
 
 int mp_thread_mainAcceptMsg(int8_t accept);
 void mp_thread_kbd_interrupt(TaskHandle_t id);
@@ -0,0 +1,299 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+    Delta (patch) firmware update format, used by 'ota.patch()' and the 'mkotapatch' host utility.
+    This header has no MicroPython dependencies, the same patch applier is used on the device and on the host.
+
+    The patch reconstructs the new firmware from the active firmware in Flash.
+    Both the old and the new firmware are handled as the byte stream which is stored in Flash:
+    5-byte prefix (AES flag, code size) followed by the application code (see 'modota.c').
+    The SHA256 hash of the new firmware is not part of the patch, it is calculated while applying it.
+
+    | ------------------------------------------------------------------------------ |
+    | Offset | Length | Comment                                                      |
+    | ------------------------------------------------------------------------------ |
+    |  0     |  4     | Magic 'KDLT'                                                 |
+    |  4     |  2     | Format version                                               |
+    |  6     |  2     | Flags, not used, 0                                           |
+    |  8     |  4     | Old firmware code size                                       |
+    | 12     |  4     | New firmware code size                                       |
+    | 16     | 32     | Old firmware SHA256 hash (as stored in Flash after the code) |
+    | 48     | 32     | New firmware SHA256 hash                                     |
+    | 80     | ...    | Operations                                                   |
+    | ------------------------------------------------------------------------------ |
+
+    All values are little-endian, 'varint' is unsigned LEB128 encoded 32-bit value.
+    Operations (1-byte opcode followed by the arguments):
+
+    OTA_PATCH_OP_END   no arguments, the output must be complete
+    OTA_PATCH_OP_COPY  varint old_offset, varint length
+                       followed by [varint skip, varint n_add, n_add bytes] segments covering 'length' bytes;
+                       'skip' bytes are copied from the old firmware unchanged,
+                       'n_add' patch bytes are added (modulo 256) to the old firmware bytes
+    OTA_PATCH_OP_DATA  varint length, followed by 'length' new bytes
+
+    The output is produced sector by sector, each completed sector is hashed and written.
+ */
+
+#ifndef _OTA_PATCH_H_
+#define _OTA_PATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define OTA_PATCH_MAGIC         0x544C444B  // 'KDLT'
+#define OTA_PATCH_VERSION       1
+#define OTA_PATCH_PREFIX_SIZE   5
+#define OTA_PATCH_HASH_SIZE     32
+#define OTA_PATCH_CHUNK         256
+
+#define OTA_PATCH_OP_END        0
+#define OTA_PATCH_OP_COPY       1
+#define OTA_PATCH_OP_DATA       2
+
+#define OTA_PATCH_OK            0
+#define OTA_PATCH_ERR_FORMAT    -1
+#define OTA_PATCH_ERR_READ      -2
+#define OTA_PATCH_ERR_WRITE     -3
+#define OTA_PATCH_ERR_RANGE     -4
+#define OTA_PATCH_ERR_HASH      -5
+
+typedef struct _ota_patch_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint8_t  old_sha[OTA_PATCH_HASH_SIZE];
+    uint8_t  new_sha[OTA_PATCH_HASH_SIZE];
+} __attribute__((packed)) ota_patch_header_t;
+
+// Patch input, old firmware and output access
+// 'read_patch' returns the number of bytes read, which can be less than requested (a single stream read),
+// 0 at the end of the patch or negative on error; other functions return 0 on success
+typedef struct _ota_patch_io_t {
+    int  (*read_patch)(void *ctx, uint8_t *buf, uint32_t len);
+    int  (*read_old)(void *ctx, uint32_t offset, uint8_t *buf, uint32_t len);
+    int  (*write_sector)(void *ctx, uint32_t offset, const uint8_t *buf, uint32_t len);
+    void (*hash_update)(void *ctx, const uint8_t *buf, uint32_t len);
+    void *ctx;
+} ota_patch_io_t;
+
+typedef struct _ota_patch_t {
+    const ota_patch_io_t *io;
+    uint8_t  *sector;       // output sector buffer
+    uint32_t sector_size;
+    uint32_t fill;          // bytes in the sector buffer
+    uint32_t out_pos;       // output bytes produced
+    uint32_t out_size;      // expected output size (prefix + new code)
+    uint32_t old_size;      // old firmware size (prefix + old code)
+    uint32_t sectors;       // sectors written
+} ota_patch_t;
+
+
+//----------------------------------------------------------------------------------------------------------------
+static inline void ota_patch_init(ota_patch_t *p, const ota_patch_io_t *io, const ota_patch_header_t *hdr, uint8_t *sector, uint32_t sector_size)
+{
+    memset(p, 0, sizeof(ota_patch_t));
+    p->io = io;
+    p->sector = sector;
+    p->sector_size = sector_size;
+    p->out_size = hdr->new_size + OTA_PATCH_PREFIX_SIZE;
+    p->old_size = hdr->old_size + OTA_PATCH_PREFIX_SIZE;
+}
+
+// Read exactly 'len' patch bytes, returns false on error or premature end of the patch
+//-----------------------------------------------------------------------------------
+static inline bool ota_patch_read_exact(const ota_patch_io_t *io, uint8_t *buf, uint32_t len)
+{
+    while (len > 0) {
+        int rd = io->read_patch(io->ctx, buf, len);
+        if ((rd <= 0) || ((uint32_t)rd > len)) return false;
+        buf += rd;
+        len -= rd;
+    }
+    return true;
+}
+
+// Read and check the patch header
+//---------------------------------------------------------------------------------------
+static inline int ota_patch_read_header(const ota_patch_io_t *io, ota_patch_header_t *hdr)
+{
+    if (!ota_patch_read_exact(io, (uint8_t *)hdr, sizeof(ota_patch_header_t))) return OTA_PATCH_ERR_READ;
+    if ((hdr->magic != OTA_PATCH_MAGIC) || (hdr->version != OTA_PATCH_VERSION)) return OTA_PATCH_ERR_FORMAT;
+    if ((hdr->old_size == 0) || (hdr->new_size == 0)) return OTA_PATCH_ERR_FORMAT;
+    return OTA_PATCH_OK;
+}
+
+//-----------------------------------------------------------------
+static inline int ota_patch_read_varint(ota_patch_t *p, uint32_t *val)
+{
+    uint8_t b;
+    uint32_t v = 0;
+    for (int shift=0; shift<35; shift+=7) {
+        if (!ota_patch_read_exact(p->io, &b, 1)) return OTA_PATCH_ERR_READ;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            *val = v;
+            return OTA_PATCH_OK;
+        }
+    }
+    return OTA_PATCH_ERR_FORMAT;
+}
+
+// Write the sector buffer, the unused part of the last sector is filled with 0xFF
+//--------------------------------------------------
+static inline int ota_patch_flush(ota_patch_t *p)
+{
+    if (p->fill == 0) return OTA_PATCH_OK;
+    if (p->fill < p->sector_size) memset(p->sector + p->fill, 0xFF, p->sector_size - p->fill);
+    if (p->io->write_sector(p->io->ctx, p->sectors * p->sector_size, p->sector, p->sector_size) != 0) return OTA_PATCH_ERR_WRITE;
+    p->sectors++;
+    p->fill = 0;
+    return OTA_PATCH_OK;
+}
+
+// Add the data to the output, the output data are hashed if requested
+//-----------------------------------------------------------------------------------------
+static inline int ota_patch_emit(ota_patch_t *p, const uint8_t *buf, uint32_t len, bool hash)
+{
+    if (hash) {
+        if ((p->out_pos + len) > p->out_size) return OTA_PATCH_ERR_RANGE;
+        p->io->hash_update(p->io->ctx, buf, len);
+        p->out_pos += len;
+    }
+    while (len > 0) {
+        uint32_t n = p->sector_size - p->fill;
+        if (n > len) n = len;
+        memcpy(p->sector + p->fill, buf, n);
+        p->fill += n;
+        buf += n;
+        len -= n;
+        if (p->fill == p->sector_size) {
+            int res = ota_patch_flush(p);
+            if (res != OTA_PATCH_OK) return res;
+        }
+    }
+    return OTA_PATCH_OK;
+}
+
+//----------------------------------------------------------------------------------------------------
+static inline int ota_patch_copy(ota_patch_t *p, uint32_t old_offset, uint32_t len, bool add)
+{
+    uint8_t old_buf[OTA_PATCH_CHUNK];
+    uint8_t add_buf[OTA_PATCH_CHUNK];
+    int res;
+
+    if ((old_offset > p->old_size) || (len > (p->old_size - old_offset))) return OTA_PATCH_ERR_RANGE;
+    while (len > 0) {
+        uint32_t n = (len > OTA_PATCH_CHUNK) ? OTA_PATCH_CHUNK : len;
+        if (p->io->read_old(p->io->ctx, old_offset, old_buf, n) != 0) return OTA_PATCH_ERR_READ;
+        if (add) {
+            if (!ota_patch_read_exact(p->io, add_buf, n)) return OTA_PATCH_ERR_READ;
+            for (uint32_t i=0; i<n; i++) old_buf[i] += add_buf[i];
+        }
+        res = ota_patch_emit(p, old_buf, n, true);
+        if (res != OTA_PATCH_OK) return res;
+        old_offset += n;
+        len -= n;
+    }
+    return OTA_PATCH_OK;
+}
+
+//-----------------------------------------------------------------------
+static inline int ota_patch_data(ota_patch_t *p, uint32_t len)
+{
+    uint8_t buf[OTA_PATCH_CHUNK];
+    int res;
+
+    while (len > 0) {
+        uint32_t n = (len > OTA_PATCH_CHUNK) ? OTA_PATCH_CHUNK : len;
+        if (!ota_patch_read_exact(p->io, buf, n)) return OTA_PATCH_ERR_READ;
+        res = ota_patch_emit(p, buf, n, true);
+        if (res != OTA_PATCH_OK) return res;
+        len -= n;
+    }
+    return OTA_PATCH_OK;
+}
+
+/*
+ * Apply all patch operations after the header
+ * On success, all complete output sectors are written and hashed,
+ * the last, incomplete sector is left in the sector buffer, waiting for 'ota_patch_finish()'
+ */
+//-------------------------------------------------
+static inline int ota_patch_apply(ota_patch_t *p)
+{
+    uint8_t op;
+    uint32_t old_offset, len, skip, n_add;
+    int res;
+
+    while (1) {
+        if (!ota_patch_read_exact(p->io, &op, 1)) return OTA_PATCH_ERR_READ;
+        if (op == OTA_PATCH_OP_END) break;
+
+        if (op == OTA_PATCH_OP_COPY) {
+            if ((res = ota_patch_read_varint(p, &old_offset)) != OTA_PATCH_OK) return res;
+            if ((res = ota_patch_read_varint(p, &len)) != OTA_PATCH_OK) return res;
+            while (len > 0) {
+                if ((res = ota_patch_read_varint(p, &skip)) != OTA_PATCH_OK) return res;
+                if ((res = ota_patch_read_varint(p, &n_add)) != OTA_PATCH_OK) return res;
+                if ((skip > len) || (n_add > (len - skip))) return OTA_PATCH_ERR_FORMAT;
+                if ((res = ota_patch_copy(p, old_offset, skip, false)) != OTA_PATCH_OK) return res;
+                old_offset += skip;
+                if ((res = ota_patch_copy(p, old_offset, n_add, true)) != OTA_PATCH_OK) return res;
+                old_offset += n_add;
+                len -= skip + n_add;
+            }
+        }
+        else if (op == OTA_PATCH_OP_DATA) {
+            if ((res = ota_patch_read_varint(p, &len)) != OTA_PATCH_OK) return res;
+            if ((res = ota_patch_data(p, len)) != OTA_PATCH_OK) return res;
+        }
+        else return OTA_PATCH_ERR_FORMAT;
+    }
+
+    if (p->out_pos != p->out_size) return OTA_PATCH_ERR_RANGE;
+    return OTA_PATCH_OK;
+}
+
+/*
+ * Compare the calculated hash of the new firmware with the expected one,
+ * on match append the hash after the firmware code and write the remaining sectors.
+ * On mismatch the last sector is not written, the firmware in Flash has no valid hash.
+ */
+//-----------------------------------------------------------------------------------------------------
+static inline int ota_patch_finish(ota_patch_t *p, const ota_patch_header_t *hdr, const uint8_t *hash)
+{
+    if (memcmp(hash, hdr->new_sha, OTA_PATCH_HASH_SIZE) != 0) return OTA_PATCH_ERR_HASH;
+    int res = ota_patch_emit(p, hash, OTA_PATCH_HASH_SIZE, false);
+    if (res != OTA_PATCH_OK) return res;
+    return ota_patch_flush(p);
+}
+
+#endif
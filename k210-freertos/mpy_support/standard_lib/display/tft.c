@@ -182,6 +182,32 @@ typedef struct {
       uint16_t dataPtr;
 } propFont;
 
+// Pre-rendered proportional font glyph (tile), (width+1) * height pixels
+typedef struct {
+    const uint8_t   *font;
+    color_t         *tile;
+    uint32_t        last_used;
+    color_t         fg;
+    color_t         bg;
+    uint8_t         code;
+    uint8_t         width;
+    uint8_t         height;
+    uint8_t         fixed;
+} glyph_tile_t;
+
+// Horizontal run of proportional font characters sent to the display in one transfer
+typedef struct {
+    color_t         *buf;
+    int             x;
+    int             y;
+    int             width;
+    int             stride;
+    int             height;
+} text_run_t;
+
+#define GLYPH_CACHE_ENTRIES     64
+#define GLYPH_CACHE_MAX_SIZE    (32*1024)   // maximal memory used by glyph tiles
+
 static dispWin_t dispWinTemp;
 
 static hfont_t vector_font;
@@ -192,11 +218,35 @@ static propFont	fontChar;
 static float _arcAngleMax = DEFAULT_ARC_ANGLE_MAX;
 static bool filling = false;
 
+// Offsets of the glyphs in the current proportional font, 0 if not in font
+static const uint8_t *glyph_index_font = NULL;
+static uint16_t glyph_index[256];
+
+static glyph_tile_t glyph_cache[GLYPH_CACHE_ENTRIES] = { 0 };
+static uint32_t glyph_cache_size = 0;
+static uint32_t glyph_cache_clock = 0;
+
+// Remove the glyph tiles of the given font from the glyph cache, all tiles if font is NULL
+//----------------------------------------------------
+static void _glyph_cache_flush(const uint8_t *font)
+{
+    for (int i=0; i<GLYPH_CACHE_ENTRIES; i++) {
+        if ((glyph_cache[i].tile) && ((font == NULL) || (glyph_cache[i].font == font))) {
+            vPortFree(glyph_cache[i].tile);
+            glyph_cache_size -= (glyph_cache[i].width+1) * glyph_cache[i].height * sizeof(color_t);
+            glyph_cache[i].tile = NULL;
+            glyph_cache[i].font = NULL;
+        }
+    }
+}
 
 //--------------------------
 static void _free_userfont()
 {
     if (userfont != NULL) {
+        // the new font may be allocated at the same address
+        _glyph_cache_flush(userfont);
+        if (glyph_index_font == userfont) glyph_index_font = NULL;
         vPortFree(userfont);
         userfont = NULL;
     }
@@ -1721,39 +1771,53 @@ static void getMaxWidthHeight()
     active_dstate->cfont.size = tempPtr;
 }
 
+// Build the glyph offsets table of the current proportional font
+//------------------------------
+static void _build_glyph_index()
+{
+	uint16_t tempPtr = 4; // point at first char data
+	uint8_t cc, cw, ch;
+
+	memset(glyph_index, 0, sizeof(glyph_index));
+    cc = active_dstate->cfont.font[tempPtr];
+    // the search for a character used to stop at the 0xFF code, keep that behavior
+    while ((cc) && (cc != 0xFF)) {
+        // the first glyph with the same code is used
+        if (glyph_index[cc] == 0) glyph_index[cc] = tempPtr;
+        cw = active_dstate->cfont.font[tempPtr+2];
+        ch = active_dstate->cfont.font[tempPtr+3];
+        tempPtr += 6;
+		if (cw != 0) {
+			// packed bits
+			tempPtr += (((cw * ch)-1) / 8) + 1;
+		}
+	    cc = active_dstate->cfont.font[tempPtr];
+	}
+    glyph_index_font = active_dstate->cfont.font;
+}
+
 // Return the Glyph data for an individual character in the proportional font
 //------------------------------------
 static uint8_t getCharPtr(uint8_t c) {
-  uint16_t tempPtr = 4; // point at first char data
-
-  do {
-	fontChar.charCode = active_dstate->cfont.font[tempPtr++];
-    if (fontChar.charCode == 0xFF) return 0;
-
-    fontChar.adjYOffset = active_dstate->cfont.font[tempPtr++];
-    fontChar.width = active_dstate->cfont.font[tempPtr++];
-    fontChar.height = active_dstate->cfont.font[tempPtr++];
-    fontChar.xOffset = active_dstate->cfont.font[tempPtr++];
-    fontChar.xOffset = fontChar.xOffset < 0x80 ? fontChar.xOffset : -(0xFF - fontChar.xOffset);
-    fontChar.xDelta = active_dstate->cfont.font[tempPtr++];
-
-    if ((c != fontChar.charCode) && (fontChar.charCode != 0)) {
-      if (fontChar.width != 0) {
-        // packed bits
-        tempPtr += (((fontChar.width * fontChar.height)-1) / 8) + 1;
-      }
-    }
-  } while ((c != fontChar.charCode) && (fontChar.charCode != 0));
-
+  if (glyph_index_font != active_dstate->cfont.font) _build_glyph_index();
+
+  uint16_t tempPtr = glyph_index[c];
+  if ((c == 0) || (tempPtr == 0)) return 0;
+
+  fontChar.charCode = active_dstate->cfont.font[tempPtr++];
+  fontChar.adjYOffset = active_dstate->cfont.font[tempPtr++];
+  fontChar.width = active_dstate->cfont.font[tempPtr++];
+  fontChar.height = active_dstate->cfont.font[tempPtr++];
+  fontChar.xOffset = active_dstate->cfont.font[tempPtr++];
+  fontChar.xOffset = fontChar.xOffset < 0x80 ? fontChar.xOffset : -(0xFF - fontChar.xOffset);
+  fontChar.xDelta = active_dstate->cfont.font[tempPtr++];
   fontChar.dataPtr = tempPtr;
-  if (c == fontChar.charCode) {
-    if (active_dstate->font_forceFixed > 0) {
-      // fix width & offset for forced fixed width
-      fontChar.xDelta = active_dstate->cfont.max_x_size;
-      fontChar.xOffset = (fontChar.xDelta - fontChar.width) / 2;
-    }
+
+  if (active_dstate->font_forceFixed > 0) {
+    // fix width & offset for forced fixed width
+    fontChar.xDelta = active_dstate->cfont.max_x_size;
+    fontChar.xOffset = (fontChar.xDelta - fontChar.width) / 2;
   }
-  else return 0;
 
   return 1;
 }
@@ -1887,6 +1951,7 @@ bool TFT_setFont(uint8_t font, mp_obj_t font_file, bool info)
         else {
             active_dstate->cfont.offset = 4;
             getMaxWidthHeight();
+            _build_glyph_index();
         }
     }
 
@@ -1909,10 +1974,145 @@ bool TFT_setFont(uint8_t font, mp_obj_t font_file, bool info)
 // Character visible pixels rectangle is (xOffset, yOffset) (xOffset+Width-1, yOffset+Height-1)
 //---------------------------------------------------------------------------------------------
 
+// Render the proportional character glyph into the buffer of (char_width+1) * y_size pixels
+// character is already in fontChar
+//-----------------------------------------------------------
+static void _render_prop_glyph(color_t *buf, int char_width)
+{
+	int len = (char_width+1) * active_dstate->cfont.y_size;
+	color_t fg = active_dstate->_fg;
+	uint16_t dataPtr = fontChar.dataPtr;
+	uint8_t ch = 0;
+	int bit = 0;
+
+	// fill with background color
+	for (int n = 0; n < len; n++) {
+		buf[n] = active_dstate->_bg;
+	}
+	// set character pixels to foreground color
+	for (int j=0; j < fontChar.height; j++) {
+		color_t *line = buf + ((char_width+1) * (j+fontChar.adjYOffset)) + fontChar.xOffset;
+		for (int i=0; i < fontChar.width; i++) {
+			if (bit == 0) {
+				ch = active_dstate->cfont.font[dataPtr++];
+				if (ch == 0) {
+					// no visible pixels in the next 8 bits
+					int n = ((fontChar.width - i) < 8) ? (fontChar.width - i) : 8;
+					bit = 8 - n;
+					i += n - 1;
+					continue;
+				}
+				bit = 8;
+			}
+			bit--;
+			if (ch & (1 << bit)) line[i] = fg;
+		}
+	}
+}
+
+// Get the pre-rendered glyph of the character from the glyph cache,
+// render the glyph and add it to the cache if not found
+// character is already in fontChar
+//------------------------------------------------
+static color_t *_get_glyph_tile(int char_width)
+{
+	const uint8_t *font = active_dstate->cfont.font;
+	uint8_t fixed = (active_dstate->font_forceFixed > 0);
+	int height = active_dstate->cfont.y_size;
+	uint32_t size = (char_width+1) * height * sizeof(color_t);
+	int i, lru = 0;
+
+	if ((char_width > 254) || (height > 255) || (size > (GLYPH_CACHE_MAX_SIZE/4))) return NULL;
+
+	glyph_cache_clock++;
+	for (i=0; i<GLYPH_CACHE_ENTRIES; i++) {
+		glyph_tile_t *g = &glyph_cache[i];
+		if ((g->tile) && (g->font == font) && (g->code == fontChar.charCode) && (g->fg == active_dstate->_fg) && (g->bg == active_dstate->_bg) &&
+				(g->width == char_width) && (g->height == height) && (g->fixed == fixed)) {
+			g->last_used = glyph_cache_clock;
+			return g->tile;
+		}
+		// free entry or the least recently used one
+		if (glyph_cache[lru].tile) {
+			if ((g->tile == NULL) || (g->last_used < glyph_cache[lru].last_used)) lru = i;
+		}
+	}
+
+	// Not found, free the least recently used entries to make room for the new tile
+	while (1) {
+		if (glyph_cache[lru].tile) {
+			vPortFree(glyph_cache[lru].tile);
+			glyph_cache_size -= (glyph_cache[lru].width+1) * glyph_cache[lru].height * sizeof(color_t);
+			glyph_cache[lru].tile = NULL;
+		}
+		if ((glyph_cache_size + size) <= GLYPH_CACHE_MAX_SIZE) break;
+		for (i=0; i<GLYPH_CACHE_ENTRIES; i++) {
+			if ((glyph_cache[i].tile) && ((glyph_cache[lru].tile == NULL) || (glyph_cache[i].last_used < glyph_cache[lru].last_used))) lru = i;
+		}
+	}
+
+	glyph_tile_t *g = &glyph_cache[lru];
+	g->tile = pvPortMalloc(size);
+	if (g->tile == NULL) return NULL;
+	glyph_cache_size += size;
+	g->font = font;
+	g->code = fontChar.charCode;
+	g->fg = active_dstate->_fg;
+	g->bg = active_dstate->_bg;
+	g->width = char_width;
+	g->height = height;
+	g->fixed = fixed;
+	g->last_used = glyph_cache_clock;
+	_render_prop_glyph(g->tile, char_width);
+	return g->tile;
+}
+
+// Send the text run to the display
+//---------------------------------------------
+static void _text_run_flush(text_run_t *run)
+{
+	if (run->width == 0) return;
+	if (run->width < run->stride) {
+		// make the run lines contiguous
+		for (int j=1; j < run->height; j++) {
+			memmove(run->buf + (j * run->width), run->buf + (j * run->stride), run->width * sizeof(color_t));
+		}
+	}
+	send_data(run->x, run->y, run->x+run->width, run->y+run->height, run->width * run->height, run->buf);
+	run->width = 0;
+}
+
+// Add the character glyph to the text run, send the run to the display if the character does not continue it
+// character is already in fontChar
+//-------------------------------------------------------------------
+static bool _text_run_add(text_run_t *run, int x, int y, int char_width)
+{
+	color_t *tile = _get_glyph_tile(char_width);
+	if (tile == NULL) return false;
+
+	int tile_width = char_width + 1;
+	if ((run->width > 0) && ((x != (run->x + run->width)) || (y != run->y) || ((run->width + tile_width) > run->stride))) {
+		_text_run_flush(run);
+	}
+	if (tile_width > run->stride) {
+		send_data(x, y, x+tile_width, y+run->height, tile_width * run->height, tile);
+		return true;
+	}
+	if (run->width == 0) {
+		run->x = x;
+		run->y = y;
+	}
+	for (int j=0; j < run->height; j++) {
+		memcpy(run->buf + (j * run->stride) + run->width, tile + (j * tile_width), tile_width * sizeof(color_t));
+	}
+	run->width += tile_width;
+	return true;
+}
+
 // print non-rotated proportional character
 // character is already in fontChar
-//----------------------------------------------
-static int printProportionalChar(int x, int y) {
+//------------------------------------------------------------
+static int printProportionalChar(int x, int y, text_run_t *run) {
 	uint8_t ch = 0;
 	int i, j, char_width;
     int cx, cy;
@@ -1920,35 +2120,19 @@ static int printProportionalChar(int x, int y) {
 	char_width = ((fontChar.width > fontChar.xDelta) ? fontChar.width : fontChar.xDelta);
 
 	if ((active_dstate->font_buffered_char) && (!active_dstate->font_transparent) && (active_dstate->tft_active_mode != TFT_MODE_EPD)) {
-		int len, bufPos;
+		// === use the pre-rendered glyph for faster sending ===
+		if ((run) && (_text_run_add(run, x, y, char_width))) return char_width;
 
+		color_t *tile = _get_glyph_tile(char_width);
+		if (tile) {
+			send_data(x, y, x+char_width+1, y+active_dstate->cfont.y_size, (char_width+1) * active_dstate->cfont.y_size, tile);
+			return char_width;
+		}
 		// === buffer Glyph data for faster sending ===
-		len = (char_width+1) * active_dstate->cfont.y_size;
-		color_t *color_line = pvPortMalloc(len*3);
+		int len = (char_width+1) * active_dstate->cfont.y_size;
+		color_t *color_line = pvPortMalloc(len * sizeof(color_t));
 		if (color_line) {
-			// fill with background color
-			for (int n = 0; n < len; n++) {
-				color_line[n] = active_dstate->_bg;
-			}
-			// set character pixels to foreground color
-			uint8_t mask = 0x80;
-			for (j=0; j < fontChar.height; j++) {
-				for (i=0; i < fontChar.width; i++) {
-					if (((i + (j*fontChar.width)) % 8) == 0) {
-						mask = 0x80;
-						ch = active_dstate->cfont.font[fontChar.dataPtr++];
-					}
-					if ((ch & mask) != 0) {
-						// visible pixel
-		                cx = (uint16_t)(fontChar.xOffset+i);
-		                cy = (uint16_t)(j+fontChar.adjYOffset);
-		                bufPos = ((char_width+1) * cy) + cx;
-						//bufPos = ((j + fontChar.adjYOffset) * (char_width+1)) + (fontChar.xOffset + i);  // bufY + bufX
-						color_line[bufPos] = active_dstate->_fg;
-					}
-					mask >>= 1;
-				}
-			}
+			_render_prop_glyph(color_line, char_width);
 			// send to display in one transaction
 			send_data(x, y, x+char_width+1, y+active_dstate->cfont.y_size, len, color_line);
 			vPortFree(color_line);
@@ -2390,6 +2574,15 @@ void TFT_print(char *st, int x, int y) {
 
     int offset = TFT_OFFSET;
 
+    // non-rotated proportional font characters are collected into runs sent to the display in one transfer
+    text_run_t run = { 0 };
+    if ((active_dstate->cfont.x_size == 0) && (active_dstate->font_rotate == 0) && (active_dstate->font_buffered_char) &&
+            (!active_dstate->font_transparent) && (active_dstate->tft_active_mode != TFT_MODE_EPD) && (stl > 1)) {
+        run.height = tmph;
+        run.stride = active_dstate->dispWin.x2 - active_dstate->dispWin.x1 + 1;
+        run.buf = pvPortMalloc(run.stride * run.height * sizeof(color_t));
+    }
+
     for (i=0; i<stl; i++) {
         ch = st[i]; // get string character
 
@@ -2423,7 +2616,7 @@ void TFT_print(char *st, int x, int y) {
             // Let's print the character
             if (active_dstate->cfont.x_size == 0) {
                 // == proportional font
-                if (active_dstate->font_rotate == 0) active_dstate->TFT_X += printProportionalChar(active_dstate->TFT_X, active_dstate->TFT_Y) + 1;
+                if (active_dstate->font_rotate == 0) active_dstate->TFT_X += printProportionalChar(active_dstate->TFT_X, active_dstate->TFT_Y, (run.buf) ? &run : NULL) + 1;
                 else {
                     // rotated proportional font
                     offset += rotatePropChar(x, y, offset);
@@ -2448,6 +2641,11 @@ void TFT_print(char *st, int x, int y) {
             }
         }
     }
+
+    if (run.buf) {
+        _text_run_flush(&run);
+        vPortFree(run.buf);
+    }
 }
 
 
@@ -411,14 +411,22 @@ void send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf)
 }
 
 // Write color data to TFT framebuffer from given buffer
-//==================================================================================
-void send_data_scale(int x1, int y1, int width, int height, color_t *buf, int scale)
+// If 'swap' is set, even and odd pixels are swapped while copying
+// (DVP writes RGB565 frames as 32-bit words with swapped pixel pairs)
+//-----------------------------------------------------------------------------------------------
+static void _send_data_scale(int x1, int y1, int width, int height, color_t *buf, int scale, bool swap)
 {
-    //if (!active_dstate->use_frame_buffer) return;
-
     if ((x1==0) && (y1==0) && (width == active_dstate->_width) && (height == active_dstate->_height) && (scale <= 1)) {
         if (active_dstate->use_frame_buffer) {
-            memcpy(active_dstate->tft_frame_buffer, buf, width*height*2);
+            if (swap) {
+                uint32_t *src = (uint32_t *)buf;
+                uint32_t *dst = (uint32_t *)active_dstate->tft_frame_buffer;
+                uint32_t n = (width*height) / 2;
+                for (uint32_t i=0; i<n; i++) {
+                    dst[i] = (src[i] >> 16) | (src[i] << 16);
+                }
+            }
+            else memcpy(active_dstate->tft_frame_buffer, buf, width*height*2);
             return;
         }
     }
@@ -432,6 +440,8 @@ void send_data_scale(int x1, int y1, int width, int height, color_t *buf, int sc
     }
     if (xyscale <= 1) xyscale = 1;
 
+    // pixel index xor mask, 1 swaps even and odd pixels
+    int sw = (swap) ? 1 : 0;
     for (y = 0; y < height; y++) {
         ty = (y/xyscale) + y1; // display row
         if (ty < 0) continue;
@@ -440,15 +450,29 @@ void send_data_scale(int x1, int y1, int width, int height, color_t *buf, int sc
             tx = (x/xyscale) + x1; // display column
             if (tx < 0) continue;
             if (tx >= active_dstate->_width) break;
-            if (active_dstate->use_frame_buffer) active_dstate->tft_frame_buffer[(ty * active_dstate->_width) + tx] = buf[(y * width) + x];
+            if (active_dstate->use_frame_buffer) active_dstate->tft_frame_buffer[(ty * active_dstate->_width) + tx] = buf[((y * width) + x) ^ sw];
             else if (active_dstate->tft_active_mode == TFT_MODE_TFT) {
-                drawPixel(x, y, buf[(y * width) + x]);
+                drawPixel(x, y, buf[((y * width) + x) ^ sw]);
                 mp_hal_wdt_reset();
             }
         }
     }
 }
 
+//==================================================================================
+void send_data_scale(int x1, int y1, int width, int height, color_t *buf, int scale)
+{
+    _send_data_scale(x1, y1, width, height, buf, scale, false);
+}
+
+// Same as 'send_data_scale', but the pixel pairs are swapped while copying
+// Used to display DVP frames without swapping them in place first
+//=======================================================================================
+void send_data_scale_swap(int x1, int y1, int width, int height, color_t *buf, int scale)
+{
+    _send_data_scale(x1, y1, width, height, buf, scale, true);
+}
+
 // ToDo: Why SPI drive cannot send more than ~120 KB at once !?
 //======================
 void send_frame_buffer()
@@ -201,6 +201,7 @@ void disp_spi_transfer_cmd_data(int8_t cmd, uint8_t *data, uint32_t len);
 void drawPixel(int16_t x, int16_t y, color_t color);
 void send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf);
 void send_data_scale(int x1, int y1, int width, int height, color_t *buf, int scale);
+void send_data_scale_swap(int x1, int y1, int width, int height, color_t *buf, int scale);
 void TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t data, uint32_t len);
 void send_frame_buffer();
 void TFT_display_setvars(display_config_t *dconfig);
@@ -34,6 +34,8 @@
 #include "syslog.h"
 #include "devices.h"
 #include "lwip/apps/sntp.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
 
 #include "network.h"
 
@@ -49,6 +51,10 @@
 
 #define GSM_MAX_INIT_TRIES      4
 #define UART_WAIT_AFTER_SEND    (1 / portTICK_RATE_MS)
+// HDLC frame delimiter, the PPPoS task is woken on complete frames
+#define PPP_FLAG_CHAR           0x7E
+// Max time to wait for a frame, data not ending with the delimiter is passed to PPPoS after this time
+#define PPPOS_RX_TIMEOUT        (50 / portTICK_PERIOD_MS)
 
 extern bool tcpip_adapter_initialized;
 
@@ -533,17 +539,20 @@ static int _task_idle()
     return gstat;
 }
 
-//----------------------------------------
-static void _handle_pppos_data(char *data)
+// Wait for frames received from GSM and pass them to the PPPoS in the lwIP thread
+// The data are copied from the uart buffer directly into the pbuf chain
+// which is passed to the lwIP thread as a single message
+//-----------------------------------
+static void _handle_pppos_data(void)
 {
     // --- Handle data received from GSM (to be passed to the PPPoS) ---
-    bool do_check = false;
+    bool timeout = false;
     if (mpy_uarts[gsm_uart_num].task_semaphore) {
-        do_check = (xSemaphoreTake(mpy_uarts[gsm_uart_num].task_semaphore, 5 / portTICK_PERIOD_MS ) == pdTRUE);
+        timeout = (xSemaphoreTake(mpy_uarts[gsm_uart_num].task_semaphore, PPPOS_RX_TIMEOUT) != pdTRUE);
     }
     else {
         vTaskDelay(5 / portTICK_PERIOD_MS);
-        do_check = true;
+        timeout = true;
     }
     if (ntp_got_time > 0) {
         if (gsm_debug) LOGM(GSM_PPP_TAG, "NTP time synchronized (%lu)", ntp_got_time);
@@ -554,19 +563,29 @@ static void _handle_pppos_data(char *data)
         }
     }
 
-    if (do_check) {
-        //if (xSemaphoreTake(mpy_uarts[gsm_uart_num].uart_mutex, PPPOSMUTEX_TIMEOUT) == pdTRUE) {
-        int len;
-        while (1) {
-            len = uart_buf_length(mpy_uarts[gsm_uart_num].uart_buf, NULL);
-            if (len == 0) break;
-            uart_buf_get(mpy_uarts[gsm_uart_num].uart_buf, (uint8_t *)data, len);
-            // pass received data to PPPoS
-            pppos_input_tcpip(ppp_ppp_pcb, (u8_t*)data, len);
-            pppos_tx_count += len;
+    uart_ringbuf_t *r = mpy_uarts[gsm_uart_num].uart_buf;
+    size_t len;
+    while (1) {
+        taskENTER_CRITICAL();
+        // pass only complete frames, unless waiting timed out or the buffer is half full
+        len = r->frame_length;
+        if ((timeout) || (r->length >= (r->size / 2))) len = r->length;
+        taskEXIT_CRITICAL();
+        if (len == 0) break;
+
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+        if (p == NULL) {
+            // no free pbufs, the data stays in the uart buffer
+            if (gsm_debug) LOGW(GSM_PPP_TAG, "PPPoS input: no free pbuf");
+            break;
+        }
+        for (struct pbuf *q = p; q != NULL; q = q->next) {
+            uart_buf_get(r, (uint8_t *)q->payload, q->len);
+        }
+        if (tcpip_inpkt(p, ppp_netif(ppp_ppp_pcb), pppos_input_sys) != ERR_OK) {
+            pbuf_free(p);
         }
-        //    xSemaphoreGive(mpy_uarts[gsm_uart_num].uart_mutex);
-        //}
+        pppos_tx_count += len;
     }
 }
 
@@ -866,10 +885,14 @@ static void gsm_pppos_client_task(void *pv)
         if (gsm_debug) {
             if (mpy_uarts[gsm_uart_num].task_semaphore) {
                 LOGM(GSM_PPP_TAG, "Using uart semaphore (%d)", mpy_uarts[gsm_uart_num].uart_buffer.notify);
-                mpy_uarts[gsm_uart_num].uart_buffer.notify = true;
             }
             LOGM(GSM_PPP_TAG, "Configure PPPoS");
         }
+        // Wake the task only on received HDLC frames
+        mpy_uarts[gsm_uart_num].uart_buffer.frame_char = PPP_FLAG_CHAR;
+        mpy_uarts[gsm_uart_num].uart_buffer.frame_length = 0;
+        mpy_uarts[gsm_uart_num].uart_buffer.frame_mode = true;
+        mpy_uarts[gsm_uart_num].uart_buffer.notify = true;
         // Prepare and start PPPoS
 		res = pppapi_set_default(ppp_ppp_pcb);
 		if (res == 0) {
@@ -883,6 +906,7 @@ static void gsm_pppos_client_task(void *pv)
             vTaskDelay(100 / portTICK_PERIOD_MS);
 		}
 		if (res != 0) {
+		    mpy_uarts[gsm_uart_num].uart_buffer.frame_mode = false;
 		    do_pppos_connect = 0;
 	        if (gsm_debug) {
 	            LOGW(GSM_PPP_TAG, "Error starting PPPoS (%d)", res);
@@ -918,7 +942,7 @@ static void gsm_pppos_client_task(void *pv)
 				while (ppp_status != ATDEV_STATEDISCONNECTED) {
                     // --- Handle data received from GSM (to be passed to the PPPoS) ---
                     //-----------------------
-                    _handle_pppos_data(data);
+                    _handle_pppos_data();
                     //-----------------------
 
                     if (mp_hal_ticks_ms() > wait_end) {
@@ -929,7 +953,8 @@ static void gsm_pppos_client_task(void *pv)
 				    }
 				}
 
-                // disconnect modem
+                // disconnect modem, AT command responses are not HDLC framed
+                mpy_uarts[gsm_uart_num].uart_buffer.frame_mode = false;
                 vTaskDelay(500 / portTICK_PERIOD_MS);
                 at_uart_flush(gsm_uart_num);
                 mutex_taken = xSemaphoreTake(mpy_uarts[gsm_uart_num].uart_mutex, PPPOSMUTEX_TIMEOUT);
@@ -980,12 +1005,13 @@ static void gsm_pppos_client_task(void *pv)
 
 			// --- Handle data received from GSM (to be passed to the PPPoS) ---
 			//-----------------------
-			_handle_pppos_data(data);
+			_handle_pppos_data();
             //-----------------------
 
 			// =================================================================================
 
 		}  // Handle GSM modem responses & disconnects loop
+        mpy_uarts[gsm_uart_num].uart_buffer.frame_mode = false;
 
 		if (gstat < 0) break;  // terminate task requested
 	}  // main task loop
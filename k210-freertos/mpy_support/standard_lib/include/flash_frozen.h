@@ -0,0 +1,73 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Modules frozen to Flash at run time
+ *
+ * '.mpy' files are linked once ('uos.mpy_freeze()') into the dedicated Flash region:
+ * qstrs are resolved to the ids they will have when the region is active (firmware
+ * qstrs keep their ids, new ones form a qstr pool in Flash), constant objects and
+ * raw code structures are created in Flash with their final XIP addresses.
+ * On the next MicroPython start the region's qstr pool is linked right after the
+ * firmware's pools and the modules are imported as frozen modules; bytecode and
+ * constant tables are executed in place through the SPI3 XIP window.
+ *
+ * Region layout:
+ *   sector 0:  header, raw code table, module names
+ *   sector 1-: qstrs, constant objects, bytecode, constant tables, raw codes, qstr pool
+ */
+
+#ifndef _FLASH_FROZEN_H_
+#define _FLASH_FROZEN_H_
+
+#include "py/obj.h"
+#include "py/qstr.h"
+#include "py/emitglue.h"
+
+#define FLASH_FROZEN_MAGIC      0x5A46504D  // "MPFZ"
+#define FLASH_FROZEN_VERSION    1
+#define FLASH_FROZEN_HDR_SIZE   4096        // header sector
+
+typedef struct _flash_frozen_header_t {
+    uint32_t magic;
+    uint32_t crc32;                         // crc of the header sector from 'version' to 'hdr_size'
+    uint16_t version;
+    uint16_t count;                         // number of modules
+    uint32_t hdr_size;                      // used size of the header sector
+    uint32_t size;                          // used size of the region
+    uint32_t data_crc32;                    // crc of the region data (after the header sector)
+    uint32_t fw_id;                         // identifies the firmware the region is linked against
+    const qstr_pool_t *pool;                // pool with the qstrs not present in the firmware, NULL if none
+    const mp_raw_code_t *const *content;    // modules raw code
+    const char *names;                      // module names, in the same format as 'mp_frozen_mpy_names'
+} flash_frozen_header_t;
+
+void flash_frozen_init(void);
+
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(flash_frozen_freeze_obj);
+MP_DECLARE_CONST_FUN_OBJ_0(flash_frozen_list_obj);
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Read-only flash image partition
+ *
+ * The image is built on the host ('mkflashimg' utility) and written to the
+ * flash partition following the configuration and user variables sectors.
+ * The files in the image are never copied to RAM, they are accessed in place
+ * through the SPI3 XIP window ('uos.mmap()').
+ *
+ * This header is also used by the host utility, it must not depend on MicroPython.
+ */
+
+#ifndef _FLASH_IMAGE_H_
+#define _FLASH_IMAGE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define FLASH_IMAGE_MAGIC       0x474D494BUL    // "KIMG"
+#define FLASH_IMAGE_VERSION     1
+#define FLASH_IMAGE_NAME_LEN    48
+// file data alignment in the image, fonts and tables can be used as arrays of any type
+#define FLASH_IMAGE_ALIGN       64
+
+typedef struct _flash_image_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;         // number of directory entries following the header
+    uint32_t size;          // total image size in bytes
+    uint32_t crc32;         // CRC32 of the directory entries
+} flash_image_header_t;
+
+typedef struct _flash_image_entry_t {
+    char name[FLASH_IMAGE_NAME_LEN];    // path relative to the image root, without leading '/'
+    uint32_t offset;        // data offset from the image start
+    uint32_t size;          // data size in bytes
+    uint32_t crc32;         // CRC32 of the data
+    uint32_t flags;         // reserved
+} flash_image_entry_t;
+
+//----------------------------------------------------------------------------------
+static inline uint32_t flash_image_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int i=0; i<8; i++) crc = (crc >> 1) ^ (0xEDB88320UL & (-(crc & 1)));
+    }
+    return ~crc;
+}
+
+// Check the image header and directory, returns the number of entries or -1 if not valid
+//-----------------------------------------------------------------------------
+static inline int flash_image_check(const uint8_t *image, uint32_t partition_size)
+{
+    const flash_image_header_t *hdr = (const flash_image_header_t *)image;
+    if ((hdr->magic != FLASH_IMAGE_MAGIC) || (hdr->version != FLASH_IMAGE_VERSION)) return -1;
+    uint32_t dir_size = hdr->count * sizeof(flash_image_entry_t);
+    if ((hdr->size > partition_size) || ((sizeof(flash_image_header_t) + dir_size) > hdr->size)) return -1;
+    if (flash_image_crc32(0, image + sizeof(flash_image_header_t), dir_size) != hdr->crc32) return -1;
+    return hdr->count;
+}
+
+// Find the directory entry, 'image' must be checked with 'flash_image_check'
+//---------------------------------------------------------------------------------------------
+static inline const flash_image_entry_t *flash_image_find(const uint8_t *image, const char *name)
+{
+    const flash_image_header_t *hdr = (const flash_image_header_t *)image;
+    const flash_image_entry_t *entry = (const flash_image_entry_t *)(image + sizeof(flash_image_header_t));
+    while (*name == '/') name++;
+    for (int i=0; i<hdr->count; i++, entry++) {
+        if (strncmp(entry->name, name, FLASH_IMAGE_NAME_LEN) == 0) return entry;
+    }
+    return NULL;
+}
+
+#ifndef FLASH_IMAGE_HOST
+#include "py/obj.h"
+
+MP_DECLARE_CONST_FUN_OBJ_1(flash_image_mmap_obj);
+MP_DECLARE_CONST_FUN_OBJ_0(flash_image_list_obj);
+MP_DECLARE_CONST_FUN_OBJ_1(flash_image_install_obj);
+#endif
+
+#endif
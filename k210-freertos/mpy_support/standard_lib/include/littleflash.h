@@ -34,6 +34,7 @@
 #include "w25qxx.h"
 #include "lfs.h"
 #include "extmod/vfs.h"
+#include "vfs_buffered.h"
 
 // these are the values for fs_user_mount_t.flags
 #define MODULE_LITTLEFS      (0x0001) // readblocks[2]/writeblocks[2] contain native func
@@ -64,6 +65,7 @@
 
 typedef struct _littlefs_file_obj_t {
     mp_obj_base_t base;
+    vfs_file_buffer_t fbuf;
     lfs_t* fs;
     lfs_file_t fd;
     uint32_t timestamp;
@@ -105,8 +107,8 @@ int map_lfs_error(int err);
 
 void littleFlash_term();
 
-MP_DECLARE_CONST_FUN_OBJ_3(littlefs_vfs_open_obj);
-MP_DECLARE_CONST_FUN_OBJ_3(littlefs_vfs_open_ex_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_open_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(littlefs_vfs_open_ex_obj);
 
 #endif // MICROPY_VFS_LITTLEFS
 
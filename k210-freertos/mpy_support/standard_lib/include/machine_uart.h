@@ -76,6 +76,11 @@ typedef struct _uart_ringbuf_t {
     uint8_t *buf;
     uint8_t uart_num;
     uint8_t notify;
+    // In frame mode the task is notified only when the frame delimiter is received
+    // or the buffer is half full; frame_length is the buffer length up to the last delimiter
+    uint8_t frame_mode;
+    uint8_t frame_char;
+    size_t frame_length;
 } uart_ringbuf_t;
 
 typedef struct _uart_uarts_t {
@@ -245,6 +245,12 @@ typedef struct _machine_hw_spi_obj_t {
     uint32_t            ws_rst;
     uint32_t            ws_needed_buf_size;
     bool                ws2812_white;
+    QueueHandle_t       queue_done_sem;     // given after each completed queued transaction
+    volatile uint32_t   queue_queued;       // number of queued transactions
+    volatile uint32_t   queue_done;         // number of completed queued transactions
+    volatile uint32_t   queue_errors;       // number of failed queued transactions
+    volatile bool       queue_abort;        // pending queued transactions are skipped (deinit)
+    mp_obj_t            queue_refs;         // buffers used by queued transactions, kept until completed
     enum {
         MACHINE_HW_SPI_STATE_NONE,
         MACHINE_HW_SPI_STATE_INIT,
@@ -319,11 +325,41 @@ void _set_sys_time(struct tm *tm_inf, int zone);
 
 int spi_master_hard_init(uint8_t mosi, int8_t miso, uint8_t sck, int8_t cs, gpio_pin_func_t func);
 
+/*
+ * Compiled I2C transaction list, created by I2C.compile()
+ * header, 'count' entries, data to be written
+ */
+#define I2C_TXN_MAGIC   0x4E585449  // 'ITXN'
+
+typedef struct _i2c_txn_header_t {
+    uint32_t magic;
+    uint16_t count;         // number of transactions
+    uint16_t rd_total;      // total number of bytes read by all transactions
+    uint32_t size;          // total size of the compiled list
+} i2c_txn_header_t;
+
+typedef struct _i2c_txn_entry_t {
+    uint16_t addr;          // slave address
+    uint16_t wr_len;        // number of bytes to write
+    uint16_t rd_len;        // number of bytes to read after write (repeated start)
+    uint16_t wr_offset;     // offset of the data to write from the list start
+} i2c_txn_entry_t;
+
+const i2c_txn_header_t *machine_i2c_txn_get(mp_obj_t txn_in);
+int machine_i2c_txn_run(mp_obj_t i2c_in, const i2c_txn_header_t *txn, uint8_t *out);
+
+void machine_spi_check_master(mp_obj_t spi_in);
+void machine_spi_bit_order(mp_obj_t spi_in, uint8_t *buf, size_t len);
+int machine_spi_transfer(mp_obj_t spi_in, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len);
+void machine_sampler_bus_deinit(mp_obj_t bus);
+void machine_hw_spi_queue_reset(void);
+
 extern const mp_obj_type_t machine_pin_type;
 extern const mp_obj_type_t machine_uart_type;
 extern const mp_obj_type_t machine_hw_i2c_type;
 extern const mp_obj_type_t machine_hw_spi_type;
 extern const mp_obj_type_t machine_timer_type;
+extern const mp_obj_type_t machine_sampler_type;
 extern const mp_obj_type_t machine_pwm_type;
 extern const mp_obj_type_t machine_onewire_type;
 extern const mp_obj_type_t machine_ds18x20_type;
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_VFS_BUFFERED_H
+#define MICROPY_INCLUDED_VFS_BUFFERED_H
+
+#include "py/obj.h"
+#include "py/stream.h"
+
+// Buffered stream layer shared by the littlefs, SPIFFS and SD card file objects.
+// The file system specific read/write/ioctl functions are only called with
+// large blocks, the small reads and writes are served from the file's buffer.
+
+#define VFS_BUFFER_DEFAULT_SIZE     (512)
+#define VFS_BUFFER_MAX_SIZE         (32*1024)
+
+#define VFS_BUFFER_FLAG_DIRTY       (0x01)  // buffer holds data not yet written to the file
+#define VFS_BUFFER_FLAG_LINE        (0x02)  // line buffered, flush on '\n'
+#define VFS_BUFFER_FLAG_CLOSED      (0x04)
+
+typedef struct _vfs_file_buffer_t {
+    const mp_stream_p_t *raw;   // unbuffered file system functions
+    byte *buf;                  // NULL if the file is unbuffered
+    uint32_t size;
+    uint32_t pos;               // read position in the buffer
+    uint32_t fill;              // number of valid bytes in the buffer
+    uint32_t flags;
+} vfs_file_buffer_t;
+
+// All buffered file objects must start with this header
+typedef struct _vfs_buffered_obj_t {
+    mp_obj_base_t base;
+    vfs_file_buffer_t fbuf;
+} vfs_buffered_obj_t;
+
+size_t vfs_buffered_size(mp_int_t buffering);
+void vfs_buffered_init(vfs_buffered_obj_t *self, const mp_stream_p_t *raw, byte *buf, size_t size, mp_int_t buffering);
+mp_obj_t vfs_buffered_iternext(mp_obj_t self_in);
+
+extern const mp_stream_p_t vfs_buffered_fileio_stream_p;
+extern const mp_stream_p_t vfs_buffered_textio_stream_p;
+extern const mp_obj_dict_t vfs_buffered_locals_dict;
+
+#endif // MICROPY_INCLUDED_VFS_BUFFERED_H
@@ -49,7 +49,7 @@ extern const byte fresult_to_errno_table[20];
 extern const mp_obj_type_t mp_sdcard_vfs_type;
 const char *sdcard_local_path(const char *path, sdcard_user_mount_t *vfsobj);
 
-MP_DECLARE_CONST_FUN_OBJ_3(sdcard_vfs_open_obj);
-MP_DECLARE_CONST_FUN_OBJ_3(sdcard_vfs_open_ex_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(sdcard_vfs_open_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(sdcard_vfs_open_ex_obj);
 
 #endif // MICROPY_INCLUDED_EXTMOD_VFS_SDCARD_H
@@ -32,6 +32,7 @@
 #include "py/lexer.h"
 #include "py/obj.h"
 #include "extmod/vfs.h"
+#include "vfs_buffered.h"
 #include "spiffs.h"
 // these are the values for fs_user_mount_t.flags
 #define MODULE_SPIFFS        (0x0001) // readblocks[2]/writeblocks[2] contain native func
@@ -60,6 +61,7 @@ typedef struct _spiffs_FILE{
 
 typedef struct _spiffs_file_obj_t {
     mp_obj_base_t base;
+    vfs_file_buffer_t fbuf;
     spiffs_FILE fp;
 } spiffs_file_obj_t;
 
@@ -138,8 +140,8 @@ int mp_module_spiffs_format(spiffs* fs);
 MP_NOINLINE bool init_flash_filesystem();
 const char *spiffs_local_path(const char *path);
 
-MP_DECLARE_CONST_FUN_OBJ_3(spiffs_vfs_open_obj);
-MP_DECLARE_CONST_FUN_OBJ_3(spiffs_vfs_open_ex_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(spiffs_vfs_open_obj);
+MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(spiffs_vfs_open_ex_obj);
 
 #endif
 
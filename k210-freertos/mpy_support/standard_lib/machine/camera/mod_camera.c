@@ -35,6 +35,7 @@
 #include "py/nlr.h"
 #include "py/runtime.h"
 #include "py/objstr.h"
+#include "py/objarray.h"
 #include "py/stream.h"
 #include "extmod/vfs.h"
 #include "modmachine.h"
@@ -49,6 +50,12 @@
 #define DEST_TFT        1
 #define DEST_FILE       2
 
+// Maximal number of frame buffers in the streaming frame pool
+#define CAMERA_POOL_MAX_BUFFERS     8
+#define CAMERA_POOL_DEF_BUFFERS     3
+// Sent to the ready queue to wake the 'get_frame()' waiters when the stream is stopped
+#define CAMERA_POOL_WAKEUP          0xFF
+
 typedef struct _mod_camera_obj_t {
     mp_obj_base_t       base;
     mp_obj_t            buff_obj0;
@@ -56,6 +63,20 @@ typedef struct _mod_camera_obj_t {
     sensor_t            sensor;
     SemaphoreHandle_t   semaphore;
     TaskHandle_t        preview_task;
+    // === Streaming frame pool ===
+    // Buffer ownership: free_queue -> ISR (filling) -> ready_queue -> Python (owned) -> free_queue
+    mp_obj_t            pool_obj[CAMERA_POOL_MAX_BUFFERS];
+    QueueHandle_t       pool_free_queue;    // indexes of the buffers available to the DVP
+    QueueHandle_t       pool_ready_queue;   // indexes of the captured frames, oldest first
+    uint8_t             pool_size;          // number of buffers in the pool
+    uint8_t             pool_filling;       // index of the buffer DVP is currently writing to
+    uint8_t             pool_owned;         // bitmask of the buffers owned by Python
+    uint8_t             pool_lent;          // bitmask of the buffers ever handed to Python as memoryview
+    bool                streaming;          // true if the frame pool capture is active
+    volatile uint32_t   pool_readers;       // number of 'get_frame()' callers waiting on the ready queue
+    volatile uint32_t   pool_gen;           // incremented when the stream is stopped
+    uint32_t            frames_captured;
+    uint32_t            frames_dropped;
 } mod_camera_obj_t;
 
 typedef struct _task_params_t {
@@ -198,6 +219,29 @@ static void check_preview(mod_camera_obj_t *self)
     }
 }
 
+//-------------------------------------------------------------
+static inline uint8_t *pool_buffer(mod_camera_obj_t *self, int idx)
+{
+    return ((mp_obj_array_t *)self->pool_obj[idx])->items + 8;
+}
+
+// Hand the just completed frame to the ready queue and continue capturing
+// into the next free buffer. If no free buffer is available (consumer is slow),
+// the captured frame is dropped and the same buffer is reused.
+// This function is executed from dvp interrupt
+//--------------------------------------------------------------------------------
+static void pool_frame_done(mod_camera_obj_t *self, BaseType_t *xHigherPriorityTaskWoken)
+{
+    uint8_t next;
+    if (xQueueReceiveFromISR(self->pool_free_queue, &next, xHigherPriorityTaskWoken) == pdTRUE) {
+        xQueueSendFromISR(self->pool_ready_queue, &self->pool_filling, xHigherPriorityTaskWoken);
+        self->pool_filling = next;
+        dvp_set_output_attributes(self->sensor.dvp_handle, DATA_FOR_DISPLAY, VIDEO_FMT_RGB565, pool_buffer(self, next));
+        self->frames_captured++;
+    }
+    else self->frames_dropped++;
+}
+
 //---------------------------------------------
 // This function is executed from dvp interrupt
 //-------------------------------------------------------------
@@ -218,6 +262,12 @@ static void on_dvp_irq(dvp_frame_event_t event, void* userdata)
             }
             break;
         case VIDEO_FE_END:
+            if (self->streaming) {
+                // Frame pool capture, runs until stopped
+                pool_frame_done(self, &xHigherPriorityTaskWoken);
+                if (xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
+                break;
+            }
             // Frame complete
             if (self->sensor.frame_count) self->sensor.frame_count--;
             self->sensor.gram_mux ^= 0x01; // select next (active) frame buffer
@@ -247,9 +297,55 @@ static void on_dvp_irq(dvp_frame_event_t event, void* userdata)
     }
 }
 
+// The buffers handed to Python as memoryview may still be referenced,
+// they are only dropped from the pool and freed by the GC when no longer used
+//-----------------------------------------------
+static void pool_delete(mod_camera_obj_t *self)
+{
+    for (int i=0; i<CAMERA_POOL_MAX_BUFFERS; i++) {
+        if ((self->pool_obj[i] != mp_const_none) && ((self->pool_lent & (1 << i)) == 0)) {
+            mp_obj_delete_frame_buffer((mp_obj_array_t *)self->pool_obj[i]);
+        }
+        self->pool_obj[i] = mp_const_none;
+    }
+    if (self->pool_free_queue) vQueueDelete(self->pool_free_queue);
+    if (self->pool_ready_queue) vQueueDelete(self->pool_ready_queue);
+    self->pool_free_queue = NULL;
+    self->pool_ready_queue = NULL;
+    self->pool_size = 0;
+    self->pool_owned = 0;
+    self->pool_lent = 0;
+}
+
+//---------------------------------------------
+static void stop_stream(mod_camera_obj_t *self)
+{
+    if (!self->streaming) return;
+
+    self->sensor.frame_count = 0;
+    dvp_disable(&self->sensor);
+    self->streaming = false;
+    self->pool_gen++;
+    // DVP buffer pointer must point to the capture buffer again
+    dvp_set_output_attributes(self->sensor.dvp_handle, DATA_FOR_DISPLAY, VIDEO_FMT_RGB565, self->sensor.gram0);
+    // Other threads may wait in 'get_frame()' with GIL released,
+    // wake them and wait until they are not using the queues before deleting them
+    if (self->pool_readers) {
+        uint8_t wakeup = CAMERA_POOL_WAKEUP;
+        xQueueReset(self->pool_ready_queue);
+        while (self->pool_readers) {
+            xQueueSend(self->pool_ready_queue, &wakeup, 0);
+            vTaskDelay(1);
+        }
+    }
+    pool_delete(self);
+    LOGD(TAG, "Stream stopped, captured: %u, dropped: %u", self->frames_captured, self->frames_dropped);
+}
+
 //------------------------------------------------
 static void _camera_deinit(mod_camera_obj_t *self)
 {
+    stop_stream(self);
     dvp_deinit(&self->sensor);
     cam_delete_buffers(self);
     cam_pins_deinit();
@@ -259,14 +355,35 @@ static void _camera_deinit(mod_camera_obj_t *self)
     camera_is_init = false;
 }
 
+// Swap even and odd pixels, one 32-bit word (pixel pair) at a time
 //------------------------------------------------
 static void swap_pixels(uint16_t *cbuff, int size)
 {
-    uint16_t tmpclr;
-    for (int i=0; i<size; i+=2) {
-        tmpclr = cbuff[i];
-        cbuff[i] = cbuff[i+1];
-        cbuff[i+1] = tmpclr;
+    uint32_t *wbuff = (uint32_t *)cbuff;
+    for (int i=0; i<(size/2); i++) {
+        wbuff[i] = (wbuff[i] >> 16) | (wbuff[i] << 16);
+    }
+}
+
+// Copy the frame swapping even and odd pixels in the same pass
+//---------------------------------------------------------------------------
+static void copy_swap_pixels(uint8_t *dst, const uint8_t *src, int size)
+{
+    if (((uintptr_t)dst & 3) == 0) {
+        uint32_t *wdst = (uint32_t *)dst;
+        const uint32_t *wsrc = (const uint32_t *)src;
+        for (int i=0; i<(size/2); i++) {
+            wdst[i] = (wsrc[i] >> 16) | (wsrc[i] << 16);
+        }
+    }
+    else {
+        // unaligned destination
+        for (int i=0; i<(size*2); i+=4) {
+            dst[i] = src[i+2];
+            dst[i+1] = src[i+3];
+            dst[i+2] = src[i];
+            dst[i+3] = src[i+1];
+        }
     }
 }
 
@@ -303,8 +420,7 @@ static void init_frames(mod_camera_obj_t *self, bool delete)
     if (show) {
         // Display the last captured frame
         color_t *cbuff = (uint16_t *)((self->sensor.gram_mux) ? self->sensor.gram0 : self->sensor.gram1);
-        swap_pixels(cbuff, dvp_cam_resolution[self->sensor.framesize][0] * dvp_cam_resolution[self->sensor.framesize][1]);
-        send_data_scale(0, 0, dvp_cam_resolution[self->sensor.framesize][0], dvp_cam_resolution[self->sensor.framesize][1], cbuff, 0);
+        send_data_scale_swap(0, 0, dvp_cam_resolution[self->sensor.framesize][0], dvp_cam_resolution[self->sensor.framesize][1], cbuff, 0);
         send_frame_buffer();
     }
 }
@@ -356,9 +472,9 @@ static void preview_task(void *pvParameters)
 
         if (active_dstate->tft_frame_buffer) {
             // Display captured frame
+            // Even and odd pixels are swapped while copying to the frame buffer
             color_t *cbuff = (uint16_t *)((self->sensor.gram_mux) ? self->sensor.gram0 : self->sensor.gram1);
-            swap_pixels(cbuff, dvp_cam_resolution[self->sensor.framesize][0] * dvp_cam_resolution[self->sensor.framesize][1]);
-            send_data_scale(0, 0, dvp_cam_resolution[self->sensor.framesize][0], dvp_cam_resolution[self->sensor.framesize][1], cbuff, 0);
+            send_data_scale_swap(0, 0, dvp_cam_resolution[self->sensor.framesize][0], dvp_cam_resolution[self->sensor.framesize][1], cbuff, 0);
             if (task_params->disp_fps) {
                 sprintf(str_tft, "%0.2f fps", fps);
                 TFT_print(str_tft, 5, 5);
@@ -467,7 +583,11 @@ STATIC void mod_camera_print(const mp_print_t *print, mp_obj_t self_in, mp_print
                 dvp_cam_resolution[self->sensor.framesize][0], dvp_cam_resolution[self->sensor.framesize][1],
                 self->sensor.xclk,
                 (self->preview_task) ? "2*" : "", self->sensor.gram_size+8,
-                (self->preview_task) ? "Preview" : "Capture");
+                (self->preview_task) ? "Preview" : ((self->streaming) ? "Stream" : "Capture"));
+        if (self->streaming) {
+            mp_printf(print, "\n       Frame pool: %u buffers, captured: %u, dropped: %u",
+                    self->pool_size, self->frames_captured, self->frames_dropped);
+        }
     }
     else {
         mp_printf(print, "Camera( deinitialized )");
@@ -523,6 +643,17 @@ STATIC mp_obj_t mod_camera_make_new(const mp_obj_type_t *type, size_t n_args, si
     self->sensor.irq_func_data = (void *)self;
     self->sensor.frame_count = 1;
     self->preview_task = NULL;
+    for (int i=0; i<CAMERA_POOL_MAX_BUFFERS; i++) {
+        self->pool_obj[i] = mp_const_none;
+    }
+    self->pool_free_queue = NULL;
+    self->pool_ready_queue = NULL;
+    self->pool_size = 0;
+    self->pool_owned = 0;
+    self->pool_lent = 0;
+    self->pool_readers = 0;
+    self->pool_gen = 0;
+    self->streaming = false;
 
     LOGD(TAG, "Camera deinit");
     dvp_deinit(&self->sensor);
@@ -579,6 +710,7 @@ STATIC mp_obj_t mod_camera_reset(mp_obj_t self_in)
 
     check_camera(self);
     stop_preview_task(self);
+    stop_stream(self);
 
     LOGD(TAG, "Deinitialize camera");
     dvp_deinit(&self->sensor);
@@ -623,6 +755,7 @@ STATIC mp_obj_t mod_camera_set_size(mp_obj_t self_in, mp_obj_t size_in)
         if (self->sensor.check_framesize(size) != 0) {
             mp_raise_ValueError("Unsupported size.");
         }
+        stop_stream(self);
         self->sensor.framesize = size;
         dvp_config_size(&self->sensor);
         if (!cam_create_buffer(self)) return mp_const_false;
@@ -670,6 +803,7 @@ STATIC mp_obj_t mod_camera_capture(mp_uint_t n_args, const mp_obj_t *pos_args, m
 
     check_camera(self);
     stop_preview_task(self);
+    stop_stream(self);
 
     #if USE_DEBUG_PIN
     gpio_set_pin_value(gpiohs_handle, debug_pin, 1);
@@ -873,7 +1007,8 @@ STATIC mp_obj_t mod_camera_capture(mp_uint_t n_args, const mp_obj_t *pos_args, m
         LOGD(TAG, "Process RGB565");
         // Captured data have swapped even and odd pixels, fix it
         // (Data are written to buffer as 32-bit values)
-        swap_pixels((uint16_t *)frame_buffer, width*height);
+        // When displaying, pixels are swapped while copying to the frame buffer
+        if (dest != DEST_TFT) swap_pixels((uint16_t *)frame_buffer, width*height);
 
         if (dest == DEST_BUFFER) {
             LOGD(TAG, "Save to buffer");
@@ -884,7 +1019,7 @@ STATIC mp_obj_t mod_camera_capture(mp_uint_t n_args, const mp_obj_t *pos_args, m
         }
         else if (dest == DEST_TFT) {
             LOGD(TAG, "Show on display");
-            send_data_scale(0, 0, width, height, (color_t *)frame_buffer, 0);
+            send_data_scale_swap(0, 0, width, height, (color_t *)frame_buffer, 0);
 
             tft_setup((uint8_t)(args[ARG_time].u_int & 3));
             send_frame_buffer();
@@ -933,6 +1068,9 @@ STATIC mp_obj_t mod_camera_preview(mp_uint_t n_args, const mp_obj_t *pos_args, m
     }
 
     // Check conditions to run preview
+    if (self->streaming) {
+        mp_raise_msg(&mp_type_OSError, "Cannot execute while streaming");
+    }
     if (self->sensor.pixformat == PIXFORMAT_JPEG) {
         mp_raise_msg(&mp_type_OSError, "preview not supported when in JPEG mode.");
     }
@@ -1113,6 +1251,185 @@ STATIC mp_obj_t mod_camera_exposure(size_t n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_camera_exposure_obj, 1, 2, mod_camera_exposure);
 
+// ===== Frame pool streaming =====
+
+// Start continuous capture into the pool of 'buffers' frame buffers
+// or stop it if 'start' is False
+//----------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_camera_stream(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_start, ARG_buffers };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_start,                     MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_buffers,  MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = CAMERA_POOL_DEF_BUFFERS} },
+    };
+
+    mod_camera_obj_t *self = pos_args[0];
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args-1, pos_args+1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    check_preview(self);
+
+    if (!args[ARG_start].u_bool) {
+        stop_stream(self);
+        return mp_const_none;
+    }
+    if (self->streaming) return mp_const_none;
+
+    if (self->sensor.pixformat == PIXFORMAT_JPEG) {
+        mp_raise_msg(&mp_type_OSError, "stream not supported when in JPEG mode.");
+    }
+    int nbuf = args[ARG_buffers].u_int;
+    if ((nbuf < 2) || (nbuf > CAMERA_POOL_MAX_BUFFERS)) {
+        mp_raise_ValueError("Number of buffers out of range (2 ~ 8)");
+    }
+
+    // === Create the frame pool ===
+    self->pool_free_queue = xQueueCreate(nbuf, sizeof(uint8_t));
+    self->pool_ready_queue = xQueueCreate(nbuf, sizeof(uint8_t));
+    if ((self->pool_free_queue == NULL) || (self->pool_ready_queue == NULL)) {
+        pool_delete(self);
+        mp_raise_msg(&mp_type_OSError, "Error creating frame pool queues.");
+    }
+    for (int i=0; i<nbuf; i++) {
+        self->pool_obj[i] = mp_obj_new_frame_buffer(self->sensor.gram_size+8);
+        if (self->pool_obj[i] == mp_const_none) {
+            pool_delete(self);
+            mp_raise_msg(&mp_type_OSError, "Error creating frame pool buffer.");
+        }
+    }
+    self->pool_size = nbuf;
+    self->pool_owned = 0;
+    self->pool_lent = 0;
+    // The first buffer is filled by DVP, all others are free
+    self->pool_filling = 0;
+    for (uint8_t i=1; i<nbuf; i++) {
+        xQueueSend(self->pool_free_queue, &i, 0);
+    }
+    self->frames_captured = 0;
+    self->frames_dropped = 0;
+    LOGD(TAG, "Frame pool created: %d * %u bytes", nbuf, self->sensor.gram_size+8);
+
+    // === Start capturing frames ===
+    // DVP output address must point to the pool buffer before the capture is enabled
+    dvp_set_output_attributes(self->sensor.dvp_handle, DATA_FOR_DISPLAY, VIDEO_FMT_RGB565, pool_buffer(self, 0));
+    self->sensor.frame_count = 1;
+    self->streaming = true;
+    mp_hal_wdt_reset();
+    dvp_enable(&self->sensor);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(mod_camera_stream_obj, 1, mod_camera_stream);
+
+// Get the oldest captured frame from the pool as memoryview
+// The frame buffer is owned by the caller until released with 'release()'
+// The frame is returned as captured by DVP, with even and odd pixels swapped.
+// If the 'into' buffer is given, the frame is copied into it with the pixels
+// swapped during the copy, the pool buffer is immediately returned to the pool.
+//-------------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_camera_get_frame(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_timeout, ARG_into };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timeout,                   MP_ARG_INT,  {.u_int = 1000} },
+        { MP_QSTR_into,     MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+    };
+
+    mod_camera_obj_t *self = pos_args[0];
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args-1, pos_args+1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    check_camera(self);
+    if (!self->streaming) {
+        mp_raise_msg(&mp_type_OSError, "Camera is not streaming");
+    }
+    uint16_t width = dvp_cam_resolution[self->sensor.framesize][0];
+    uint16_t height = dvp_cam_resolution[self->sensor.framesize][1];
+    mp_buffer_info_t bufinfo;
+    if (args[ARG_into].u_obj != mp_const_none) {
+        mp_get_buffer_raise(args[ARG_into].u_obj, &bufinfo, MP_BUFFER_WRITE);
+        if (bufinfo.len < (width*height*2)) {
+            mp_raise_ValueError("Buffer too small");
+        }
+    }
+
+    uint8_t idx;
+    uint32_t gen = self->pool_gen;
+    TickType_t tmo = (args[ARG_timeout].u_int < 0) ? portMAX_DELAY : (args[ARG_timeout].u_int / portTICK_PERIOD_MS);
+    // Wait for the frame with GIL released
+    // The queue may only be deleted by 'stop_stream()' after the reader count drops to 0
+    __atomic_fetch_add(&self->pool_readers, 1, __ATOMIC_SEQ_CST);
+    MP_THREAD_GIL_EXIT();
+    BaseType_t res = xQueueReceive(self->pool_ready_queue, &idx, tmo);
+    __atomic_fetch_sub(&self->pool_readers, 1, __ATOMIC_SEQ_CST);
+    MP_THREAD_GIL_ENTER();
+    // the stream was stopped (and possibly restarted) while waiting
+    if ((res != pdTRUE) || (idx == CAMERA_POOL_WAKEUP) || (gen != self->pool_gen)) return mp_const_none;
+
+    uint8_t *frame_buffer = pool_buffer(self, idx);
+    if (args[ARG_into].u_obj != mp_const_none) {
+        copy_swap_pixels((uint8_t *)bufinfo.buf, frame_buffer, width*height);
+        xQueueSend(self->pool_free_queue, &idx, 0);
+        return args[ARG_into].u_obj;
+    }
+
+    self->pool_owned |= (1 << idx);
+    self->pool_lent |= (1 << idx);
+    return mp_obj_new_memoryview('B' | MP_OBJ_ARRAY_TYPECODE_FLAG_RW, width*height*2, frame_buffer);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(mod_camera_get_frame_obj, 1, mod_camera_get_frame);
+
+// Return the frame obtained by 'get_frame()' to the pool
+// If no frame is given, all frames owned by Python are released
+//----------------------------------------------------------------------
+STATIC mp_obj_t mod_camera_release(size_t n_args, const mp_obj_t *args)
+{
+    mod_camera_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    check_camera(self);
+    if (!self->streaming) return mp_const_false;
+
+    if (n_args == 1) {
+        for (uint8_t i=0; i<self->pool_size; i++) {
+            if (self->pool_owned & (1 << i)) {
+                self->pool_owned &= ~(1 << i);
+                xQueueSend(self->pool_free_queue, &i, 0);
+            }
+        }
+        return mp_const_true;
+    }
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_READ);
+    for (uint8_t i=0; i<self->pool_size; i++) {
+        uint8_t *frame_buffer = pool_buffer(self, i);
+        if (((uint8_t *)bufinfo.buf >= frame_buffer) && ((uint8_t *)bufinfo.buf < (frame_buffer + self->sensor.gram_size))) {
+            if ((self->pool_owned & (1 << i)) == 0) return mp_const_false;
+            self->pool_owned &= ~(1 << i);
+            xQueueSend(self->pool_free_queue, &i, 0);
+            return mp_const_true;
+        }
+    }
+    mp_raise_ValueError("Not a camera frame");
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_camera_release_obj, 1, 2, mod_camera_release);
+
+// Returns tuple: (captured_frames, dropped_frames, ready_frames)
+//--------------------------------------------------
+STATIC mp_obj_t mod_camera_stats(mp_obj_t self_in)
+{
+    mod_camera_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int(self->frames_captured);
+    tuple[1] = mp_obj_new_int(self->frames_dropped);
+    tuple[2] = mp_obj_new_int((self->streaming) ? uxQueueMessagesWaiting(self->pool_ready_queue) : 0);
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_camera_stats_obj, mod_camera_stats);
+
 
 //==============================================================
 STATIC const mp_rom_map_elem_t mod_camera_locals_dict_table[] = {
@@ -1132,6 +1449,10 @@ STATIC const mp_rom_map_elem_t mod_camera_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_quality),         MP_ROM_PTR(&mod_camera_quality_obj) },
     { MP_ROM_QSTR(MP_QSTR_size),            MP_ROM_PTR(&mod_camera_set_size_obj) },
     { MP_ROM_QSTR(MP_QSTR_exposure),        MP_ROM_PTR(&mod_camera_exposure_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream),          MP_ROM_PTR(&mod_camera_stream_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get_frame),       MP_ROM_PTR(&mod_camera_get_frame_obj) },
+    { MP_ROM_QSTR(MP_QSTR_release),         MP_ROM_PTR(&mod_camera_release_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),           MP_ROM_PTR(&mod_camera_stats_obj) },
 
     { MP_ROM_QSTR(MP_QSTR_MODE_RGB565),     MP_ROM_INT(PIXFORMAT_RGB565) },
     { MP_ROM_QSTR(MP_QSTR_MODE_JPEG),       MP_ROM_INT(PIXFORMAT_JPEG) },
@@ -366,6 +366,9 @@ static bool i2c_hard_deinit(mp_machine_i2c_obj_t *i2c_obj)
 //------------------------------------------------------------
 static void _mp_machine_i2c_deinit(mp_machine_i2c_obj_t *self)
 {
+    // stop the samplers using this bus
+    machine_sampler_bus_deinit(self);
+
     if ((i2c_used[self->i2c_num] == I2C_MODE_SLAVE) && (i2c_slave_task_handle)) {
         xTaskNotify(i2c_slave_task_handle, I2C_SLAVE_DRIVER_DELETED, eSetValueWithOverwrite);
         int tmo = 120;
@@ -1269,6 +1272,199 @@ STATIC mp_obj_t mp_machine_i2c_is_ready(mp_obj_t self_in, mp_obj_t addr_in)
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mp_machine_i2c_is_ready_obj, mp_machine_i2c_is_ready);
 
 
+// ==== Master transaction lists ==============================================================
+
+/*
+ * Transaction list is compiled into a bytes object which can be reused
+ * without any allocation: header, entries, data to be written
+ * Each entry is executed as write, read or write followed by read with repeated start
+ */
+
+//----------------------------------------------------
+STATIC mp_obj_t i2c_txn_compile(mp_obj_t list_in)
+{
+    size_t count = 0;
+    mp_obj_t *items;
+    mp_obj_get_array(list_in, &count, &items);
+    if ((count == 0) || (count > 255)) {
+        mp_raise_ValueError("1 - 255 transactions allowed");
+    }
+
+    // Check the transactions and calculate the total size
+    size_t size = sizeof(i2c_txn_header_t) + (count * sizeof(i2c_txn_entry_t));
+    size_t rd_total = 0;
+    mp_buffer_info_t bufinfo;
+    for (int i=0; i<count; i++) {
+        size_t n = 0;
+        mp_obj_t *entry;
+        mp_obj_get_array(items[i], &n, &entry);
+        if (n != 3) {
+            mp_raise_ValueError("Transaction must be (addr, wr_data, rd_len)");
+        }
+        _checkAddr(mp_obj_get_int(entry[0]));
+        if (mp_obj_is_int(entry[1])) size++;
+        else if (entry[1] != mp_const_none) {
+            mp_get_buffer_raise(entry[1], &bufinfo, MP_BUFFER_READ);
+            size += bufinfo.len;
+        }
+        int rd_len = mp_obj_get_int(entry[2]);
+        if (rd_len < 0) {
+            mp_raise_ValueError("Wrong read length");
+        }
+        rd_total += rd_len;
+    }
+    if ((size > 0xFFFF) || (rd_total > 0xFFFF)) {
+        mp_raise_ValueError("Transaction list too long");
+    }
+
+    // Create the compiled list
+    vstr_t vstr;
+    vstr_init_len(&vstr, size);
+    memset(vstr.buf, 0, size);
+    i2c_txn_header_t *hdr = (i2c_txn_header_t *)vstr.buf;
+    i2c_txn_entry_t *txn = (i2c_txn_entry_t *)(vstr.buf + sizeof(i2c_txn_header_t));
+    size_t offset = sizeof(i2c_txn_header_t) + (count * sizeof(i2c_txn_entry_t));
+    hdr->magic = I2C_TXN_MAGIC;
+    hdr->count = count;
+    hdr->rd_total = rd_total;
+    hdr->size = size;
+    for (int i=0; i<count; i++) {
+        size_t n = 0;
+        mp_obj_t *entry;
+        mp_obj_get_array(items[i], &n, &entry);
+        txn[i].addr = mp_obj_get_int(entry[0]);
+        txn[i].rd_len = mp_obj_get_int(entry[2]);
+        txn[i].wr_offset = offset;
+        if (mp_obj_is_int(entry[1])) {
+            // single byte, register address
+            vstr.buf[offset] = mp_obj_get_int(entry[1]) & 0xFF;
+            txn[i].wr_len = 1;
+        }
+        else if (entry[1] != mp_const_none) {
+            mp_get_buffer_raise(entry[1], &bufinfo, MP_BUFFER_READ);
+            memcpy(vstr.buf + offset, bufinfo.buf, bufinfo.len);
+            txn[i].wr_len = bufinfo.len;
+        }
+        if ((txn[i].wr_len == 0) && (txn[i].rd_len == 0)) {
+            vstr_clear(&vstr);
+            mp_raise_ValueError("Empty transaction");
+        }
+        offset += txn[i].wr_len;
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+// Get and check the compiled transaction list
+//---------------------------------------------------------
+const i2c_txn_header_t *machine_i2c_txn_get(mp_obj_t txn_in)
+{
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(txn_in, &bufinfo, MP_BUFFER_READ);
+    const i2c_txn_header_t *hdr = (const i2c_txn_header_t *)bufinfo.buf;
+    if ((bufinfo.len < sizeof(i2c_txn_header_t)) || (((uintptr_t)bufinfo.buf & 3) != 0) ||
+            (hdr->magic != I2C_TXN_MAGIC) || (hdr->size != bufinfo.len) ||
+            ((sizeof(i2c_txn_header_t) + (hdr->count * sizeof(i2c_txn_entry_t))) > bufinfo.len)) {
+        mp_raise_ValueError("Not a compiled transaction list");
+    }
+    const i2c_txn_entry_t *txn = (const i2c_txn_entry_t *)(hdr + 1);
+    for (int i=0; i<hdr->count; i++) {
+        if ((txn[i].wr_offset + txn[i].wr_len) > bufinfo.len) {
+            mp_raise_ValueError("Not a compiled transaction list");
+        }
+    }
+    return hdr;
+}
+
+/*
+ * Execute all transactions from the compiled list, read data is placed into 'out' buffer
+ * which must be at least 'txn->rd_total' bytes long
+ * Can be used without GIL, no MicroPython objects are created
+ * Returns the number of bytes read or -(index+1) of the failed transaction
+ */
+//-----------------------------------------------------------------------------------------
+int machine_i2c_txn_run(mp_obj_t i2c_in, const i2c_txn_header_t *txn, uint8_t *out)
+{
+    mp_machine_i2c_obj_t *self = (mp_machine_i2c_obj_t *)i2c_in;
+    const i2c_txn_entry_t *entry = (const i2c_txn_entry_t *)(txn + 1);
+    const uint8_t *base = (const uint8_t *)txn;
+    int ret, rd_total = 0;
+
+    for (int i=0; i<txn->count; i++, entry++) {
+        handle_t i2c_dev = i2c_get_device(self->i2c_handle, entry->addr, (entry->addr < 0x80) ? 7 : 10);
+        i2c_dev_set_clock_rate(i2c_dev, self->speed);
+        if ((entry->wr_len > 0) && (entry->rd_len > 0)) {
+            ret = i2c_dev_transfer_sequential(i2c_dev, base + entry->wr_offset, entry->wr_len, out + rd_total, entry->rd_len);
+        }
+        else if (entry->wr_len > 0) ret = io_write(i2c_dev, base + entry->wr_offset, entry->wr_len);
+        else ret = io_read(i2c_dev, out + rd_total, entry->rd_len);
+        io_close(i2c_dev);
+
+        if (ret <= 0) return -(i+1);
+        rd_total += entry->rd_len;
+    }
+    return rd_total;
+}
+
+//-------------------------------------------------------------------------
+STATIC mp_obj_t mp_machine_i2c_compile(mp_obj_t self_in, mp_obj_t list_in)
+{
+    mp_machine_i2c_obj_t *self = self_in;
+    _checkMaster(self);
+
+    return i2c_txn_compile(list_in);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mp_machine_i2c_compile_obj, mp_machine_i2c_compile);
+
+//-------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t mp_machine_i2c_transaction(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    STATIC const mp_arg_t machine_i2c_transaction_args[] = {
+        { MP_QSTR_txn,     MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_into,    MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_machine_i2c_obj_t *self = pos_args[0];
+    _checkMaster(self);
+
+    // parse arguments
+    mp_arg_val_t args[MP_ARRAY_SIZE(machine_i2c_transaction_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(args), machine_i2c_transaction_args, args);
+
+    // Compiled transaction list or list of (addr, wr_data, rd_len) tuples
+    mp_obj_t txn_obj = args[0].u_obj;
+    if ((mp_obj_is_type(txn_obj, &mp_type_list)) || (mp_obj_is_type(txn_obj, &mp_type_tuple))) {
+        txn_obj = i2c_txn_compile(txn_obj);
+    }
+    const i2c_txn_header_t *txn = machine_i2c_txn_get(txn_obj);
+
+    uint8_t *out;
+    vstr_t vstr;
+    if (args[1].u_obj != mp_const_none) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[1].u_obj, &bufinfo, MP_BUFFER_WRITE);
+        if (bufinfo.len < txn->rd_total) {
+            mp_raise_ValueError("Buffer too small");
+        }
+        out = bufinfo.buf;
+    }
+    else {
+        vstr_init_len(&vstr, txn->rd_total);
+        out = (uint8_t *)vstr.buf;
+    }
+
+    MP_THREAD_GIL_EXIT();
+    int ret = machine_i2c_txn_run(self, txn, out);
+    MP_THREAD_GIL_ENTER();
+    if (ret < 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "I2C transaction %d error", -ret - 1));
+    }
+
+    if (args[1].u_obj != mp_const_none) return mp_obj_new_int(ret);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mp_machine_i2c_transaction_obj, 1, mp_machine_i2c_transaction);
+
+
 // ============================================================================================
 // ==== I2C slave functions ===================================================================
 // ============================================================================================
@@ -1421,6 +1617,10 @@ STATIC const mp_rom_map_elem_t mp_machine_i2c_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_scan),                (mp_obj_t)&mp_machine_i2c_scan_obj },
     { MP_ROM_QSTR(MP_QSTR_is_ready),            (mp_obj_t)&mp_machine_i2c_is_ready_obj },
 
+    // Transaction lists
+    { MP_ROM_QSTR(MP_QSTR_compile),             (mp_obj_t)&mp_machine_i2c_compile_obj },
+    { MP_ROM_QSTR(MP_QSTR_transaction),         (mp_obj_t)&mp_machine_i2c_transaction_obj },
+
     // Standard slave methods
     { MP_ROM_QSTR(MP_QSTR_setdata),             (mp_obj_t)&mp_machine_i2c_slave_setdata_obj },
     { MP_ROM_QSTR(MP_QSTR_fillbuffer),          (mp_obj_t)&mp_machine_i2c_slave_setbuffer_obj },
@@ -0,0 +1,500 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/*
+ * Background sensor sampling engine
+ *
+ * The hardware timer interrupt wakes up the high priority sampler task
+ * which executes the transaction (compiled I2C transaction list or SPI write/read)
+ * and stores the timestamped sample into the ring buffer.
+ * MicroPython is not involved in sampling, no GIL is used, sampling is not affected
+ * by the garbage collection or other MicroPython activities.
+ * The ring buffer has a single producer (sampler task) and a single consumer (MicroPython),
+ * no locking is needed. If the ring buffer is full, new samples are dropped and counted.
+ *
+ * Sample record: 32-bit timestamp in microseconds (little endian), sample data, padding to 4 bytes
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "mpthreadport.h"
+#include "modmachine.h"
+#include "syslog.h"
+
+#define SAMPLER_TASK_PRIORITY       MP_THREAD_MAX_PRIORITY
+#define SAMPLER_TASK_STACK_SIZE     configMINIMAL_STACK_SIZE
+#define SAMPLER_TASK_EXIT           0x80000000
+#define SAMPLER_MIN_PERIOD          100         // minimal sampling period in us
+#define SAMPLER_MAX_PERIOD          1000000     // maximal sampling period in us
+#define SAMPLER_MAX_SAMPLES         65536       // maximal ring buffer size in samples
+
+typedef struct _machine_sampler_obj_t {
+    mp_obj_base_t           base;
+    int8_t                  id;             // hw timer number (0~11), -1 if not initialized
+    bool                    running;
+    handle_t                handle;         // hw timer handle
+    mp_obj_t                bus;            // I2C or SPI object
+    mp_obj_t                txn;            // compiled I2C transaction list or SPI write data
+    const i2c_txn_header_t  *i2c_txn;       // I2C transaction list, NULL for SPI
+    const uint8_t           *spi_wr;        // SPI data to write
+    uint16_t                spi_wr_len;
+    uint16_t                data_len;       // sample data length
+    uint32_t                rec_size;       // record size in ring buffer
+    uint32_t                size;           // ring buffer size in records
+    uint8_t                 *ring;          // ring buffer
+    volatile uint32_t       head;           // number of records written (by the task)
+    volatile uint32_t       tail;           // number of records read (by MicroPython)
+    uint32_t                period;         // sampling period in us
+    volatile uint32_t       samples;        // number of samples taken
+    volatile uint32_t       overruns;       // number of samples dropped, ring buffer full
+    volatile uint32_t       errors;         // number of failed transactions
+    volatile uint32_t       missed;         // number of timer events missed, sampling took too long
+    TaskHandle_t            task;
+    SemaphoreHandle_t       task_done;      // given by the task when it exits
+} machine_sampler_obj_t;
+
+const mp_obj_type_t machine_sampler_type;
+
+
+//-------------------------------------------
+static void sampler_task(void *pvParameters)
+{
+    machine_sampler_obj_t *self = (machine_sampler_obj_t *)pvParameters;
+    uint32_t events, slot;
+    uint8_t *rec;
+    int ret;
+
+    while (1) {
+        events = ulTaskNotifyTake(pdTRUE, 1000 / portTICK_RATE_MS);
+        if (events & SAMPLER_TASK_EXIT) break;
+        if (events == 0) continue;
+        if (events > 1) self->missed += events - 1;
+
+        uint32_t timestamp = (uint32_t)mp_hal_ticks_us();
+        if ((self->head - self->tail) >= self->size) {
+            self->overruns++;
+            continue;
+        }
+        slot = self->head % self->size;
+        rec = self->ring + (slot * self->rec_size);
+
+        if (self->i2c_txn) ret = machine_i2c_txn_run(self->bus, self->i2c_txn, rec + 4);
+        else ret = machine_spi_transfer(self->bus, self->spi_wr, self->spi_wr_len, rec + 4, self->data_len);
+        self->samples++;
+        if (ret <= 0) {
+            self->errors++;
+            continue;
+        }
+        memcpy(rec, &timestamp, 4);
+        // record must be complete before it is seen by MicroPython
+        __sync_synchronize();
+        self->head++;
+    }
+
+    // 'self' may be freed as soon as the semaphore is given
+    SemaphoreHandle_t task_done = self->task_done;
+    self->task = NULL;
+    xSemaphoreGive(task_done);
+    vTaskDelete(NULL);
+}
+
+//--------------------------------------------
+STATIC void machine_sampler_isr(void *userdata)
+{
+    machine_sampler_obj_t *self = (machine_sampler_obj_t *)userdata;
+    if (self->task == NULL) return;
+
+    BaseType_t HPTaskAwoken = pdFALSE;
+    vTaskNotifyGiveFromISR(self->task, &HPTaskAwoken);
+    if (HPTaskAwoken == pdTRUE) vPortYieldFromISR();
+}
+
+//----------------------------------------------------------
+static void sampler_check(machine_sampler_obj_t *self)
+{
+    if (self->id < 0) {
+        mp_raise_ValueError("Sampler not initialized.");
+    }
+}
+
+//-----------------------------------------------------------
+static void sampler_deinit(machine_sampler_obj_t *self)
+{
+    if (self->id < 0) return;
+
+    if (self->handle) {
+        timer_set_on_tick(self->handle, NULL, NULL);
+        timer_set_enable(self->handle, false);
+        io_close(self->handle);
+        self->handle = 0;
+    }
+    self->running = false;
+    if (self->task) {
+        // terminate the sampler task and wait until it confirms the exit,
+        // the transaction in progress (limited by the bus timeouts) is finished first.
+        // The GIL is not released, this can run as a finaliser during the garbage collection
+        xTaskNotify(self->task, SAMPLER_TASK_EXIT, eSetBits);
+        xSemaphoreTake(self->task_done, portMAX_DELAY);
+    }
+    if (self->task_done) {
+        vSemaphoreDelete(self->task_done);
+        self->task_done = NULL;
+    }
+    if (self->ring) {
+        vPortFree(self->ring);
+        self->ring = NULL;
+    }
+    mpy_timers_used[self->id] = NULL;
+    self->id = -1;
+    self->bus = MP_OBJ_NULL;
+    self->txn = MP_OBJ_NULL;
+    self->i2c_txn = NULL;
+}
+
+// Called before the I2C or SPI bus is deinitialized or reconfigured,
+// the samplers using the bus are stopped and deinitialized
+//============================================
+void machine_sampler_bus_deinit(mp_obj_t bus)
+{
+    for (int i=0; i<TIMER_MAX_TIMERS; i++) {
+        machine_sampler_obj_t *sampler = (machine_sampler_obj_t *)mpy_timers_used[i];
+        if ((sampler) && (mp_obj_is_type(sampler, &machine_sampler_type)) && (sampler->bus == bus)) {
+            LOGW("SAMPLER", "Bus deinitialized, sampler on timer %d stopped", i);
+            sampler_deinit(sampler);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+STATIC void machine_sampler_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    machine_sampler_obj_t *self = self_in;
+
+    if (self->id < 0) {
+        mp_printf(print, "Sampler(Not initialized)");
+        return;
+    }
+    mp_printf(print, "Sampler(timer=%d, bus=%s, period=%u us, data=%u B, record=%u B, size=%u)\n",
+            self->id, (self->i2c_txn) ? "I2C" : "SPI", self->period, self->data_len, self->rec_size, self->size);
+    mp_printf(print, "        Running: %s; Samples: %u; Available: %u; Overruns: %u; Errors: %u; Missed: %u",
+            (self->running) ? "yes" : "no", self->samples, self->head - self->tail,
+            self->overruns, self->errors, self->missed);
+}
+
+/*
+ * Sampler(timer, bus, txn, period=1000, size=256)
+ *   timer:  hardware timer number used (0~11)
+ *   bus:    I2C (master) or SPI (master) object
+ *   txn:    I2C: transaction list compiled with I2C.compile() or list of (addr, wr_data, rd_len) tuples
+ *           SPI: (wr_data, rd_len) tuple
+ *   period: sampling period in microseconds
+ *   size:   ring buffer size in samples
+ */
+//------------------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t machine_sampler_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum { ARG_timer, ARG_bus, ARG_txn, ARG_period, ARG_size, ARG_start };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timer,    MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_bus,      MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_txn,      MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_period,   MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 1000} },
+        { MP_QSTR_size,     MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 256} },
+        { MP_QSTR_start,    MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = true} },
+    };
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, all_args + n_args);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, all_args, &kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    int tmr = args[ARG_timer].u_int;
+    if ((tmr < 0) || (tmr >= TIMER_MAX_TIMERS)) {
+        mp_raise_ValueError("Only timers 0~11 can be used.");
+    }
+    if (mpy_timers_used[tmr] != NULL) {
+        mp_raise_ValueError("Timer already used.");
+    }
+    if ((args[ARG_period].u_int < SAMPLER_MIN_PERIOD) || (args[ARG_period].u_int > SAMPLER_MAX_PERIOD)) {
+        mp_raise_ValueError("Period out of range (100 ~ 1000000 us)");
+    }
+    if ((args[ARG_size].u_int < 2) || (args[ARG_size].u_int > SAMPLER_MAX_SAMPLES)) {
+        mp_raise_ValueError("Size out of range (2 ~ 65536)");
+    }
+
+    machine_sampler_obj_t *self = m_new_obj_with_finaliser(machine_sampler_obj_t);
+    memset(self, 0, sizeof(machine_sampler_obj_t));
+    self->base.type = &machine_sampler_type;
+    self->id = -1;
+
+    // Get the transaction
+    mp_obj_t bus = args[ARG_bus].u_obj;
+    mp_obj_t txn = args[ARG_txn].u_obj;
+    if (mp_obj_is_type(bus, &machine_hw_i2c_type)) {
+        if ((mp_obj_is_type(txn, &mp_type_list)) || (mp_obj_is_type(txn, &mp_type_tuple))) {
+            txn = mp_call_function_1(mp_load_attr(bus, MP_QSTR_compile), txn);
+        }
+        self->i2c_txn = machine_i2c_txn_get(txn);
+        self->data_len = self->i2c_txn->rd_total;
+    }
+    else if (mp_obj_is_type(bus, &machine_hw_spi_type)) {
+        machine_spi_check_master(bus);
+        size_t n = 0;
+        mp_obj_t *items;
+        mp_obj_get_array(txn, &n, &items);
+        if (n != 2) {
+            mp_raise_ValueError("SPI transaction must be (wr_data, rd_len)");
+        }
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(items[0], &bufinfo, MP_BUFFER_READ);
+        int rd_len = mp_obj_get_int(items[1]);
+        if ((bufinfo.len > 0xFFFF) || (rd_len < 0) || (rd_len > 0xFFFF)) {
+            mp_raise_ValueError("SPI transaction too long");
+        }
+        // keep the copy of the data to write, in SPI bit order
+        uint8_t *wr = m_new(uint8_t, bufinfo.len + 1);
+        memcpy(wr, bufinfo.buf, bufinfo.len);
+        machine_spi_bit_order(bus, wr, bufinfo.len);
+        txn = mp_obj_new_bytearray_by_ref(bufinfo.len, wr);
+        self->spi_wr = wr;
+        self->spi_wr_len = bufinfo.len;
+        self->data_len = rd_len;
+    }
+    else {
+        mp_raise_TypeError("I2C or SPI object expected");
+    }
+    if (self->data_len == 0) {
+        mp_raise_ValueError("Transaction does not read any data");
+    }
+    self->bus = bus;
+    self->txn = txn;
+    self->period = args[ARG_period].u_int;
+    self->size = args[ARG_size].u_int;
+    self->rec_size = (4 + self->data_len + 3) & ~3;
+
+    self->ring = pvPortMalloc(self->size * self->rec_size);
+    if (self->ring == NULL) {
+        mp_raise_msg(&mp_type_MemoryError, "Error allocating sampler buffer");
+    }
+    self->id = tmr;
+    mpy_timers_used[tmr] = (void *)self;
+
+    self->task_done = xSemaphoreCreateBinary();
+    if (self->task_done == NULL) {
+        sampler_deinit(self);
+        mp_raise_msg(&mp_type_MemoryError, "Error creating sampler semaphore");
+    }
+
+    BaseType_t res = xTaskCreate(
+            sampler_task,                           // function entry
+            "Sampler_task",                         // task name
+            SAMPLER_TASK_STACK_SIZE,                // stack_deepth
+            (void *)self,                           // function argument
+            SAMPLER_TASK_PRIORITY,                  // task priority
+            &self->task);                           // task handle
+    if (res != pdPASS) {
+        self->task = NULL;
+        sampler_deinit(self);
+        mp_raise_msg(&mp_type_OSError, "Error creating sampler task");
+    }
+
+    char timer_dev[16];
+    sprintf(timer_dev, "/dev/timer%d", tmr);
+    self->handle = io_open(timer_dev);
+    if (self->handle == 0) {
+        sampler_deinit(self);
+        mp_raise_ValueError("Error opening timer device");
+    }
+    timer_set_interval(self->handle, (size_t)self->period * 1000);
+    timer_set_on_tick(self->handle, machine_sampler_isr, (void *)self);
+    if (args[ARG_start].u_bool) {
+        timer_set_enable(self->handle, true);
+        self->running = true;
+    }
+    return self;
+}
+
+//------------------------------------------------------
+STATIC mp_obj_t machine_sampler_deinit(mp_obj_t self_in)
+{
+    sampler_deinit((machine_sampler_obj_t *)self_in);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_sampler_deinit_obj, machine_sampler_deinit);
+
+//-----------------------------------------------------
+STATIC mp_obj_t machine_sampler_start(mp_obj_t self_in)
+{
+    machine_sampler_obj_t *self = self_in;
+    sampler_check(self);
+
+    timer_set_enable(self->handle, true);
+    self->running = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_sampler_start_obj, machine_sampler_start);
+
+//----------------------------------------------------
+STATIC mp_obj_t machine_sampler_stop(mp_obj_t self_in)
+{
+    machine_sampler_obj_t *self = self_in;
+    sampler_check(self);
+
+    timer_set_enable(self->handle, false);
+    self->running = false;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_sampler_stop_obj, machine_sampler_stop);
+
+// Return the number of available samples
+//---------------------------------------------------
+STATIC mp_obj_t machine_sampler_any(mp_obj_t self_in)
+{
+    machine_sampler_obj_t *self = self_in;
+    sampler_check(self);
+
+    return mp_obj_new_int_from_uint(self->head - self->tail);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_sampler_any_obj, machine_sampler_any);
+
+// Copy up to 'max' available records to 'buf', remove them from the ring buffer
+//-------------------------------------------------------------------------------------
+static uint32_t sampler_drain(machine_sampler_obj_t *self, uint8_t *buf, uint32_t max)
+{
+    uint32_t n = self->head - self->tail;
+    if (n > max) n = max;
+    // read the records only after the head is read
+    __sync_synchronize();
+    uint32_t slot = self->tail % self->size;
+    uint32_t n1 = self->size - slot;
+    if (n1 > n) n1 = n;
+    memcpy(buf, self->ring + (slot * self->rec_size), n1 * self->rec_size);
+    if (n > n1) memcpy(buf + (n1 * self->rec_size), self->ring, (n - n1) * self->rec_size);
+    // records must be copied before the slots are released
+    __sync_synchronize();
+    self->tail += n;
+    return n;
+}
+
+// Read and remove all (or up to 'n') available records, return them as bytearray
+//------------------------------------------------------------------------
+STATIC mp_obj_t machine_sampler_read(size_t n_args, const mp_obj_t *args)
+{
+    machine_sampler_obj_t *self = args[0];
+    sampler_check(self);
+
+    uint32_t max = self->size;
+    if (n_args > 1) {
+        int n = mp_obj_get_int(args[1]);
+        if (n < 0) n = 0;
+        if (n < max) max = n;
+    }
+    uint32_t n = self->head - self->tail;
+    if (n > max) n = max;
+    uint8_t *buf = m_new(uint8_t, (n * self->rec_size) + 1);
+    n = sampler_drain(self, buf, n);
+    return mp_obj_new_bytearray_by_ref(n * self->rec_size, buf);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_sampler_read_obj, 1, 2, machine_sampler_read);
+
+// Read and remove as many records as fit into the buffer, return the number of records
+//-------------------------------------------------------------------------
+STATIC mp_obj_t machine_sampler_readinto(mp_obj_t self_in, mp_obj_t buf_in)
+{
+    machine_sampler_obj_t *self = self_in;
+    sampler_check(self);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_WRITE);
+    uint32_t n = sampler_drain(self, bufinfo.buf, bufinfo.len / self->rec_size);
+    return mp_obj_new_int_from_uint(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(machine_sampler_readinto_obj, machine_sampler_readinto);
+
+// Return (record_size, data_offset, data_length)
+//------------------------------------------------------
+STATIC mp_obj_t machine_sampler_record(mp_obj_t self_in)
+{
+    machine_sampler_obj_t *self = self_in;
+    sampler_check(self);
+
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int(self->rec_size);
+    tuple[1] = mp_obj_new_int(4);
+    tuple[2] = mp_obj_new_int(self->data_len);
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_sampler_record_obj, machine_sampler_record);
+
+// Return (samples, overruns, errors, missed), optionally reset the counters
+//-------------------------------------------------------------------------
+STATIC mp_obj_t machine_sampler_stats(size_t n_args, const mp_obj_t *args)
+{
+    machine_sampler_obj_t *self = args[0];
+    sampler_check(self);
+
+    mp_obj_t tuple[4];
+    tuple[0] = mp_obj_new_int_from_uint(self->samples);
+    tuple[1] = mp_obj_new_int_from_uint(self->overruns);
+    tuple[2] = mp_obj_new_int_from_uint(self->errors);
+    tuple[3] = mp_obj_new_int_from_uint(self->missed);
+    if ((n_args > 1) && (mp_obj_is_true(args[1]))) {
+        self->samples = 0;
+        self->overruns = 0;
+        self->errors = 0;
+        self->missed = 0;
+    }
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(machine_sampler_stats_obj, 1, 2, machine_sampler_stats);
+
+
+//===================================================================
+STATIC const mp_rom_map_elem_t machine_sampler_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),     MP_ROM_PTR(&machine_sampler_deinit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_deinit),      MP_ROM_PTR(&machine_sampler_deinit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_start),       MP_ROM_PTR(&machine_sampler_start_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop),        MP_ROM_PTR(&machine_sampler_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_any),         MP_ROM_PTR(&machine_sampler_any_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read),        MP_ROM_PTR(&machine_sampler_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto),    MP_ROM_PTR(&machine_sampler_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_record),      MP_ROM_PTR(&machine_sampler_record_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),       MP_ROM_PTR(&machine_sampler_stats_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(machine_sampler_locals_dict, machine_sampler_locals_dict_table);
+
+//===========================================
+const mp_obj_type_t machine_sampler_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Sampler,
+    .print = machine_sampler_print,
+    .make_new = machine_sampler_make_new,
+    .locals_dict = (mp_obj_dict_t*)&machine_sampler_locals_dict,
+};
@@ -66,6 +66,7 @@
 #include <math.h>
 
 #include "FreeRTOS.h"
+#include "semphr.h"
 #include "mpconfigport.h"
 
 #include "devices.h"
@@ -76,6 +77,7 @@
 #include "py/runtime.h"
 #include "py/obj.h"
 #include "py/objstr.h"
+#include "py/objlist.h"
 
 #include "modmachine.h"
 #include "mphalport.h"
@@ -88,6 +90,10 @@
 
 #define SPI_SLAVE_MUTEX_WAIT_TIME   20
 
+#define SPI_QUEUE_LENGTH            8       // maximal number of queued transactions per SPI bus
+#define SPI_QUEUE_MAX_SEGMENTS      8       // maximal number of tx buffers in one queued transaction
+#define SPI_QUEUE_TASK_STACK_SIZE   configMINIMAL_STACK_SIZE
+
 static const char *slave_err[12] = {
     "Ok",
     "Wrong command",
@@ -116,8 +122,26 @@ static const char *slave_commands[10] = {
     "Unknown",
 };
 
+// Queued transaction, executed by the SPI bus queue task
+typedef struct _spi_queue_txn_t {
+    machine_hw_spi_obj_t    *spi;
+    int8_t                  cs_gpio;                        // gpiohs used as software CS, -1 if not used
+    uint8_t                 nseg;                           // number of tx buffers
+    uint8_t                 *bounce;                        // allocated tx buffer, freed after the transfer
+    const uint8_t           *tx[SPI_QUEUE_MAX_SEGMENTS];
+    size_t                  tx_len[SPI_QUEUE_MAX_SEGMENTS];
+    uint8_t                 *rx;
+    size_t                  rx_len;
+} spi_queue_txn_t;
+
+typedef struct _spi_queue_bus_t {
+    QueueHandle_t           queue;
+    TaskHandle_t            task;
+} spi_queue_bus_t;
+
 static const char *TAG = "[SPI]";
 static machine_hw_spi_obj_t *slave_obj = NULL;
+static spi_queue_bus_t spi_queue_bus[2] = { 0 };
 
 
 static bool neopixel_show(machine_hw_spi_obj_t *self, bool test);
@@ -558,6 +582,12 @@ mp_obj_t machine_hw_spi_make_new(const mp_obj_type_t *type, size_t n_args, size_
     self->state = MACHINE_HW_SPI_STATE_NONE;
     self->slave_queue = NULL;
     self->slave_task = NULL;
+    self->queue_done_sem = NULL;
+    self->queue_queued = 0;
+    self->queue_done = 0;
+    self->queue_errors = 0;
+    self->queue_abort = false;
+    self->queue_refs = MP_OBJ_NULL;
 
     self->spi_num = args[ARG_id].u_int;
     if ((self->spi_num < 0) || (self->spi_num >= SPI_INTERFACE_MAX)) {
@@ -898,6 +928,336 @@ STATIC mp_obj_t machine_hw_spi_init(mp_uint_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(machine_hw_spi_init_obj, 0, machine_hw_spi_init);
 
+// ==== Queued transactions ===================================================================
+
+/*
+ * Transactions are queued to the SPI bus queue task and executed asynchronously,
+ * the transfers are performed by the SPI driver using DMA.
+ * SPI objects using the same SPI bus (with different CS) share the same queue,
+ * the transactions are executed in the order they were queued.
+ * All tx buffers of the transaction are transfered with CS active:
+ *  - if software CS (Pin) is used, the buffers are transfered one after another
+ *  - if hardware CS is used, the buffers are gathered into one DMA transfer
+ * The SPI objects with pending transactions are referenced from the instance's root pointers
+ * ('spi_queue_objs' list), so they and their buffers can't be collected while the queue task uses them.
+ */
+
+//------------------------------------------------------------------
+static bool spi_queue_transfer(spi_queue_txn_t *txn)
+{
+    machine_hw_spi_obj_t *self = txn->spi;
+    int last = txn->nseg - 1;
+    int ret = 1;
+
+    if (txn->cs_gpio >= 0) gpio_set_pin_value(gpiohs_handle, txn->cs_gpio, GPIO_PV_LOW);
+    for (int i=0; (i<last) && (ret > 0); i++) {
+        ret = io_write(self->spi_device, txn->tx[i], txn->tx_len[i]);
+    }
+    if (ret > 0) {
+        if (last >= 0) ret = machine_spi_transfer(self, txn->tx[last], txn->tx_len[last], txn->rx, txn->rx_len);
+        else ret = machine_spi_transfer(self, NULL, 0, txn->rx, txn->rx_len);
+    }
+    if (txn->cs_gpio >= 0) gpio_set_pin_value(gpiohs_handle, txn->cs_gpio, GPIO_PV_HIGH);
+    return (ret > 0);
+}
+
+//============================================
+static void spi_queue_task(void *pvParameters)
+{
+    spi_queue_bus_t *bus = (spi_queue_bus_t *)pvParameters;
+    spi_queue_txn_t txn;
+
+    while (1) {
+        if (xQueueReceive(bus->queue, &txn, portMAX_DELAY) != pdTRUE) continue;
+
+        machine_hw_spi_obj_t *self = txn.spi;
+        // the transactions of the SPI being deinitialized are not executed, only completed
+        bool ok = (self->queue_abort) ? false : spi_queue_transfer(&txn);
+        if (txn.bounce) vPortFree(txn.bounce);
+        if (!ok) self->queue_errors++;
+        // received data must be complete before the transaction is reported as done
+        __sync_synchronize();
+        // the SPI object is not accessed after it is seen as idle, see spi_queue_idle()
+        taskENTER_CRITICAL();
+        self->queue_done++;
+        xSemaphoreGive(self->queue_done_sem);
+        taskEXIT_CRITICAL();
+    }
+}
+
+// Returns true if all queued transactions are finished and the queue task is done with the SPI object
+//----------------------------------------------------
+static bool spi_queue_idle(machine_hw_spi_obj_t *self)
+{
+    taskENTER_CRITICAL();
+    bool idle = (self->queue_done == self->queue_queued);
+    taskEXIT_CRITICAL();
+    return idle;
+}
+
+// Remove the SPI objects without pending transactions from the root pointers list
+// and add 'self' if it is not NULL
+//----------------------------------------------------
+static void spi_queue_root(machine_hw_spi_obj_t *self)
+{
+    if (MP_STATE_PORT(spi_queue_objs) == MP_OBJ_NULL) {
+        if (self == NULL) return;
+        MP_STATE_PORT(spi_queue_objs) = mp_obj_new_list(0, NULL);
+    }
+    mp_obj_list_t *list = MP_OBJ_TO_PTR(MP_STATE_PORT(spi_queue_objs));
+    bool found = false;
+    size_t n = 0;
+    for (size_t i = 0; i < list->len; i++) {
+        machine_hw_spi_obj_t *spi = MP_OBJ_TO_PTR(list->items[i]);
+        if (spi == self) found = true;
+        else if (spi_queue_idle(spi)) continue;
+        list->items[n++] = list->items[i];
+    }
+    for (size_t i = n; i < list->len; i++) {
+        list->items[i] = MP_OBJ_NULL;
+    }
+    list->len = n;
+    if ((self) && (!found)) mp_obj_list_append(MP_STATE_PORT(spi_queue_objs), MP_OBJ_FROM_PTR(self));
+}
+
+// Wait until all queued transactions are finished, must be called without GIL
+//-------------------------------------------------------------------------------
+static bool spi_queue_wait(machine_hw_spi_obj_t *self, TickType_t ticks_to_wait)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait = ticks_to_wait;
+    while (self->queue_done != self->queue_queued) {
+        xSemaphoreTake(self->queue_done_sem, wait);
+        if (ticks_to_wait != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= ticks_to_wait) break;
+            wait = ticks_to_wait - elapsed;
+        }
+    }
+    return spi_queue_idle(self);
+}
+
+// Abort the pending queued transactions, the one in progress is finished.
+// The queue task must be done with all of them before the semaphore and buffers are released
+//-----------------------------------------------------
+static void spi_queue_abort(machine_hw_spi_obj_t *self)
+{
+    if (spi_queue_idle(self)) return;
+    self->queue_abort = true;
+    MP_THREAD_GIL_EXIT();
+    spi_queue_wait(self, portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+    self->queue_abort = false;
+}
+
+// Called on MicroPython instance's soft reset, before the heap is initialized
+// The pending transactions of the instance's SPI objects are aborted,
+// the queue task must not access the objects and buffers after the heap is reinitialized
+//===================================
+void machine_hw_spi_queue_reset(void)
+{
+    if (MP_STATE_PORT(spi_queue_objs) != MP_OBJ_NULL) {
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_list_get(MP_STATE_PORT(spi_queue_objs), &n, &items);
+        for (size_t i = 0; i < n; i++) {
+            machine_hw_spi_obj_t *spi = MP_OBJ_TO_PTR(items[i]);
+            if (spi_queue_idle(spi)) continue;
+            spi->queue_abort = true;
+            spi_queue_wait(spi, portMAX_DELAY);
+            spi->queue_abort = false;
+        }
+    }
+    MP_STATE_PORT(spi_queue_objs) = MP_OBJ_NULL;
+}
+
+// Create the SPI bus queue and task if not yet created
+//----------------------------------------------------------
+static void spi_queue_init(machine_hw_spi_obj_t *self)
+{
+    spi_queue_bus_t *bus = &spi_queue_bus[self->spi_num & 1];
+    if (self->queue_done_sem == NULL) {
+        self->queue_done_sem = xSemaphoreCreateBinary();
+        if (self->queue_done_sem == NULL) {
+            mp_raise_msg(&mp_type_OSError, "Error creating SPI queue semaphore");
+        }
+    }
+    if (bus->queue == NULL) {
+        bus->queue = xQueueCreate(SPI_QUEUE_LENGTH, sizeof(spi_queue_txn_t));
+        if (bus->queue == NULL) {
+            mp_raise_msg(&mp_type_OSError, "Error creating SPI queue");
+        }
+    }
+    if (bus->task == NULL) {
+        BaseType_t res = xTaskCreate(
+                spi_queue_task,                         // function entry
+                "SPI_queue_task",                       // task name
+                SPI_QUEUE_TASK_STACK_SIZE,              // stack_deepth
+                (void *)bus,                            // function argument
+                MICROPY_TASK_PRIORITY+1,                // task priority
+                &bus->task);                            // task handle
+        if (res != pdPASS) {
+            bus->task = NULL;
+            mp_raise_msg(&mp_type_OSError, "Error creating SPI queue task");
+        }
+    }
+}
+
+/*
+ * Queue the SPI transaction, returns immediately (if the queue is not full)
+ *   tx: buffer or list of buffers to write, or None
+ *   rx: buffer to read into, or None; read while writing the last tx buffer
+ *       in duplex mode, after writing in half-duplex mode
+ *   cs: Pin object used as software CS (active low), if not given the hardware CS is used
+ * The buffers must not be changed until the transaction is finished (SPI.wait())
+ * Returns the number of transactions still pending
+ */
+//---------------------------------------------------------------------------------------------
+STATIC mp_obj_t mp_machine_spi_queue(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_tx, ARG_rx, ARG_cs };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_tx,   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_rx,                     MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_cs,   MP_ARG_KW_ONLY  | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    machine_hw_spi_obj_t *self = pos_args[0];
+    checkSPImaster(self);
+    if (self->spi_num > SPI_MASTER_1) {
+        mp_raise_msg(&mp_type_OSError, "SPI not in master mode");
+    }
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args-1, pos_args+1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    spi_queue_txn_t txn = { 0 };
+    txn.spi = self;
+    txn.cs_gpio = -1;
+    mp_buffer_info_t bufinfo;
+    size_t tx_total = 0;
+
+    // Get tx buffers
+    if (args[ARG_tx].u_obj != mp_const_none) {
+        size_t n = 1;
+        mp_obj_t *items = &args[ARG_tx].u_obj;
+        if ((mp_obj_is_type(args[ARG_tx].u_obj, &mp_type_list)) || (mp_obj_is_type(args[ARG_tx].u_obj, &mp_type_tuple))) {
+            mp_obj_get_array(args[ARG_tx].u_obj, &n, &items);
+            if (n > SPI_QUEUE_MAX_SEGMENTS) {
+                mp_raise_ValueError("Too many tx buffers (max 8)");
+            }
+        }
+        for (int i=0; i<n; i++) {
+            mp_get_buffer_raise(items[i], &bufinfo, MP_BUFFER_READ);
+            if (bufinfo.len == 0) continue;
+            txn.tx[txn.nseg] = bufinfo.buf;
+            txn.tx_len[txn.nseg] = bufinfo.len;
+            txn.nseg++;
+            tx_total += bufinfo.len;
+        }
+    }
+    // Get rx buffer
+    if (args[ARG_rx].u_obj != mp_const_none) {
+        mp_get_buffer_raise(args[ARG_rx].u_obj, &bufinfo, MP_BUFFER_WRITE);
+        txn.rx = bufinfo.buf;
+        txn.rx_len = bufinfo.len;
+    }
+    if ((tx_total == 0) && (txn.rx_len == 0)) {
+        mp_raise_ValueError("Nothing to transfer");
+    }
+    // Get software CS
+    if (args[ARG_cs].u_obj != mp_const_none) {
+        if (!mp_obj_is_type(args[ARG_cs].u_obj, &machine_pin_type)) {
+            mp_raise_TypeError("cs must be Pin object");
+        }
+        txn.cs_gpio = ((machine_pin_obj_t *)args[ARG_cs].u_obj)->gpio;
+        if (txn.cs_gpio < 0) {
+            mp_raise_ValueError("cs Pin not initialized");
+        }
+    }
+
+    spi_queue_init(self);
+
+    // Gather tx buffers into one buffer if needed
+    if ((tx_total > 0) && (((txn.nseg > 1) && (txn.cs_gpio < 0)) || (self->firstbit == MICROPY_PY_MACHINE_SPI_LSB))) {
+        txn.bounce = pvPortMalloc(tx_total);
+        if (txn.bounce == NULL) {
+            mp_raise_msg(&mp_type_MemoryError, "Error allocating SPI buffer");
+        }
+        size_t offset = 0;
+        for (int i=0; i<txn.nseg; i++) {
+            memcpy(txn.bounce + offset, txn.tx[i], txn.tx_len[i]);
+            offset += txn.tx_len[i];
+        }
+        if (self->firstbit == MICROPY_PY_MACHINE_SPI_LSB) reverse(txn.bounce, tx_total);
+        txn.tx[0] = txn.bounce;
+        txn.tx_len[0] = tx_total;
+        txn.nseg = 1;
+    }
+
+    // Keep the used buffers referenced until the transaction is finished
+    if (self->queue_refs == MP_OBJ_NULL) self->queue_refs = mp_obj_new_list(0, NULL);
+    mp_obj_list_append(self->queue_refs, args[ARG_tx].u_obj);
+    mp_obj_list_append(self->queue_refs, args[ARG_rx].u_obj);
+
+    // Keep the SPI object referenced until all its transactions are finished
+    spi_queue_root(self);
+
+    self->queue_queued++;
+    MP_THREAD_GIL_EXIT();
+    xQueueSend(spi_queue_bus[self->spi_num & 1].queue, &txn, portMAX_DELAY);
+    MP_THREAD_GIL_ENTER();
+
+    return mp_obj_new_int_from_uint(self->queue_queued - self->queue_done);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mp_machine_spi_queue_obj, 2, mp_machine_spi_queue);
+
+/*
+ * Wait until all queued transactions are finished
+ *   timeout: maximal time to wait in ms, -1 (default) waits forever
+ * Returns False on timeout, True if all transactions are finished
+ * Raises an exception if any of the transactions failed
+ */
+//------------------------------------------------------------------------
+STATIC mp_obj_t mp_machine_spi_wait(size_t n_args, const mp_obj_t *args)
+{
+    machine_hw_spi_obj_t *self = args[0];
+    checkSPImaster(self);
+
+    TickType_t ticks_to_wait = portMAX_DELAY;
+    if (n_args > 1) {
+        int tmo = mp_obj_get_int(args[1]);
+        if (tmo >= 0) ticks_to_wait = tmo / portTICK_PERIOD_MS;
+    }
+
+    if (!spi_queue_idle(self)) {
+        MP_THREAD_GIL_EXIT();
+        bool idle = spi_queue_wait(self, ticks_to_wait);
+        MP_THREAD_GIL_ENTER();
+        if (!idle) return mp_const_false;
+    }
+
+    // all finished, release the buffers and the SPI object
+    self->queue_refs = MP_OBJ_NULL;
+    spi_queue_root(NULL);
+    uint32_t errors = self->queue_errors;
+    self->queue_errors = 0;
+    if (errors) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "%u queued SPI transaction(s) failed", errors));
+    }
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_machine_spi_wait_obj, 1, 2, mp_machine_spi_wait);
+
+// Return the number of pending queued transactions
+//---------------------------------------------------------
+STATIC mp_obj_t mp_machine_spi_pending(mp_obj_t self_in)
+{
+    machine_hw_spi_obj_t *self = self_in;
+    return mp_obj_new_int_from_uint(self->queue_queued - self->queue_done);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_machine_spi_pending_obj, mp_machine_spi_pending);
+
 //-----------------------------------------------------
 STATIC mp_obj_t machine_hw_spi_deinit(mp_obj_t self_in)
 {
@@ -905,6 +1265,8 @@ STATIC mp_obj_t machine_hw_spi_deinit(mp_obj_t self_in)
     if (self->state != MACHINE_HW_SPI_STATE_INIT) {
         mp_raise_msg(&mp_type_OSError, "SPI not initialized");
     }
+    // stop the samplers using this bus
+    machine_sampler_bus_deinit(self);
 
     if (self->spi_num == SPI_SLAVE) {
         spi_slave_deinit(self->handle);
@@ -926,6 +1288,14 @@ STATIC mp_obj_t machine_hw_spi_deinit(mp_obj_t self_in)
         }
     }
 
+    spi_queue_abort(self);
+    if (self->queue_done_sem) {
+        vSemaphoreDelete(self->queue_done_sem);
+        self->queue_done_sem = NULL;
+    }
+    self->queue_refs = MP_OBJ_NULL;
+    spi_queue_root(NULL);
+
     io_close(self->handle);
     self->handle = 0;
     spi_hard_deinit(self);
@@ -941,6 +1311,46 @@ STATIC mp_obj_t machine_hw_spi_deinit(mp_obj_t self_in)
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(machine_hw_spi_deinit_obj, machine_hw_spi_deinit);
 
 
+// ==== Master transfer for use from C, no GIL needed ====
+
+// Check if the object is initialized SPI master, raise exception if not
+//------------------------------------------------
+void machine_spi_check_master(mp_obj_t spi_in)
+{
+    if (!mp_obj_is_type(spi_in, &machine_hw_spi_type)) {
+        mp_raise_TypeError("SPI object expected");
+    }
+    checkSPImaster((machine_hw_spi_obj_t *)spi_in);
+}
+
+// Convert the data to be written to the SPI bit order
+//--------------------------------------------------------------------
+void machine_spi_bit_order(mp_obj_t spi_in, uint8_t *buf, size_t len)
+{
+    machine_hw_spi_obj_t *self = spi_in;
+    if (self->firstbit == MICROPY_PY_MACHINE_SPI_LSB) reverse(buf, len);
+}
+
+/*
+ * Write 'wr_len' bytes (already in SPI bit order), then read 'rd_len' bytes
+ * in the same transaction (full duplex: read while writing)
+ * Returns the number of bytes read or written, <= 0 on error
+ */
+//----------------------------------------------------------------------------------------------------------------
+int machine_spi_transfer(mp_obj_t spi_in, const uint8_t *wr, size_t wr_len, uint8_t *rd, size_t rd_len)
+{
+    machine_hw_spi_obj_t *self = spi_in;
+    int ret;
+
+    if (rd_len == 0) return io_write(self->spi_device, wr, wr_len);
+    if (wr_len == 0) ret = io_read(self->spi_device, rd, rd_len);
+    else if (self->duplex) ret = spi_dev_transfer_full_duplex(self->spi_device, wr, wr_len, rd, rd_len);
+    else ret = spi_dev_transfer_sequential(self->spi_device, wr, wr_len, rd, rd_len);
+
+    if ((ret > 0) && (self->firstbit == MICROPY_PY_MACHINE_SPI_LSB)) reverse(rd, rd_len);
+    return ret;
+}
+
 //----------------------------------------------------------------------
 STATIC mp_obj_t mp_machine_spi_read(size_t n_args, const mp_obj_t *args)
 {
@@ -1790,6 +2200,9 @@ STATIC const mp_rom_map_elem_t machine_spi_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_write),               (mp_obj_t)&mp_machine_spi_write_obj },
     { MP_ROM_QSTR(MP_QSTR_write_readinto),      (mp_obj_t)&mp_machine_spi_write_readinto_obj },
     { MP_ROM_QSTR(MP_QSTR_slave_cmd),           (mp_obj_t)&mp_machine_spi_slavecmd_obj },
+    { MP_ROM_QSTR(MP_QSTR_queue),               (mp_obj_t)&mp_machine_spi_queue_obj },
+    { MP_ROM_QSTR(MP_QSTR_wait),                (mp_obj_t)&mp_machine_spi_wait_obj },
+    { MP_ROM_QSTR(MP_QSTR_pending),             (mp_obj_t)&mp_machine_spi_pending_obj },
 
     // Slave methods
     { MP_ROM_QSTR(MP_QSTR_setdata),             (mp_obj_t)&mp_machine_spi_slave_setdata_obj },
@@ -85,6 +85,7 @@ static void uart_on_irq_recv(void *userdata)
     mpy_uarts[*nuart].irq_flag = true;
     uart_ringbuf_t *r = mpy_uarts[*nuart].uart_buf;
     uint8_t c;
+    bool frame_end = false;
 
     while (uart[*nuart]->LSR & 1) {
         c = (uint8_t)(uart[*nuart]->RBR & 0xff);
@@ -93,12 +94,17 @@ static void uart_on_irq_recv(void *userdata)
                 r->buf[r->tail] = c;
                 r->tail = (r->tail + 1) % r->size;
                 r->length++;
+                if ((r->frame_mode) && (c == r->frame_char)) {
+                    r->frame_length = r->length;
+                    frame_end = true;
+                }
             }
             else r->overflow++;
         }
         else r->overflow++;
     }
     mpy_uarts[*nuart].irq_flag = false;
+    if ((r->frame_mode) && (!frame_end) && (r->length < (r->size / 2))) return;
     if ((mpy_uarts[*nuart].task_semaphore) && (r->notify)) {
         BaseType_t xHigherPriorityTaskWoken = pdFALSE;
         xSemaphoreGiveFromISR(mpy_uarts[*nuart].task_semaphore, &xHigherPriorityTaskWoken);
@@ -189,6 +195,7 @@ int uart_buf_get(uart_ringbuf_t *r, uint8_t *dest, size_t len)
 
     if (r->uart_num < UART_NUM_MAX) taskENTER_CRITICAL();
     r->length -= cnt;
+    r->frame_length = (r->frame_length > cnt) ? (r->frame_length - cnt) : 0;
     if (r->uart_num < UART_NUM_MAX) taskEXIT_CRITICAL();
 
     return cnt;
@@ -214,6 +221,7 @@ int uart_buf_remove(uart_ringbuf_t *r, size_t len)
 
     if (r->uart_num < UART_NUM_MAX) taskENTER_CRITICAL();
     r->length -= cnt;
+    r->frame_length = (r->frame_length > cnt) ? (r->frame_length - cnt) : 0;
     if (r->uart_num < UART_NUM_MAX) taskEXIT_CRITICAL();
 
     return cnt;
@@ -339,6 +347,7 @@ void uart_buf_flush(uart_ringbuf_t *r)
         r->length = 0;
         r->overflow = 0;
     }
+    r->frame_length = 0;
     if (r->uart_num < UART_NUM_MAX) taskEXIT_CRITICAL();
 }
 
@@ -380,6 +389,8 @@ void uart_ringbuf_alloc(uint8_t uart_num, size_t sz)
     mpy_uarts[uart_num].uart_buffer.length = 0;
     mpy_uarts[uart_num].uart_buffer.uart_num = uart_num;
     mpy_uarts[uart_num].uart_buffer.notify = false;
+    mpy_uarts[uart_num].uart_buffer.frame_mode = false;
+    mpy_uarts[uart_num].uart_buffer.frame_length = 0;
     mpy_uarts[uart_num].uart_buf = &mpy_uarts[uart_num].uart_buffer;
 }
 
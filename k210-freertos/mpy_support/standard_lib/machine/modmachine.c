@@ -438,6 +438,43 @@ STATIC mp_obj_t mod_machine_log_level(mp_obj_t level_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_machine_log_level_obj, mod_machine_log_level);
 
+/*
+ * Get or set the log mode
+ * LOG_PRINT:  log messages are formatted and printed immediately
+ * LOG_STREAM: binary log entries are recorded and sent by a low priority task,
+ *             use 'logdecode.py' on the host to decode them
+ * LOG_BUFFER: binary log entries are only recorded in RAM, the oldest entries are overwritten,
+ *             the buffer is sent on fatal error or can be read with 'machine.logbuffer()'
+ */
+//-----------------------------------------------------------------
+STATIC mp_obj_t mod_machine_log_mode(size_t n_args, const mp_obj_t *args)
+{
+    if (n_args > 0) {
+        int32_t mode = mp_obj_get_int(args[0]);
+        if ((mode < SYSLOG_DEFERRED_OFF) || (mode > SYSLOG_DEFERRED_BUFFER)) {
+            mp_raise_ValueError("Log mode LOG_PRINT, LOG_STREAM or LOG_BUFFER expected");
+        }
+        if (syslog_deferred_mode(mode) != mode) {
+            mp_raise_msg(&mp_type_OSError, "Error starting log task");
+        }
+    }
+    return mp_obj_new_int(user_log_deferred);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_machine_log_mode_obj, 0, 1, mod_machine_log_mode);
+
+// Returns the recorded binary log entries of both processors as bytes object
+//--------------------------------------
+STATIC mp_obj_t mod_machine_log_buffer()
+{
+    vstr_t vstr;
+    vstr_init_len(&vstr, SYSLOG_DEFERRED_BUFFER_SIZE * 2);
+    size_t len = syslog_deferred_get(0, (uint8_t *)vstr.buf, SYSLOG_DEFERRED_BUFFER_SIZE);
+    len += syslog_deferred_get(1, (uint8_t *)vstr.buf + len, SYSLOG_DEFERRED_BUFFER_SIZE);
+    vstr.len = len;
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_machine_log_buffer_obj, mod_machine_log_buffer);
+
 //-------------------------------------------------------------------
 STATIC mp_obj_t mod_machine_crc8(size_t n_args, const mp_obj_t *args)
 {
@@ -516,9 +553,48 @@ STATIC mp_obj_t mod_machine_baudrate(size_t n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_machine_baudrate_obj, 0, 1, mod_machine_baudrate);
 
+/*
+ * Get the REPL/log output buffer status, optionally set the policy used when the buffer is full
+ * Returns tuple: (policy, buffer_size, pending_bytes, max_used_bytes, dropped_bytes)
+ */
+//-----------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_machine_repl_output(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_policy, ARG_reset };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_policy,   MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+        { MP_QSTR_reset,    MP_ARG_KW_ONLY | MP_ARG_BOOL, { .u_bool = false } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[ARG_policy].u_obj != mp_const_none) {
+        int policy = mp_obj_get_int(args[ARG_policy].u_obj);
+        if ((policy != UARTHS_TX_BLOCK) && (policy != UARTHS_TX_DROP)) {
+            mp_raise_ValueError("Policy REPL_BLOCK or REPL_DROP expected");
+        }
+        uarths_tx_policy = policy;
+    }
+
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_int(uarths_tx_policy);
+    tuple[1] = mp_obj_new_int(MICRO_PY_UARTHS_TX_BUFFER_SIZE);
+    tuple[2] = mp_obj_new_int(uarths_tx_pending());
+    tuple[3] = mp_obj_new_int_from_uint(uarths_tx_max_used);
+    tuple[4] = mp_obj_new_int_from_uint(uarths_tx_dropped);
+    if (args[ARG_reset].u_bool) {
+        uarths_tx_max_used = 0;
+        uarths_tx_dropped = 0;
+    }
+    return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_machine_repl_output_obj, 0, mod_machine_repl_output);
+
 //---------------------------------
 STATIC mp_obj_t machine_reset(void)
 {
+    // send the buffered output before reset
+    uarths_flush();
     sysctl->soft_reset.soft_reset = 1; // This function does not return.
     while (1) {
         ;
@@ -1035,11 +1111,14 @@ STATIC const mp_map_elem_t machine_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_reset_reason),    MP_ROM_PTR(&mod_machine_reset_reason_obj) },
     { MP_ROM_QSTR(MP_QSTR_pinstat),         MP_ROM_PTR(&machine_pinstat_obj) },
     { MP_ROM_QSTR(MP_QSTR_loglevel),        MP_ROM_PTR(&mod_machine_log_level_obj) },
+    { MP_ROM_QSTR(MP_QSTR_logmode),         MP_ROM_PTR(&mod_machine_log_mode_obj) },
+    { MP_ROM_QSTR(MP_QSTR_logbuffer),       MP_ROM_PTR(&mod_machine_log_buffer_obj) },
     { MP_ROM_QSTR(MP_QSTR_crc8),            MP_ROM_PTR(&mod_machine_crc8_obj) },
     { MP_ROM_QSTR(MP_QSTR_crc16),           MP_ROM_PTR(&mod_machine_crc16_obj) },
     { MP_ROM_QSTR(MP_QSTR_crc32),           MP_ROM_PTR(&mod_machine_crc32_obj) },
     { MP_ROM_QSTR(MP_QSTR_base64enc),       MP_ROM_PTR(&mod_machine_base64_obj) },
     { MP_ROM_QSTR(MP_QSTR_repl_baudrate),   MP_ROM_PTR(&mod_machine_baudrate_obj) },
+    { MP_ROM_QSTR(MP_QSTR_repl_output),     MP_ROM_PTR(&mod_machine_repl_output_obj) },
     { MP_ROM_QSTR(MP_QSTR_wdt),             MP_ROM_PTR(&mod_machine_wdt_obj) },
     { MP_ROM_QSTR(MP_QSTR_wdt_reset),       MP_ROM_PTR(&mod_machine_wdt_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR_fsdebug),         MP_ROM_PTR(&mod_machine_fsdebug_obj) },
@@ -1060,6 +1139,7 @@ STATIC const mp_map_elem_t machine_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_I2C),             MP_ROM_PTR(&machine_hw_i2c_type) },
     { MP_ROM_QSTR(MP_QSTR_SPI),             MP_ROM_PTR(&machine_hw_spi_type) },
     { MP_ROM_QSTR(MP_QSTR_Timer),           MP_ROM_PTR(&machine_timer_type) },
+    { MP_ROM_QSTR(MP_QSTR_Sampler),         MP_ROM_PTR(&machine_sampler_type) },
     { MP_ROM_QSTR(MP_QSTR_PWM),             MP_ROM_PTR(&machine_pwm_type) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_Onewire),     MP_ROM_PTR(&machine_onewire_type) },
 
@@ -1070,6 +1150,11 @@ STATIC const mp_map_elem_t machine_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_LOG_INFO),        MP_ROM_INT(LOG_INFO) },
     { MP_ROM_QSTR(MP_QSTR_LOG_DEBUG),       MP_ROM_INT(LOG_DEBUG) },
     { MP_ROM_QSTR(MP_QSTR_LOG_VERBOSE),     MP_ROM_INT(LOG_VERBOSE) },
+    { MP_ROM_QSTR(MP_QSTR_LOG_PRINT),       MP_ROM_INT(SYSLOG_DEFERRED_OFF) },
+    { MP_ROM_QSTR(MP_QSTR_LOG_STREAM),      MP_ROM_INT(SYSLOG_DEFERRED_STREAM) },
+    { MP_ROM_QSTR(MP_QSTR_LOG_BUFFER),      MP_ROM_INT(SYSLOG_DEFERRED_BUFFER) },
+    { MP_ROM_QSTR(MP_QSTR_REPL_BLOCK),      MP_ROM_INT(UARTHS_TX_BLOCK) },
+    { MP_ROM_QSTR(MP_QSTR_REPL_DROP),       MP_ROM_INT(UARTHS_TX_DROP) },
 };
 
 //===========================
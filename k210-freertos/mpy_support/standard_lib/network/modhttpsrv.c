@@ -0,0 +1,1193 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Http server implemented in C
+ *
+ * Requests are parsed by http_parser, static files are sent directly from the file system,
+ * only the requests for registered routes are passed to the Python handler functions.
+ * The connections upgraded to WebSocket are passed to the handler as 'network.WebSocket' objects.
+ * Multiple connections and keep-alive are handled in one loop,
+ * running in the thread which executes 'HTTPServer.serve()'.
+ * Works with WiFi (ESP8266/ESP8285) and lwIP interfaces.
+ */
+
+#include "mpconfigport.h"
+
+#if MICROPY_PY_USE_HTTPSERVER
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "syslog.h"
+
+#include "at_util.h"
+#include "http_parser.h"
+#include "lwip/sockets.h"
+
+#include "py/runtime.h"
+#include "py/objstr.h"
+#include "py/objtuple.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "extmod/vfs.h"
+#include "mphalport.h"
+#include "mpthreadport.h"
+
+#define HTTPSRV_MAX_CONN            4
+#define HTTPSRV_RX_BUF_SIZE         1024
+#define HTTPSRV_TX_BUF_SIZE         2048
+#define HTTPSRV_MAX_URL_LEN         255
+#define HTTPSRV_MAX_HEADERS_LEN     1024
+#define HTTPSRV_MAX_BODY_LEN        16384
+#define HTTPSRV_MAX_PATH_LEN        160
+#define HTTPSRV_SEND_TIMEOUT        5000
+#define HTTPSRV_IDLE_WAIT           (2 / portTICK_PERIOD_MS)
+#define HTTPSRV_SERVER_NAME         "K210 MicroPython"
+#define HTTPSRV_WS_MAX_MSG          4096
+
+extern const mp_obj_module_t mp_module_usocket;
+extern const mp_obj_module_t mp_module_thread;
+void _socket_settimeout(socket_obj_t *sock, uint64_t timeout_ms);
+bool websocket_accept_key(const char *key, char *accept, int accept_len);
+mp_obj_t websocket_new(mp_obj_t sock, bool server, size_t max_msg, const uint8_t *pending, size_t pending_len);
+
+typedef struct _httpsrv_conn_t {
+    mp_obj_t        sock;                   // client socket, MP_OBJ_NULL if not used
+    http_parser     parser;
+    uint64_t        last_active;
+    uint16_t        error;                  // http status of the error detected while parsing
+    bool            complete;               // complete request received
+    bool            gzip;                   // client accepts gzip encoding
+    bool            in_value;               // last received header part was the value
+    size_t          rx_len;                 // not yet parsed data in rx_buf
+    size_t          url_len;
+    size_t          hdr_len;
+    size_t          max_body;
+    vstr_t          body;
+    char            url[HTTPSRV_MAX_URL_LEN+1];
+    char            hdr[HTTPSRV_MAX_HEADERS_LEN];   // header field and value pairs, zero terminated
+    char            rx_buf[HTTPSRV_RX_BUF_SIZE];
+} httpsrv_conn_t;
+
+typedef struct _httpsrv_obj_t {
+    mp_obj_base_t   base;
+    mp_obj_t        sock;                   // listening socket
+    mp_obj_t        routes;                 // list of (path, handler, method, content_type) tuples
+    int             port;
+    int             max_conn;
+    uint32_t        keepalive;              // connection idle timeout in ms
+    size_t          max_body;
+    volatile bool   running;
+    volatile bool   stop;
+    uint32_t        requests;
+    uint32_t        files;
+    uint32_t        handled;
+    uint32_t        errors;
+    char            root[64];
+    char            *tx_buf;
+    httpsrv_conn_t  *conn;
+} httpsrv_obj_t;
+
+typedef struct _httpsrv_mime_t {
+    const char *ext;
+    const char *type;
+} httpsrv_mime_t;
+
+static const httpsrv_mime_t mime_types[] = {
+    { ".html",  "text/html" },
+    { ".htm",   "text/html" },
+    { ".css",   "text/css" },
+    { ".js",    "application/javascript" },
+    { ".json",  "application/json" },
+    { ".txt",   "text/plain" },
+    { ".csv",   "text/csv" },
+    { ".xml",   "application/xml" },
+    { ".xhtml", "application/xhtml+xml" },
+    { ".png",   "image/png" },
+    { ".jpg",   "image/jpeg" },
+    { ".jpeg",  "image/jpeg" },
+    { ".gif",   "image/gif" },
+    { ".svg",   "image/svg+xml" },
+    { ".ico",   "image/x-icon" },
+    { ".zip",   "application/zip" },
+    { ".pdf",   "application/pdf" },
+    { NULL,     "application/octet-stream" },
+};
+
+static const qstr request_fields[] = {
+    MP_QSTR_method, MP_QSTR_path, MP_QSTR_query, MP_QSTR_headers, MP_QSTR_body, MP_QSTR_addr
+};
+
+static const char *TAG = "[HTTPSRV]";
+
+const mp_obj_type_t httpserver_type;
+
+
+// ==== Request parsing =====================================================
+
+//-----------------------------------------------------------------------
+static bool _hdr_add(httpsrv_conn_t *conn, const char *at, size_t length)
+{
+    // keep space for the terminating zero
+    if ((conn->hdr_len + length + 1) >= HTTPSRV_MAX_HEADERS_LEN) {
+        conn->error = 431;
+        return false;
+    }
+    memcpy(conn->hdr + conn->hdr_len, at, length);
+    conn->hdr_len += length;
+    return true;
+}
+
+//--------------------------------------------------
+static int http_on_message_begin(http_parser *parser)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    conn->url_len = 0;
+    conn->hdr_len = 0;
+    conn->body.len = 0;
+    conn->error = 0;
+    conn->gzip = false;
+    conn->in_value = false;
+    conn->complete = false;
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+static int http_on_url(http_parser *parser, const char *at, size_t length)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    if ((conn->url_len + length) > HTTPSRV_MAX_URL_LEN) {
+        conn->error = 414;
+        return 1;
+    }
+    memcpy(conn->url + conn->url_len, at, length);
+    conn->url_len += length;
+    conn->url[conn->url_len] = '\0';
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+static int http_on_header_field(http_parser *parser, const char *at, size_t length)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    if (conn->in_value) {
+        // terminate the previous value
+        conn->hdr[conn->hdr_len++] = '\0';
+        conn->in_value = false;
+    }
+    return (_hdr_add(conn, at, length)) ? 0 : 1;
+}
+
+//----------------------------------------------------------------------------------
+static int http_on_header_value(http_parser *parser, const char *at, size_t length)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    if (!conn->in_value) {
+        // terminate the field name
+        conn->hdr[conn->hdr_len++] = '\0';
+        conn->in_value = true;
+    }
+    return (_hdr_add(conn, at, length)) ? 0 : 1;
+}
+
+//------------------------------------------------------
+static int http_on_headers_complete(http_parser *parser)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    if (conn->in_value) {
+        conn->hdr[conn->hdr_len++] = '\0';
+        conn->in_value = false;
+    }
+    // check the headers used by the server
+    char *p = conn->hdr;
+    while (p < (conn->hdr + conn->hdr_len)) {
+        char *value = p + strlen(p) + 1;
+        if (value >= (conn->hdr + conn->hdr_len)) break;
+        if ((strcasecmp(p, "Accept-Encoding") == 0) && (strstr(value, "gzip"))) conn->gzip = true;
+        p = value + strlen(value) + 1;
+    }
+    if ((parser->content_length != ULLONG_MAX) && (parser->content_length > conn->max_body)) {
+        conn->error = 413;
+        return 1;
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------------
+static int http_on_body(http_parser *parser, const char *at, size_t length)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    if ((conn->body.len + length) > conn->max_body) {
+        conn->error = 413;
+        return 1;
+    }
+    vstr_add_strn(&conn->body, at, length);
+    return 0;
+}
+
+//-----------------------------------------------------
+static int http_on_message_complete(http_parser *parser)
+{
+    httpsrv_conn_t *conn = (httpsrv_conn_t *)parser->data;
+    conn->complete = true;
+    // stop parsing, pipelined requests are parsed after the response is sent
+    http_parser_pause(parser, 1);
+    return 0;
+}
+
+static const http_parser_settings parser_settings = {
+    .on_message_begin = http_on_message_begin,
+    .on_url = http_on_url,
+    .on_header_field = http_on_header_field,
+    .on_header_value = http_on_header_value,
+    .on_headers_complete = http_on_headers_complete,
+    .on_body = http_on_body,
+    .on_message_complete = http_on_message_complete,
+};
+
+
+// ==== Connections =========================================================
+
+// Returns false for the BaseException subclasses not derived from Exception (KeyboardInterrupt, SystemExit)
+//-----------------------------------------
+static bool _is_exception(void *exc)
+{
+    return mp_obj_is_subclass_fast(MP_OBJ_FROM_PTR(((mp_obj_base_t *)exc)->type), MP_OBJ_FROM_PTR(&mp_type_Exception));
+}
+
+//---------------------------------------------------------------
+static void _conn_reset(httpsrv_obj_t *self, httpsrv_conn_t *conn)
+{
+    http_parser_init(&conn->parser, HTTP_REQUEST);
+    conn->parser.data = conn;
+    conn->max_body = self->max_body;
+    conn->rx_len = 0;
+    http_on_message_begin(&conn->parser);
+}
+
+//---------------------------------------------------------------
+static void _conn_close(httpsrv_obj_t *self, httpsrv_conn_t *conn)
+{
+    if (conn->sock == MP_OBJ_NULL) return;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_stream_close(conn->sock);
+        nlr_pop();
+    }
+    conn->sock = MP_OBJ_NULL;
+    conn->rx_len = 0;
+}
+
+// Send all data to the client socket
+//----------------------------------------------------------------------
+static bool _conn_send(httpsrv_conn_t *conn, const char *data, size_t len)
+{
+    const mp_stream_p_t *stream = mp_get_stream(conn->sock);
+    uint64_t send_end = mp_hal_ticks_ms() + HTTPSRV_SEND_TIMEOUT;
+    int errcode;
+
+    while (len > 0) {
+        mp_uint_t n = stream->write(conn->sock, data, len, &errcode);
+        if ((n == MP_STREAM_ERROR) || (n == 0)) {
+            if (n == 0) errcode = MP_EAGAIN;
+            if (((errcode != MP_EAGAIN) && (errcode != MP_ETIMEDOUT)) || (mp_hal_ticks_ms() > send_end)) {
+                return false;
+            }
+            // socket buffer full, let other threads run while waiting
+            MP_THREAD_GIL_EXIT();
+            vTaskDelay(HTTPSRV_IDLE_WAIT);
+            MP_THREAD_GIL_ENTER();
+            mp_hal_wdt_reset();
+            continue;
+        }
+        data += n;
+        len -= n;
+    }
+    conn->last_active = mp_hal_ticks_ms();
+    return true;
+}
+
+//--------------------------------------------
+static const char *_status_text(int status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default:  return (status < 400) ? "OK" : "Error";
+    }
+}
+
+// Format the response header into the server's tx buffer, returns the header length
+//-------------------------------------------------------------------------------------------------------------------
+static size_t _format_header(httpsrv_obj_t *self, int status, const char *ctype, const char *extra, size_t content_len, bool keep_alive)
+{
+    size_t size = HTTPSRV_TX_BUF_SIZE;
+    int len = snprintf(self->tx_buf, size,
+            "HTTP/1.1 %d %s\r\nServer: " HTTPSRV_SERVER_NAME "\r\nContent-Length: %lu\r\nConnection: %s\r\n",
+            status, _status_text(status), content_len, (keep_alive) ? "keep-alive" : "close");
+    if (ctype) len += snprintf(self->tx_buf + len, size - len, "Content-Type: %s\r\n", ctype);
+    if ((extra) && ((len + strlen(extra)) < (size - 3))) {
+        strcpy(self->tx_buf + len, extra);
+        len += strlen(extra);
+    }
+    len += snprintf(self->tx_buf + len, size - len, "\r\n");
+    return len;
+}
+
+// Send the response with the body from memory
+// The body is sent together with the header if it fits into the tx buffer,
+// otherwise directly from its buffer
+//-------------------------------------------------------------------------------------------------------------------
+static bool _send_response(httpsrv_obj_t *self, httpsrv_conn_t *conn, int status, const char *ctype, const char *extra,
+                           const char *body, size_t body_len, bool keep_alive, bool head_only)
+{
+    size_t hlen = _format_header(self, status, ctype, extra, body_len, keep_alive);
+    if (head_only) body_len = 0;
+    if ((hlen + body_len) <= HTTPSRV_TX_BUF_SIZE) {
+        if (body_len) memcpy(self->tx_buf + hlen, body, body_len);
+        return _conn_send(conn, self->tx_buf, hlen + body_len);
+    }
+    if (!_conn_send(conn, self->tx_buf, hlen)) return false;
+    return _conn_send(conn, body, body_len);
+}
+
+//---------------------------------------------------------------------------------------------------------
+static bool _send_error(httpsrv_obj_t *self, httpsrv_conn_t *conn, int status, bool keep_alive, bool head_only)
+{
+    char body[64];
+    int len = snprintf(body, sizeof(body), "%d %s\r\n", status, _status_text(status));
+    self->errors++;
+    return _send_response(self, conn, status, "text/plain", NULL, body, len, keep_alive, head_only);
+}
+
+
+// ==== Static files ========================================================
+
+//--------------------------------------------
+static const char *_mime_type(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    int i = 0;
+    if (ext) {
+        for (i = 0; mime_types[i].ext != NULL; i++) {
+            if (strcasecmp(ext, mime_types[i].ext) == 0) break;
+        }
+    }
+    else while (mime_types[i].ext != NULL) i++;
+    return mime_types[i].type;
+}
+
+// Decode %xx in place
+//------------------------------------
+static void _url_decode(char *str)
+{
+    char *src = str, *dst = str;
+    while (*src) {
+        if ((src[0] == '%') && (src[1]) && (src[2])) {
+            char hex[3] = { src[1], src[2], '\0' };
+            char *end;
+            long c = strtol(hex, &end, 16);
+            if ((*end == '\0') && (c > 0)) {
+                *dst++ = (char)c;
+                src += 3;
+                continue;
+            }
+        }
+        *dst++ = *src++;
+    }
+    *dst = '\0';
+}
+
+// Send the file from the server's root directory
+// Returns false if the file does not exist
+// The file data are read into the tx buffer, after the header for the first block,
+// and sent from there, no other buffers are used
+//-------------------------------------------------------------------------------------------------------------------
+static bool _serve_file(httpsrv_obj_t *self, httpsrv_conn_t *conn, const char *url_path, bool keep_alive, bool head_only, bool *sent)
+{
+    char path[HTTPSRV_MAX_PATH_LEN+8];
+    *sent = false;
+
+    if ((strlen(self->root) + strlen(url_path) + 11) >= HTTPSRV_MAX_PATH_LEN) return false;
+    if (strstr(url_path, "..")) return false;
+    sprintf(path, "%s%s", self->root, url_path);
+
+    mp_import_stat_t st = mp_vfs_import_stat(path);
+    if (st == MP_IMPORT_STAT_DIR) {
+        if (path[strlen(path)-1] != '/') strcat(path, "/");
+        strcat(path, "index.html");
+        st = mp_vfs_import_stat(path);
+    }
+    if (st != MP_IMPORT_STAT_FILE) return false;
+
+    const char *ctype = _mime_type(path);
+    const char *extra = NULL;
+    size_t plen = strlen(path);
+    if (conn->gzip) {
+        // serve the compressed file if available
+        strcat(path, ".gz");
+        if (mp_vfs_import_stat(path) == MP_IMPORT_STAT_FILE) extra = "Content-Encoding: gzip\r\n";
+        else path[plen] = '\0';
+    }
+
+    mp_obj_t path_obj = mp_obj_new_str(path, strlen(path));
+    mp_obj_t fargs[2] = { path_obj, mp_obj_new_str("rb", 2) };
+    size_t fsize = 0;
+    {
+        mp_obj_t stat = mp_vfs_stat(path_obj);
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_tuple_get(stat, &n, &items);
+        fsize = mp_obj_get_int(items[6]);
+    }
+    mp_obj_t file = mp_vfs_open(2, fargs, (mp_map_t*)&mp_const_empty_map);
+    const mp_stream_p_t *fstream = mp_get_stream(file);
+
+    bool res = true;
+    size_t remaining = (head_only) ? 0 : fsize;
+    size_t pos = _format_header(self, 200, ctype, extra, fsize, keep_alive);
+    int errcode;
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        while (remaining > 0) {
+            size_t n = HTTPSRV_TX_BUF_SIZE - pos;
+            if (n > remaining) n = remaining;
+            mp_uint_t rd = fstream->read(file, self->tx_buf + pos, n, &errcode);
+            if ((rd == MP_STREAM_ERROR) || (rd == 0)) {
+                res = false;
+                break;
+            }
+            pos += rd;
+            remaining -= rd;
+            if ((pos == HTTPSRV_TX_BUF_SIZE) || (remaining == 0)) {
+                if (!_conn_send(conn, self->tx_buf, pos)) {
+                    res = false;
+                    break;
+                }
+                pos = 0;
+            }
+        }
+        if ((res) && (pos > 0)) res = _conn_send(conn, self->tx_buf, pos);
+        nlr_pop();
+    }
+    else {
+        mp_stream_close(file);
+        nlr_jump(nlr.ret_val);
+    }
+    mp_stream_close(file);
+    self->files++;
+    // the response was started, the connection must be closed on error
+    *sent = res;
+    return true;
+}
+
+
+// ==== Dynamic requests ====================================================
+
+// Find the route matching the path and method
+// The route path ending with '*' matches all paths starting with it
+//-------------------------------------------------------------------------------------------
+static mp_obj_t _find_route(httpsrv_obj_t *self, const char *path, const char *method)
+{
+    size_t n_routes;
+    mp_obj_t *routes;
+    mp_obj_list_get(self->routes, &n_routes, &routes);
+
+    for (size_t i = 0; i < n_routes; i++) {
+        mp_obj_t *route = ((mp_obj_tuple_t *)MP_OBJ_TO_PTR(routes[i]))->items;
+        size_t rlen;
+        const char *rpath = mp_obj_str_get_data(route[0], &rlen);
+        if ((rlen > 0) && (rpath[rlen-1] == '*')) {
+            if (strncmp(path, rpath, rlen-1) != 0) continue;
+        }
+        else if ((strlen(path) != rlen) || (strncmp(path, rpath, rlen) != 0)) continue;
+        if ((route[2] != mp_const_none) && (strcasecmp(method, mp_obj_str_get_str(route[2])) != 0)) continue;
+        return routes[i];
+    }
+    return MP_OBJ_NULL;
+}
+
+// Get the value of the request header, NULL if not found
+//-------------------------------------------------------------------
+static const char *_get_header(httpsrv_conn_t *conn, const char *name)
+{
+    char *p = conn->hdr;
+    while (p < (conn->hdr + conn->hdr_len)) {
+        char *value = p + strlen(p) + 1;
+        if (value >= (conn->hdr + conn->hdr_len)) break;
+        if (strcasecmp(p, name) == 0) return value;
+        p = value + strlen(value) + 1;
+    }
+    return NULL;
+}
+
+//------------------------------------------------------
+static mp_obj_t _make_request(httpsrv_conn_t *conn, const char *method, const char *path, const char *query)
+{
+    mp_obj_t headers = mp_obj_new_dict(0);
+    char *p = conn->hdr;
+    while (p < (conn->hdr + conn->hdr_len)) {
+        char *value = p + strlen(p) + 1;
+        if (value >= (conn->hdr + conn->hdr_len)) break;
+        // header names are converted to lower case
+        for (char *c = p; *c; c++) {
+            if ((*c >= 'A') && (*c <= 'Z')) *c += 'a' - 'A';
+        }
+        mp_obj_dict_store(headers, mp_obj_new_str(p, strlen(p)), mp_obj_new_str(value, strlen(value)));
+        p = value + strlen(value) + 1;
+    }
+    socket_obj_t *sock = MP_OBJ_TO_PTR(conn->sock);
+    mp_obj_t addr[2] = {
+        mp_obj_new_str(sock->remote_ip, strlen(sock->remote_ip)),
+        mp_obj_new_int(sock->remote_port),
+    };
+    mp_obj_t items[6] = {
+        mp_obj_new_str(method, strlen(method)),
+        mp_obj_new_str(path, strlen(path)),
+        (query) ? mp_obj_new_str(query, strlen(query)) : mp_const_none,
+        headers,
+        mp_obj_new_bytes((const byte *)conn->body.buf, conn->body.len),
+        mp_obj_new_tuple(2, addr),
+    };
+    return mp_obj_new_attrtuple(request_fields, 6, items);
+}
+
+// Call the route's handler and send the response
+// The handler returns:
+//   None                                       -> 204 No Content
+//   str, bytes, bytearray                      -> 200, text/html or application/octet-stream
+//   dict or list                               -> 200, JSON encoded, application/json
+//   (status, body [, content_type [, headers]]) tuple
+//-------------------------------------------------------------------------------------------------------------------
+static bool _handle_route(httpsrv_obj_t *self, httpsrv_conn_t *conn, mp_obj_t route, mp_obj_t request, bool keep_alive, bool head_only)
+{
+    mp_obj_t *rt = ((mp_obj_tuple_t *)MP_OBJ_TO_PTR(route))->items;
+    int status = 200;
+    const char *ctype = (rt[3] != mp_const_none) ? mp_obj_str_get_str(rt[3]) : NULL;
+    mp_obj_t headers = mp_const_none;
+    mp_obj_t body;
+    mp_obj_t res;
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        res = mp_call_function_1(rt[1], request);
+        nlr_pop();
+    }
+    else {
+        // KeyboardInterrupt, SystemExit, ... stop the server
+        if (!_is_exception(nlr.ret_val)) nlr_jump(nlr.ret_val);
+        mp_printf(&mp_plat_print, "%s handler exception: ", TAG);
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+        return _send_error(self, conn, 500, keep_alive, head_only);
+    }
+    self->handled++;
+
+    body = res;
+    if (mp_obj_is_type(res, &mp_type_tuple)) {
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_tuple_get(res, &n, &items);
+        if ((n < 2) || (n > 4)) {
+            LOGW(TAG, "Wrong handler result for '%s'", conn->url);
+            return _send_error(self, conn, 500, keep_alive, head_only);
+        }
+        status = mp_obj_get_int(items[0]);
+        body = items[1];
+        if ((n > 2) && (items[2] != mp_const_none)) ctype = mp_obj_str_get_str(items[2]);
+        if (n > 3) headers = items[3];
+    }
+    else if (res == mp_const_none) status = 204;
+
+    // extra headers
+    vstr_t hdr;
+    mp_print_t hdr_print;
+    vstr_init_print(&hdr, 64, &hdr_print);
+    if (mp_obj_is_type(headers, &mp_type_dict)) {
+        mp_map_t *map = mp_obj_dict_get_map(headers);
+        for (size_t i = 0; i < map->alloc; i++) {
+            if (mp_map_slot_is_filled(map, i)) {
+                mp_obj_print_helper(&hdr_print, map->table[i].key, PRINT_STR);
+                vstr_add_str(&hdr, ": ");
+                mp_obj_print_helper(&hdr_print, map->table[i].value, PRINT_STR);
+                vstr_add_str(&hdr, "\r\n");
+            }
+        }
+    }
+
+    // response body, 'json' holds the body converted to string
+    mp_buffer_info_t bufinfo = { .buf = NULL, .len = 0 };
+    vstr_t json;
+    json.buf = NULL;
+    if (body == mp_const_none) {
+        // no body
+    }
+    else if (mp_obj_is_type(body, &mp_type_dict) || mp_obj_is_type(body, &mp_type_list)) {
+        mp_print_t print;
+        vstr_init_print(&json, 128, &print);
+        mp_obj_print_helper(&print, body, PRINT_JSON);
+        bufinfo.buf = json.buf;
+        bufinfo.len = json.len;
+        if (ctype == NULL) ctype = "application/json";
+    }
+    else if (mp_obj_is_str(body)) {
+        mp_get_buffer_raise(body, &bufinfo, MP_BUFFER_READ);
+        if (ctype == NULL) ctype = "text/html";
+    }
+    else if (mp_get_buffer(body, &bufinfo, MP_BUFFER_READ)) {
+        if (ctype == NULL) ctype = "application/octet-stream";
+    }
+    else {
+        mp_print_t print;
+        vstr_init_print(&json, 32, &print);
+        mp_obj_print_helper(&print, body, PRINT_STR);
+        bufinfo.buf = json.buf;
+        bufinfo.len = json.len;
+        if (ctype == NULL) ctype = "text/plain";
+    }
+
+    bool sent = _send_response(self, conn, status, ctype, (hdr.len) ? vstr_null_terminated_str(&hdr) : NULL,
+                               bufinfo.buf, bufinfo.len, keep_alive, head_only);
+    vstr_clear(&hdr);
+    if (json.buf) vstr_clear(&json);
+    return sent;
+}
+
+// Close the WebSocket, the errors are ignored
+//--------------------------------
+static void _ws_close(mp_obj_t ws)
+{
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t dest[2];
+        mp_load_method(ws, MP_QSTR_close, dest);
+        mp_call_method_n_kw(0, 0, dest);
+        nlr_pop();
+    }
+}
+
+// WebSocket handler thread function
+// The WebSocket has no finaliser, it is closed here when the handler returns
+//------------------------------------------------------------------------------
+STATIC mp_obj_t _ws_handler_run(mp_obj_t handler, mp_obj_t ws, mp_obj_t request)
+{
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_call_function_2(handler, ws, request);
+        nlr_pop();
+    }
+    else {
+        _ws_close(ws);
+        // KeyboardInterrupt, SystemExit, ... terminate the thread
+        if (!_is_exception(nlr.ret_val)) nlr_jump(nlr.ret_val);
+        mp_printf(&mp_plat_print, "%s WS handler exception: ", TAG);
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+        return mp_const_none;
+    }
+    _ws_close(ws);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(_ws_handler_run_obj, _ws_handler_run);
+
+// Upgrade the connection to WebSocket
+// The client socket is passed to the WebSocket object and removed from the server's connections,
+// the route's handler is called with (websocket, request) arguments
+//-------------------------------------------------------------------------------------------------------------------
+static bool _handle_upgrade(httpsrv_obj_t *self, httpsrv_conn_t *conn, mp_obj_t route, const char *path, const char *query)
+{
+    const char *key = _get_header(conn, "Sec-WebSocket-Key");
+    char accept[32];
+    if ((route == MP_OBJ_NULL) || (((mp_obj_tuple_t *)MP_OBJ_TO_PTR(route))->items[2] == mp_const_none)) {
+        // only the routes registered with method 'WS' accept the WebSocket connections
+        _send_error(self, conn, 404, false, false);
+        return false;
+    }
+    if ((key == NULL) || (!websocket_accept_key(key, accept, sizeof(accept)-1))) {
+        _send_error(self, conn, 400, false, false);
+        return false;
+    }
+    size_t len = snprintf(self->tx_buf, HTTPSRV_TX_BUF_SIZE,
+                          "HTTP/1.1 101 Switching Protocols\r\n"
+                          "Server: %s\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Accept: %s\r\n\r\n",
+                          HTTPSRV_SERVER_NAME, accept);
+    if (!_conn_send(conn, self->tx_buf, len)) return false;
+
+    mp_obj_t request = _make_request(conn, "GET", path, query);
+    // the data received after the upgrade request belong to the WebSocket
+    mp_obj_t ws = websocket_new(conn->sock, true, HTTPSRV_WS_MAX_MSG, (const uint8_t *)conn->rx_buf, conn->rx_len);
+    conn->sock = MP_OBJ_NULL;
+    conn->rx_len = 0;
+
+    // the handler runs in its own thread, the server continues serving the other connections
+    mp_obj_t th_args[3] = { ((mp_obj_tuple_t *)MP_OBJ_TO_PTR(route))->items[1], ws, request };
+    mp_obj_t start_args[3] = { MP_OBJ_NEW_QSTR(MP_QSTR_WS_handler), MP_OBJ_FROM_PTR(&_ws_handler_run_obj), mp_obj_new_tuple(3, th_args) };
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_call_function_n_kw(mp_load_attr(MP_OBJ_FROM_PTR(&mp_module_thread), MP_QSTR_start_new_thread), 3, 0, start_args);
+        nlr_pop();
+    }
+    else {
+        mp_printf(&mp_plat_print, "%s handler thread not started: ", TAG);
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+        _ws_close(ws);
+        return false;
+    }
+    self->handled++;
+    return false;
+}
+
+// Handle the complete request, returns false if the connection must be closed
+//------------------------------------------------------------------------------
+static bool _handle_request(httpsrv_obj_t *self, httpsrv_conn_t *conn)
+{
+    const char *method = http_method_str(conn->parser.method);
+    bool head_only = (conn->parser.method == HTTP_HEAD);
+    bool keep_alive = (self->keepalive > 0) && http_should_keep_alive(&conn->parser);
+    self->requests++;
+
+    // split the path and query
+    char *query = strchr(conn->url, '?');
+    if (query) *query++ = '\0';
+    char *path = conn->url;
+    // absolute URL (proxy form)
+    if (strncmp(path, "http://", 7) == 0) {
+        path = strchr(path + 7, '/');
+        if (path == NULL) path = "/";
+    }
+    _url_decode(path);
+
+    if (conn->parser.upgrade) {
+        const char *upgrade = _get_header(conn, "Upgrade");
+        if ((upgrade) && (strcasecmp(upgrade, "websocket") == 0)) {
+            return _handle_upgrade(self, conn, _find_route(self, path, "WS"), path, query);
+        }
+    }
+
+    mp_obj_t route = _find_route(self, path, method);
+    if (route != MP_OBJ_NULL) {
+        mp_obj_t request = _make_request(conn, method, path, query);
+        return _handle_route(self, conn, route, request, keep_alive, head_only) && keep_alive;
+    }
+
+    if ((conn->parser.method == HTTP_GET) || (head_only)) {
+        bool sent;
+        if (_serve_file(self, conn, path, keep_alive, head_only, &sent)) return sent && keep_alive;
+        return _send_error(self, conn, 404, keep_alive, head_only) && keep_alive;
+    }
+    return _send_error(self, conn, 405, keep_alive, false) && keep_alive;
+}
+
+// Parse the received data, handle the complete requests
+// Returns false if the connection must be closed
+//---------------------------------------------------------------
+static bool _conn_process(httpsrv_obj_t *self, httpsrv_conn_t *conn)
+{
+    while (conn->rx_len > 0) {
+        size_t n = http_parser_execute(&conn->parser, &parser_settings, conn->rx_buf, conn->rx_len);
+        enum http_errno err = HTTP_PARSER_ERRNO(&conn->parser);
+
+        if ((err != HPE_OK) && (err != HPE_PAUSED)) {
+            _send_error(self, conn, (conn->error) ? conn->error : 400, false, false);
+            return false;
+        }
+        // keep the not parsed data (pipelined request)
+        if (n < conn->rx_len) memmove(conn->rx_buf, conn->rx_buf + n, conn->rx_len - n);
+        conn->rx_len -= n;
+
+        if (!conn->complete) break;
+
+        http_parser_pause(&conn->parser, 0);
+        bool keep = _handle_request(self, conn);
+        conn->complete = false;
+        if (!keep) return false;
+    }
+    return true;
+}
+
+
+// ==== Server ==============================================================
+
+// Create the listening socket, the same way as it is done in Python
+//------------------------------------------------
+static void _server_open(httpsrv_obj_t *self)
+{
+    mp_obj_t dest[5];
+    self->sock = mp_call_function_0(mp_load_attr(MP_OBJ_FROM_PTR(&mp_module_usocket), MP_QSTR_socket));
+
+    mp_load_method(self->sock, MP_QSTR_setsockopt, dest);
+    dest[2] = MP_OBJ_NEW_SMALL_INT(SOL_SOCKET);
+    dest[3] = MP_OBJ_NEW_SMALL_INT(SO_REUSEADDR);
+    dest[4] = MP_OBJ_NEW_SMALL_INT(1);
+    mp_call_method_n_kw(3, 0, dest);
+
+    mp_load_method(self->sock, MP_QSTR_listen, dest);
+    dest[2] = MP_OBJ_NEW_SMALL_INT(self->max_conn);
+    mp_call_method_n_kw(1, 0, dest);
+
+    mp_obj_t addr[2] = { mp_obj_new_str("0.0.0.0", 7), mp_obj_new_int(self->port) };
+    mp_load_method(self->sock, MP_QSTR_bind, dest);
+    dest[2] = mp_obj_new_tuple(2, addr);
+    // connection timeout used by the WiFi module, in seconds
+    dest[3] = mp_obj_new_int((self->keepalive / 1000) + 30);
+    mp_call_method_n_kw(2, 0, dest);
+
+    _socket_settimeout((socket_obj_t *)MP_OBJ_TO_PTR(self->sock), 10);
+}
+
+//-------------------------------------------------
+static void _server_close(httpsrv_obj_t *self)
+{
+    for (int i = 0; i < self->max_conn; i++) {
+        _conn_close(self, &self->conn[i]);
+    }
+    if (self->sock != mp_const_none) {
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            mp_stream_close(self->sock);
+            nlr_pop();
+        }
+        self->sock = mp_const_none;
+    }
+}
+
+// Check if the new connection is waiting to be accepted
+//-------------------------------------------------------
+static bool _server_accept_ready(httpsrv_obj_t *self)
+{
+    socket_obj_t *sock = MP_OBJ_TO_PTR(self->sock);
+    #if MICROPY_PY_USE_WIFI
+    if (net_active_interfaces & ACTIVE_INTERFACE_WIFI) {
+        // the connections are accepted by the WiFi task
+        for (int i = 0; i < MAX_SERVER_CONNECTIONS; i++) {
+            if (sock->conn_fd[i] >= 0) return true;
+        }
+        return false;
+    }
+    #endif
+    int errcode;
+    mp_uint_t ret = mp_get_stream(self->sock)->ioctl(self->sock, MP_STREAM_POLL, MP_STREAM_POLL_RD, &errcode);
+    return ((ret != MP_STREAM_ERROR) && (ret & MP_STREAM_POLL_RD));
+}
+
+// Accept the new connection if there is a free connection slot
+//-------------------------------------------------
+static bool _server_accept(httpsrv_obj_t *self)
+{
+    httpsrv_conn_t *conn = NULL;
+    for (int i = 0; i < self->max_conn; i++) {
+        if (self->conn[i].sock == MP_OBJ_NULL) {
+            conn = &self->conn[i];
+            break;
+        }
+    }
+    // no free slot, the connection stays pending
+    if ((conn == NULL) || (!_server_accept_ready(self))) return false;
+
+    mp_obj_t dest[2];
+    mp_load_method(self->sock, MP_QSTR_accepted, dest);
+    mp_obj_t res = mp_call_method_n_kw(0, 0, dest);
+    mp_obj_t client = ((mp_obj_tuple_t *)MP_OBJ_TO_PTR(res))->items[0];
+    if (client == mp_const_none) return false;
+
+    _socket_settimeout((socket_obj_t *)MP_OBJ_TO_PTR(client), 10);
+    conn->sock = client;
+    _conn_reset(self, conn);
+    conn->last_active = mp_hal_ticks_ms();
+    return true;
+}
+
+// Read and process the data received on the connection
+// Returns true if some data were received
+//-------------------------------------------------------------------
+static bool _server_conn_read(httpsrv_obj_t *self, httpsrv_conn_t *conn)
+{
+    const mp_stream_p_t *stream = mp_get_stream(conn->sock);
+    socket_obj_t *sock = MP_OBJ_TO_PTR(conn->sock);
+    int errcode;
+
+    mp_uint_t ret = stream->ioctl(conn->sock, MP_STREAM_POLL, MP_STREAM_POLL_RD | MP_STREAM_POLL_HUP, &errcode);
+    if ((ret == MP_STREAM_ERROR) || (ret & MP_STREAM_POLL_HUP)) {
+        _conn_close(self, conn);
+        return false;
+    }
+    if (!(ret & MP_STREAM_POLL_RD)) {
+        if ((mp_hal_ticks_ms() - conn->last_active) > self->keepalive) _conn_close(self, conn);
+        return false;
+    }
+
+    size_t size = HTTPSRV_RX_BUF_SIZE - conn->rx_len;
+    if (size == 0) {
+        // the pipelined requests don't fit into the buffer
+        _send_error(self, conn, 431, false, false);
+        _conn_close(self, conn);
+        return true;
+    }
+    mp_uint_t n = stream->read(conn->sock, conn->rx_buf + conn->rx_len, size, &errcode);
+    if (n == MP_STREAM_ERROR) {
+        if ((errcode != MP_EAGAIN) && (errcode != MP_ETIMEDOUT)) _conn_close(self, conn);
+        return false;
+    }
+    if ((n == 0) || (sock->peer_closed)) {
+        // closed by the client
+        _conn_close(self, conn);
+        return false;
+    }
+    conn->rx_len += n;
+    conn->last_active = mp_hal_ticks_ms();
+    if (!_conn_process(self, conn)) _conn_close(self, conn);
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+STATIC mp_obj_t httpsrv_serve(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_timeout };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timeout,  MP_ARG_INT, { .u_int = -1 } },
+    };
+    httpsrv_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (self->running) {
+        mp_raise_msg(&mp_type_OSError, "Server already running");
+    }
+    if (net_active_interfaces == ACTIVE_INTERFACE_NONE) {
+        mp_raise_msg(&mp_type_OSError, "No active network interface");
+    }
+    uint64_t serve_end = (args[ARG_timeout].u_int > 0) ? mp_hal_ticks_ms() + args[ARG_timeout].u_int : 0;
+
+    _server_open(self);
+    self->running = true;
+    self->stop = false;
+    LOGD(TAG, "Started on port %d", self->port);
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        while (!self->stop) {
+            bool active = _server_accept(self);
+            for (int i = 0; i < self->max_conn; i++) {
+                if (self->conn[i].sock != MP_OBJ_NULL) {
+                    if (_server_conn_read(self, &self->conn[i])) active = true;
+                }
+            }
+            if (!active) {
+                MP_THREAD_GIL_EXIT();
+                vTaskDelay(HTTPSRV_IDLE_WAIT);
+                MP_THREAD_GIL_ENTER();
+            }
+            mp_handle_pending();
+            mp_hal_wdt_reset();
+
+            if (mp_thread_getnotify(1) & THREAD_NOTIFY_EXIT) {
+                mp_thread_getnotify(0);
+                break;
+            }
+            if ((serve_end) && (mp_hal_ticks_ms() > serve_end)) break;
+        }
+        nlr_pop();
+    }
+    else {
+        _server_close(self);
+        self->running = false;
+        nlr_jump(nlr.ret_val);
+    }
+    _server_close(self);
+    self->running = false;
+    LOGD(TAG, "Stopped");
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(httpsrv_serve_obj, 1, httpsrv_serve);
+
+//-------------------------------------------------
+STATIC mp_obj_t httpsrv_stop(mp_obj_t self_in)
+{
+    httpsrv_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    self->stop = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(httpsrv_stop_obj, httpsrv_stop);
+
+// Register the Python handler for the path
+// The routes with method='WS' accept the WebSocket connections, the handler is called as handler(websocket, request)
+//------------------------------------------------------------------------------------
+STATIC mp_obj_t httpsrv_route(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_path, ARG_handler, ARG_method, ARG_content_type };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_path,         MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_handler,      MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_method,       MP_ARG_OBJ,                   { .u_obj = mp_const_none } },
+        { MP_QSTR_content_type, MP_ARG_KW_ONLY | MP_ARG_OBJ,  { .u_obj = mp_const_none } },
+    };
+    httpsrv_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    const char *path = mp_obj_str_get_str(args[ARG_path].u_obj);
+    if (path[0] != '/') {
+        mp_raise_ValueError("Path must start with '/'");
+    }
+    if (!mp_obj_is_callable(args[ARG_handler].u_obj)) {
+        mp_raise_ValueError("Handler must be a function");
+    }
+    if (args[ARG_method].u_obj != mp_const_none) mp_obj_str_get_str(args[ARG_method].u_obj);
+    if (args[ARG_content_type].u_obj != mp_const_none) mp_obj_str_get_str(args[ARG_content_type].u_obj);
+
+    mp_obj_t route[4] = { args[ARG_path].u_obj, args[ARG_handler].u_obj, args[ARG_method].u_obj, args[ARG_content_type].u_obj };
+    mp_obj_list_append(self->routes, mp_obj_new_tuple(4, route));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(httpsrv_route_obj, 3, httpsrv_route);
+
+// Returns tuple: (requests, files_sent, handler_calls, errors, active_connections)
+//-------------------------------------------------
+STATIC mp_obj_t httpsrv_stats(mp_obj_t self_in)
+{
+    httpsrv_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    int active = 0;
+    for (int i = 0; i < self->max_conn; i++) {
+        if (self->conn[i].sock != MP_OBJ_NULL) active++;
+    }
+    mp_obj_t tuple[5] = {
+        mp_obj_new_int_from_uint(self->requests),
+        mp_obj_new_int_from_uint(self->files),
+        mp_obj_new_int_from_uint(self->handled),
+        mp_obj_new_int_from_uint(self->errors),
+        mp_obj_new_int(active),
+    };
+    return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(httpsrv_stats_obj, httpsrv_stats);
+
+//------------------------------------------------------------------------------------------------
+STATIC mp_obj_t httpsrv_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum { ARG_port, ARG_root, ARG_maxconn, ARG_keepalive, ARG_maxbody };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_port,         MP_ARG_INT,                  { .u_int = 80 } },
+        { MP_QSTR_root,         MP_ARG_OBJ,                  { .u_obj = mp_const_none } },
+        { MP_QSTR_maxconn,      MP_ARG_KW_ONLY | MP_ARG_INT, { .u_int = 2 } },
+        { MP_QSTR_keepalive,    MP_ARG_KW_ONLY | MP_ARG_INT, { .u_int = 5 } },
+        { MP_QSTR_maxbody,      MP_ARG_KW_ONLY | MP_ARG_INT, { .u_int = HTTPSRV_MAX_BODY_LEN } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if ((args[ARG_maxconn].u_int < 1) || (args[ARG_maxconn].u_int > HTTPSRV_MAX_CONN)) {
+        mp_raise_ValueError("maxconn 1~4 expected");
+    }
+    const char *root = "/flash/www";
+    if (args[ARG_root].u_obj != mp_const_none) root = mp_obj_str_get_str(args[ARG_root].u_obj);
+    if (strlen(root) >= 64) {
+        mp_raise_ValueError("Root path too long");
+    }
+
+    httpsrv_obj_t *self = m_new_obj_with_finaliser(httpsrv_obj_t);
+    memset(self, 0, sizeof(httpsrv_obj_t));
+    self->base.type = &httpserver_type;
+    self->sock = mp_const_none;
+    self->routes = mp_obj_new_list(0, NULL);
+    self->port = args[ARG_port].u_int;
+    self->max_conn = args[ARG_maxconn].u_int;
+    self->keepalive = (args[ARG_keepalive].u_int > 0) ? args[ARG_keepalive].u_int * 1000 : 0;
+    self->max_body = (args[ARG_maxbody].u_int > 0) ? args[ARG_maxbody].u_int : 0;
+    strcpy(self->root, root);
+    // remove the trailing '/'
+    if ((strlen(self->root) > 0) && (self->root[strlen(self->root)-1] == '/')) self->root[strlen(self->root)-1] = '\0';
+
+    // the buffers are allocated from MicroPython heap, they are freed when the object is collected
+    self->tx_buf = m_new(char, HTTPSRV_TX_BUF_SIZE);
+    self->conn = m_new0(httpsrv_conn_t, self->max_conn);
+    for (int i = 0; i < self->max_conn; i++) {
+        self->conn[i].sock = MP_OBJ_NULL;
+        vstr_init(&self->conn[i].body, 0);
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+
+//-------------------------------------------------
+STATIC mp_obj_t httpsrv_del(mp_obj_t self_in)
+{
+    httpsrv_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    self->stop = true;
+    if (!self->running) _server_close(self);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(httpsrv_del_obj, httpsrv_del);
+
+//-----------------------------------------------------------------------------------------
+STATIC void httpsrv_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    httpsrv_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "HTTPServer(port=%d, root='%s', maxconn=%d, keepalive=%u, routes=%u, %s)",
+            self->port, self->root, self->max_conn, self->keepalive / 1000,
+            mp_obj_get_int(mp_obj_len(self->routes)), (self->running) ? "running" : "stopped");
+}
+
+//=========================================================
+STATIC const mp_rom_map_elem_t httpsrv_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),     MP_ROM_PTR(&httpsrv_del_obj) },
+    { MP_ROM_QSTR(MP_QSTR_route),       MP_ROM_PTR(&httpsrv_route_obj) },
+    { MP_ROM_QSTR(MP_QSTR_serve),       MP_ROM_PTR(&httpsrv_serve_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop),        MP_ROM_PTR(&httpsrv_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),       MP_ROM_PTR(&httpsrv_stats_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(httpsrv_locals_dict, httpsrv_locals_dict_table);
+
+//=========================================
+const mp_obj_type_t httpserver_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_HTTPServer,
+    .print = httpsrv_print,
+    .make_new = httpsrv_make_new,
+    .locals_dict = (mp_obj_dict_t*)&httpsrv_locals_dict,
+};
+
+#endif
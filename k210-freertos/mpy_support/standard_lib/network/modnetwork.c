@@ -64,6 +64,12 @@ extern const mp_obj_type_t mqtt_type;
 extern const mp_obj_type_t requests_type;
 #endif
 
+#if MICROPY_PY_USE_HTTPSERVER
+extern const mp_obj_type_t httpserver_type;
+#endif
+
+extern const mp_obj_type_t websocket_type;
+
 
 //---------------------------------------
 STATIC mp_obj_t mod_network_wifi_active()
@@ -128,6 +134,12 @@ STATIC const mp_map_elem_t mp_module_network_globals_table[] = {
     #if MICROPY_PY_USE_REQUESTS
     { MP_ROM_QSTR(MP_QSTR_requests),        MP_ROM_PTR(&requests_type) },
     #endif
+
+    #if MICROPY_PY_USE_HTTPSERVER
+    { MP_ROM_QSTR(MP_QSTR_HTTPServer),      MP_ROM_PTR(&httpserver_type) },
+    #endif
+
+    { MP_ROM_QSTR(MP_QSTR_WebSocket),       MP_ROM_PTR(&websocket_type) },
 };
 
 //===========================
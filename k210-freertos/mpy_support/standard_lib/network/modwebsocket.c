@@ -0,0 +1,611 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * WebSocket (RFC 6455) framing on top of the connected socket
+ *
+ * The frames are parsed incrementally, the received data are read directly
+ * into the message buffer and unmasked 64 bits at a time.
+ * The payload of the sent frames is written directly from the caller's buffer
+ * (server side, the frames sent by the server are not masked).
+ * Used by 'network.HTTPServer' for upgraded connections and by 'microWebSocket.py'.
+ */
+
+#include "mpconfigport.h"
+
+#if MICROPY_PY_USE_NETTWORK
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <netif/ppp/polarssl/sha1.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "syslog.h"
+
+#include "at_util.h"
+#include "platform_k210.h"
+#include "transport_ws.h"
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "py/unicode.h"
+#include "mphalport.h"
+#include "mpthreadport.h"
+
+#define WS_OPCODE_CONT          0x00
+#define WS_OPCODE_CONTROL       0x08
+#define WS_MAX_FRAME_HEADER     14
+#define WS_MAX_CONTROL_PAYLOAD  125
+#define WS_SMALL_FRAME          256         // frames up to this size are sent with one write
+#define WS_DEFAULT_MAX_MSG      4096
+#define WS_SEND_TIMEOUT         5000
+#define WS_GUID                 "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define WS_CLOSE_NORMAL         1000
+#define WS_CLOSE_PROTOCOL       1002
+#define WS_CLOSE_INVALID_DATA   1007
+#define WS_CLOSE_TOO_BIG        1009
+
+enum {
+    WS_STATE_HEADER = 0,
+    WS_STATE_PAYLOAD,
+};
+
+typedef struct _websocket_obj_t {
+    mp_obj_base_t   base;
+    mp_obj_t        sock;
+    bool            server;
+    bool            closed;
+    bool            send_cont;              // fragmented message is being sent
+    uint8_t         state;
+    // frame being received
+    uint8_t         hdr[WS_MAX_FRAME_HEADER];
+    uint8_t         hdr_len;
+    uint8_t         hdr_need;
+    uint8_t         opcode;
+    bool            fin;
+    uint8_t         mask[4];
+    bool            masked;
+    uint64_t        payload_len;
+    uint64_t        payload_rcv;
+    // message being assembled from the data frames
+    uint8_t         msg_type;               // WS_OPCODE_TEXT, WS_OPCODE_BINARY or 0
+    size_t          msg_len;
+    size_t          max_msg;
+    uint8_t         *msg;
+    uint8_t         ctrl[WS_MAX_CONTROL_PAYLOAD];
+    // data received before the connection was upgraded
+    uint8_t         *pending;
+    size_t          pending_len;
+    uint32_t        rx_msgs;
+    uint32_t        tx_msgs;
+} websocket_obj_t;
+
+static const char *TAG = "[WEBSOCKET]";
+
+const mp_obj_type_t websocket_type;
+
+
+// XOR the data with the mask, 'offset' is the position of the first byte in the frame payload
+// The same function is used for masking and unmasking
+//----------------------------------------------------------------------------------
+static void _ws_mask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset)
+{
+    // byte-wise up to 64-bit aligned address
+    while ((len > 0) && ((uintptr_t)data & 7)) {
+        *data++ ^= mask[offset++ & 3];
+        len--;
+    }
+    if (len >= 8) {
+        uint8_t mask8[8];
+        uint64_t mask64;
+        for (int i = 0; i < 8; i++) {
+            mask8[i] = mask[(offset + i) & 3];
+        }
+        memcpy(&mask64, mask8, 8);
+        uint64_t *data64 = (uint64_t *)data;
+        size_t n = len >> 3;
+        for (size_t i = 0; i < n; i++) {
+            data64[i] ^= mask64;
+        }
+        // the mask position is not changed after multiple of 8 bytes
+        data += n << 3;
+        len -= n << 3;
+    }
+    while (len > 0) {
+        *data++ ^= mask[offset++ & 3];
+        len--;
+    }
+}
+
+// Calculate the 'Sec-WebSocket-Accept' value for the client's key
+//-------------------------------------------------------------
+bool websocket_accept_key(const char *key, char *accept, int accept_len)
+{
+    char buf[96];
+    unsigned char digest[20];
+    int len = snprintf(buf, sizeof(buf), "%s%s", key, WS_GUID);
+    if (len >= sizeof(buf)) return false;
+    sha1((unsigned char *)buf, (size_t)len, digest);
+    if (!base64_encode(digest, 20, (unsigned char *)accept, &accept_len)) return false;
+    accept[accept_len] = '\0';
+    return true;
+}
+
+// Write all data to the socket
+//-------------------------------------------------------------------------
+static bool _ws_write(websocket_obj_t *self, const uint8_t *data, size_t len)
+{
+    const mp_stream_p_t *stream = mp_get_stream(self->sock);
+    uint64_t send_end = mp_hal_ticks_ms() + WS_SEND_TIMEOUT;
+    int errcode;
+
+    while (len > 0) {
+        mp_uint_t n = stream->write(self->sock, data, len, &errcode);
+        if ((n == MP_STREAM_ERROR) || (n == 0)) {
+            if (n == 0) errcode = MP_EAGAIN;
+            if (((errcode != MP_EAGAIN) && (errcode != MP_ETIMEDOUT)) || (mp_hal_ticks_ms() > send_end)) {
+                return false;
+            }
+            mp_hal_wdt_reset();
+            continue;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+static size_t _ws_frame_header(websocket_obj_t *self, uint8_t *hdr, uint8_t opcode, bool fin, size_t len)
+{
+    size_t hlen = 0;
+    hdr[hlen++] = opcode | ((fin) ? WS_FIN : 0);
+    uint8_t mask_bit = (self->server) ? 0 : WS_MASK;
+    if (len < WS_SIZE16) {
+        hdr[hlen++] = mask_bit | len;
+    }
+    else if (len <= 0xFFFF) {
+        hdr[hlen++] = mask_bit | WS_SIZE16;
+        hdr[hlen++] = (len >> 8) & 0xFF;
+        hdr[hlen++] = len & 0xFF;
+    }
+    else {
+        hdr[hlen++] = mask_bit | WS_SIZE64;
+        for (int i = 7; i >= 0; i--) {
+            hdr[hlen++] = ((uint64_t)len >> (i * 8)) & 0xFF;
+        }
+    }
+    if (!self->server) {
+        uint32_t mask = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        memcpy(hdr + hlen, &mask, 4);
+        hlen += 4;
+    }
+    return hlen;
+}
+
+// Send one frame
+// The server's frames are not masked, the payload is sent directly from the 'data' buffer.
+// The client's frames are masked in chunks on the stack, the caller's data are not modified.
+//-------------------------------------------------------------------------------------------------------
+static bool _ws_send_frame(websocket_obj_t *self, uint8_t opcode, bool fin, const uint8_t *data, size_t len)
+{
+    if (self->closed) return false;
+
+    uint8_t buf[WS_MAX_FRAME_HEADER + WS_SMALL_FRAME];
+    size_t hlen = _ws_frame_header(self, buf, opcode, fin, len);
+
+    if (self->server) {
+        if (len <= WS_SMALL_FRAME) {
+            if (len) memcpy(buf + hlen, data, len);
+            return _ws_write(self, buf, hlen + len);
+        }
+        if (!_ws_write(self, buf, hlen)) return false;
+        return _ws_write(self, data, len);
+    }
+
+    uint8_t mask[4];
+    memcpy(mask, buf + hlen - 4, 4);
+    size_t offset = 0;
+    size_t first = hlen;
+    do {
+        size_t n = len - offset;
+        if (n > WS_SMALL_FRAME) n = WS_SMALL_FRAME;
+        memcpy(buf + first, data + offset, n);
+        _ws_mask(buf + first, n, mask, offset);
+        if (!_ws_write(self, buf, first + n)) return false;
+        offset += n;
+        first = 0;
+    } while (offset < len);
+    return true;
+}
+
+//--------------------------------------------------------
+static void _ws_close(websocket_obj_t *self, uint16_t code)
+{
+    if (self->closed) return;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        if (code) {
+            uint8_t payload[2] = { code >> 8, code & 0xFF };
+            _ws_send_frame(self, WS_OPCODE_CLOSE, true, payload, 2);
+        }
+        mp_stream_close(self->sock);
+        nlr_pop();
+    }
+    self->closed = true;
+    self->msg_type = 0;
+    self->msg_len = 0;
+    self->send_cont = false;
+}
+
+// Read up to 'len' available bytes, does not wait for the data
+// Returns the number of bytes read or -1 if the connection is closed
+//-----------------------------------------------------------------
+static int _ws_read(websocket_obj_t *self, uint8_t *buf, size_t len)
+{
+    if (self->pending) {
+        // data received together with the upgrade request
+        if (len > self->pending_len) len = self->pending_len;
+        memcpy(buf, self->pending, len);
+        self->pending_len -= len;
+        if (self->pending_len) memmove(self->pending, self->pending + len, self->pending_len);
+        else {
+            m_del(uint8_t, self->pending, 0);
+            self->pending = NULL;
+        }
+        return len;
+    }
+
+    const mp_stream_p_t *stream = mp_get_stream(self->sock);
+    int errcode;
+    mp_uint_t ret = stream->ioctl(self->sock, MP_STREAM_POLL, MP_STREAM_POLL_RD | MP_STREAM_POLL_HUP, &errcode);
+    if ((ret == MP_STREAM_ERROR) || (ret & MP_STREAM_POLL_HUP)) return -1;
+    if (!(ret & MP_STREAM_POLL_RD)) return 0;
+
+    mp_uint_t n = stream->read(self->sock, buf, len, &errcode);
+    if (n == MP_STREAM_ERROR) {
+        return ((errcode == MP_EAGAIN) || (errcode == MP_ETIMEDOUT)) ? 0 : -1;
+    }
+    // ready for reading, but no data: closed by the peer
+    return (n == 0) ? -1 : (int)n;
+}
+
+// Parse the frame header, returns false on protocol error
+//--------------------------------------------------
+static bool _ws_parse_header(websocket_obj_t *self)
+{
+    uint8_t *hdr = self->hdr;
+    self->fin = (hdr[0] & WS_FIN) != 0;
+    self->opcode = hdr[0] & 0x0F;
+    self->masked = (hdr[1] & WS_MASK) != 0;
+    uint8_t len7 = hdr[1] & 0x7F;
+    int pos = 2;
+
+    if (len7 == WS_SIZE16) {
+        self->payload_len = ((uint64_t)hdr[2] << 8) | hdr[3];
+        pos += 2;
+    }
+    else if (len7 == WS_SIZE64) {
+        self->payload_len = 0;
+        for (int i = 0; i < 8; i++) {
+            self->payload_len = (self->payload_len << 8) | hdr[pos++];
+        }
+    }
+    else self->payload_len = len7;
+    if (self->masked) memcpy(self->mask, hdr + pos, 4);
+    self->payload_rcv = 0;
+
+    // all frames sent by the client must be masked (RFC 6455, 5.1)
+    if ((self->server) && (!self->masked)) return false;
+
+    if (self->opcode & WS_OPCODE_CONTROL) {
+        // control frames can't be fragmented
+        if ((!self->fin) || (self->payload_len > WS_MAX_CONTROL_PAYLOAD)) return false;
+        if ((self->opcode != WS_OPCODE_CLOSE) && (self->opcode != WS_OPCODE_PING) && (self->opcode != WS_OPCODE_PONG)) return false;
+    }
+    else if (self->opcode == WS_OPCODE_CONT) {
+        if (self->msg_type == 0) return false;
+    }
+    else if ((self->opcode == WS_OPCODE_TEXT) || (self->opcode == WS_OPCODE_BINARY)) {
+        if (self->msg_type != 0) return false;
+        self->msg_type = self->opcode;
+    }
+    else return false;
+    return true;
+}
+
+// Handle the completely received frame
+// Returns the message object if the complete message was received
+//-----------------------------------------------------
+static mp_obj_t _ws_frame_complete(websocket_obj_t *self)
+{
+    self->state = WS_STATE_HEADER;
+    self->hdr_len = 0;
+    self->hdr_need = 2;
+
+    switch (self->opcode) {
+        case WS_OPCODE_PING:
+            _ws_send_frame(self, WS_OPCODE_PONG, true, self->ctrl, self->payload_len);
+            return MP_OBJ_NULL;
+        case WS_OPCODE_PONG:
+            return MP_OBJ_NULL;
+        case WS_OPCODE_CLOSE: {
+            // echo the status code
+            uint16_t code = (self->payload_len >= 2) ? ((self->ctrl[0] << 8) | self->ctrl[1]) : WS_CLOSE_NORMAL;
+            _ws_close(self, code);
+            return MP_OBJ_NULL;
+        }
+        default:
+            break;
+    }
+
+    self->msg_len += self->payload_len;
+    if (!self->fin) return MP_OBJ_NULL;
+
+    mp_obj_t msg;
+    if (self->msg_type == WS_OPCODE_TEXT) {
+        if (!utf8_check(self->msg, self->msg_len)) {
+            LOGW(TAG, "Invalid UTF-8 text message");
+            _ws_close(self, WS_CLOSE_INVALID_DATA);
+            return MP_OBJ_NULL;
+        }
+        msg = mp_obj_new_str((const char *)self->msg, self->msg_len);
+    }
+    else msg = mp_obj_new_bytes(self->msg, self->msg_len);
+    self->msg_type = 0;
+    self->msg_len = 0;
+    self->rx_msgs++;
+    return msg;
+}
+
+// Process the available received data
+// Returns the message object or MP_OBJ_NULL if no complete message is available
+//-----------------------------------------------
+static mp_obj_t _ws_process(websocket_obj_t *self)
+{
+    while (!self->closed) {
+        if (self->state == WS_STATE_HEADER) {
+            int n = _ws_read(self, self->hdr + self->hdr_len, self->hdr_need - self->hdr_len);
+            if (n < 0) {
+                _ws_close(self, 0);
+                break;
+            }
+            if (n == 0) break;
+            self->hdr_len += n;
+            if (self->hdr_len < self->hdr_need) continue;
+
+            if (self->hdr_need == 2) {
+                // the header length is known after the first two bytes
+                uint8_t len7 = self->hdr[1] & 0x7F;
+                if (len7 == WS_SIZE16) self->hdr_need += 2;
+                else if (len7 == WS_SIZE64) self->hdr_need += 8;
+                if (self->hdr[1] & WS_MASK) self->hdr_need += 4;
+                if (self->hdr_need > 2) continue;
+            }
+            if (!_ws_parse_header(self)) {
+                LOGW(TAG, "Protocol error");
+                _ws_close(self, WS_CLOSE_PROTOCOL);
+                break;
+            }
+            if ((!(self->opcode & WS_OPCODE_CONTROL)) && ((self->msg_len + self->payload_len) > self->max_msg)) {
+                LOGW(TAG, "Message too big");
+                _ws_close(self, WS_CLOSE_TOO_BIG);
+                break;
+            }
+            if (self->payload_len == 0) {
+                mp_obj_t msg = _ws_frame_complete(self);
+                if (msg != MP_OBJ_NULL) return msg;
+                continue;
+            }
+            self->state = WS_STATE_PAYLOAD;
+        }
+        else {
+            // the payload is received directly into the message (or control) buffer
+            uint8_t *dest = (self->opcode & WS_OPCODE_CONTROL) ? self->ctrl : self->msg + self->msg_len;
+            dest += self->payload_rcv;
+            int n = _ws_read(self, dest, self->payload_len - self->payload_rcv);
+            if (n < 0) {
+                _ws_close(self, 0);
+                break;
+            }
+            if (n == 0) break;
+            if (self->masked) _ws_mask(dest, n, self->mask, self->payload_rcv);
+            self->payload_rcv += n;
+            if (self->payload_rcv < self->payload_len) continue;
+
+            mp_obj_t msg = _ws_frame_complete(self);
+            if (msg != MP_OBJ_NULL) return msg;
+        }
+    }
+    return MP_OBJ_NULL;
+}
+
+// Create the WebSocket object on already connected (and upgraded) socket
+// 'pending' are the data received after the upgrade request
+//----------------------------------------------------------------------------------------------------
+mp_obj_t websocket_new(mp_obj_t sock, bool server, size_t max_msg, const uint8_t *pending, size_t pending_len)
+{
+    websocket_obj_t *self = m_new_obj(websocket_obj_t);
+    memset(self, 0, sizeof(websocket_obj_t));
+    self->base.type = &websocket_type;
+    self->sock = sock;
+    self->server = server;
+    self->hdr_need = 2;
+    self->max_msg = max_msg;
+    self->msg = m_new(uint8_t, max_msg);
+    if (pending_len) {
+        self->pending = m_new(uint8_t, pending_len);
+        memcpy(self->pending, pending, pending_len);
+        self->pending_len = pending_len;
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+
+//------------------------------------------------------------------------------------------------
+STATIC mp_obj_t websocket_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum { ARG_sock, ARG_server, ARG_maxmsg };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_sock,     MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_server,   MP_ARG_BOOL,                  { .u_bool = true } },
+        { MP_QSTR_maxmsg,   MP_ARG_KW_ONLY | MP_ARG_INT,  { .u_int = WS_DEFAULT_MAX_MSG } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_get_stream_raise(args[ARG_sock].u_obj, MP_STREAM_OP_READ | MP_STREAM_OP_WRITE | MP_STREAM_OP_IOCTL);
+    if (args[ARG_maxmsg].u_int < WS_MAX_CONTROL_PAYLOAD) {
+        mp_raise_ValueError("maxmsg too small");
+    }
+    return websocket_new(args[ARG_sock].u_obj, args[ARG_server].u_bool, args[ARG_maxmsg].u_int, NULL, 0);
+}
+
+// Send the text (str) or binary (bytes, bytearray, memoryview, array) message
+// With fin=False the message is sent in fragments, the last one must be sent with fin=True
+//------------------------------------------------------------------------------------
+STATIC mp_obj_t websocket_send(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_data, ARG_binary, ARG_fin };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_data,     MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_binary,   MP_ARG_OBJ,                   { .u_obj = mp_const_none } },
+        { MP_QSTR_fin,      MP_ARG_KW_ONLY | MP_ARG_BOOL, { .u_bool = true } },
+    };
+    websocket_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (self->closed) return mp_const_false;
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_data].u_obj, &bufinfo, MP_BUFFER_READ);
+    bool binary = !mp_obj_is_str(args[ARG_data].u_obj);
+    if (args[ARG_binary].u_obj != mp_const_none) binary = mp_obj_is_true(args[ARG_binary].u_obj);
+
+    uint8_t opcode = (self->send_cont) ? WS_OPCODE_CONT : ((binary) ? WS_OPCODE_BINARY : WS_OPCODE_TEXT);
+    bool res = _ws_send_frame(self, opcode, args[ARG_fin].u_bool, bufinfo.buf, bufinfo.len);
+    if (!res) {
+        _ws_close(self, 0);
+        return mp_const_false;
+    }
+    self->send_cont = !args[ARG_fin].u_bool;
+    if (!self->send_cont) self->tx_msgs++;
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(websocket_send_obj, 2, websocket_send);
+
+// Receive the message
+// Returns str (text message), bytes (binary message) or None if no message was received in 'timeout' ms
+// timeout=0: only the already received data are processed; timeout=-1: wait until the message is received
+//------------------------------------------------------------------------------------
+STATIC mp_obj_t websocket_recv(size_t n_args, const mp_obj_t *args)
+{
+    websocket_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t timeout = (n_args > 1) ? mp_obj_get_int(args[1]) : 0;
+    uint64_t recv_end = mp_hal_ticks_ms() + timeout;
+
+    while (!self->closed) {
+        mp_obj_t msg = _ws_process(self);
+        if (msg != MP_OBJ_NULL) return msg;
+        if (self->closed) break;
+        if ((timeout >= 0) && (mp_hal_ticks_ms() >= recv_end)) break;
+
+        MP_THREAD_GIL_EXIT();
+        vTaskDelay(1);
+        MP_THREAD_GIL_ENTER();
+        mp_handle_pending();
+        mp_hal_wdt_reset();
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(websocket_recv_obj, 1, 2, websocket_recv);
+
+//------------------------------------------------------------------
+STATIC mp_obj_t websocket_ping(size_t n_args, const mp_obj_t *args)
+{
+    websocket_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t bufinfo = { .buf = NULL, .len = 0 };
+    if (n_args > 1) {
+        mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len > WS_MAX_CONTROL_PAYLOAD) {
+            mp_raise_ValueError("Ping data too long");
+        }
+    }
+    return mp_obj_new_bool(_ws_send_frame(self, WS_OPCODE_PING, true, bufinfo.buf, bufinfo.len));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(websocket_ping_obj, 1, 2, websocket_ping);
+
+//-------------------------------------------------------------------
+STATIC mp_obj_t websocket_close(size_t n_args, const mp_obj_t *args)
+{
+    websocket_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    uint16_t code = (n_args > 1) ? mp_obj_get_int(args[1]) : WS_CLOSE_NORMAL;
+    _ws_close(self, code);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(websocket_close_obj, 1, 2, websocket_close);
+
+//---------------------------------------------------
+STATIC mp_obj_t websocket_closed(mp_obj_t self_in)
+{
+    websocket_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_bool(self->closed);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(websocket_closed_obj, websocket_closed);
+
+//-----------------------------------------------------------------------------------------
+STATIC void websocket_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    websocket_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "WebSocket(%s, maxmsg=%u, received=%u, sent=%u, %s)",
+            (self->server) ? "server" : "client", self->max_msg, self->rx_msgs, self->tx_msgs,
+            (self->closed) ? "closed" : "open");
+}
+
+//=========================================================
+STATIC const mp_rom_map_elem_t websocket_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_send),        MP_ROM_PTR(&websocket_send_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recv),        MP_ROM_PTR(&websocket_recv_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ping),        MP_ROM_PTR(&websocket_ping_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close),       MP_ROM_PTR(&websocket_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR_closed),      MP_ROM_PTR(&websocket_closed_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(websocket_locals_dict, websocket_locals_dict_table);
+
+//=========================================
+const mp_obj_type_t websocket_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_WebSocket,
+    .print = websocket_print,
+    .make_new = websocket_make_new,
+    .locals_dict = (mp_obj_dict_t*)&websocket_locals_dict,
+};
+
+#endif
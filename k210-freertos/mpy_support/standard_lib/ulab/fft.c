@@ -23,6 +23,50 @@
 
 #if ULAB_FFT_MODULE
 
+#if ULAB_FFT_HARDWARE
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "devices.h"
+#endif
+
+// Twiddle factor plans, one per power of 2 size, created on first use and never freed.
+// A plan for size n holds cos(2*pi*k/n) and sin(2*pi*k/n) for k = 0 .. n/2-1
+// and can also be used (with stride) for any smaller power of 2 size.
+// Plans are allocated from the system heap, outside of the MicroPython heap.
+// The plans are shared by both MicroPython instances, a new plan is published
+// atomically after it is filled; if the other instance was faster, its plan is used.
+static mp_float_t *fft_plans[FFT_MAX_PLAN_BITS+1];
+
+static mp_float_t *fft_get_plan(size_t n) {
+    uint8_t bits = 0;
+    while(((size_t)1 << bits) < n) {
+        bits++;
+    }
+    if(bits > FFT_MAX_PLAN_BITS) {
+        return NULL;
+    }
+    mp_float_t *plan = __atomic_load_n(&fft_plans[bits], __ATOMIC_ACQUIRE);
+    if(plan == NULL) {
+        size_t half = n >> 1;
+        plan = (mp_float_t *)malloc(2 * half * sizeof(mp_float_t));
+        if(plan == NULL) {
+            return NULL;
+        }
+        for(size_t k=0; k < half; k++) {
+            mp_float_t theta = 2.0 * MP_PI * k / n;
+            plan[k] = MICROPY_FLOAT_C_FUN(cos)(theta);
+            plan[half+k] = MICROPY_FLOAT_C_FUN(sin)(theta);
+        }
+        mp_float_t *expected = NULL;
+        if(!__atomic_compare_exchange_n(&fft_plans[bits], &expected, plan, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // created by the other instance in the meantime
+            free(plan);
+            plan = expected;
+        }
+    }
+    return plan;
+}
+
 void fft_kernel(mp_float_t *real, mp_float_t *imag, int n, int isign) {
     // This is basically a modification of four1 from Numerical Recipes
     // The main difference is that this function takes two arrays, one 
@@ -72,6 +116,184 @@ void fft_kernel(mp_float_t *real, mp_float_t *imag, int n, int isign) {
     }
 }
 
+// Same as fft_kernel, but the twiddle factors are taken from the plan created for size
+// n*stride, so no trigonometric functions are evaluated
+static void fft_kernel_plan(mp_float_t *real, mp_float_t *imag, size_t n, int isign, const mp_float_t *plan, size_t stride) {
+    size_t j, m, mmax, istep;
+    mp_float_t tempr, tempi, wr, wi;
+    const mp_float_t *plan_sin = plan + ((n * stride) >> 1);
+
+    j = 0;
+    for(size_t i = 0; i < n; i++) {
+        if (j > i) {
+            SWAP(mp_float_t, real[i], real[j]);
+            SWAP(mp_float_t, imag[i], imag[j]);
+        }
+        m = n >> 1;
+        while (j >= m && m > 0) {
+            j -= m;
+            m >>= 1;
+        }
+        j += m;
+    }
+
+    mmax = 1;
+    while (n > mmax) {
+        istep = mmax << 1;
+        // twiddle index step for this stage
+        size_t tstep = (n / istep) * stride;
+        for(m = 0; m < mmax; m++) {
+            wr = plan[m * tstep];
+            wi = -isign * plan_sin[m * tstep];
+            for(size_t i = m; i < n; i += istep) {
+                j = i + mmax;
+                tempr = wr * real[j] - wi * imag[j];
+                tempi = wr * imag[j] + wi * real[j];
+                real[j] = real[i] - tempr;
+                imag[j] = imag[i] - tempi;
+                real[i] += tempr;
+                imag[i] += tempi;
+            }
+        }
+        mmax = istep;
+    }
+}
+
+// Forward transform of real input of length n (power of 2, >= 4).
+// The input is in real[], the full complex (hermitian) result is returned in real[] and imag[].
+// The n real samples are packed into n/2 complex points, transformed with the
+// half-size complex FFT and separated afterwards.
+static void fft_real_forward(mp_float_t *real, mp_float_t *imag, size_t n, const mp_float_t *plan, bool hw, mp_float_t hw_scale) {
+    size_t half = n >> 1;
+    // pack: z[k] = x[2k] + i*x[2k+1]
+    for(size_t k=0; k < half; k++) {
+        imag[k] = real[2*k+1];
+        real[k] = real[2*k];
+    }
+    #if ULAB_FFT_HARDWARE
+    if(hw) {
+        fft_hw_kernel(real, imag, half, 1, hw_scale);
+    } else
+    #endif
+    {
+        (void)hw;
+        (void)hw_scale;
+        fft_kernel_plan(real, imag, half, 1, plan, 2);
+    }
+
+    const mp_float_t *plan_sin = plan + half;
+    mp_float_t z0r = real[0], z0i = imag[0];
+    for(size_t k=1; k <= (half >> 1); k++) {
+        size_t l = half - k;
+        mp_float_t ar = real[k], ai = imag[k];
+        mp_float_t br = real[l], bi = imag[l];
+        // even and odd sample spectra
+        mp_float_t fer = 0.5 * (ar + br);
+        mp_float_t fei = 0.5 * (ai - bi);
+        mp_float_t for_ = 0.5 * (ai + bi);
+        mp_float_t foi = 0.5 * (br - ar);
+        // t = W^k * Fo
+        mp_float_t wr = plan[k], wi = -plan_sin[k];
+        mp_float_t tr = wr * for_ - wi * foi;
+        mp_float_t ti = wr * foi + wi * for_;
+        real[k] = fer + tr;
+        imag[k] = fei + ti;
+        real[l] = fer - tr;
+        imag[l] = -(fei - ti);
+    }
+    real[0] = z0r + z0i;
+    imag[0] = 0.0;
+    real[half] = z0r - z0i;
+    imag[half] = 0.0;
+    // the upper half is the complex conjugate of the lower half
+    for(size_t k=1; k < half; k++) {
+        real[n-k] = real[k];
+        imag[n-k] = -imag[k];
+    }
+}
+
+#if ULAB_FFT_HARDWARE
+// K210 FFT accelerator, two complex 16-bit points are packed in one 64-bit word
+typedef struct _fft_hw_data_t {
+    int16_t I1;
+    int16_t R1;
+    int16_t I2;
+    int16_t R2;
+} fft_hw_data_t;
+
+// Static buffers are used, as they must be DMA accessible
+static uint64_t fft_hw_input[FFT_HW_MAX_POINTS / 2];
+static uint64_t fft_hw_output[FFT_HW_MAX_POINTS / 2];
+static SemaphoreHandle_t fft_hw_mutex = NULL;
+
+bool fft_hw_size(size_t n) {
+    return (n == 64) || (n == 128) || (n == 256) || (n == 512);
+}
+
+bool fft_hw_integer(uint8_t typecode) {
+    return (typecode == NDARRAY_INT8) || (typecode == NDARRAY_UINT8) || (typecode == NDARRAY_INT16);
+}
+
+// Scale factor mapping the 'len' input values onto the range the accelerator
+// can transform without overflow, 0 if the result would not be precise enough.
+// All butterfly stages of the n-point hardware transform are shifted, so the
+// quantization step of the result (in input units) is n * max|x| / FFT_HW_PEAK.
+// The hardware is only used if that step is not larger than FFT_HW_MAX_STEP
+// (input LSBs), otherwise the software transform gives the better result.
+mp_float_t fft_hw_scale(const mp_float_t *real, const mp_float_t *imag, size_t len, size_t n) {
+    mp_float_t maxabs = 0.0;
+    for(size_t i=0; i < len; i++) {
+        mp_float_t re = MICROPY_FLOAT_C_FUN(fabs)(real[i]);
+        mp_float_t im = MICROPY_FLOAT_C_FUN(fabs)(imag[i]);
+        if(re > maxabs) maxabs = re;
+        if(im > maxabs) maxabs = im;
+    }
+    if(maxabs == 0.0) {
+        return 1.0;
+    }
+    if((mp_float_t)n * maxabs > FFT_HW_PEAK * FFT_HW_MAX_STEP) {
+        return 0.0;
+    }
+    return FFT_HW_PEAK / maxabs;
+}
+
+// Hardware complex transform, same (not normalized) result as fft_kernel.
+// The input values are multiplied by 'scale' and must not exceed FFT_HW_PEAK.
+// All butterfly stages are shifted, so the hardware result is divided by n.
+void fft_hw_kernel(mp_float_t *real, mp_float_t *imag, size_t n, int isign, mp_float_t scale) {
+    SemaphoreHandle_t mutex = __atomic_load_n(&fft_hw_mutex, __ATOMIC_ACQUIRE);
+    if(mutex == NULL) {
+        // the accelerator is shared by both MicroPython instances
+        SemaphoreHandle_t expected = NULL;
+        mutex = xSemaphoreCreateMutex();
+        if(!__atomic_compare_exchange_n(&fft_hw_mutex, &expected, mutex, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            vSemaphoreDelete(mutex);
+            mutex = expected;
+        }
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
+    fft_hw_data_t *data = (fft_hw_data_t *)fft_hw_input;
+    for(size_t i=0; i < (n >> 1); i++) {
+        data[i].R1 = (int16_t)MICROPY_FLOAT_C_FUN(round)(real[2*i] * scale);
+        data[i].I1 = (int16_t)MICROPY_FLOAT_C_FUN(round)(imag[2*i] * scale);
+        data[i].R2 = (int16_t)MICROPY_FLOAT_C_FUN(round)(real[2*i+1] * scale);
+        data[i].I2 = (int16_t)MICROPY_FLOAT_C_FUN(round)(imag[2*i+1] * scale);
+    }
+    fft_complex_uint16(FFT_HW_SHIFT, (isign == 1) ? FFT_DIR_FORWARD : FFT_DIR_BACKWARD, fft_hw_input, n, fft_hw_output);
+
+    mp_float_t mult = (mp_float_t)n / scale;
+    data = (fft_hw_data_t *)fft_hw_output;
+    for(size_t i=0; i < (n >> 1); i++) {
+        real[2*i] = data[i].R1 * mult;
+        imag[2*i] = data[i].I1 * mult;
+        real[2*i+1] = data[i].R2 * mult;
+        imag[2*i+1] = data[i].I2 * mult;
+    }
+    xSemaphoreGive(mutex);
+}
+#endif
+
 mp_obj_t fft_fft_ifft_spectrum(size_t n_args, mp_obj_t arg_re, mp_obj_t arg_im, uint8_t type) {
     if(!MP_OBJ_IS_TYPE(arg_re, &ulab_ndarray_type)) {
         mp_raise_NotImplementedError(translate("FFT is defined for ndarrays only"));
@@ -82,7 +304,7 @@ mp_obj_t fft_fft_ifft_spectrum(size_t n_args, mp_obj_t arg_re, mp_obj_t arg_im,
         }
     }
     // Check if input is of length of power of 2
-    ndarray_obj_t *re = MP_OBJ_TO_PTR(arg_re);
+    ndarray_obj_t *re = ndarray_dense(MP_OBJ_TO_PTR(arg_re));
     uint16_t len = re->array->len;
     if((len & (len-1)) != 0) {
         mp_raise_ValueError(translate("input array length must be power of 2"));
@@ -104,8 +326,13 @@ mp_obj_t fft_fft_ifft_spectrum(size_t n_args, mp_obj_t arg_re, mp_obj_t arg_im,
     ndarray_obj_t *out_im = create_new_ndarray(1, len, NDARRAY_FLOAT);
     mp_float_t *data_im = (mp_float_t *)out_im->array->items;
 
+    // Fixed point input can be transformed by the FFT hardware
+    #if ULAB_FFT_HARDWARE
+    bool hw_integer = fft_hw_integer(re->array->typecode);
+    #endif
+
     if(n_args == 2) {
-        ndarray_obj_t *im = MP_OBJ_TO_PTR(arg_im);
+        ndarray_obj_t *im = ndarray_dense(MP_OBJ_TO_PTR(arg_im));
         if (re->array->len != im->array->len) {
             mp_raise_ValueError(translate("real and imaginary parts must be of equal length"));
         }
@@ -117,19 +344,44 @@ mp_obj_t fft_fft_ifft_spectrum(size_t n_args, mp_obj_t arg_re, mp_obj_t arg_im,
             }
             data_im -= len;
         }
+        #if ULAB_FFT_HARDWARE
+        hw_integer = hw_integer && fft_hw_integer(im->array->typecode);
+        #endif
     }
 
-    if((type == FFT_FFT) || (type == FFT_SPECTRUM)) {
-        fft_kernel(data_re, data_im, len, 1);
-        if(type == FFT_SPECTRUM) {
-            for(size_t i=0; i < len; i++) {
-                *data_re = MICROPY_FLOAT_C_FUN(sqrt)(*data_re * *data_re + *data_im * *data_im);
-                data_re++;
-                data_im++;
-            }
+    int isign = ((type == FFT_FFT) || (type == FFT_SPECTRUM)) ? 1 : -1;
+    mp_float_t *plan = fft_get_plan(len);
+    bool real_input = (n_args == 1) && (isign == 1) && (len >= 4) && (plan != NULL);
+    // the hardware is used only if the precision of its result is sufficient
+    mp_float_t hw_scale = 0.0;
+    #if ULAB_FFT_HARDWARE
+    size_t hw_len = (real_input) ? (len >> 1) : len;
+    if(hw_integer && fft_hw_size(hw_len)) {
+        hw_scale = fft_hw_scale(data_re, data_im, len, hw_len);
+    }
+    #endif
+    if(real_input) {
+        // real input, use the half size complex transform
+        fft_real_forward(data_re, data_im, len, plan, hw_scale > 0.0, hw_scale);
+    }
+    #if ULAB_FFT_HARDWARE
+    else if(hw_scale > 0.0) {
+        fft_hw_kernel(data_re, data_im, len, isign, hw_scale);
+    }
+    #endif
+    else if(plan != NULL) {
+        fft_kernel_plan(data_re, data_im, len, isign, plan, 1);
+    } else {
+        fft_kernel(data_re, data_im, len, isign);
+    }
+
+    if(type == FFT_SPECTRUM) {
+        for(size_t i=0; i < len; i++) {
+            *data_re = MICROPY_FLOAT_C_FUN(sqrt)(*data_re * *data_re + *data_im * *data_im);
+            data_re++;
+            data_im++;
         }
-    } else { // inverse transform
-        fft_kernel(data_re, data_im, len, -1);
+    } else if(type == FFT_IFFT) {
         // TODO: numpy accepts the norm keyword argument
         for(size_t i=0; i < len; i++) {
             *data_re++ /= len;
@@ -166,10 +418,21 @@ mp_obj_t fft_ifft(size_t n_args, const mp_obj_t *args) {
 
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fft_ifft_obj, 1, 2, fft_ifft);
 
+mp_obj_t fft_spectrum(size_t n_args, const mp_obj_t *args) {
+    if(n_args == 2) {
+        return fft_fft_ifft_spectrum(n_args, args[0], args[1], FFT_SPECTRUM);
+    } else {
+        return fft_fft_ifft_spectrum(n_args, args[0], mp_const_none, FFT_SPECTRUM);
+    }
+}
+
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(fft_spectrum_obj, 1, 2, fft_spectrum);
+
 STATIC const mp_rom_map_elem_t ulab_fft_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_fft) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_fft), (mp_obj_t)&fft_fft_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ifft), (mp_obj_t)&fft_ifft_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_spectrum), (mp_obj_t)&fft_spectrum_obj },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_ulab_fft_globals, ulab_fft_globals_table);
@@ -19,6 +19,20 @@
 
 #define SWAP(t, a, b) { t tmp = a; a = b; b = tmp; }
 
+// Largest size (2^FFT_MAX_PLAN_BITS) for which the twiddle factors are cached
+#define FFT_MAX_PLAN_BITS (14)
+
+#if ULAB_FFT_HARDWARE
+// The K210 FFT accelerator supports 64, 128, 256 and 512 points
+#define FFT_HW_MAX_POINTS (512)
+// Shift (divide by 2) in all butterfly stages
+#define FFT_HW_SHIFT (0x1ff)
+// Peak input value, with all stages shifted the complex values never exceed 16 bits
+#define FFT_HW_PEAK (16384.0)
+// Largest acceptable quantization step of the hardware result in input LSBs
+#define FFT_HW_MAX_STEP (1.0)
+#endif
+
 enum FFT_TYPE {
     FFT_FFT,
     FFT_IFFT,
@@ -34,6 +48,14 @@ MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(fft_ifft_obj);
 MP_DECLARE_CONST_FUN_OBJ_VAR_BETWEEN(fft_spectrum_obj);
 
 mp_obj_t fft_fft_ifft_spectrum(size_t , mp_obj_t , mp_obj_t , uint8_t );
+void fft_kernel(mp_float_t *, mp_float_t *, int , int );
+
+#if ULAB_FFT_HARDWARE
+bool fft_hw_size(size_t );
+bool fft_hw_integer(uint8_t );
+mp_float_t fft_hw_scale(const mp_float_t *, const mp_float_t *, size_t , size_t );
+void fft_hw_kernel(mp_float_t *, mp_float_t *, size_t , int , mp_float_t );
+#endif
 
 #endif
 #endif
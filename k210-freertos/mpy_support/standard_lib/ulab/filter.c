@@ -31,8 +31,8 @@ mp_obj_t filter_convolve(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_a
         mp_raise_TypeError(translate("convolve arguments must be ndarrays"));
     }
 
-    ndarray_obj_t *a = MP_OBJ_TO_PTR(args[0].u_obj);
-    ndarray_obj_t *c = MP_OBJ_TO_PTR(args[1].u_obj);
+    ndarray_obj_t *a = ndarray_dense(MP_OBJ_TO_PTR(args[0].u_obj));
+    ndarray_obj_t *c = ndarray_dense(MP_OBJ_TO_PTR(args[1].u_obj));
     int len_a = a->array->len;
     int len_c = c->array->len;
     // deal with linear arrays only
@@ -84,9 +84,255 @@ mp_obj_t filter_convolve(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_a
 
 MP_DEFINE_CONST_FUN_OBJ_KW(filter_convolve_obj, 2, filter_convolve);
 
+// Streaming filters: the state is kept between calls, so that a signal can be 
+// processed in blocks, and the results are identical to filtering the whole signal 
+// at once. The output goes into a caller-supplied float array, if given, so that 
+// no memory is allocated in the processing loop.
+
+STATIC ndarray_obj_t *filter_get_output(mp_obj_t oout, ndarray_obj_t *in) {
+    ndarray_obj_t *out;
+    if(oout == mp_const_none) {
+        out = create_new_ndarray(in->m, in->n, NDARRAY_FLOAT);
+    } else {
+        if(!MP_OBJ_IS_TYPE(oout, &ulab_ndarray_type)) {
+            mp_raise_TypeError(translate("out must be an ndarray"));
+        }
+        out = MP_OBJ_TO_PTR(oout);
+        if((out->array->typecode != NDARRAY_FLOAT) || (out->array->len != in->array->len) || !ndarray_is_dense(out)) {
+            mp_raise_ValueError(translate("out must be a contiguous float array of the length of the input"));
+        }
+    }
+    return out;
+}
+
+STATIC mp_float_t filter_get_float(ndarray_obj_t *ndarray, size_t m, size_t n) {
+    uint8_t _sizeof = mp_binary_get_size('@', ndarray->array->typecode, NULL);
+    uint8_t *items = (uint8_t *)ndarray->array->items + NDARRAY_INDEX(ndarray, m, n)*_sizeof;
+    return ndarray_get_float_value(items, ndarray->array->typecode, 0);
+}
+
+STATIC void filter_load_input(ndarray_obj_t *in, mp_float_t *y) {
+    // copies the input into the output, converting it to float on the way; 
+    // this is a no-op, if the filter is applied in place
+    if((in->array->typecode == NDARRAY_FLOAT) && ndarray_is_dense(in)) {
+        if((mp_float_t *)in->array->items != y) {
+            memmove(y, in->array->items, in->bytes);
+        }
+        return;
+    }
+    for(size_t m=0; m < in->m; m++) {
+        for(size_t n=0; n < in->n; n++) {
+            *y++ = filter_get_float(in, m, n);
+        }
+    }
+}
+
+// one step of a second-order section in transposed direct form II
+#define SOS_STEP(y, b0, b1, b2, a1, a2, z0, z1) do {\
+    mp_float_t x = (y);\
+    mp_float_t _y = (b0)*x + (z0);\
+    (z0) = (b1)*x - (a1)*_y + (z1);\
+    (z1) = (b2)*x - (a2)*_y;\
+    (y) = _y;\
+} while(0)
+
+mp_obj_t filter_sosfilt(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_sos, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_x, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_zi, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_out, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if(!MP_OBJ_IS_TYPE(args[0].u_obj, &ulab_ndarray_type) || !MP_OBJ_IS_TYPE(args[1].u_obj, &ulab_ndarray_type)) {
+        mp_raise_TypeError(translate("sosfilt requires ndarray arguments"));
+    }
+    ndarray_obj_t *sos = MP_OBJ_TO_PTR(args[0].u_obj);
+    ndarray_obj_t *in = MP_OBJ_TO_PTR(args[1].u_obj);
+    if((sos->n != 6) || (sos->m == 0)) {
+        mp_raise_ValueError(translate("sos array must be of shape (n_section, 6)"));
+    }
+    if((in->m != 1) && (in->n != 1)) {
+        mp_raise_TypeError(translate("input must be a one-dimensional array"));
+    }
+    // zi holds the two state variables of each section; it is updated in place, 
+    // so that the next block continues, where this one left off
+    mp_float_t *zi = NULL;
+    if(args[2].u_obj != mp_const_none) {
+        if(!MP_OBJ_IS_TYPE(args[2].u_obj, &ulab_ndarray_type)) {
+            mp_raise_TypeError(translate("zi must be an ndarray"));
+        }
+        ndarray_obj_t *ozi = MP_OBJ_TO_PTR(args[2].u_obj);
+        if((ozi->array->typecode != NDARRAY_FLOAT) || (ozi->m != sos->m) || (ozi->n != 2) || !ndarray_is_dense(ozi)) {
+            mp_raise_ValueError(translate("zi must be a float array of shape (n_section, 2)"));
+        }
+        zi = (mp_float_t *)ozi->array->items;
+    }
+    ndarray_obj_t *out = filter_get_output(args[3].u_obj, in);
+    mp_float_t *y = (mp_float_t *)out->array->items;
+    filter_load_input(in, y);
+    size_t len = in->array->len;
+
+    for(size_t section=0; section < sos->m; section++) {
+        mp_float_t b0, b1, b2, a0, a1, a2;
+        b0 = filter_get_float(sos, section, 0);
+        b1 = filter_get_float(sos, section, 1);
+        b2 = filter_get_float(sos, section, 2);
+        a0 = filter_get_float(sos, section, 3);
+        a1 = filter_get_float(sos, section, 4);
+        a2 = filter_get_float(sos, section, 5);
+        if(a0 == 0.0) {
+            mp_raise_ValueError(translate("a0 must not be zero"));
+        }
+        if(a0 != 1.0) {
+            b0 /= a0; b1 /= a0; b2 /= a0; a1 /= a0; a2 /= a0;
+        }
+        // the state lives in registers during the loop
+        mp_float_t z0 = 0.0, z1 = 0.0;
+        if(zi != NULL) {
+            z0 = zi[2*section];
+            z1 = zi[2*section+1];
+        }
+        mp_float_t *yp = y;
+        size_t i = len;
+        for(; i >= 4; i -= 4, yp += 4) {
+            SOS_STEP(yp[0], b0, b1, b2, a1, a2, z0, z1);
+            SOS_STEP(yp[1], b0, b1, b2, a1, a2, z0, z1);
+            SOS_STEP(yp[2], b0, b1, b2, a1, a2, z0, z1);
+            SOS_STEP(yp[3], b0, b1, b2, a1, a2, z0, z1);
+        }
+        for(; i > 0; i--, yp++) {
+            SOS_STEP(yp[0], b0, b1, b2, a1, a2, z0, z1);
+        }
+        if(zi != NULL) {
+            zi[2*section] = z0;
+            zi[2*section+1] = z1;
+        }
+    }
+    return MP_OBJ_FROM_PTR(out);
+}
+
+MP_DEFINE_CONST_FUN_OBJ_KW(filter_sosfilt_obj, 2, filter_sosfilt);
+
+// FIR filter object: the taps, and a delay line holding the last ntaps input 
+// samples. The delay line is stored twice in a row, so that the most recent 
+// ntaps samples are always contiguous, and the inner product needs no wrap-around.
+typedef struct _filter_fir_obj_t {
+    mp_obj_base_t base;
+    size_t ntaps;
+    size_t pos;
+    mp_float_t *taps;
+    mp_float_t *delay;
+} filter_fir_obj_t;
+
+STATIC mp_obj_t filter_fir_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    if(!MP_OBJ_IS_TYPE(args[0], &ulab_ndarray_type)) {
+        mp_raise_TypeError(translate("taps must be an ndarray"));
+    }
+    ndarray_obj_t *taps = MP_OBJ_TO_PTR(args[0]);
+    if(((taps->m != 1) && (taps->n != 1)) || (taps->array->len == 0)) {
+        mp_raise_ValueError(translate("taps must be a non-empty, one-dimensional array"));
+    }
+    filter_fir_obj_t *self = m_new_obj(filter_fir_obj_t);
+    self->base.type = &filter_fir_type;
+    self->ntaps = taps->array->len;
+    self->pos = 0;
+    self->taps = m_new(mp_float_t, self->ntaps);
+    filter_load_input(taps, self->taps);
+    self->delay = m_new0(mp_float_t, 2*self->ntaps);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC void filter_fir_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    (void)kind;
+    filter_fir_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "FIR(ntaps=%u)", (unsigned)self->ntaps);
+}
+
+STATIC mp_float_t filter_fir_step(filter_fir_obj_t *self, mp_float_t x) {
+    size_t ntaps = self->ntaps;
+    self->pos = (self->pos == 0) ? ntaps - 1 : self->pos - 1;
+    mp_float_t *delay = &self->delay[self->pos];
+    delay[0] = delay[ntaps] = x;
+    // y[n] = sum_k taps[k]*x[n-k], and delay[k] is x[n-k]
+    mp_float_t *taps = self->taps;
+    mp_float_t acc0 = 0.0, acc1 = 0.0, acc2 = 0.0, acc3 = 0.0;
+    size_t k = 0;
+    for(; k+4 <= ntaps; k += 4) {
+        acc0 += taps[k] * delay[k];
+        acc1 += taps[k+1] * delay[k+1];
+        acc2 += taps[k+2] * delay[k+2];
+        acc3 += taps[k+3] * delay[k+3];
+    }
+    for(; k < ntaps; k++) {
+        acc0 += taps[k] * delay[k];
+    }
+    return (acc0 + acc1) + (acc2 + acc3);
+}
+
+mp_obj_t filter_fir_process(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_x, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_out, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    filter_fir_obj_t *self = MP_OBJ_TO_PTR(args[0].u_obj);
+    if(!MP_OBJ_IS_TYPE(args[1].u_obj, &ulab_ndarray_type)) {
+        mp_raise_TypeError(translate("input must be an ndarray"));
+    }
+    ndarray_obj_t *in = MP_OBJ_TO_PTR(args[1].u_obj);
+    if((in->m != 1) && (in->n != 1)) {
+        mp_raise_TypeError(translate("input must be a one-dimensional array"));
+    }
+    ndarray_obj_t *out = filter_get_output(args[2].u_obj, in);
+    mp_float_t *y = (mp_float_t *)out->array->items;
+    // the samples are filtered one by one, so the output can overwrite the input
+    filter_load_input(in, y);
+    for(size_t i=0; i < out->array->len; i++) {
+        y[i] = filter_fir_step(self, y[i]);
+    }
+    return MP_OBJ_FROM_PTR(out);
+}
+
+MP_DEFINE_CONST_FUN_OBJ_KW(filter_fir_process_obj, 2, filter_fir_process);
+
+mp_obj_t filter_fir_reset(mp_obj_t self_in) {
+    filter_fir_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    memset(self->delay, 0, 2*self->ntaps*sizeof(mp_float_t));
+    self->pos = 0;
+    return mp_const_none;
+}
+
+MP_DEFINE_CONST_FUN_OBJ_1(filter_fir_reset_obj, filter_fir_reset);
+
+STATIC const mp_rom_map_elem_t filter_fir_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_process), MP_ROM_PTR(&filter_fir_process_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&filter_fir_reset_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(filter_fir_locals_dict, filter_fir_locals_dict_table);
+
+const mp_obj_type_t filter_fir_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_FIR,
+    .print = filter_fir_print,
+    .make_new = filter_fir_make_new,
+    .locals_dict = (mp_obj_dict_t*)&filter_fir_locals_dict,
+};
+
 STATIC const mp_rom_map_elem_t ulab_filter_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_filter) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_convolve), (mp_obj_t)&filter_convolve_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sosfilt), (mp_obj_t)&filter_sosfilt_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_FIR), (mp_obj_t)&filter_fir_type },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_ulab_filter_globals, ulab_filter_globals_table);
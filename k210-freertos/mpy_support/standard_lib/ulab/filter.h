@@ -19,7 +19,10 @@
 
 extern mp_obj_module_t ulab_filter_module;
 
+extern const mp_obj_type_t filter_fir_type;
+
 MP_DECLARE_CONST_FUN_OBJ_KW(filter_convolve_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(filter_sosfilt_obj);
 
 #endif
 #endif
@@ -16,6 +16,7 @@
 #include "py/runtime.h"
 #include "py/misc.h"
 #include "linalg.h"
+#include "linalg_kernels.h"
 
 #if ULAB_LINALG_MODULE
 
@@ -62,43 +63,43 @@ MP_DEFINE_CONST_FUN_OBJ_KW(linalg_size_obj, 1, linalg_size);
 bool linalg_invert_matrix(mp_float_t *data, size_t N) {
     // returns true, of the inversion was successful, 
     // false, if the matrix is singular
-    
-    // initially, this is the unit matrix: the contents of this matrix is what 
-    // will be returned after all the transformations
-    mp_float_t *unit = m_new(mp_float_t, N*N);
+    // on success, data is replaced by its inverse
+    uint16_t *perm = m_new(uint16_t, N);
+    mp_float_t *inverse = m_new(mp_float_t, N*N);
+    int8_t parity;
+    bool success = linalg_lu_decompose(data, N, perm, &parity);
+    if(success) {
+        linalg_lu_solve(data, N, perm, NULL, inverse, N);
+        memcpy(data, inverse, sizeof(mp_float_t)*N*N);
+    }
+    m_del(mp_float_t, inverse, N*N);
+    m_del(uint16_t, perm, N);
+    return success;
+}
 
-    mp_float_t elem = 1.0;
-    // initialise the unit matrix
-    memset(unit, 0, sizeof(mp_float_t)*N*N);
-    for(size_t m=0; m < N; m++) {
-        memcpy(&unit[m*(N+1)], &elem, sizeof(mp_float_t));
+STATIC ndarray_obj_t *linalg_float_ndarray(ndarray_obj_t *ndarray) {
+    // returns ndarray, if it is a dense float array, or a dense float copy of it otherwise
+    ndarray = ndarray_dense(ndarray);
+    if(ndarray->array->typecode == NDARRAY_FLOAT) {
+        return ndarray;
     }
-    for(size_t m=0; m < N; m++){
-        // this could be faster with ((c < epsilon) && (c > -epsilon))
-        if(MICROPY_FLOAT_C_FUN(fabs)(data[m*(N+1)]) < epsilon) {
-            m_del(mp_float_t, unit, N*N);
-            return false;
-        }
-        for(size_t n=0; n < N; n++){
-            if(m != n){
-                elem = data[N*n+m] / data[m*(N+1)];
-                for(size_t k=0; k < N; k++){
-                    data[N*n+k] -= elem * data[N*m+k];
-                    unit[N*n+k] -= elem * unit[N*m+k];
-                }
-            }
-        }
+    ndarray_obj_t *out = create_new_ndarray(ndarray->m, ndarray->n, NDARRAY_FLOAT);
+    mp_float_t *data = (mp_float_t *)out->array->items;
+    for(size_t i=0; i < ndarray->array->len; i++) {
+        data[i] = ndarray_get_float_value(ndarray->array->items, ndarray->array->typecode, i);
     }
-    for(size_t m=0; m < N; m++){ 
-        elem = data[m*(N+1)];
-        for(size_t n=0; n < N; n++){
-            data[N*m+n] /= elem;
-            unit[N*m+n] /= elem;
-        }
+    return out;
+}
+
+STATIC ndarray_obj_t *linalg_square_matrix(mp_obj_t oin) {
+    if(!MP_OBJ_IS_TYPE(oin, &ulab_ndarray_type)) {
+        mp_raise_TypeError(translate("function defined for ndarrays only"));
     }
-    memcpy(data, unit, sizeof(mp_float_t)*N*N);
-    m_del(mp_float_t, unit, N*N);
-    return true;
+    ndarray_obj_t *in = MP_OBJ_TO_PTR(oin);
+    if(in->m != in->n) {
+        mp_raise_ValueError(translate("input must be square matrix"));
+    }
+    return in;
 }
 
 mp_obj_t linalg_inv(mp_obj_t o_in) {
@@ -107,28 +108,15 @@ mp_obj_t linalg_inv(mp_obj_t o_in) {
         mp_raise_TypeError(translate("only ndarrays can be inverted"));
     }
     ndarray_obj_t *o = MP_OBJ_TO_PTR(o_in);
-    if(!MP_OBJ_IS_TYPE(o_in, &ulab_ndarray_type)) {
-        mp_raise_TypeError(translate("only ndarray objects can be inverted"));
-    }
     if(o->m != o->n) {
         mp_raise_ValueError(translate("only square matrices can be inverted"));
     }
+    // the decomposition is done in place, so we need a copy, even if the input is a float array
     ndarray_obj_t *inverted = create_new_ndarray(o->m, o->n, NDARRAY_FLOAT);
-    mp_float_t *data = (mp_float_t *)inverted->array->items;
-    mp_obj_t elem;
-    for(size_t m=0; m < o->m; m++) { // rows first
-        for(size_t n=0; n < o->n; n++) { // columns next
-            // this could, perhaps, be done in single line... 
-            // On the other hand, we probably spend little time here
-            elem = mp_binary_get_val_array(o->array->typecode, o->array->items, m*o->n+n);
-            data[m*o->n+n] = (mp_float_t)mp_obj_get_float(elem);
-        }
-    }
+    ndarray_obj_t *in = linalg_float_ndarray(o);
+    memcpy(inverted->array->items, in->array->items, inverted->bytes);
     
-    if(!linalg_invert_matrix(data, o->m)) {
-        // TODO: I am not sure this is needed here. Otherwise, 
-        // how should we free up the unused RAM of inverted?
-        m_del(mp_float_t, inverted->array->items, o->n*o->n);
+    if(!linalg_invert_matrix((mp_float_t *)inverted->array->items, o->m)) {
         mp_raise_ValueError(translate("input matrix is singular"));
     }
     return MP_OBJ_FROM_PTR(inverted);
@@ -136,81 +124,119 @@ mp_obj_t linalg_inv(mp_obj_t o_in) {
 
 MP_DEFINE_CONST_FUN_OBJ_1(linalg_inv_obj, linalg_inv);
 
-mp_obj_t linalg_dot(mp_obj_t _m1, mp_obj_t _m2) {
+mp_obj_t linalg_dot(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+        { MP_QSTR_out, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = mp_const_none } },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    
     // TODO: should the results be upcast?
-    if(!MP_OBJ_IS_TYPE(_m1, &ulab_ndarray_type) || !MP_OBJ_IS_TYPE(_m2, &ulab_ndarray_type)) {
+    if(!MP_OBJ_IS_TYPE(args[0].u_obj, &ulab_ndarray_type) || !MP_OBJ_IS_TYPE(args[1].u_obj, &ulab_ndarray_type)) {
         mp_raise_TypeError(translate("arguments must be ndarrays"));
     }
-    ndarray_obj_t *m1 = MP_OBJ_TO_PTR(_m1);
-    ndarray_obj_t *m2 = MP_OBJ_TO_PTR(_m2);    
+    ndarray_obj_t *m1 = linalg_float_ndarray(MP_OBJ_TO_PTR(args[0].u_obj));
+    ndarray_obj_t *m2 = linalg_float_ndarray(MP_OBJ_TO_PTR(args[1].u_obj));
     if(m1->n != m2->m) {
         mp_raise_ValueError(translate("matrix dimensions do not match"));
     }
-    // TODO: numpy uses upcasting here
-    ndarray_obj_t *out = create_new_ndarray(m1->m, m2->n, NDARRAY_FLOAT);
+    ndarray_obj_t *out;
+    if(args[2].u_obj == mp_const_none) {
+        out = create_new_ndarray(m1->m, m2->n, NDARRAY_FLOAT);
+    } else {
+        if(!MP_OBJ_IS_TYPE(args[2].u_obj, &ulab_ndarray_type)) {
+            mp_raise_TypeError(translate("out must be an ndarray"));
+        }
+        out = MP_OBJ_TO_PTR(args[2].u_obj);
+        if((out->array->typecode != NDARRAY_FLOAT) || (out->m != m1->m) || (out->n != m2->n) || !ndarray_is_dense(out)) {
+            mp_raise_ValueError(translate("out must be a contiguous float array of the shape of the product"));
+        }
+    }
     mp_float_t *outdata = (mp_float_t *)out->array->items;
-    mp_float_t sum, v1, v2;
-    for(size_t i=0; i < m1->m; i++) { // rows of m1
-        for(size_t j=0; j < m2->n; j++) { // columns of m2
-            sum = 0.0;
-            for(size_t k=0; k < m2->m; k++) {
-                // (i, k) * (k, j)
-                v1 = ndarray_get_float_value(m1->array->items, m1->array->typecode, i*m1->n+k);
-                v2 = ndarray_get_float_value(m2->array->items, m2->array->typecode, k*m2->n+j);
-                sum += v1 * v2;
-            }
-            outdata[j*m1->m+i] = sum;
+    mp_float_t *a = (mp_float_t *)m1->array->items;
+    mp_float_t *b = (mp_float_t *)m2->array->items;
+    // if out shares its storage with one of the operands, the product must be 
+    // accumulated elsewhere; small matrices can use the stack for that
+    uint8_t *o0 = (uint8_t *)outdata, *o1 = o0 + out->bytes;
+    if(((o0 < (uint8_t *)a + m1->bytes) && ((uint8_t *)a < o1)) || ((o0 < (uint8_t *)b + m2->bytes) && ((uint8_t *)b < o1))) {
+        mp_float_t buffer[36];
+        mp_float_t *product = (out->array->len <= 36) ? buffer : m_new(mp_float_t, out->array->len);
+        linalg_gemm(a, b, product, m1->m, m1->n, m2->n);
+        memcpy(outdata, product, out->bytes);
+        if(product != buffer) {
+            m_del(mp_float_t, product, out->array->len);
         }
+    } else {
+        linalg_gemm(a, b, outdata, m1->m, m1->n, m2->n);
     }
     return MP_OBJ_FROM_PTR(out);
 }
 
-MP_DEFINE_CONST_FUN_OBJ_2(linalg_dot_obj, linalg_dot);
+MP_DEFINE_CONST_FUN_OBJ_KW(linalg_dot_obj, 2, linalg_dot);
 
 mp_obj_t linalg_det(mp_obj_t oin) {
-    if(!MP_OBJ_IS_TYPE(oin, &ulab_ndarray_type)) {
-        mp_raise_TypeError(translate("function defined for ndarrays only"));
-    }
-    ndarray_obj_t *in = MP_OBJ_TO_PTR(oin);
-    if(in->m != in->n) {
-        mp_raise_ValueError(translate("input must be square matrix"));
-    }
-    
-    mp_float_t *tmp = m_new(mp_float_t, in->n*in->n);
-    for(size_t i=0; i < in->array->len; i++){
-        tmp[i] = ndarray_get_float_value(in->array->items, in->array->typecode, i);
-    }
-    mp_float_t c;
-    for(size_t m=0; m < in->m-1; m++){
-        if(MICROPY_FLOAT_C_FUN(fabs)(tmp[m*(in->n+1)]) < epsilon) {
-            m_del(mp_float_t, tmp, in->n*in->n);
-            return mp_obj_new_float(0.0);
-        }
-        for(size_t n=0; n < in->n; n++){
-            if(m != n) {
-                c = tmp[in->n*n+m] / tmp[m*(in->n+1)];
-                for(size_t k=0; k < in->n; k++){
-                    tmp[in->n*n+k] -= c * tmp[in->n*m+k];
-                }
-            }
+    ndarray_obj_t *in = linalg_square_matrix(oin);
+    size_t N = in->n;
+    // the decomposition is done in place, so we always work on a copy
+    ndarray_obj_t *lu = create_new_ndarray(N, N, NDARRAY_FLOAT);
+    memcpy(lu->array->items, linalg_float_ndarray(in)->array->items, lu->bytes);
+    mp_float_t *tmp = (mp_float_t *)lu->array->items;
+    uint16_t *perm = m_new(uint16_t, N);
+    int8_t parity;
+    mp_float_t det = 0.0;
+    if(linalg_lu_decompose(tmp, N, perm, &parity)) {
+        det = parity;
+        for(size_t m=0; m < N; m++){ 
+            det *= tmp[m*(N+1)];
         }
     }
-    mp_float_t det = 1.0;
-                            
-    for(size_t m=0; m < in->m; m++){ 
-        det *= tmp[m*(in->n+1)];
-    }
-    m_del(mp_float_t, tmp, in->n*in->n);
+    m_del(uint16_t, perm, N);
     return mp_obj_new_float(det);
 }
 
 MP_DEFINE_CONST_FUN_OBJ_1(linalg_det_obj, linalg_det);
 
+mp_obj_t linalg_solve(mp_obj_t oA, mp_obj_t ob) {
+    // Solves A*x = b without inverting A. b can be a vector of length N (either a row, or a column), 
+    // or an (N, k) matrix, in which case the k columns are solved for simultaneously.
+    ndarray_obj_t *A = linalg_square_matrix(oA);
+    if(!MP_OBJ_IS_TYPE(ob, &ulab_ndarray_type)) {
+        mp_raise_TypeError(translate("function defined for ndarrays only"));
+    }
+    ndarray_obj_t *b = linalg_float_ndarray(MP_OBJ_TO_PTR(ob));
+    size_t N = A->n, nrhs;
+    if((b->m == 1) && (b->n == N)) { // a row vector is treated as a single right hand side
+        nrhs = 1;
+    } else if(b->m == N) {
+        nrhs = b->n;
+    } else {
+        mp_raise_ValueError(translate("matrix dimensions do not match"));
+    }
+    ndarray_obj_t *lu = create_new_ndarray(N, N, NDARRAY_FLOAT);
+    memcpy(lu->array->items, linalg_float_ndarray(A)->array->items, lu->bytes);
+    uint16_t *perm = m_new(uint16_t, N);
+    int8_t parity;
+    if(!linalg_lu_decompose((mp_float_t *)lu->array->items, N, perm, &parity)) {
+        m_del(uint16_t, perm, N);
+        mp_raise_ValueError(translate("input matrix is singular"));
+    }
+    ndarray_obj_t *x = create_new_ndarray(b->m, b->n, NDARRAY_FLOAT);
+    linalg_lu_solve((mp_float_t *)lu->array->items, N, perm, (mp_float_t *)b->array->items, 
+                    (mp_float_t *)x->array->items, nrhs);
+    m_del(uint16_t, perm, N);
+    return MP_OBJ_FROM_PTR(x);
+}
+
+MP_DEFINE_CONST_FUN_OBJ_2(linalg_solve_obj, linalg_solve);
+
 mp_obj_t linalg_eig(mp_obj_t oin) {
     if(!MP_OBJ_IS_TYPE(oin, &ulab_ndarray_type)) {
         mp_raise_TypeError(translate("function defined for ndarrays only"));
     }
-    ndarray_obj_t *in = MP_OBJ_TO_PTR(oin);
+    ndarray_obj_t *in = ndarray_dense(MP_OBJ_TO_PTR(oin));
     if(in->m != in->n) {
         mp_raise_ValueError(translate("input must be square matrix"));
     }
@@ -340,7 +366,7 @@ mp_obj_t linalg_cholesky(mp_obj_t oin) {
 		mp_raise_TypeError(translate("function is defined for ndarrays only"));
 	}
 	
-	ndarray_obj_t *in = MP_OBJ_TO_PTR(oin); 
+	ndarray_obj_t *in = ndarray_dense(MP_OBJ_TO_PTR(oin)); 
 	if(in->m != in->n) {
 		mp_raise_ValueError(translate("input must be square matrix"));
 	}
@@ -400,6 +426,7 @@ STATIC const mp_rom_map_elem_t ulab_linalg_globals_table[] = {
 	{ MP_ROM_QSTR(MP_QSTR_inv), (mp_obj_t)&linalg_inv_obj },
 	{ MP_ROM_QSTR(MP_QSTR_dot), (mp_obj_t)&linalg_dot_obj },
 	{ MP_ROM_QSTR(MP_QSTR_det), (mp_obj_t)&linalg_det_obj },
+	{ MP_ROM_QSTR(MP_QSTR_solve), (mp_obj_t)&linalg_solve_obj },
 	{ MP_ROM_QSTR(MP_QSTR_eig), (mp_obj_t)&linalg_eig_obj },
 	{ MP_ROM_QSTR(MP_QSTR_cholesky), (mp_obj_t)&linalg_cholesky_obj },
 };
@@ -33,8 +33,9 @@ extern mp_obj_module_t ulab_linalg_module;
 
 MP_DECLARE_CONST_FUN_OBJ_KW(linalg_size_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(linalg_inv_obj);
-MP_DECLARE_CONST_FUN_OBJ_2(linalg_dot_obj);
+MP_DECLARE_CONST_FUN_OBJ_KW(linalg_dot_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(linalg_det_obj);
+MP_DECLARE_CONST_FUN_OBJ_2(linalg_solve_obj);
 MP_DECLARE_CONST_FUN_OBJ_1(linalg_eig_obj);
 
 #endif
@@ -0,0 +1,194 @@
+/*
+ * This file is part of the micropython-ulab project, 
+ *
+ * https://github.com/v923z/micropython-ulab
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2020 Zoltán Vörös
+*/
+
+// Dense matrix kernels of the linalg module. This header has no MicroPython 
+// dependencies, the same kernels are used by linalg.c and by the host benchmark 
+// in linalgbench. The includer has to define mp_float_t, MICROPY_FLOAT_C_FUN, and epsilon.
+
+#ifndef _LINALG_KERNELS_
+#define _LINALG_KERNELS_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef MIN
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#endif
+
+#ifndef SWAP
+#define SWAP(t, a, b) { t tmp = a; a = b; b = tmp; }
+#endif
+
+// edge length of the tiles in the matrix product: three 32x32 tiles of doubles 
+// take 24 kB, and still fit into the 32 kB data cache of the K210
+#define LINALG_BLOCK   32
+
+// The kernels below work on dense, row-major mp_float_t matrices. The sizes that 
+// come up in small state estimators (3x3, 4x4, and 6x6) are dispatched to copies 
+// of the kernels, in which the dimensions are compile-time constants, so that 
+// the compiler can unroll the loops completely.
+#define LINALG_ALWAYS_INLINE static inline __attribute__((always_inline))
+
+LINALG_ALWAYS_INLINE void linalg_gemm_small(const mp_float_t *a, const mp_float_t *b, mp_float_t *c, 
+                                            const size_t M, const size_t K, const size_t N) {
+    _Pragma("GCC unroll 6")
+    for(size_t i=0; i < M; i++) {
+        _Pragma("GCC unroll 6")
+        for(size_t j=0; j < N; j++) {
+            mp_float_t sum = 0.0;
+            _Pragma("GCC unroll 6")
+            for(size_t k=0; k < K; k++) {
+                sum += a[i*K+k] * b[k*N+j];
+            }
+            c[i*N+j] = sum;
+        }
+    }
+}
+
+static void linalg_gemm(const mp_float_t *a, const mp_float_t *b, mp_float_t *c, size_t M, size_t K, size_t N) {
+    // c = a * b, where a is of shape (M, K), and b is of shape (K, N); c must not overlap with a, or b
+    if((M == K) && ((N == K) || (N == 1))) {
+        switch(M) {
+            case 3: (N == 1) ? linalg_gemm_small(a, b, c, 3, 3, 1) : linalg_gemm_small(a, b, c, 3, 3, 3); return;
+            case 4: (N == 1) ? linalg_gemm_small(a, b, c, 4, 4, 1) : linalg_gemm_small(a, b, c, 4, 4, 4); return;
+            case 6: (N == 1) ? linalg_gemm_small(a, b, c, 6, 6, 1) : linalg_gemm_small(a, b, c, 6, 6, 6); return;
+            default: break;
+        }
+    }
+    // A (LINALG_BLOCK x LINALG_BLOCK) tile of b is kept in the cache, while it is 
+    // applied to all rows of a; the innermost loop runs along contiguous rows of b, and c
+    memset(c, 0, sizeof(mp_float_t)*M*N);
+    for(size_t k0=0; k0 < K; k0 += LINALG_BLOCK) {
+        size_t k1 = MIN(k0 + LINALG_BLOCK, K);
+        for(size_t j0=0; j0 < N; j0 += LINALG_BLOCK) {
+            size_t j1 = MIN(j0 + LINALG_BLOCK, N);
+            for(size_t i=0; i < M; i++) {
+                const mp_float_t *arow = &a[i*K];
+                mp_float_t *crow = &c[i*N];
+                for(size_t k=k0; k < k1; k++) {
+                    const mp_float_t aik = arow[k];
+                    const mp_float_t *brow = &b[k*N];
+                    for(size_t j=j0; j < j1; j++) {
+                        crow[j] += aik * brow[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+LINALG_ALWAYS_INLINE bool linalg_lu_kernel(mp_float_t *a, const size_t N, uint16_t *perm, int8_t *parity) {
+    *parity = 1;
+    _Pragma("GCC unroll 6")
+    for(size_t i=0; i < N; i++) {
+        perm[i] = i;
+    }
+    _Pragma("GCC unroll 6")
+    for(size_t k=0; k < N; k++) {
+        // partial pivoting: bring the largest remaining entry of column k to the diagonal
+        size_t p = k;
+        mp_float_t largest = MICROPY_FLOAT_C_FUN(fabs)(a[k*N+k]);
+        _Pragma("GCC unroll 6")
+        for(size_t i=k+1; i < N; i++) {
+            mp_float_t w = MICROPY_FLOAT_C_FUN(fabs)(a[i*N+k]);
+            if(w > largest) {
+                largest = w;
+                p = i;
+            }
+        }
+        if(largest < epsilon) {
+            return false;
+        }
+        if(p != k) {
+            _Pragma("GCC unroll 6")
+            for(size_t j=0; j < N; j++) {
+                SWAP(mp_float_t, a[k*N+j], a[p*N+j]);
+            }
+            SWAP(uint16_t, perm[k], perm[p]);
+            *parity = -*parity;
+        }
+        mp_float_t inverse_pivot = 1.0 / a[k*N+k];
+        _Pragma("GCC unroll 6")
+        for(size_t i=k+1; i < N; i++) {
+            mp_float_t l = a[i*N+k] * inverse_pivot;
+            a[i*N+k] = l;
+            _Pragma("GCC unroll 6")
+            for(size_t j=k+1; j < N; j++) {
+                a[i*N+j] -= l * a[k*N+j];
+            }
+        }
+    }
+    return true;
+}
+
+static bool linalg_lu_decompose(mp_float_t *a, size_t N, uint16_t *perm, int8_t *parity) {
+    // Decomposes the (N, N) matrix a in place, so that P*A = L*U, where L is unit lower triangular, 
+    // and is stored below the diagonal of a, while U occupies the diagonal, and the upper triangle. 
+    // Row i of P*A is row perm[i] of A, and parity is the sign of the permutation. 
+    // Returns false, if the matrix is singular.
+    switch(N) {
+        case 3: return linalg_lu_kernel(a, 3, perm, parity);
+        case 4: return linalg_lu_kernel(a, 4, perm, parity);
+        case 6: return linalg_lu_kernel(a, 6, perm, parity);
+        default: return linalg_lu_kernel(a, N, perm, parity);
+    }
+}
+
+LINALG_ALWAYS_INLINE void linalg_lu_substitute(const mp_float_t *lu, const size_t N, mp_float_t *x, const size_t nrhs) {
+    // forward substitution with the unit lower triangle...
+    _Pragma("GCC unroll 6")
+    for(size_t i=1; i < N; i++) {
+        _Pragma("GCC unroll 6")
+        for(size_t k=0; k < i; k++) {
+            const mp_float_t l = lu[i*N+k];
+            for(size_t j=0; j < nrhs; j++) {
+                x[i*nrhs+j] -= l * x[k*nrhs+j];
+            }
+        }
+    }
+    // ... and back substitution with the upper triangle
+    _Pragma("GCC unroll 6")
+    for(size_t i=N; i-- > 0; ) {
+        _Pragma("GCC unroll 6")
+        for(size_t k=i+1; k < N; k++) {
+            const mp_float_t u = lu[i*N+k];
+            for(size_t j=0; j < nrhs; j++) {
+                x[i*nrhs+j] -= u * x[k*nrhs+j];
+            }
+        }
+        const mp_float_t inverse_pivot = 1.0 / lu[i*(N+1)];
+        for(size_t j=0; j < nrhs; j++) {
+            x[i*nrhs+j] *= inverse_pivot;
+        }
+    }
+}
+
+static void linalg_lu_solve(const mp_float_t *lu, size_t N, const uint16_t *perm, const mp_float_t *b, mp_float_t *x, size_t nrhs) {
+    // Solves A*x = b for the (N, nrhs) matrix x, where lu, and perm are the output of linalg_lu_decompose. 
+    // If b is NULL, the right hand side is the unit matrix, i.e., x will be the inverse of A.
+    for(size_t i=0; i < N; i++) {
+        for(size_t j=0; j < nrhs; j++) {
+            if(b == NULL) {
+                x[i*nrhs+j] = (perm[i] == j) ? 1.0 : 0.0;
+            } else {
+                x[i*nrhs+j] = b[perm[i]*nrhs+j];
+            }
+        }
+    }
+    switch(N) {
+        case 3: linalg_lu_substitute(lu, 3, x, nrhs); break;
+        case 4: linalg_lu_substitute(lu, 4, x, nrhs); break;
+        case 6: linalg_lu_substitute(lu, 6, x, nrhs); break;
+        default: linalg_lu_substitute(lu, N, x, nrhs); break;
+    }
+}
+
+#endif
@@ -38,6 +38,24 @@ STATIC mp_obj_array_t *array_new(char typecode, size_t n) {
     return o;
 }
 
+STATIC mp_obj_array_t *array_new_view(char typecode, size_t n, void *items) {
+    // an array header pointing into someone else's storage; the storage itself 
+    // is kept alive by the owner field of the ndarray
+    mp_obj_array_t *o = m_new_obj(mp_obj_array_t);
+    o->base.type = &mp_type_array;
+    o->typecode = typecode;
+    o->free = 0;
+    o->len = n;
+    o->items = items;
+    return o;
+}
+
+STATIC mp_obj_t ndarray_get_item(ndarray_obj_t *ndarray, int32_t index) {
+    // index is the signed offset from array->items, as returned by NDARRAY_INDEX
+    uint8_t _sizeof = mp_binary_get_size('@', ndarray->array->typecode, NULL);
+    return mp_binary_get_val_array(ndarray->array->typecode, (uint8_t *)ndarray->array->items + index*_sizeof, 0);
+}
+
 mp_float_t ndarray_get_float_value(void *data, uint8_t typecode, size_t index) {
     if(typecode == NDARRAY_UINT8) {
         return (mp_float_t)((uint8_t *)data)[index];
@@ -62,26 +80,27 @@ void fill_array_iterable(mp_float_t *array, mp_obj_t iterable) {
     }
 }
 
-void ndarray_print_row(const mp_print_t *print, mp_obj_array_t *data, size_t n0, size_t n) {
+void ndarray_print_row(const mp_print_t *print, ndarray_obj_t *ndarray, int32_t n0, int32_t stride, size_t n) {
+    // prints n items starting at offset n0, stride items apart
     mp_print_str(print, "[");
     size_t i;
     if(n < PRINT_MAX) { // if the array is short, print everything
-        mp_obj_print_helper(print, mp_binary_get_val_array(data->typecode, data->items, n0), PRINT_REPR);
+        mp_obj_print_helper(print, ndarray_get_item(ndarray, n0), PRINT_REPR);
         for(i=1; i<n; i++) {
             mp_print_str(print, ", ");
-            mp_obj_print_helper(print, mp_binary_get_val_array(data->typecode, data->items, n0+i), PRINT_REPR);
+            mp_obj_print_helper(print, ndarray_get_item(ndarray, n0+(int32_t)i*stride), PRINT_REPR);
         }
     } else {
-        mp_obj_print_helper(print, mp_binary_get_val_array(data->typecode, data->items, n0), PRINT_REPR);
+        mp_obj_print_helper(print, ndarray_get_item(ndarray, n0), PRINT_REPR);
         for(i=1; i<3; i++) {
             mp_print_str(print, ", ");
-            mp_obj_print_helper(print, mp_binary_get_val_array(data->typecode, data->items, n0+i), PRINT_REPR);
+            mp_obj_print_helper(print, ndarray_get_item(ndarray, n0+(int32_t)i*stride), PRINT_REPR);
         }
         mp_printf(print, ", ..., ");
-        mp_obj_print_helper(print, mp_binary_get_val_array(data->typecode, data->items, n0+n-3), PRINT_REPR);
+        mp_obj_print_helper(print, ndarray_get_item(ndarray, n0+(int32_t)(n-3)*stride), PRINT_REPR);
         for(size_t i=1; i<3; i++) {
             mp_print_str(print, ", ");
-            mp_obj_print_helper(print, mp_binary_get_val_array(data->typecode, data->items, n0+n-3+i), PRINT_REPR);
+            mp_obj_print_helper(print, ndarray_get_item(ndarray, n0+(int32_t)(n-3+i)*stride), PRINT_REPR);
         }
     }
     mp_print_str(print, "]");
@@ -95,15 +114,17 @@ void ndarray_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t ki
     if(self->array->len == 0) {
         mp_print_str(print, "[]");
     } else {
-        if((self->m == 1) || (self->n == 1)) {
-            ndarray_print_row(print, self->array, 0, self->array->len);
+        if(self->m == 1) {
+            ndarray_print_row(print, self, 0, self->strides[1], self->n);
+        } else if(self->n == 1) {
+            ndarray_print_row(print, self, 0, self->strides[0], self->m);
         } else {
             // TODO: add vertical ellipses for the case, when self->m > PRINT_MAX
             mp_print_str(print, "[");
-            ndarray_print_row(print, self->array, 0, self->n);
+            ndarray_print_row(print, self, 0, self->strides[1], self->n);
             for(size_t i=1; i < self->m; i++) {
                 mp_print_str(print, ",\n\t ");
-                ndarray_print_row(print, self->array, i*self->n, self->n);
+                ndarray_print_row(print, self, NDARRAY_INDEX(self, i, 0), self->strides[1], self->n);
             }
             mp_print_str(print, "]");
         }
@@ -141,14 +162,69 @@ ndarray_obj_t *create_new_ndarray(size_t m, size_t n, uint8_t typecode) {
     // we could, perhaps, leave this step out, and initialise the array only, when needed
     memset(array->items, 0, ndarray->bytes); 
     ndarray->array = array;
+    ndarray->strides[0] = n;
+    ndarray->strides[1] = 1;
+    ndarray->owner = MP_OBJ_NULL;
+    ndarray->export = NULL;
     return ndarray;
 }
 
+ndarray_obj_t *ndarray_new_view(ndarray_obj_t *source, size_t m, size_t n, int32_t offset, int32_t stride_m, int32_t stride_n) {
+    // Creates an (m, n) ndarray that shares its data with source. offset, and the strides 
+    // are measured in items of source, i.e., they already include the strides of source
+    ndarray_obj_t *ndarray = m_new_obj(ndarray_obj_t);
+    ndarray->base.type = &ulab_ndarray_type;
+    ndarray->m = m;
+    ndarray->n = n;
+    uint8_t _sizeof = mp_binary_get_size('@', source->array->typecode, NULL);
+    ndarray->array = array_new_view(source->array->typecode, m*n, (uint8_t *)source->array->items + offset*_sizeof);
+    ndarray->bytes = m * n * _sizeof;
+    // strides of degenerate axes are irrelevant, but dense views should look dense
+    ndarray->strides[0] = (m == 1) ? (int32_t)n : stride_m;
+    ndarray->strides[1] = (n == 1) ? 1 : stride_n;
+    ndarray->owner = (source->owner != MP_OBJ_NULL) ? source->owner : MP_OBJ_FROM_PTR(source);
+    ndarray->export = NULL;
+    return ndarray;
+}
+
+bool ndarray_is_dense(ndarray_obj_t *ndarray) {
+    // true, if the items are laid out in C order without gaps, starting at array->items
+    return ((ndarray->m < 2) || (ndarray->strides[0] == (int32_t)ndarray->n)) && 
+           ((ndarray->n < 2) || (ndarray->strides[1] == 1));
+}
+
+void ndarray_copy_strided(ndarray_obj_t *target, ndarray_obj_t *source) {
+    // copies the items of source into target; the two must have the same shape, and typecode
+    uint8_t _sizeof = mp_binary_get_size('@', source->array->typecode, NULL);
+    if(ndarray_is_dense(target) && ndarray_is_dense(source)) {
+        memmove(target->array->items, source->array->items, source->bytes);
+        return;
+    }
+    uint8_t *tarray = (uint8_t *)target->array->items;
+    uint8_t *sarray = (uint8_t *)source->array->items;
+    for(size_t i=0; i < source->m; i++) {
+        for(size_t j=0; j < source->n; j++) {
+            memcpy(tarray + NDARRAY_INDEX(target, i, j)*_sizeof, sarray + NDARRAY_INDEX(source, i, j)*_sizeof, _sizeof);
+        }
+    }
+}
+
+ndarray_obj_t *ndarray_dense(ndarray_obj_t *ndarray) {
+    // returns ndarray itself, if its items are contiguous, or a compacted copy otherwise. 
+    // Functions that walk array->items linearly should call this first.
+    if(ndarray_is_dense(ndarray)) {
+        return ndarray;
+    }
+    ndarray_obj_t *out = create_new_ndarray(ndarray->m, ndarray->n, ndarray->array->typecode);
+    ndarray_copy_strided(out, ndarray);
+    return out;
+}
+
 mp_obj_t ndarray_copy(mp_obj_t self_in) {
     // returns a verbatim (shape and typecode) copy of self_in
     ndarray_obj_t *self = MP_OBJ_TO_PTR(self_in);
     ndarray_obj_t *out = create_new_ndarray(self->m, self->n, self->array->typecode);
-    memcpy(out->array->items, self->array->items, self->bytes);
+    ndarray_copy_strided(out, self);
     return MP_OBJ_FROM_PTR(out);
 }
 
@@ -288,15 +364,17 @@ mp_bound_slice_t simple_slice(int16_t start, int16_t stop, int16_t step) {
     return slice;
 }
 
-void insert_binary_value(ndarray_obj_t *ndarray, size_t nd_index, ndarray_obj_t *values, size_t value_index) {
+void insert_binary_value(ndarray_obj_t *ndarray, int32_t nd_index, ndarray_obj_t *values, int32_t value_index) {
     // there is probably a more elegant implementation...
-    mp_obj_t tmp = mp_binary_get_val_array(values->array->typecode, values->array->items, value_index);
+    // the indices are offsets with respect to array->items, as returned by NDARRAY_INDEX
+    mp_obj_t tmp = ndarray_get_item(values, value_index);
     if((values->array->typecode == NDARRAY_FLOAT) && (ndarray->array->typecode != NDARRAY_FLOAT)) {
         // workaround: rounding seems not to work in the arm compiler
         int32_t x = (int32_t)floorf(mp_obj_get_float(tmp)+0.5);
         tmp = mp_obj_new_int(x);
     }
-    mp_binary_set_val_array(ndarray->array->typecode, ndarray->array->items, nd_index, tmp); 
+    uint8_t _sizeof = mp_binary_get_size('@', ndarray->array->typecode, NULL);
+    mp_binary_set_val_array(ndarray->array->typecode, (uint8_t *)ndarray->array->items + nd_index*_sizeof, 0, tmp); 
 }
 
 mp_obj_t insert_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n, 
@@ -324,7 +402,7 @@ mp_obj_t insert_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
             for(size_t i=0; i < m; i++) {
                 cindex = column.start;
                 for(size_t j=0; j < n; j++) {
-                    insert_binary_value(ndarray, rindex*ndarray->n+cindex, values, i*M*n+j*N);
+                    insert_binary_value(ndarray, NDARRAY_INDEX(ndarray, rindex, cindex), values, NDARRAY_INDEX(values, i*M, j*N));
                     cindex += column.step;
                 }
                 rindex += row.step;
@@ -338,7 +416,7 @@ mp_obj_t insert_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
                 cindex = 0;
                 while((column_item = mp_iternext(column_iterable)) != MP_OBJ_STOP_ITERATION) {
                     if(mp_obj_is_true(column_item)) {
-                        insert_binary_value(ndarray, rindex*ndarray->n+cindex, values, i*M*n+j*N);
+                        insert_binary_value(ndarray, NDARRAY_INDEX(ndarray, rindex, cindex), values, NDARRAY_INDEX(values, i*M, j*N));
                         j++;
                     }
                     cindex++;
@@ -357,7 +435,7 @@ mp_obj_t insert_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
                 if(mp_obj_is_true(row_item)) {
                     cindex = column.start;
                     for(size_t j=0; j < n; j++) {
-                        insert_binary_value(ndarray, rindex*ndarray->n+cindex, values, i*M*n+j*N);
+                        insert_binary_value(ndarray, NDARRAY_INDEX(ndarray, rindex, cindex), values, NDARRAY_INDEX(values, i*M, j*N));
                         cindex += column.step;
                     }
                     i++;
@@ -373,7 +451,7 @@ mp_obj_t insert_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
                     column_iterable = mp_getiter(column_list, &column_iter_buf);                   
                     while((column_item = mp_iternext(column_iterable)) != MP_OBJ_STOP_ITERATION) {
                         if(mp_obj_is_true(column_item)) {
-                            insert_binary_value(ndarray, rindex*ndarray->n+cindex, values, i*M*n+j*N);
+                            insert_binary_value(ndarray, NDARRAY_INDEX(ndarray, rindex, cindex), values, NDARRAY_INDEX(values, i*M, j*N));
                             j++;
                         }
                         cindex++;
@@ -394,6 +472,12 @@ mp_obj_t iterate_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
     if(values != NULL) {
         return insert_slice_list(ndarray, m, n, row, column, row_list, column_list, values);
     }
+    if((row_list == mp_const_none) && (column_list == mp_const_none) && (m*n != 0)) {
+        // slices, and integers select a regular lattice of the items, so that 
+        // we can return a view instead of copying the data
+        return MP_OBJ_FROM_PTR(ndarray_new_view(ndarray, m, n, NDARRAY_INDEX(ndarray, row.start, column.start), 
+                                        row.step*ndarray->strides[0], column.step*ndarray->strides[1]));
+    }
     uint8_t _sizeof = mp_binary_get_size('@', ndarray->array->typecode, NULL);
     ndarray_obj_t *out = create_new_ndarray(m, n, ndarray->array->typecode);
     uint8_t *target = (uint8_t *)out->array->items;
@@ -405,7 +489,7 @@ mp_obj_t iterate_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
             for(size_t i=0; i < m; i++) {
                 cindex = column.start;
                 for(size_t j=0; j < n; j++) {
-                    memcpy(target+(i*n+j)*_sizeof, source+(rindex*ndarray->n+cindex)*_sizeof, _sizeof);
+                    memcpy(target+(i*n+j)*_sizeof, source+NDARRAY_INDEX(ndarray, rindex, cindex)*_sizeof, _sizeof);
                     cindex += column.step;
                 }
                 rindex += row.step;
@@ -420,7 +504,7 @@ mp_obj_t iterate_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
                 cindex = 0;
                 while((column_item = mp_iternext(column_iterable)) != MP_OBJ_STOP_ITERATION) {
                     if(mp_obj_is_true(column_item)) {
-                        memcpy(target+(i*n+j)*_sizeof, source+(rindex*ndarray->n+cindex)*_sizeof, _sizeof);
+                        memcpy(target+(i*n+j)*_sizeof, source+NDARRAY_INDEX(ndarray, rindex, cindex)*_sizeof, _sizeof);
                         j++;
                     }
                     cindex++;
@@ -439,7 +523,7 @@ mp_obj_t iterate_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
                 if(mp_obj_is_true(row_item)) {
                     cindex = column.start;
                     for(size_t j=0; j < n; j++) {
-                        memcpy(target+(i*n+j)*_sizeof, source+(rindex*ndarray->n+cindex)*_sizeof, _sizeof);
+                        memcpy(target+(i*n+j)*_sizeof, source+NDARRAY_INDEX(ndarray, rindex, cindex)*_sizeof, _sizeof);
                         cindex += column.step;
                     }
                     i++;
@@ -455,7 +539,7 @@ mp_obj_t iterate_slice_list(ndarray_obj_t *ndarray, size_t m, size_t n,
                     column_iterable = mp_getiter(column_list, &column_iter_buf);                   
                     while((column_item = mp_iternext(column_iterable)) != MP_OBJ_STOP_ITERATION) {
                         if(mp_obj_is_true(column_item)) {
-                            memcpy(target+(i*n+j)*_sizeof, source+(rindex*ndarray->n+cindex)*_sizeof, _sizeof);
+                            memcpy(target+(i*n+j)*_sizeof, source+NDARRAY_INDEX(ndarray, rindex, cindex)*_sizeof, _sizeof);
                             j++;
                         }
                         cindex++;
@@ -478,7 +562,7 @@ mp_obj_t ndarray_get_slice(ndarray_obj_t *ndarray, mp_obj_t index, ndarray_obj_t
         column_slice = generate_slice(ndarray->n, index);
         if(slice_length(column_slice) == 1) { // we were asked for a single item
             // subscribe returns an mp_obj_t, if and only, if the index is an integer, and we have a row vector
-            return mp_binary_get_val_array(ndarray->array->typecode, ndarray->array->items, column_slice.start);
+            return ndarray_get_item(ndarray, NDARRAY_INDEX(ndarray, 0, column_slice.start));
         }
     }
     
@@ -600,17 +684,14 @@ mp_obj_t ndarray_iternext(mp_obj_t self_in) {
         if(ndarray->n == ndarray->array->len) { // we have a linear array
             // read the current value
             mp_obj_t value;
-            value = mp_binary_get_val_array(ndarray->array->typecode, ndarray->array->items, self->cur);
+            value = ndarray_get_item(ndarray, NDARRAY_INDEX(ndarray, 0, self->cur));
             self->cur++;
             return value;
-        } else { // we have a matrix, return the number of rows
-            ndarray_obj_t *value = create_new_ndarray(1, ndarray->n, ndarray->array->typecode);
-            // copy the memory content here
-            uint8_t *tmp = (uint8_t *)ndarray->array->items;
-            size_t strip_size = ndarray->n * mp_binary_get_size('@', ndarray->array->typecode, NULL);
-            memcpy(value->array->items, &tmp[self->cur*strip_size], strip_size);
+        } else { // we have a matrix, return the rows as views
+            ndarray_obj_t *value = ndarray_new_view(ndarray, 1, ndarray->n, NDARRAY_INDEX(ndarray, self->cur, 0), 
+                                                    ndarray->strides[0], ndarray->strides[1]);
             self->cur++;
-            return value;
+            return MP_OBJ_FROM_PTR(value);
         }
     } else {
         return MP_OBJ_STOP_ITERATION;
@@ -653,32 +734,48 @@ mp_obj_t ndarray_flatten(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_a
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
-    mp_obj_t self_copy = ndarray_copy(pos_args[0]);
-    ndarray_obj_t *ndarray = MP_OBJ_TO_PTR(self_copy);
+    ndarray_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
     
     GET_STR_DATA_LEN(args[0].u_obj, order, len);    
     if((len != 1) || ((memcmp(order, "C", 1) != 0) && (memcmp(order, "F", 1) != 0))) {
         mp_raise_ValueError(translate("flattening order must be either 'C', or 'F'"));
     }
 
-    // if order == 'C', we simply have to set m, and n, there is nothing else to do
+    // if the items can be reached with a single stride in the requested order, 
+    // the result is a view, and there is nothing to copy
+    size_t length = self->m * self->n;
+    if((self->m == 1) || (self->n == 1)) {
+        return MP_OBJ_FROM_PTR(ndarray_new_view(self, 1, length, 0, 0, (self->m == 1) ? self->strides[1] : self->strides[0]));
+    }
+    if((memcmp(order, "C", 1) == 0) && ndarray_is_dense(self)) {
+        return MP_OBJ_FROM_PTR(ndarray_new_view(self, 1, length, 0, 0, 1));
+    }
+    if((memcmp(order, "F", 1) == 0) && (self->strides[0] == 1) && (self->strides[1] == (int32_t)self->m)) {
+        // e.g., a transposed matrix: in Fortran order, the items are contiguous
+        return MP_OBJ_FROM_PTR(ndarray_new_view(self, 1, length, 0, 0, 1));
+    }
+    
+    ndarray_obj_t *ndarray = create_new_ndarray(1, length, self->array->typecode);
+    uint8_t _sizeof = mp_binary_get_size('@', self->array->typecode, NULL);
+    uint8_t *self_array = (uint8_t *)self->array->items;
+    uint8_t *array = (uint8_t *)ndarray->array->items;
+    size_t i=0;
     if(memcmp(order, "F", 1) == 0) {
-        ndarray_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
-        uint8_t _sizeof = mp_binary_get_size('@', self->array->typecode, NULL);
-        // get the data of self_in: we won't need a temporary buffer for the transposition
-        uint8_t *self_array = (uint8_t *)self->array->items;
-        uint8_t *array = (uint8_t *)ndarray->array->items;
-        size_t i=0;
         for(size_t n=0; n < self->n; n++) {
             for(size_t m=0; m < self->m; m++) {
-                memcpy(array+_sizeof*i, self_array+_sizeof*(m*self->n + n), _sizeof);
+                memcpy(array+_sizeof*i, self_array+_sizeof*NDARRAY_INDEX(self, m, n), _sizeof);
+                i++;
+            }
+        }
+    } else {
+        for(size_t m=0; m < self->m; m++) {
+            for(size_t n=0; n < self->n; n++) {
+                memcpy(array+_sizeof*i, self_array+_sizeof*NDARRAY_INDEX(self, m, n), _sizeof);
                 i++;
             }
-        }        
+        }
     }
-    ndarray->n = ndarray->array->len;
-    ndarray->m = 1;
-    return self_copy;
+    return MP_OBJ_FROM_PTR(ndarray);
 }
 
 // Binary operations
@@ -691,7 +788,6 @@ mp_obj_t ndarray_binary_op(mp_binary_op_t op, mp_obj_t lhs, mp_obj_t rhs) {
     // TODO: conform to numpy with the upcasting
     // TODO: implement in-place operators
     mp_obj_t RHS = MP_OBJ_NULL;
-    bool rhs_is_scalar = true;
     if(MP_OBJ_IS_INT(rhs)) {
         int32_t ivalue = mp_obj_get_int(rhs);
         if((ivalue > 0) && (ivalue < 256)) {
@@ -710,31 +806,41 @@ mp_obj_t ndarray_binary_op(mp_binary_op_t op, mp_obj_t lhs, mp_obj_t rhs) {
         CREATE_SINGLE_ITEM(RHS, mp_float_t, NDARRAY_FLOAT, fvalue);
     } else {
         RHS = rhs;
-        rhs_is_scalar = false;
     }
     //else 
     if(MP_OBJ_IS_TYPE(lhs, &ulab_ndarray_type) && MP_OBJ_IS_TYPE(RHS, &ulab_ndarray_type)) { 
         // next, the ndarray stuff
         ndarray_obj_t *ol = MP_OBJ_TO_PTR(lhs);
         ndarray_obj_t *or = MP_OBJ_TO_PTR(RHS);
-        if(!rhs_is_scalar && ((ol->m != or->m) || (ol->n != or->n))) {
+        // numpy's broadcasting rules: along each axis, the lengths must either be equal, 
+        // or one of them must be 1, in which case that operand is stretched by means of a zero stride
+        if(((ol->m != or->m) && (ol->m != 1) && (or->m != 1)) || 
+           ((ol->n != or->n) && (ol->n != 1) && (or->n != 1))) {
             mp_raise_ValueError(translate("operands could not be broadcast together"));
         }
-        // At this point, the operands should have the same shape
+        size_t m = (ol->m == 1) ? or->m : ol->m;
+        size_t n = (ol->n == 1) ? or->n : ol->n;
+        int32_t ls[2] = { (ol->m == 1) ? 0 : ol->strides[0], (ol->n == 1) ? 0 : ol->strides[1] };
+        int32_t rs[2] = { (or->m == 1) ? 0 : or->strides[0], (or->n == 1) ? 0 : or->strides[1] };
         switch(op) {
             case MP_BINARY_OP_EQUAL:
                 // Two arrays are equal, if their shape, typecode, and elements are equal
                 if((ol->m != or->m) || (ol->n != or->n) || (ol->array->typecode != or->array->typecode)) {
                     return mp_const_false;
                 } else {
-                    size_t i = ol->bytes;
+                    // At this point, we can simply compare the bytes, the type is irrelevant
+                    uint8_t _sizeof = mp_binary_get_size('@', ol->array->typecode, NULL);
                     uint8_t *l = (uint8_t *)ol->array->items;
                     uint8_t *r = (uint8_t *)or->array->items;
-                    while(i) { // At this point, we can simply compare the bytes, the type is irrelevant
-                        if(*l++ != *r++) {
-                            return mp_const_false;
+                    if(ndarray_is_dense(ol) && ndarray_is_dense(or)) {
+                        return mp_obj_new_bool(memcmp(l, r, ol->bytes) == 0);
+                    }
+                    for(size_t i=0; i < ol->m; i++) {
+                        for(size_t j=0; j < ol->n; j++) {
+                            if(memcmp(l + NDARRAY_INDEX(ol, i, j)*_sizeof, r + NDARRAY_INDEX(or, i, j)*_sizeof, _sizeof) != 0) {
+                                return mp_const_false;
+                            }
                         }
-                        i--;
                     }
                     return mp_const_true;
                 }
@@ -762,63 +868,63 @@ mp_obj_t ndarray_binary_op(mp_binary_op_t op, mp_obj_t lhs, mp_obj_t rhs) {
                 // typecode of result, type_out, type_left, type_right, lhs operand, rhs operand, operator
                 if(ol->array->typecode == NDARRAY_UINT8) {
                     if(or->array->typecode == NDARRAY_UINT8) {
-                        RUN_BINARY_LOOP(NDARRAY_UINT8, uint8_t, uint8_t, uint8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_UINT8, uint8_t, uint8_t, uint8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT8) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, uint8_t, int8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, uint8_t, int8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_UINT16) {
-                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint8_t, uint16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint8_t, uint16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT16) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, uint8_t, int16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, uint8_t, int16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_FLOAT) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint8_t, mp_float_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint8_t, mp_float_t, ol, or, op, m, n, ls, rs);
                     }
                 } else if(ol->array->typecode == NDARRAY_INT8) {
                     if(or->array->typecode == NDARRAY_UINT8) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int8_t, uint8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int8_t, uint8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT8) {
-                        RUN_BINARY_LOOP(NDARRAY_INT8, int8_t, int8_t, int8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT8, int8_t, int8_t, int8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_UINT16) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int8_t, uint16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int8_t, uint16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT16) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int8_t, int16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int8_t, int16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_FLOAT) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, int8_t, mp_float_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, int8_t, mp_float_t, ol, or, op, m, n, ls, rs);
                     }                
                 } else if(ol->array->typecode == NDARRAY_UINT16) {
                     if(or->array->typecode == NDARRAY_UINT8) {
-                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint16_t, uint8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint16_t, uint8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT8) {
-                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint16_t, int8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint16_t, int8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_UINT16) {
-                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint16_t, uint16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_UINT16, uint16_t, uint16_t, uint16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT16) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint16_t, int16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint16_t, int16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_FLOAT) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint8_t, mp_float_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint16_t, mp_float_t, ol, or, op, m, n, ls, rs);
                     }
                 } else if(ol->array->typecode == NDARRAY_INT16) {
                     if(or->array->typecode == NDARRAY_UINT8) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int16_t, uint8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int16_t, uint8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT8) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int16_t, int8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int16_t, int8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_UINT16) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, int16_t, uint16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, int16_t, uint16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT16) {
-                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int16_t, int16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_INT16, int16_t, int16_t, int16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_FLOAT) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, uint16_t, mp_float_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, int16_t, mp_float_t, ol, or, op, m, n, ls, rs);
                     }
                 } else if(ol->array->typecode == NDARRAY_FLOAT) {
                     if(or->array->typecode == NDARRAY_UINT8) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, uint8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, uint8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT8) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, int8_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, int8_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_UINT16) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, uint16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, uint16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_INT16) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, int16_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, int16_t, ol, or, op, m, n, ls, rs);
                     } else if(or->array->typecode == NDARRAY_FLOAT) {
-                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, mp_float_t, ol, or, op);
+                        RUN_BINARY_LOOP(NDARRAY_FLOAT, mp_float_t, mp_float_t, mp_float_t, ol, or, op, m, n, ls, rs);
                     }
                 } else { // this should never happen
                     mp_raise_TypeError(translate("wrong input type"));
@@ -910,33 +1016,14 @@ mp_obj_t ndarray_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
 
 mp_obj_t ndarray_transpose(mp_obj_t self_in) {
     ndarray_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    // the size of a single item in the array
-    uint8_t _sizeof = mp_binary_get_size('@', self->array->typecode, NULL);
-    
-    // NOTE: 
-    // if the matrices are square, we can simply swap items, but 
-    // generic matrices can't be transposed in place, so we have to 
-    // declare a temporary variable
-    
     // NOTE: 
-    //  In the old matrix, the coordinate (m, n) is m*self->n + n
-    //  We have to assign this to the coordinate (n, m) in the new 
-    //  matrix, i.e., to n*self->m + m (since the new matrix has self->m columns)
-    
-    // one-dimensional arrays can be transposed by simply swapping the dimensions
-    if((self->m != 1) && (self->n != 1)) {
-        uint8_t *c = (uint8_t *)self->array->items;
-        // self->bytes is the size of the bytearray, irrespective of the typecode
-        uint8_t *tmp = m_new(uint8_t, self->bytes);
-        for(size_t m=0; m < self->m; m++) {
-            for(size_t n=0; n < self->n; n++) {
-                memcpy(tmp+_sizeof*(n*self->m + m), c+_sizeof*(m*self->n + n), _sizeof);
-            }
-        }
-        memcpy(self->array->items, tmp, self->bytes);
-        m_del(uint8_t, tmp, self->bytes);
-    } 
+    //  The item (m, n) lives at m*strides[0] + n*strides[1], so the transposition 
+    //  amounts to swapping the dimensions, and the strides; no data have to be moved. 
+    //  Functions that need the items in C order will call ndarray_dense() on the result.
     SWAP(size_t, self->m, self->n);
+    SWAP(int32_t, self->strides[0], self->strides[1]);
+    if(self->m == 1) self->strides[0] = self->n;
+    if(self->n == 1) self->strides[1] = 1;
     return mp_const_none;
 }
 
@@ -959,8 +1046,28 @@ mp_obj_t ndarray_reshape(mp_obj_t self_in, mp_obj_t shape) {
         // TODO: the proper error message would be "cannot reshape array of size %d into shape (%d, %d)"
         mp_raise_ValueError(translate("cannot reshape array (incompatible input/output shape)"));
     }
+    if(!ndarray_is_dense(self)) {
+        if((self->m == 1) || (self->n == 1)) {
+            // a strided vector can be turned into a row, or column vector without moving the data
+            int32_t stride = (self->m == 1) ? self->strides[1] : self->strides[0];
+            if((m == 1) || (n == 1)) {
+                self->m = m;
+                self->n = n;
+                self->strides[0] = (m == 1) ? n : stride;
+                self->strides[1] = (n == 1) ? 1 : stride;
+                return MP_OBJ_FROM_PTR(self);
+            }
+        }
+        // the items can't be described by two strides in the new shape, so 
+        // we have to compact them into a buffer of our own
+        ndarray_obj_t *dense = ndarray_dense(self);
+        self->array = dense->array;
+        self->owner = MP_OBJ_NULL;
+    }
     self->m = m;
     self->n = n;
+    self->strides[0] = n;
+    self->strides[1] = 1;
     return MP_OBJ_FROM_PTR(self);
 }
 
@@ -968,6 +1075,24 @@ MP_DEFINE_CONST_FUN_OBJ_2(ndarray_reshape_obj, ndarray_reshape);
 
 mp_int_t ndarray_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags) {
     ndarray_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if(!ndarray_is_dense(self)) {
+        // a strided view can't be exported as a flat buffer; for reading, we
+        // hand out a compacted copy, but writes would not reach the original items
+        if(flags & MP_BUFFER_WRITE) {
+            mp_raise_ValueError(translate("strided view can't be written through the buffer protocol"));
+        }
+        // the copy is kept in the view, so that it lives as long as the view,
+        // and is refreshed on every request
+        if((self->export == NULL) || (self->export->len != self->m * self->n)) {
+            self->export = array_new(self->array->typecode, self->m * self->n);
+        }
+        ndarray_obj_t dense = *self;
+        dense.array = self->export;
+        dense.strides[0] = self->n;
+        dense.strides[1] = 1;
+        ndarray_copy_strided(&dense, self);
+        return !mp_get_buffer(self->export, bufinfo, flags);
+    }
     // buffer_p.get_buffer() returns zero for success, while mp_get_buffer returns true for success
     return !mp_get_buffer(self->array, bufinfo, flags);
 }
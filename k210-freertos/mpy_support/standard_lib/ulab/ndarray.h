@@ -47,17 +47,31 @@ typedef struct _ndarray_obj_t {
     size_t len;
     mp_obj_array_t *array;
     size_t bytes;
+    // strides are given in items, and array->items points to the first element of the view,
+    // so that a freshly created ndarray has strides {n, 1}
+    int32_t strides[2];
+    // the ndarray holding the storage of a view, or MP_OBJ_NULL, if the data are our own
+    mp_obj_t owner;
+    // compacted (read-only) copy of the items of a non-dense ndarray, exported by the buffer protocol
+    mp_obj_array_t *export;
 } ndarray_obj_t;
 
+// offset of element (i, j) with respect to array->items
+#define NDARRAY_INDEX(ndarray, i, j) ((int32_t)(i)*(ndarray)->strides[0] + (int32_t)(j)*(ndarray)->strides[1])
+
 mp_obj_t mp_obj_new_ndarray_iterator(mp_obj_t , size_t , mp_obj_iter_buf_t *);
 
 mp_float_t ndarray_get_float_value(void *, uint8_t , size_t );
 void fill_array_iterable(mp_float_t *, mp_obj_t );
 
-void ndarray_print_row(const mp_print_t *, mp_obj_array_t *, size_t , size_t );
+void ndarray_print_row(const mp_print_t *, ndarray_obj_t *, int32_t , int32_t , size_t );
 void ndarray_print(const mp_print_t *, mp_obj_t , mp_print_kind_t );
 void ndarray_assign_elements(mp_obj_array_t *, mp_obj_t , uint8_t , size_t *);
 ndarray_obj_t *create_new_ndarray(size_t , size_t , uint8_t );
+ndarray_obj_t *ndarray_new_view(ndarray_obj_t *, size_t , size_t , int32_t , int32_t , int32_t );
+bool ndarray_is_dense(ndarray_obj_t *);
+ndarray_obj_t *ndarray_dense(ndarray_obj_t *);
+void ndarray_copy_strided(ndarray_obj_t *, ndarray_obj_t *);
 
 mp_obj_t ndarray_copy(mp_obj_t );
 #ifdef CIRCUITPY
@@ -99,43 +113,60 @@ mp_int_t ndarray_get_buffer(mp_obj_t obj, mp_buffer_info_t *bufinfo, mp_uint_t f
     should work outside the loop, but it doesn't. Go figure! 
 */
 
-#define RUN_BINARY_LOOP(typecode, type_out, type_left, type_right, ol, or, op) do {\
+// The operands are broadcast over a result of shape (m, n): ls, and rs are the strides 
+// of the left, and right hand side, with 0 along the axes that are stretched
+#define BROADCAST_LOOP(odata, type_left, type_right, left, right, m, n, ls, rs, operator) do {\
+    for(size_t i=0; i < (m); i++) {\
+        type_left *l = (left) + (int32_t)i*(ls)[0];\
+        type_right *r = (right) + (int32_t)i*(rs)[0];\
+        for(size_t j=0; j < (n); j++, l += (ls)[1], r += (rs)[1]) {\
+            *(odata)++ = *l operator *r;\
+        }\
+    }\
+} while(0)
+
+#define RUN_BINARY_LOOP(typecode, type_out, type_left, type_right, ol, or, op, m, n, ls, rs) do {\
     type_left *left = (type_left *)(ol)->array->items;\
     type_right *right = (type_right *)(or)->array->items;\
-    uint8_t inc = 0;\
-    if((or)->array->len > 1) inc = 1;\
     if(((op) == MP_BINARY_OP_ADD) || ((op) == MP_BINARY_OP_SUBTRACT) || ((op) == MP_BINARY_OP_MULTIPLY)) {\
-        ndarray_obj_t *out = create_new_ndarray(ol->m, ol->n, typecode);\
+        ndarray_obj_t *out = create_new_ndarray((m), (n), typecode);\
         type_out *(odata) = (type_out *)out->array->items;\
-        if((op) == MP_BINARY_OP_ADD) { for(size_t i=0, j=0; i < (ol)->array->len; i++, j+=inc) odata[i] = left[i] + right[j];}\
-        if((op) == MP_BINARY_OP_SUBTRACT) { for(size_t i=0, j=0; i < (ol)->array->len; i++, j+=inc) odata[i] = left[i] - right[j];}\
-        if((op) == MP_BINARY_OP_MULTIPLY) { for(size_t i=0, j=0; i < (ol)->array->len; i++, j+=inc) odata[i] = left[i] * right[j];}\
+        if((op) == MP_BINARY_OP_ADD) BROADCAST_LOOP(odata, type_left, type_right, left, right, m, n, ls, rs, +);\
+        if((op) == MP_BINARY_OP_SUBTRACT) BROADCAST_LOOP(odata, type_left, type_right, left, right, m, n, ls, rs, -);\
+        if((op) == MP_BINARY_OP_MULTIPLY) BROADCAST_LOOP(odata, type_left, type_right, left, right, m, n, ls, rs, *);\
         return MP_OBJ_FROM_PTR(out);\
     } else if((op) == MP_BINARY_OP_TRUE_DIVIDE) {\
-        ndarray_obj_t *out = create_new_ndarray(ol->m, ol->n, NDARRAY_FLOAT);\
+        ndarray_obj_t *out = create_new_ndarray((m), (n), NDARRAY_FLOAT);\
         mp_float_t *odata = (mp_float_t *)out->array->items;\
-        for(size_t i=0, j=0; i < (ol)->array->len; i++, j+=inc) odata[i] = (mp_float_t)left[i]/(mp_float_t)right[j];\
+        for(size_t i=0; i < (m); i++) {\
+            type_left *l = left + (int32_t)i*(ls)[0];\
+            type_right *r = right + (int32_t)i*(rs)[0];\
+            for(size_t j=0; j < (n); j++, l += (ls)[1], r += (rs)[1]) {\
+                *odata++ = (mp_float_t)(*l)/(mp_float_t)(*r);\
+            }\
+        }\
         return MP_OBJ_FROM_PTR(out);\
     } else if(((op) == MP_BINARY_OP_LESS) || ((op) == MP_BINARY_OP_LESS_EQUAL) ||  \
              ((op) == MP_BINARY_OP_MORE) || ((op) == MP_BINARY_OP_MORE_EQUAL)) {\
         mp_obj_t out_list = mp_obj_new_list(0, NULL);\
-        size_t m = (ol)->m, n = (ol)->n;\
-        for(size_t i=0, r=0; i < m; i++, r+=inc) {\
-            mp_obj_t row = mp_obj_new_list(n, NULL);\
+        for(size_t i=0; i < (m); i++) {\
+            mp_obj_t row = mp_obj_new_list((n), NULL);\
             mp_obj_list_t *row_ptr = MP_OBJ_TO_PTR(row);\
-            for(size_t j=0, s=0; j < n; j++, s+=inc) {\
+            type_left *l = left + (int32_t)i*(ls)[0];\
+            type_right *r = right + (int32_t)i*(rs)[0];\
+            for(size_t j=0; j < (n); j++, l += (ls)[1], r += (rs)[1]) {\
                 row_ptr->items[j] = mp_const_false;\
                 if((op) == MP_BINARY_OP_LESS) {\
-                    if(left[i*n+j] < right[r*n+s]) row_ptr->items[j] = mp_const_true;\
+                    if(*l < *r) row_ptr->items[j] = mp_const_true;\
                 } else if((op) == MP_BINARY_OP_LESS_EQUAL) {\
-                    if(left[i*n+j] <= right[r*n+s]) row_ptr->items[j] = mp_const_true;\
+                    if(*l <= *r) row_ptr->items[j] = mp_const_true;\
                 } else if((op) == MP_BINARY_OP_MORE) {\
-                    if(left[i*n+j] > right[r*n+s]) row_ptr->items[j] = mp_const_true;\
+                    if(*l > *r) row_ptr->items[j] = mp_const_true;\
                 } else if((op) == MP_BINARY_OP_MORE_EQUAL) {\
-                    if(left[i*n+j] >= right[r*n+s]) row_ptr->items[j] = mp_const_true;\
+                    if(*l >= *r) row_ptr->items[j] = mp_const_true;\
                 }\
             }\
-            if(m == 1) return row;\
+            if((m) == 1) return row;\
             mp_obj_list_append(out_list, row);\
         }\
         return out_list;\
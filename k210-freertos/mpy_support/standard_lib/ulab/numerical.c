@@ -32,31 +32,47 @@ enum NUMERICAL_FUNCTION_TYPE {
 };
 
 void axis_sorter(ndarray_obj_t *ndarray, mp_obj_t axis, size_t *m, size_t *n, size_t *N, 
-                 size_t *increment, size_t *len, size_t *start_inc) {
+                 int32_t *increment, size_t *len, int32_t *start_inc) {
+    // increment, and start_inc are strides, so that views can be reduced without copying them; 
+    // when flattening a matrix, the caller has to make sure that the array is dense
     if(axis == mp_const_none) { // flatten the array
         *m = 1;
         *n = 1;
         *len = ndarray->array->len;
         *N = 1;
-        *increment = 1;
+        if(ndarray->m == 1) {
+            *increment = ndarray->strides[1];
+        } else if(ndarray->n == 1) {
+            *increment = ndarray->strides[0];
+        } else {
+            *increment = 1;
+        }
         *start_inc = ndarray->array->len;
     } else if((mp_obj_get_int(axis) == 1)) { // along the horizontal axis
         *m = ndarray->m;
         *n = 1;
         *len = ndarray->n;
         *N = ndarray->m;
-        *increment = 1;
-        *start_inc = ndarray->n;
+        *increment = ndarray->strides[1];
+        *start_inc = ndarray->strides[0];
     } else { // along vertical axis
         *m = 1;
         *n = ndarray->n;
         *len = ndarray->m;
         *N = ndarray->n;
-        *increment = ndarray->n;
-        *start_inc = 1;
+        *increment = ndarray->strides[0];
+        *start_inc = ndarray->strides[1];
     }    
 }
 
+STATIC ndarray_obj_t *numerical_flattenable(ndarray_obj_t *ndarray, mp_obj_t axis) {
+    // a strided matrix can't be walked with a single increment, when flattened
+    if((axis == mp_const_none) && (ndarray->m > 1) && (ndarray->n > 1)) {
+        return ndarray_dense(ndarray);
+    }
+    return ndarray;
+}
+
 mp_obj_t numerical_sum_mean_std_iterable(mp_obj_t oin, uint8_t optype, size_t ddof) {
     mp_float_t value, sum = 0.0, sq_sum = 0.0;
     mp_obj_iter_buf_t iter_buf;
@@ -84,13 +100,14 @@ mp_obj_t numerical_sum_mean_std_iterable(mp_obj_t oin, uint8_t optype, size_t dd
 }
 
 STATIC mp_obj_t numerical_sum_mean_ndarray(ndarray_obj_t *ndarray, mp_obj_t axis, uint8_t optype) {
-    size_t m, n, increment, start, start_inc, N, len; 
+    size_t m, n, N, len; 
+    int32_t increment, start, start_inc;
     axis_sorter(ndarray, axis, &m, &n, &N, &increment, &len, &start_inc);
     ndarray_obj_t *results = create_new_ndarray(m, n, NDARRAY_FLOAT);
     mp_float_t sum, sq_sum;
     mp_float_t *farray = (mp_float_t *)results->array->items;
     for(size_t j=0; j < N; j++) { // result index
-        start = j * start_inc;
+        start = (int32_t)j * start_inc;
         sum = sq_sum = 0.0;
         if(ndarray->array->typecode == NDARRAY_UINT8) {
             RUN_SUM(ndarray, uint8_t, optype, len, start, increment);
@@ -116,7 +133,8 @@ STATIC mp_obj_t numerical_sum_mean_ndarray(ndarray_obj_t *ndarray, mp_obj_t axis
 }
 
 mp_obj_t numerical_std_ndarray(ndarray_obj_t *ndarray, mp_obj_t axis, size_t ddof) {
-    size_t m, n, increment, start, start_inc, N, len; 
+    size_t m, n, N, len; 
+    int32_t increment, start, start_inc;
     mp_float_t sum, sum_sq;
     
     axis_sorter(ndarray, axis, &m, &n, &N, &increment, &len, &start_inc);
@@ -126,7 +144,7 @@ mp_obj_t numerical_std_ndarray(ndarray_obj_t *ndarray, mp_obj_t axis, size_t ddo
     ndarray_obj_t *results = create_new_ndarray(m, n, NDARRAY_FLOAT);
     mp_float_t *farray = (mp_float_t *)results->array->items;
     for(size_t j=0; j < N; j++) { // result index
-        start = j * start_inc;
+        start = (int32_t)j * start_inc;
         sum = 0.0;
         sum_sq = 0.0;
         if(ndarray->array->typecode == NDARRAY_UINT8) {
@@ -171,7 +189,8 @@ mp_obj_t numerical_argmin_argmax_iterable(mp_obj_t oin, mp_obj_t axis, uint8_t o
 }
 
 mp_obj_t numerical_argmin_argmax_ndarray(ndarray_obj_t *ndarray, mp_obj_t axis, uint8_t optype) {
-    size_t m, n, increment, start, start_inc, N, len;
+    size_t m, n, N, len;
+    int32_t increment, start, start_inc;
     axis_sorter(ndarray, axis, &m, &n, &N, &increment, &len, &start_inc);
     ndarray_obj_t *results;
     if((optype == NUMERICAL_ARGMIN) || (optype == NUMERICAL_ARGMAX)) {
@@ -184,7 +203,7 @@ mp_obj_t numerical_argmin_argmax_ndarray(ndarray_obj_t *ndarray, mp_obj_t axis,
     }
     
     for(size_t j=0; j < N; j++) { // result index
-        start = j * start_inc;
+        start = (int32_t)j * start_inc;
         if((ndarray->array->typecode == NDARRAY_UINT8) || (ndarray->array->typecode == NDARRAY_INT8)) {
             if((optype == NUMERICAL_MAX) || (optype == NUMERICAL_MIN)) {
                 RUN_ARGMIN(ndarray, results, uint8_t, uint8_t, len, start, increment, optype, j);
@@ -235,7 +254,7 @@ STATIC mp_obj_t numerical_function(size_t n_args, const mp_obj_t *pos_args, mp_m
                 return mp_const_none;
         }
     } else if(MP_OBJ_IS_TYPE(oin, &ulab_ndarray_type)) {
-        ndarray_obj_t *ndarray = MP_OBJ_TO_PTR(oin);
+        ndarray_obj_t *ndarray = numerical_flattenable(MP_OBJ_TO_PTR(oin), axis);
         switch(optype) {
             case NUMERICAL_MIN:
             case NUMERICAL_MAX:
@@ -310,7 +329,7 @@ mp_obj_t numerical_std(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_arg
     if(MP_OBJ_IS_TYPE(oin, &mp_type_tuple) || MP_OBJ_IS_TYPE(oin, &mp_type_list) || MP_OBJ_IS_TYPE(oin, &mp_type_range)) {
         return numerical_sum_mean_std_iterable(oin, NUMERICAL_STD, ddof);
     } else if(MP_OBJ_IS_TYPE(oin, &ulab_ndarray_type)) {
-        ndarray_obj_t *ndarray = MP_OBJ_TO_PTR(oin);
+        ndarray_obj_t *ndarray = numerical_flattenable(MP_OBJ_TO_PTR(oin), axis);
         return numerical_std_ndarray(ndarray, axis, ddof);
     } else {
         mp_raise_TypeError(translate("input must be tuple, list, range, or ndarray"));
@@ -338,7 +357,9 @@ mp_obj_t numerical_roll(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_ar
         mp_raise_ValueError(translate("axis must be None, 0, or 1"));
     }
 
-    ndarray_obj_t *in = MP_OBJ_TO_PTR(oin);
+    // a strided view is rolled in a compacted copy, and the result is written back at the end
+    ndarray_obj_t *target = MP_OBJ_TO_PTR(oin);
+    ndarray_obj_t *in = ndarray_dense(target);
     uint8_t _sizeof = mp_binary_get_size('@', in->array->typecode, NULL);
     size_t len;
     int16_t _shift;
@@ -369,6 +390,7 @@ mp_obj_t numerical_roll(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_ar
             memmove(&array[(m+1)*len*_sizeof-_shift], tmp, _shift);
         }
         m_del(uint8_t, tmp, _shift);
+        if(in != target) ndarray_copy_strided(target, in);
         return mp_const_none;
     } else {
         len = in->m;
@@ -396,6 +418,7 @@ mp_obj_t numerical_roll(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_ar
         }
         m_del(uint8_t, tmp, _shift);
         m_del(uint8_t, _data, _sizeof*len);
+        if(in != target) ndarray_copy_strided(target, in);
         return mp_const_none;
     }
 }
@@ -420,8 +443,8 @@ mp_obj_t numerical_flip(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_ar
         mp_raise_ValueError(translate("axis must be None, 0, or 1"));
     }
 
-    ndarray_obj_t *in = MP_OBJ_TO_PTR(args[0].u_obj);
-    mp_obj_t oout = ndarray_copy(args[0].u_obj);
+    ndarray_obj_t *in = ndarray_dense(MP_OBJ_TO_PTR(args[0].u_obj));
+    mp_obj_t oout = ndarray_copy(MP_OBJ_FROM_PTR(in));
     ndarray_obj_t *out = MP_OBJ_TO_PTR(oout);
     uint8_t _sizeof = mp_binary_get_size('@', in->array->typecode, NULL);
     uint8_t *array_in = (uint8_t *)in->array->items;
@@ -465,7 +488,7 @@ mp_obj_t numerical_diff(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_ar
         mp_raise_TypeError(translate("diff argument must be an ndarray"));
     }
     
-    ndarray_obj_t *in = MP_OBJ_TO_PTR(args[0].u_obj);
+    ndarray_obj_t *in = ndarray_dense(MP_OBJ_TO_PTR(args[0].u_obj));
     size_t increment, N, M;
     if((args[2].u_int == -1) || (args[2].u_int == 1)) { // differentiate along the horizontal axis
         increment = 1;
@@ -526,10 +549,12 @@ mp_obj_t numerical_sort_helper(mp_obj_t oin, mp_obj_t axis, uint8_t inplace) {
         mp_raise_TypeError(translate("sort argument must be an ndarray"));
     }
 
-    ndarray_obj_t *ndarray;
+    ndarray_obj_t *ndarray, *target = NULL;
     mp_obj_t out;
     if(inplace == 1) {
-        ndarray = MP_OBJ_TO_PTR(oin);
+        // strided views are sorted in a compacted copy, which is then written back
+        target = MP_OBJ_TO_PTR(oin);
+        ndarray = ndarray_dense(target);
     } else {
         out = ndarray_copy(oin);
         ndarray = MP_OBJ_TO_PTR(out);
@@ -571,6 +596,12 @@ mp_obj_t numerical_sort_helper(mp_obj_t oin, mp_obj_t axis, uint8_t inplace) {
         }
     }
     if(inplace == 1) {
+        if(ndarray != target) {
+            ndarray->m = target->m;
+            ndarray->n = target->n;
+            ndarray->strides[0] = target->n;
+            ndarray_copy_strided(target, ndarray);
+        }
         return mp_const_none;
     } else {
         return out;
@@ -618,7 +649,7 @@ mp_obj_t numerical_argsort(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw
         mp_raise_TypeError(translate("argsort argument must be an ndarray"));
     }
 
-    ndarray_obj_t *ndarray = MP_OBJ_TO_PTR(args[0].u_obj);
+    ndarray_obj_t *ndarray = ndarray_dense(MP_OBJ_TO_PTR(args[0].u_obj));
     size_t increment, start_inc, end, N, m, n;
     if(args[1].u_obj == mp_const_none) { // flatten the array
         m = 1;
@@ -30,15 +30,15 @@ extern mp_obj_module_t ulab_numerical_module;
     size_t best_index = 0;\
     if(((op) == NUMERICAL_MAX) || ((op) == NUMERICAL_ARGMAX)) {\
         for(size_t i=1; i < (len); i++) {\
-            if(array[(start)+i*(increment)] > array[(start)+best_index*(increment)]) best_index = i;\
+            if(array[(start)+(int32_t)i*(increment)] > array[(start)+(int32_t)best_index*(increment)]) best_index = i;\
         }\
-        if((op) == NUMERICAL_MAX) outarray[(pos)] = array[(start)+best_index*(increment)];\
+        if((op) == NUMERICAL_MAX) outarray[(pos)] = array[(start)+(int32_t)best_index*(increment)];\
         else outarray[(pos)] = best_index;\
     } else{\
         for(size_t i=1; i < (len); i++) {\
-            if(array[(start)+i*(increment)] < array[(start)+best_index*(increment)]) best_index = i;\
+            if(array[(start)+(int32_t)i*(increment)] < array[(start)+(int32_t)best_index*(increment)]) best_index = i;\
         }\
-        if((op) == NUMERICAL_MIN) outarray[(pos)] = array[(start)+best_index*(increment)];\
+        if((op) == NUMERICAL_MIN) outarray[(pos)] = array[(start)+(int32_t)best_index*(increment)];\
         else outarray[(pos)] = best_index;\
     }\
 } while(0)
@@ -47,7 +47,7 @@ extern mp_obj_module_t ulab_numerical_module;
     type *array = (type *)(ndarray)->array->items;\
     type value;\
     for(size_t j=0; j < (len); j++) {\
-        value = array[(start)+j*(increment)];\
+        value = array[(start)+(int32_t)j*(increment)];\
         sum += value;\
     }\
 } while(0)
@@ -56,11 +56,11 @@ extern mp_obj_module_t ulab_numerical_module;
     type *array = (type *)(ndarray)->array->items;\
     mp_float_t value;\
     for(size_t j=0; j < (len); j++) {\
-        sum += array[(start)+j*(increment)];\
+        sum += array[(start)+(int32_t)j*(increment)];\
     }\
     sum /= (len);\
     for(size_t j=0; j < (len); j++) {\
-        value = (array[(start)+j*(increment)] - sum);\
+        value = (array[(start)+(int32_t)j*(increment)] - sum);\
         sum_sq += value * value;\
     }\
 } while(0)
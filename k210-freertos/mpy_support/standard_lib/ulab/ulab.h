@@ -30,6 +30,9 @@
 // FFT costs about 2 kB of flash space
 #define ULAB_FFT_MODULE (1)
 
+// use the K210 FFT accelerator for fixed point (integer) input
+#define ULAB_FFT_HARDWARE (1)
+
 // the filter module takes about 1 kB of flash space
 #define ULAB_FILTER_MODULE (1)
 
@@ -30,7 +30,7 @@ mp_obj_t vectorise_generic_vector(mp_obj_t o_in, mp_float_t (*f)(mp_float_t)) {
     }
     mp_float_t x;
     if(MP_OBJ_IS_TYPE(o_in, &ulab_ndarray_type)) {
-        ndarray_obj_t *source = MP_OBJ_TO_PTR(o_in);
+        ndarray_obj_t *source = ndarray_dense(MP_OBJ_TO_PTR(o_in));
         ndarray_obj_t *ndarray = create_new_ndarray(source->m, source->n, NDARRAY_FLOAT);
         mp_float_t *dataout = (mp_float_t *)ndarray->array->items;
         if(source->array->typecode == NDARRAY_UINT8) {
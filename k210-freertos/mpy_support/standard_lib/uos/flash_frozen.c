@@ -0,0 +1,604 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "py/mpconfig.h"
+
+#if MICROPY_MODULE_FROZEN_MPY_EXTRA
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/reader.h"
+#include "py/bc.h"
+#include "py/bc0.h"
+#include "py/objstr.h"
+#include "py/objint.h"
+#include "py/parsenum.h"
+#include "py/persistentcode.h"
+#include "py/smallint.h"
+#include "py/mperrno.h"
+#include "extmod/vfs.h"
+#include "genhdr/mpversion.h"
+#include "syslog.h"
+#include "w25qxx.h"
+
+#include "flash_image.h"
+#include "flash_frozen.h"
+
+static const char *TAG = "[FLASH_FROZEN]";
+
+// Frozen modules region as seen through the XIP window
+#define FLASH_FROZEN_PTR    (w25qxx_flash_ptr + MICRO_PY_FLASH_FROZEN_START)
+
+#define QSTR_WINDOW_SIZE    (32)
+
+// Same layout as mp_obj_complex_t (objcomplex.c)
+typedef struct _frz_complex_t {
+    mp_obj_base_t base;
+    mp_float_t real;
+    mp_float_t imag;
+} frz_complex_t;
+
+typedef struct _qstr_window_t {
+    uint16_t idx;
+    uint16_t window[QSTR_WINDOW_SIZE];
+} qstr_window_t;
+
+typedef struct _frz_link_t {
+    uint32_t pos;               // write offset in the region
+    uint32_t crc;               // crc of the data written to the region
+    byte *buf;                  // sector buffer
+    mp_map_t qstr_map;          // run time qstr -> qstr id in the region's pool
+    const byte **new_qstrs;     // region's qstr pool entries
+    size_t n_qstrs;
+    size_t alloc_qstrs;
+    mp_uint_t *content;         // modules raw code
+    size_t count;
+    size_t alloc_count;
+    vstr_t names;               // module names
+    qstr_window_t qw;
+} frz_link_t;
+
+// Firmware qstr pools, the region's pool is linked after them
+static qstr_pool_t *fw_pool = NULL;
+static size_t fw_qstr_count = 0;
+// Region linked into the MicroPython instance
+static bool frozen_linked[2] = {false, false};
+
+//----------------------------------------
+static int flash_frozen_instance(void)
+{
+    return (MP_STATE_STATE() == &mp_state_ctx2) ? 1 : 0;
+}
+
+// Firmware identification, the region is only valid for the firmware it was linked against
+// (qstr ids, addresses of the types and constant objects)
+//---------------------------------------
+static uint32_t flash_frozen_fw_id(void)
+{
+    const uintptr_t fw[] = {
+        (uintptr_t)fw_pool, fw_qstr_count,
+        (uintptr_t)&mp_type_str, (uintptr_t)&mp_type_bytes, (uintptr_t)&mp_type_int,
+        #if MICROPY_PY_BUILTINS_COMPLEX
+        (uintptr_t)&mp_type_complex,
+        #endif
+        (uintptr_t)&mp_const_ellipsis_obj, (uintptr_t)&mp_execute_bytecode,
+    };
+    const char *build = MICROPY_GIT_TAG MICROPY_BUILD_DATE;
+    uint32_t crc = flash_image_crc32(0, (const uint8_t *)fw, sizeof(fw));
+    return flash_image_crc32(crc, (const uint8_t *)build, strlen(build));
+}
+
+// Called from 'mp_init()' (MICROPY_PORT_INIT_FUNC), before any run time qstr is created
+//==========================
+void flash_frozen_init(void)
+{
+    int inst = flash_frozen_instance();
+    frozen_linked[inst] = false;
+    fw_pool = MP_STATE_VM(last_pool);
+    fw_qstr_count = QSTR_TOTAL();
+
+    flash_frozen_header_t hdr;
+    if (w25qxx_read_data(MICRO_PY_FLASH_FROZEN_START, (uint8_t *)&hdr, sizeof(flash_frozen_header_t)) != W25QXX_OK) return;
+    if ((hdr.magic != FLASH_FROZEN_MAGIC) || (hdr.version != FLASH_FROZEN_VERSION) ||
+        (hdr.hdr_size < sizeof(flash_frozen_header_t)) || (hdr.hdr_size > FLASH_FROZEN_HDR_SIZE)) return;
+    if (hdr.fw_id != flash_frozen_fw_id()) {
+        LOGW(TAG, "Frozen modules linked against different firmware, run 'uos.mpy_freeze()' again");
+        return;
+    }
+    if (w25qxx_xip_map() != W25QXX_OK) {
+        LOGW(TAG, "XIP mode not available, frozen modules not used");
+        return;
+    }
+    if (flash_image_crc32(0, FLASH_FROZEN_PTR + 8, hdr.hdr_size - 8) != hdr.crc32) {
+        LOGW(TAG, "Frozen modules header CRC error");
+        return;
+    }
+    if (hdr.pool) MP_STATE_VM(last_pool) = (qstr_pool_t *)hdr.pool;
+    frozen_linked[inst] = true;
+}
+
+// Frozen modules for 'py/frozenmod.c'
+//===========================================================================
+const char *mp_frozen_mpy_extra(const struct _mp_raw_code_t *const **content)
+{
+    const flash_frozen_header_t *hdr = (const flash_frozen_header_t *)FLASH_FROZEN_PTR;
+    // after 'uos.mpy_freeze()' erases the header, already imported modules are still valid
+    if ((!frozen_linked[flash_frozen_instance()]) || (hdr->magic != FLASH_FROZEN_MAGIC)) return NULL;
+    *content = hdr->content;
+    return hdr->names;
+}
+
+
+// ==== Linker ====
+
+//-----------------------------------------------
+static void frz_flush(frz_link_t *lk, uint32_t len)
+{
+    uint32_t addr = MICRO_PY_FLASH_FROZEN_START + ((lk->pos - 1) & ~(w25qxx_FLASH_SECTOR_SIZE - 1));
+    if (w25qxx_write_data(addr, lk->buf, len) != W25QXX_OK) mp_raise_OSError(MP_EIO);
+    memset(lk->buf, 0xFF, w25qxx_FLASH_SECTOR_SIZE);
+}
+
+// Write data to the region, returns the XIP address of the data
+//-----------------------------------------------------------------------------------
+static uintptr_t frz_write(frz_link_t *lk, const void *data, size_t len, size_t align)
+{
+    static const byte pad[8] = {0};
+    while (lk->pos & (align - 1)) frz_write(lk, pad, align - (lk->pos & (align - 1)), 1);
+    if ((lk->pos + len) > MICRO_PY_FLASH_FROZEN_SIZE) mp_raise_msg(&mp_type_OSError, "Frozen modules region full");
+
+    uintptr_t addr = (uintptr_t)(FLASH_FROZEN_PTR + lk->pos);
+    const byte *src = data;
+    lk->crc = flash_image_crc32(lk->crc, src, len);
+    while (len) {
+        uint32_t offset = lk->pos & (w25qxx_FLASH_SECTOR_SIZE - 1);
+        size_t n = w25qxx_FLASH_SECTOR_SIZE - offset;
+        if (n > len) n = len;
+        memcpy(lk->buf + offset, src, n);
+        lk->pos += n;
+        src += n;
+        len -= n;
+        if ((lk->pos & (w25qxx_FLASH_SECTOR_SIZE - 1)) == 0) frz_flush(lk, w25qxx_FLASH_SECTOR_SIZE);
+    }
+    return addr;
+}
+
+//-------------------------------------------
+static int read_byte(mp_reader_t *reader)
+{
+    return reader->readbyte(reader->data);
+}
+
+//------------------------------------------------------------------
+static void read_bytes(mp_reader_t *reader, byte *buf, size_t len)
+{
+    while (len-- > 0) {
+        *buf++ = reader->readbyte(reader->data);
+    }
+}
+
+//---------------------------------------------------------
+static size_t read_uint(mp_reader_t *reader, byte **out)
+{
+    size_t unum = 0;
+    for (;;) {
+        byte b = reader->readbyte(reader->data);
+        if (out != NULL) {
+            **out = b;
+            ++*out;
+        }
+        unum = (unum << 7) | (b & 0x7f);
+        if ((b & 0x80) == 0) break;
+    }
+    return unum;
+}
+
+// qstr window, the same as in 'py/persistentcode.c'
+//--------------------------------------------------------------
+static void qstr_window_push(qstr_window_t *qw, qstr qst)
+{
+    qw->idx = (qw->idx + 1) % QSTR_WINDOW_SIZE;
+    qw->window[qw->idx] = qst;
+}
+
+//----------------------------------------------------------------
+static qstr qstr_window_access(qstr_window_t *qw, size_t idx)
+{
+    idx = (qw->idx + QSTR_WINDOW_SIZE - idx) % QSTR_WINDOW_SIZE;
+    qstr qst = qw->window[idx];
+    if (idx > qw->idx) {
+        memmove(&qw->window[idx], &qw->window[idx + 1], (QSTR_WINDOW_SIZE - idx - 1) * sizeof(uint16_t));
+        qw->window[QSTR_WINDOW_SIZE - 1] = qw->window[0];
+        idx = 0;
+    }
+    memmove(&qw->window[idx], &qw->window[idx + 1], (qw->idx - idx) * sizeof(uint16_t));
+    qw->window[qw->idx] = qst;
+    return qst;
+}
+
+// Resolve the qstr to the id it will have when the region is active:
+// firmware qstrs keep their ids, new qstrs are added to the region's qstr pool
+//-----------------------------------------------------------------------
+static qstr frz_qstr(frz_link_t *lk, const char *str, size_t len)
+{
+    // the qstr interned in this instance is used as the lookup key
+    qstr q = qstr_from_strn(str, len);
+    if (q < fw_qstr_count) return q;
+
+    mp_map_elem_t *elem = mp_map_lookup(&lk->qstr_map, MP_OBJ_NEW_QSTR(q), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+    if (elem->value == MP_OBJ_NULL) {
+        // qstr data: hash, length, data, '\0'
+        byte qhdr[MICROPY_QSTR_BYTES_IN_HASH + MICROPY_QSTR_BYTES_IN_LEN];
+        mp_uint_t hash = qstr_compute_hash((const byte *)str, len);
+        for (int i=0; i<MICROPY_QSTR_BYTES_IN_HASH; i++) qhdr[i] = hash >> (i*8);
+        for (int i=0; i<MICROPY_QSTR_BYTES_IN_LEN; i++) qhdr[MICROPY_QSTR_BYTES_IN_HASH+i] = len >> (i*8);
+        uintptr_t addr = frz_write(lk, qhdr, sizeof(qhdr), 1);
+        frz_write(lk, str, len, 1);
+        frz_write(lk, "", 1, 1);
+
+        if (lk->n_qstrs >= lk->alloc_qstrs) {
+            lk->new_qstrs = m_renew(const byte *, lk->new_qstrs, lk->alloc_qstrs, lk->alloc_qstrs + 64);
+            lk->alloc_qstrs += 64;
+        }
+        lk->new_qstrs[lk->n_qstrs] = (const byte *)addr;
+        elem->value = MP_OBJ_NEW_SMALL_INT(fw_qstr_count + lk->n_qstrs);
+        lk->n_qstrs++;
+    }
+    return MP_OBJ_SMALL_INT_VALUE(elem->value);
+}
+
+//--------------------------------------------------------------
+static qstr frz_load_qstr(frz_link_t *lk, mp_reader_t *reader)
+{
+    size_t len = read_uint(reader, NULL);
+    if (len == 0) {
+        // static qstr
+        return read_byte(reader);
+    }
+    if (len & 1) {
+        // qstr in window
+        return qstr_window_access(&lk->qw, len >> 1);
+    }
+    len >>= 1;
+    char *str = m_new(char, len);
+    read_bytes(reader, (byte *)str, len);
+    qstr qst = frz_qstr(lk, str, len);
+    m_del(char, str, len);
+    qstr_window_push(&lk->qw, qst);
+    return qst;
+}
+
+// Create the constant object in the region
+//-------------------------------------------------------------------
+static mp_uint_t frz_load_obj(frz_link_t *lk, mp_reader_t *reader)
+{
+    byte obj_type = read_byte(reader);
+    if (obj_type == 'e') return (mp_uint_t)&mp_const_ellipsis_obj;
+
+    size_t len = read_uint(reader, NULL);
+    vstr_t vstr;
+    vstr_init_len(&vstr, len);
+    read_bytes(reader, (byte *)vstr.buf, len);
+    mp_uint_t res;
+    if ((obj_type == 's') || (obj_type == 'b')) {
+        uintptr_t data = frz_write(lk, vstr.buf, len, 1);
+        frz_write(lk, "", 1, 1);
+        mp_obj_str_t o = {{(obj_type == 's') ? &mp_type_str : &mp_type_bytes}, qstr_compute_hash((const byte *)vstr.buf, len), len, (const byte *)data};
+        res = frz_write(lk, &o, sizeof(mp_obj_str_t), sizeof(mp_uint_t));
+    }
+    else {
+        mp_obj_t o;
+        if (obj_type == 'i') o = mp_parse_num_integer(vstr.buf, vstr.len, 10, NULL);
+        else o = mp_parse_num_decimal(vstr.buf, vstr.len, obj_type == 'c', false, NULL);
+
+        if (!mp_obj_is_obj(o)) {
+            // small int or float, no object needed
+            res = (mp_uint_t)o;
+        }
+        #if MICROPY_LONGINT_IMPL == MICROPY_LONGINT_IMPL_MPZ
+        else if (mp_obj_is_type(o, &mp_type_int)) {
+            mp_obj_int_t io = *(mp_obj_int_t *)MP_OBJ_TO_PTR(o);
+            uintptr_t dig = frz_write(lk, io.mpz.dig, io.mpz.len * sizeof(mpz_dig_t), sizeof(mp_uint_t));
+            io.mpz.fixed_dig = 1;
+            io.mpz.alloc = io.mpz.len;
+            io.mpz.dig = (mpz_dig_t *)dig;
+            res = frz_write(lk, &io, sizeof(mp_obj_int_t), sizeof(mp_uint_t));
+        }
+        #endif
+        #if MICROPY_PY_BUILTINS_COMPLEX
+        else if (mp_obj_is_type(o, &mp_type_complex)) {
+            frz_complex_t co = {{&mp_type_complex}, 0, 0};
+            mp_obj_get_complex(o, &co.real, &co.imag);
+            res = frz_write(lk, &co, sizeof(frz_complex_t), sizeof(mp_uint_t));
+        }
+        #endif
+        else {
+            mp_raise_ValueError("unsupported constant in .mpy file");
+        }
+    }
+    vstr_clear(&vstr);
+    return res;
+}
+
+// Link the function and its children into the region,
+// returns the XIP address of its raw code
+//------------------------------------------------------------------------
+static mp_uint_t frz_load_raw_code(frz_link_t *lk, mp_reader_t *reader)
+{
+    size_t kind_len = read_uint(reader, NULL);
+    if ((kind_len & 3) != 0) {
+        mp_raise_ValueError("native code can't be frozen to Flash");
+    }
+    size_t fun_data_len = kind_len >> 2;
+    byte *fun_data = m_new(byte, fun_data_len);
+
+    // prelude: signature and size (var-uints), simple_name and source_file qstrs, rest of the code info
+    byte *ip = fun_data;
+    read_uint(reader, &ip);
+    read_uint(reader, &ip);
+    const byte *ip_sig = fun_data;
+    MP_BC_PRELUDE_SIG_DECODE(ip_sig);
+    MP_BC_PRELUDE_SIZE_DECODE(ip_sig);
+    (void)n_state;
+    (void)n_exc_stack;
+    (void)n_def_pos_args;
+    qstr simple_name = frz_load_qstr(lk, reader);
+    ip[0] = simple_name; ip[1] = simple_name >> 8;
+    qstr source_file = frz_load_qstr(lk, reader);
+    ip[2] = source_file; ip[3] = source_file >> 8;
+    read_bytes(reader, ip + 4, n_info + n_cell - 4);
+    ip += n_info + n_cell;
+
+    // bytecode, qstr arguments are resolved to the region's ids
+    byte *ip_top = fun_data + fun_data_len;
+    while (ip < ip_top) {
+        *ip = read_byte(reader);
+        size_t sz;
+        uint f = mp_opcode_format(ip, &sz, false);
+        ++ip;
+        --sz;
+        if (f == MP_BC_FORMAT_QSTR) {
+            qstr qst = frz_load_qstr(lk, reader);
+            *ip++ = qst;
+            *ip++ = qst >> 8;
+            sz -= 2;
+        }
+        else if (f == MP_BC_FORMAT_VAR_UINT) {
+            while ((*ip++ = read_byte(reader)) & 0x80) {
+            }
+        }
+        read_bytes(reader, ip, sz);
+        ip += sz;
+    }
+
+    // constant table: argument names, constant objects, children raw code
+    size_t n_obj = read_uint(reader, NULL);
+    size_t n_raw_code = read_uint(reader, NULL);
+    size_t n_const = n_pos_args + n_kwonly_args + n_obj + n_raw_code;
+    mp_uint_t *const_table = m_new(mp_uint_t, n_const);
+    mp_uint_t *ct = const_table;
+    for (size_t i = 0; i < n_pos_args + n_kwonly_args; ++i) {
+        *ct++ = (mp_uint_t)MP_OBJ_NEW_QSTR(frz_load_qstr(lk, reader));
+    }
+    for (size_t i = 0; i < n_obj; ++i) {
+        *ct++ = frz_load_obj(lk, reader);
+    }
+    for (size_t i = 0; i < n_raw_code; ++i) {
+        *ct++ = frz_load_raw_code(lk, reader);
+    }
+
+    mp_raw_code_t rc;
+    memset(&rc, 0, sizeof(mp_raw_code_t));
+    rc.kind = MP_CODE_BYTECODE;
+    rc.scope_flags = scope_flags;
+    rc.fun_data = (const void *)frz_write(lk, fun_data, fun_data_len, 1);
+    if (n_const) rc.const_table = (const mp_uint_t *)frz_write(lk, const_table, n_const * sizeof(mp_uint_t), sizeof(mp_uint_t));
+    m_del(byte, fun_data, fun_data_len);
+    m_del(mp_uint_t, const_table, n_const);
+
+    return frz_write(lk, &rc, sizeof(mp_raw_code_t), sizeof(mp_uint_t));
+}
+
+//---------------------------------------
+static int frz_small_int_bits(void)
+{
+    mp_int_t i = MP_SMALL_INT_MAX;
+    int n = 1;
+    while (i != 0) {
+        i >>= 1;
+        ++n;
+    }
+    return n;
+}
+
+// Link the module, 'name' is relative to the frozen directory, as used by import
+//-----------------------------------------------------------------------------------
+static void frz_add_module(frz_link_t *lk, const char *fname, const char *name)
+{
+    LOGD(TAG, "Linking '%s'", name);
+    mp_reader_t reader;
+    mp_reader_new_file(&reader, fname);
+    byte header[4];
+    read_bytes(&reader, header, sizeof(header));
+    if ((header[0] != 'M') || (header[1] != MPY_VERSION) ||
+        (MPY_FEATURE_DECODE_FLAGS(header[2]) != MPY_FEATURE_FLAGS) ||
+        (MPY_FEATURE_DECODE_ARCH(header[2]) != MP_NATIVE_ARCH_NONE) ||
+        (header[3] > frz_small_int_bits()) ||
+        (read_uint(&reader, NULL) > QSTR_WINDOW_SIZE)) {
+        reader.close(reader.data);
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "incompatible .mpy file '%s'", name));
+    }
+    lk->qw.idx = 0;
+    mp_uint_t rc = frz_load_raw_code(lk, &reader);
+    reader.close(reader.data);
+
+    if (lk->count >= lk->alloc_count) {
+        lk->content = m_renew(mp_uint_t, lk->content, lk->alloc_count, lk->alloc_count + 16);
+        lk->alloc_count += 16;
+    }
+    lk->content[lk->count++] = rc;
+    vstr_add_strn(&lk->names, name, strlen(name) + 1);
+}
+
+// Link all '.mpy' files from the directory and its subdirectories
+//---------------------------------------------------------------------
+static void frz_add_dir(frz_link_t *lk, vstr_t *path, size_t base_len)
+{
+    mp_obj_t dir = mp_obj_new_str(path->buf, path->len);
+    mp_obj_t iter = mp_vfs_ilistdir(1, &dir);
+    mp_obj_t next;
+    while ((next = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        size_t n_items;
+        mp_obj_t *items;
+        mp_obj_tuple_get(next, &n_items, &items);
+        size_t name_len;
+        const char *name = mp_obj_str_get_data(items[0], &name_len);
+        size_t len = path->len;
+        vstr_add_char(path, '/');
+        vstr_add_strn(path, name, name_len);
+        if (mp_obj_get_int(items[1]) == MP_S_IFDIR) {
+            frz_add_dir(lk, path, base_len);
+        }
+        else if ((name_len > 4) && (memcmp(name + name_len - 4, ".mpy", 4) == 0)) {
+            const char *fname = vstr_null_terminated_str(path);
+            frz_add_module(lk, fname, fname + base_len + 1);
+        }
+        path->len = len;
+    }
+}
+
+// uos.mpy_freeze(path)
+//   Link all '.mpy' files from 'path' (and its subdirectories) into the frozen modules region,
+//   the modules are imported from Flash after the next soft reset.
+// uos.mpy_freeze()
+//   Disable the frozen modules, already imported modules remain valid until the reset.
+//-------------------------------------------------------------------------
+STATIC mp_obj_t flash_frozen_freeze(size_t n_args, const mp_obj_t *args)
+{
+    if ((n_args == 0) || (args[0] == mp_const_none)) {
+        // erase the header sector only, the linked qstrs and bytecode are not changed
+        if (w25qxx_sector_erase(MICRO_PY_FLASH_FROZEN_START) != W25QXX_OK) mp_raise_OSError(MP_EIO);
+        return mp_const_none;
+    }
+
+    const char *path = mp_obj_str_get_str(args[0]);
+    if ((frozen_linked[0]) || (frozen_linked[1])) {
+        mp_raise_msg(&mp_type_OSError, "Frozen modules in use, run 'uos.mpy_freeze()' and reset first");
+    }
+    if (w25qxx_xip_map() != W25QXX_OK) mp_raise_msg(&mp_type_OSError, "XIP mode not available (Flash not in QUAD mode)");
+    // invalidate the region first, an interrupted link leaves no valid header
+    if (w25qxx_sector_erase(MICRO_PY_FLASH_FROZEN_START) != W25QXX_OK) mp_raise_OSError(MP_EIO);
+
+    frz_link_t lk;
+    memset(&lk, 0, sizeof(frz_link_t));
+    lk.pos = FLASH_FROZEN_HDR_SIZE;
+    lk.buf = m_new(byte, w25qxx_FLASH_SECTOR_SIZE);
+    memset(lk.buf, 0xFF, w25qxx_FLASH_SECTOR_SIZE);
+    mp_map_init(&lk.qstr_map, 0);
+    vstr_init(&lk.names, 256);
+
+    vstr_t vpath;
+    vstr_init(&vpath, 64);
+    vstr_add_str(&vpath, path);
+    while ((vpath.len > 1) && (vpath.buf[vpath.len-1] == '/')) vpath.len--;
+    frz_add_dir(&lk, &vpath, vpath.len);
+    vstr_clear(&vpath);
+    if (lk.count == 0) mp_raise_ValueError("No .mpy files found");
+
+    // qstr pool, it is never written to: 'alloc' <= 'len', the next run time pool is allocated in RAM
+    const qstr_pool_t *pool = NULL;
+    if (lk.n_qstrs) {
+        size_t pool_size = sizeof(qstr_pool_t) + lk.n_qstrs * sizeof(const byte *);
+        qstr_pool_t *qp = m_new_obj_var(qstr_pool_t, const byte *, lk.n_qstrs);
+        qp->prev = fw_pool;
+        qp->total_prev_len = fw_qstr_count;
+        qp->alloc = (lk.n_qstrs < 10) ? lk.n_qstrs : 10;
+        qp->len = lk.n_qstrs;
+        memcpy(qp->qstrs, lk.new_qstrs, lk.n_qstrs * sizeof(const byte *));
+        pool = (const qstr_pool_t *)frz_write(&lk, qp, pool_size, sizeof(mp_uint_t));
+        m_del_var(qstr_pool_t, const byte *, lk.n_qstrs, qp);
+    }
+    if (lk.pos & (w25qxx_FLASH_SECTOR_SIZE - 1)) frz_flush(&lk, lk.pos & (w25qxx_FLASH_SECTOR_SIZE - 1));
+
+    // verify the region data through the XIP window
+    if (flash_image_crc32(0, FLASH_FROZEN_PTR + FLASH_FROZEN_HDR_SIZE, lk.pos - FLASH_FROZEN_HDR_SIZE) != lk.crc) {
+        mp_raise_msg(&mp_type_OSError, "Frozen modules verification failed");
+    }
+
+    // header sector: header, raw code table, names
+    size_t content_size = lk.count * sizeof(mp_uint_t);
+    size_t hdr_size = sizeof(flash_frozen_header_t) + content_size + lk.names.len + 1;
+    if (hdr_size > FLASH_FROZEN_HDR_SIZE) mp_raise_ValueError("Too many frozen modules");
+    flash_frozen_header_t *hdr = (flash_frozen_header_t *)lk.buf;
+    memset(lk.buf, 0xFF, w25qxx_FLASH_SECTOR_SIZE);
+    hdr->magic = FLASH_FROZEN_MAGIC;
+    hdr->version = FLASH_FROZEN_VERSION;
+    hdr->count = lk.count;
+    hdr->hdr_size = hdr_size;
+    hdr->size = lk.pos;
+    hdr->data_crc32 = lk.crc;
+    hdr->fw_id = flash_frozen_fw_id();
+    hdr->pool = pool;
+    hdr->content = (const mp_raw_code_t *const *)(FLASH_FROZEN_PTR + sizeof(flash_frozen_header_t));
+    hdr->names = (const char *)(FLASH_FROZEN_PTR + sizeof(flash_frozen_header_t) + content_size);
+    memcpy(lk.buf + sizeof(flash_frozen_header_t), lk.content, content_size);
+    memcpy(lk.buf + sizeof(flash_frozen_header_t) + content_size, lk.names.buf, lk.names.len);
+    lk.buf[hdr_size - 1] = 0;
+    hdr->crc32 = flash_image_crc32(0, lk.buf + 8, hdr_size - 8);
+    if (w25qxx_write_data(MICRO_PY_FLASH_FROZEN_START, lk.buf, hdr_size) != W25QXX_OK) mp_raise_OSError(MP_EIO);
+
+    LOGI(TAG, "%u modules frozen (%u bytes, %u new qstrs), used after soft reset", (uint32_t)lk.count, lk.pos, (uint32_t)lk.n_qstrs);
+    m_del(byte, lk.buf, w25qxx_FLASH_SECTOR_SIZE);
+    vstr_clear(&lk.names);
+    return mp_obj_new_int(lk.count);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(flash_frozen_freeze_obj, 0, 1, flash_frozen_freeze);
+
+// Returns the tuple: (list of frozen module names, modules used in this instance)
+//--------------------------------------
+STATIC mp_obj_t flash_frozen_list(void)
+{
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    flash_frozen_header_t hdr;
+    if ((w25qxx_read_data(MICRO_PY_FLASH_FROZEN_START, (uint8_t *)&hdr, sizeof(flash_frozen_header_t)) == W25QXX_OK) &&
+        (hdr.magic == FLASH_FROZEN_MAGIC) && (hdr.version == FLASH_FROZEN_VERSION) &&
+        (hdr.fw_id == flash_frozen_fw_id()) && (w25qxx_xip_map() == W25QXX_OK)) {
+        const char *name = hdr.names;
+        for (int i=0; i<hdr.count; i++) {
+            size_t len = strlen(name);
+            mp_obj_list_append(list, mp_obj_new_str(name, len));
+            name += len + 1;
+        }
+    }
+    mp_obj_t tuple[2];
+    tuple[0] = list;
+    tuple[1] = mp_obj_new_bool(frozen_linked[flash_frozen_instance()]);
+    return mp_obj_new_tuple(2, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_0(flash_frozen_list_obj, flash_frozen_list);
+
+#endif // MICROPY_MODULE_FROZEN_MPY_EXTRA
@@ -0,0 +1,148 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "py/mpconfig.h"
+
+#if MICROPY_VFS
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "extmod/vfs.h"
+#include "syslog.h"
+#include "w25qxx.h"
+#include "mphalport.h"
+
+#include "flash_image.h"
+
+static const char *TAG = "[FLASH_IMAGE]";
+
+// Flash image as seen through the XIP window
+#define FLASH_IMAGE_PTR     (w25qxx_flash_ptr + MICRO_PY_FLASH_IMAGE_START)
+
+// Enable the permanent XIP mode and check the image
+//------------------------------
+static int flash_image_map(void)
+{
+    if (MICRO_PY_FLASH_IMAGE_SIZE == 0) mp_raise_msg(&mp_type_OSError, "Flash image partition not configured");
+    if (w25qxx_xip_map() != W25QXX_OK) mp_raise_msg(&mp_type_OSError, "XIP mode not available (Flash not in QUAD mode)");
+    return flash_image_check(FLASH_IMAGE_PTR, MICRO_PY_FLASH_IMAGE_SIZE);
+}
+
+// Return the read-only memoryview of the file in the flash image
+//---------------------------------------------
+STATIC mp_obj_t flash_image_mmap(mp_obj_t path_in)
+{
+    const char *path = mp_obj_str_get_str(path_in);
+    if (flash_image_map() < 0) mp_raise_msg(&mp_type_OSError, "No valid Flash image");
+
+    const flash_image_entry_t *entry = flash_image_find(FLASH_IMAGE_PTR, path);
+    if (entry == NULL) mp_raise_OSError(MP_ENOENT);
+    // memoryview without the RW flag, flash can't be written through the XIP window
+    return mp_obj_new_memoryview('B', entry->size, (void *)(FLASH_IMAGE_PTR + entry->offset));
+}
+MP_DEFINE_CONST_FUN_OBJ_1(flash_image_mmap_obj, flash_image_mmap);
+
+// List the files in the flash image as (name, size) tuples
+//------------------------------------
+STATIC mp_obj_t flash_image_list(void)
+{
+    int count = flash_image_map();
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    const flash_image_entry_t *entry = (const flash_image_entry_t *)(FLASH_IMAGE_PTR + sizeof(flash_image_header_t));
+    for (int i=0; i<count; i++, entry++) {
+        mp_obj_t tuple[2];
+        tuple[0] = mp_obj_new_str(entry->name, strnlen(entry->name, FLASH_IMAGE_NAME_LEN));
+        tuple[1] = mp_obj_new_int_from_uint(entry->size);
+        mp_obj_list_append(list, mp_obj_new_tuple(2, tuple));
+    }
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(flash_image_list_obj, flash_image_list);
+
+// Write the image file created by 'mkflashimg' to the image partition
+// Existing memoryviews see the new content, they must not be used after the install
+//-------------------------------------------------
+STATIC mp_obj_t flash_image_install(mp_obj_t fname_in)
+{
+    if (MICRO_PY_FLASH_IMAGE_SIZE == 0) mp_raise_msg(&mp_type_OSError, "Flash image partition not configured");
+
+    mp_obj_t args[2];
+    args[0] = fname_in;
+    args[1] = mp_obj_new_str("rb", 2);
+    mp_obj_t ffd = mp_vfs_open(2, args, (mp_map_t*)&mp_const_empty_map);
+
+    uint8_t *buf = m_new(uint8_t, w25qxx_FLASH_SECTOR_SIZE);
+    flash_image_header_t hdr;
+    int rdbytes = mp_stream_posix_read((void *)ffd, (char *)&hdr, sizeof(flash_image_header_t));
+    int fsize = mp_stream_posix_lseek((void *)ffd, 0, SEEK_END);
+    mp_stream_posix_lseek((void *)ffd, 0, SEEK_SET);
+    if ((rdbytes != sizeof(flash_image_header_t)) || (hdr.magic != FLASH_IMAGE_MAGIC) || (hdr.size != fsize)) {
+        mp_stream_close(ffd);
+        mp_raise_ValueError("Not a Flash image file");
+    }
+    if (hdr.size > MICRO_PY_FLASH_IMAGE_SIZE) {
+        mp_stream_close(ffd);
+        mp_raise_ValueError("Image too big for the partition");
+    }
+
+    LOGD(TAG, "Writing %d bytes at %08X", fsize, MICRO_PY_FLASH_IMAGE_START);
+    uint32_t addr = MICRO_PY_FLASH_IMAGE_START;
+    int remain = fsize;
+    enum w25qxx_status_t res = W25QXX_OK;
+    while (remain > 0) {
+        int blk_size = (remain > w25qxx_FLASH_SECTOR_SIZE) ? w25qxx_FLASH_SECTOR_SIZE : remain;
+        rdbytes = mp_stream_posix_read((void *)ffd, (char *)buf, blk_size);
+        if (rdbytes != blk_size) {
+            res = W25QXX_ERROR;
+            break;
+        }
+        res = w25qxx_write_data(addr, buf, blk_size);
+        if (res != W25QXX_OK) break;
+        addr += blk_size;
+        remain -= blk_size;
+    }
+    mp_stream_close(ffd);
+    m_del(uint8_t, buf, w25qxx_FLASH_SECTOR_SIZE);
+    if (res != W25QXX_OK) mp_raise_OSError(MP_EIO);
+
+    // verify the directory and the data through the XIP window
+    int count = flash_image_map();
+    if (count < 0) mp_raise_msg(&mp_type_OSError, "Image verification failed");
+    const flash_image_entry_t *entry = (const flash_image_entry_t *)(FLASH_IMAGE_PTR + sizeof(flash_image_header_t));
+    for (int i=0; i<count; i++, entry++) {
+        if (flash_image_crc32(0, FLASH_IMAGE_PTR + entry->offset, entry->size) != entry->crc32) {
+            LOGE(TAG, "CRC error: '%.*s'", FLASH_IMAGE_NAME_LEN, entry->name);
+            mp_raise_msg(&mp_type_OSError, "Image verification failed");
+        }
+    }
+    return mp_obj_new_int(count);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(flash_image_install_obj, flash_image_install);
+
+#endif // MICROPY_VFS
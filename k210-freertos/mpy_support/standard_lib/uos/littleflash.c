@@ -80,11 +80,24 @@ static uint8_t lookahead_buffer[LITTLEFS_CFG_LOOKAHEAD_SIZE] __attribute__((alig
 // LFS disk interface for internal flash
 // ============================================================================
 
+// Take the FS lock
+// While waiting, the caller's GIL is released the same way as while waiting for the flash driver:
+// the FS lock owner may be writing to Flash and need the GIL of the caller's instance (XIP suspended)
+//-----------------------------
+static bool littlefs_lock(void)
+{
+    if (xSemaphoreTake(littlefs_mutex, 0) == pdTRUE) return true;
+    int arg = (w25qxx_lock_hook) ? w25qxx_lock_hook(W25QXX_HOOK_WAIT_START, 0) : 0;
+    bool res = (xSemaphoreTake(littlefs_mutex, LITTLEFS_MUTEX_TIMEOUT) == pdTRUE);
+    if (w25qxx_lock_hook) w25qxx_lock_hook(W25QXX_HOOK_WAIT_END, arg);
+    return res;
+}
+
 //-------------------------------------------------------------------------------------------------------------------
 static int internal_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
 {
     uint32_t phy_addr = LITTLEFS_CFG_START_ADDR + (block * LITTLEFS_CFG_SECTOR_SIZE) + off;
-    if (xSemaphoreTake(littlefs_mutex, LITTLEFS_MUTEX_TIMEOUT) != pdTRUE) {
+    if (!littlefs_lock()) {
         if (w25qxx_debug) LOGE(TAG, "[READ] Mutex timeout: bkl=%u, off=%u, sz=%u, adr=0x%x", block, off, size, phy_addr);
         return LFS_ERR_IO;
     }
@@ -104,7 +117,7 @@ static int internal_read(const struct lfs_config *c, lfs_block_t block, lfs_off_
 static int internal_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
 {
     uint32_t phy_addr = LITTLEFS_CFG_START_ADDR + (block * LITTLEFS_CFG_SECTOR_SIZE) + off;
-    if (xSemaphoreTake(littlefs_mutex, LITTLEFS_MUTEX_TIMEOUT) != pdTRUE) {
+    if (!littlefs_lock()) {
         if (w25qxx_debug) LOGE(TAG, "[PROG] Mutex timeout: bkl=%u, off=%u, sz=%u, adr=0x%x", block, off, size, phy_addr);
         return LFS_ERR_IO;
     }
@@ -129,7 +142,7 @@ static int internal_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_
 static int internal_erase(const struct lfs_config *c, lfs_block_t block)
 {
     uint32_t phy_addr = LITTLEFS_CFG_START_ADDR + (block * w25qxx_FLASH_SECTOR_SIZE);
-    if (xSemaphoreTake(littlefs_mutex, LITTLEFS_MUTEX_TIMEOUT) != pdTRUE) {
+    if (!littlefs_lock()) {
         //if (w25qxx_debug) LOGE(TAG, "[ERASE] Mutex timeout: bkl=%u, adr=0x%x", block, phy_addr);
         return LFS_ERR_IO;
     }
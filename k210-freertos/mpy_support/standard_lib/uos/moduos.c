@@ -52,6 +52,8 @@
 #include "vfs_sdcard.h"
 #endif
 #include "mphalport.h"
+#include "flash_image.h"
+#include "flash_frozen.h"
 
 
 STATIC const qstr os_uname_info_fields[] = {
@@ -397,6 +399,13 @@ STATIC const mp_rom_map_elem_t os_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_get_file),        MP_ROM_PTR(&os_getfile_obj) },
     { MP_ROM_QSTR(MP_QSTR_send_file),       MP_ROM_PTR(&os_sendfile_obj) },
     { MP_ROM_QSTR(MP_QSTR_listdirex),       MP_ROM_PTR(&os_list_dir_files_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mmap),            MP_ROM_PTR(&flash_image_mmap_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mmap_list),       MP_ROM_PTR(&flash_image_list_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mmap_install),    MP_ROM_PTR(&flash_image_install_obj) },
+    #if MICROPY_MODULE_FROZEN_MPY_EXTRA
+    { MP_ROM_QSTR(MP_QSTR_mpy_freeze),      MP_ROM_PTR(&flash_frozen_freeze_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mpy_frozen),      MP_ROM_PTR(&flash_frozen_list_obj) },
+    #endif
     #endif
 	#if MICROPY_VFS_SPIFFS
 	{ MP_ROM_QSTR(MP_QSTR_VfsFlashfs),      MP_ROM_PTR(&mp_spiffs_vfs_type) },
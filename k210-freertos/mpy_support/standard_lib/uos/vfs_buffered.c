@@ -0,0 +1,390 @@
+/*
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Buffered stream layer for the VFS file objects
+ *
+ * littlefs, SPIFFS and FatFS file objects register their own read/write/ioctl
+ * functions as 'raw' stream and use the stream protocol defined here.
+ * Small reads are served from the read-ahead buffer, small writes are collected
+ * in the buffer and written to the file when it is full (or on '\n' for line
+ * buffered text files), on seek, flush or close.
+ * Reads and writes larger than the buffer bypass it.
+ */
+
+#include "py/mpconfig.h"
+
+#if MICROPY_VFS
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+
+#include "vfs_buffered.h"
+
+//----------------------------------------------------------------
+static inline vfs_file_buffer_t *get_fbuf(mp_obj_t self_in)
+{
+    return &((vfs_buffered_obj_t *)MP_OBJ_TO_PTR(self_in))->fbuf;
+}
+
+//-------------------------------------------------------------------------------------------------------
+STATIC mp_uint_t raw_seek(mp_obj_t self_in, vfs_file_buffer_t *fbuf, mp_off_t offset, int whence, int *errcode)
+{
+    struct mp_stream_seek_t seek_s;
+    seek_s.offset = offset;
+    seek_s.whence = whence;
+    if (fbuf->raw->ioctl(self_in, MP_STREAM_SEEK, (uintptr_t)&seek_s, errcode) == MP_STREAM_ERROR) {
+        return MP_STREAM_ERROR;
+    }
+    return seek_s.offset;
+}
+
+// Write the pending data to the file
+//------------------------------------------------------------------------------
+STATIC int buffer_flush(mp_obj_t self_in, vfs_file_buffer_t *fbuf, int *errcode)
+{
+    uint32_t done = 0;
+    int res = 0;
+    while (done < fbuf->fill) {
+        mp_uint_t n = fbuf->raw->write(self_in, fbuf->buf + done, fbuf->fill - done, errcode);
+        if ((n == MP_STREAM_ERROR) || (n == 0)) {
+            if (n == 0) *errcode = MP_EIO;
+            res = -1;
+            break;
+        }
+        done += n;
+    }
+    // on error the pending data are discarded, so that close() can still succeed
+    fbuf->flags &= ~VFS_BUFFER_FLAG_DIRTY;
+    fbuf->pos = 0;
+    fbuf->fill = 0;
+    return res;
+}
+
+// Empty the buffer and set the file position to the logical stream position
+//-----------------------------------------------------------------------------
+STATIC int buffer_sync(mp_obj_t self_in, vfs_file_buffer_t *fbuf, int *errcode)
+{
+    if (fbuf->flags & VFS_BUFFER_FLAG_DIRTY) return buffer_flush(self_in, fbuf, errcode);
+
+    uint32_t unread = fbuf->fill - fbuf->pos;
+    fbuf->pos = 0;
+    fbuf->fill = 0;
+    if (unread > 0) {
+        // move back over the read-ahead data
+        if (raw_seek(self_in, fbuf, -(mp_off_t)unread, MP_SEEK_CUR, errcode) == MP_STREAM_ERROR) return -1;
+    }
+    return 0;
+}
+
+// Read 'size' bytes, less only at the end of file.
+// C code reads files with a single mp_stream_posix_read() call, so no short reads are returned.
+//---------------------------------------------------------------------------------------
+STATIC mp_uint_t buffered_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode)
+{
+    vfs_file_buffer_t *fbuf = get_fbuf(self_in);
+    if (fbuf->flags & VFS_BUFFER_FLAG_CLOSED) {
+        *errcode = MP_EBADF;
+        return MP_STREAM_ERROR;
+    }
+    if (fbuf->buf == NULL) return fbuf->raw->read(self_in, buf, size, errcode);
+
+    if (fbuf->flags & VFS_BUFFER_FLAG_DIRTY) {
+        if (buffer_flush(self_in, fbuf, errcode) != 0) return MP_STREAM_ERROR;
+    }
+
+    uint8_t *out = (uint8_t *)buf;
+    mp_uint_t done = 0;
+    while (done < size) {
+        uint32_t avail = fbuf->fill - fbuf->pos;
+        if (avail > 0) {
+            // first from the read-ahead buffer
+            mp_uint_t n = size - done;
+            if (n > avail) n = avail;
+            memcpy(out + done, fbuf->buf + fbuf->pos, n);
+            fbuf->pos += n;
+            done += n;
+            continue;
+        }
+        mp_uint_t n;
+        if ((size - done) >= fbuf->size) {
+            // large reads go directly to the caller's buffer
+            n = fbuf->raw->read(self_in, out + done, size - done, errcode);
+            if ((n != MP_STREAM_ERROR) && (n > 0)) done += n;
+        }
+        else {
+            n = fbuf->raw->read(self_in, fbuf->buf, fbuf->size, errcode);
+            fbuf->pos = 0;
+            fbuf->fill = (n == MP_STREAM_ERROR) ? 0 : n;
+        }
+        if (n == MP_STREAM_ERROR) {
+            // the data already read are returned, the error is reported on the next read
+            return (done > 0) ? done : MP_STREAM_ERROR;
+        }
+        if (n == 0) break; // end of file
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------------------------------
+STATIC mp_uint_t buffered_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode)
+{
+    vfs_file_buffer_t *fbuf = get_fbuf(self_in);
+    if (fbuf->flags & VFS_BUFFER_FLAG_CLOSED) {
+        *errcode = MP_EBADF;
+        return MP_STREAM_ERROR;
+    }
+    if (fbuf->buf == NULL) return fbuf->raw->write(self_in, buf, size, errcode);
+
+    if (!(fbuf->flags & VFS_BUFFER_FLAG_DIRTY) && (fbuf->fill > 0)) {
+        // switching from reading to writing
+        if (buffer_sync(self_in, fbuf, errcode) != 0) return MP_STREAM_ERROR;
+    }
+
+    // all data are written, as for reading, C code expects no short writes
+    const uint8_t *in = (const uint8_t *)buf;
+    mp_uint_t done = 0;
+    while (done < size) {
+        if ((fbuf->fill == 0) && ((size - done) >= fbuf->size)) {
+            mp_uint_t n = fbuf->raw->write(self_in, in + done, size - done, errcode);
+            if ((n == MP_STREAM_ERROR) || (n == 0)) {
+                if (n == 0) *errcode = MP_EIO;
+                return (done > 0) ? done : MP_STREAM_ERROR;
+            }
+            done += n;
+            continue;
+        }
+
+        uint32_t n = fbuf->size - fbuf->fill;
+        if ((size - done) < n) n = size - done;
+        memcpy(fbuf->buf + fbuf->fill, in + done, n);
+        fbuf->fill += n;
+        fbuf->flags |= VFS_BUFFER_FLAG_DIRTY;
+
+        if ((fbuf->fill == fbuf->size) ||
+                ((fbuf->flags & VFS_BUFFER_FLAG_LINE) && (memchr(in + done, '\n', n) != NULL))) {
+            if (buffer_flush(self_in, fbuf, errcode) != 0) return (done > 0) ? done : MP_STREAM_ERROR;
+        }
+        done += n;
+    }
+    return done;
+}
+
+//--------------------------------------------------------------------------------------------------
+STATIC mp_uint_t buffered_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode)
+{
+    vfs_file_buffer_t *fbuf = get_fbuf(self_in);
+
+    if (request == MP_STREAM_CLOSE) {
+        // close() is called again from the finaliser
+        if (fbuf->flags & VFS_BUFFER_FLAG_CLOSED) return 0;
+        fbuf->flags |= VFS_BUFFER_FLAG_CLOSED;
+        int flush_err = 0;
+        int res = 0;
+        if (fbuf->flags & VFS_BUFFER_FLAG_DIRTY) res = buffer_flush(self_in, fbuf, &flush_err);
+        if (fbuf->raw->ioctl(self_in, request, arg, errcode) == MP_STREAM_ERROR) return MP_STREAM_ERROR;
+        if (res != 0) {
+            *errcode = flush_err;
+            return MP_STREAM_ERROR;
+        }
+        return 0;
+    }
+    if (fbuf->flags & VFS_BUFFER_FLAG_CLOSED) {
+        *errcode = MP_EBADF;
+        return MP_STREAM_ERROR;
+    }
+    if (fbuf->buf == NULL) return fbuf->raw->ioctl(self_in, request, arg, errcode);
+
+    if (request == MP_STREAM_SEEK) {
+        struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
+        if (s->whence == MP_SEEK_CUR) {
+            bool dirty = (fbuf->flags & VFS_BUFFER_FLAG_DIRTY);
+            mp_off_t new_pos = (mp_off_t)fbuf->pos + s->offset;
+            if ((s->offset == 0) || (!dirty && (new_pos >= 0) && (new_pos <= (mp_off_t)fbuf->fill))) {
+                // tell(), or seek inside the read buffer, the buffer is kept
+                mp_uint_t raw_pos = raw_seek(self_in, fbuf, 0, MP_SEEK_CUR, errcode);
+                if (raw_pos == MP_STREAM_ERROR) return MP_STREAM_ERROR;
+                if (dirty) {
+                    s->offset = raw_pos + fbuf->fill;
+                }
+                else {
+                    fbuf->pos = new_pos;
+                    s->offset = raw_pos - (fbuf->fill - fbuf->pos);
+                }
+                return 0;
+            }
+        }
+        if (buffer_sync(self_in, fbuf, errcode) != 0) return MP_STREAM_ERROR;
+    }
+    else if (request == MP_STREAM_FLUSH) {
+        if (buffer_sync(self_in, fbuf, errcode) != 0) return MP_STREAM_ERROR;
+    }
+    return fbuf->raw->ioctl(self_in, request, arg, errcode);
+}
+
+// Read one line, the buffer is scanned for '\n' with memchr
+//---------------------------------------------------------------------
+STATIC mp_obj_t buffered_readline(size_t n_args, const mp_obj_t *args)
+{
+    mp_obj_t self_in = args[0];
+    vfs_file_buffer_t *fbuf = get_fbuf(self_in);
+    if (fbuf->buf == NULL) {
+        return mp_call_function_n_kw(MP_OBJ_FROM_PTR(&mp_stream_unbuffered_readline_obj), n_args, 0, args);
+    }
+    bool is_text = mp_get_stream(self_in)->is_text;
+
+    mp_int_t max_size = -1;
+    if (n_args > 1) {
+        max_size = mp_obj_get_int(args[1]);
+    }
+    int error;
+    if (fbuf->flags & VFS_BUFFER_FLAG_CLOSED) mp_raise_OSError(MP_EBADF);
+    if (fbuf->flags & VFS_BUFFER_FLAG_DIRTY) {
+        if (buffer_flush(self_in, fbuf, &error) != 0) mp_raise_OSError(error);
+    }
+
+    vstr_t vstr;
+    vstr.buf = NULL;
+    size_t len = 0;
+    while (len != (size_t)max_size) {
+        uint32_t avail = fbuf->fill - fbuf->pos;
+        if (avail == 0) {
+            mp_uint_t n = fbuf->raw->read(self_in, fbuf->buf, fbuf->size, &error);
+            if (n == MP_STREAM_ERROR) mp_raise_OSError(error);
+            fbuf->pos = 0;
+            fbuf->fill = n;
+            if (n == 0) break; // EOF
+            avail = n;
+        }
+        if ((max_size >= 0) && (avail > ((size_t)max_size - len))) avail = (size_t)max_size - len;
+
+        const byte *start = fbuf->buf + fbuf->pos;
+        const byte *nl = memchr(start, '\n', avail);
+        if (nl != NULL) avail = nl - start + 1;
+        fbuf->pos += avail;
+        len += avail;
+
+        bool done = (nl != NULL) || (len == (size_t)max_size);
+        if ((done) && (vstr.buf == NULL)) {
+            // the whole line was in the buffer, no need to copy it twice
+            if (is_text) return mp_obj_new_str((const char *)start, avail);
+            return mp_obj_new_bytes(start, avail);
+        }
+        if (vstr.buf == NULL) vstr_init(&vstr, (avail < 64) ? 64 : avail * 2);
+        vstr_add_strn(&vstr, (const char *)start, avail);
+        if (done) break;
+    }
+    if (vstr.buf == NULL) {
+        return (is_text) ? MP_OBJ_NEW_QSTR(MP_QSTR_) : mp_const_empty_bytes;
+    }
+    return mp_obj_new_str_from_vstr((is_text) ? &mp_type_str : &mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(buffered_readline_obj, 1, 2, buffered_readline);
+
+//-----------------------------------------------------
+STATIC mp_obj_t buffered_readlines(mp_obj_t self_in)
+{
+    mp_obj_t lines = mp_obj_new_list(0, NULL);
+    for (;;) {
+        mp_obj_t line = buffered_readline(1, &self_in);
+        if (!mp_obj_is_true(line)) break;
+        mp_obj_list_append(lines, line);
+    }
+    return lines;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(buffered_readlines_obj, buffered_readlines);
+
+//----------------------------------------------
+mp_obj_t vfs_buffered_iternext(mp_obj_t self_in)
+{
+    mp_obj_t line = buffered_readline(1, &self_in);
+    if (mp_obj_is_true(line)) return line;
+    return MP_OBJ_STOP_ITERATION;
+}
+
+//--------------------------------------------------------------------
+STATIC mp_obj_t buffered___exit__(size_t n_args, const mp_obj_t *args)
+{
+    (void)n_args;
+    return mp_stream_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(buffered___exit___obj, 4, 4, buffered___exit__);
+
+// Buffer size for the 'buffering' argument of open()
+//--------------------------------------------------------
+size_t vfs_buffered_size(mp_int_t buffering)
+{
+    if (buffering == 0) return 0;
+    if ((buffering < 0) || (buffering == 1)) return VFS_BUFFER_DEFAULT_SIZE;
+    if (buffering > VFS_BUFFER_MAX_SIZE) return VFS_BUFFER_MAX_SIZE;
+    return buffering;
+}
+
+//------------------------------------------------------------------------------------------------------------------------
+void vfs_buffered_init(vfs_buffered_obj_t *self, const mp_stream_p_t *raw, byte *buf, size_t size, mp_int_t buffering)
+{
+    self->fbuf.raw = raw;
+    self->fbuf.buf = (size > 0) ? buf : NULL;
+    self->fbuf.size = size;
+    self->fbuf.pos = 0;
+    self->fbuf.fill = 0;
+    self->fbuf.flags = 0;
+    if ((buffering == 1) && (mp_get_stream(MP_OBJ_FROM_PTR(self))->is_text)) self->fbuf.flags |= VFS_BUFFER_FLAG_LINE;
+}
+
+STATIC const mp_rom_map_elem_t vfs_buffered_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readline), MP_ROM_PTR(&buffered_readline_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readlines), MP_ROM_PTR(&buffered_readlines_obj) },
+    { MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&mp_stream_write_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_stream_flush_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR_seek), MP_ROM_PTR(&mp_stream_seek_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tell), MP_ROM_PTR(&mp_stream_tell_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&buffered___exit___obj) },
+};
+MP_DEFINE_CONST_DICT(vfs_buffered_locals_dict, vfs_buffered_locals_dict_table);
+
+const mp_stream_p_t vfs_buffered_fileio_stream_p = {
+    .read = buffered_read,
+    .write = buffered_write,
+    .ioctl = buffered_ioctl,
+};
+
+const mp_stream_p_t vfs_buffered_textio_stream_p = {
+    .read = buffered_read,
+    .write = buffered_write,
+    .ioctl = buffered_ioctl,
+    .is_text = true,
+};
+
+#endif // MICROPY_VFS
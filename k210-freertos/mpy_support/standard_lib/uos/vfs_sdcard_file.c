@@ -35,6 +35,7 @@
 #include "py/stream.h"
 #include "py/mperrno.h"
 #include "vfs_sdcard.h"
+#include "vfs_buffered.h"
 
 
 const mp_obj_type_t mp_type_vfs_sdcard_textio;
@@ -44,6 +45,7 @@ const mp_obj_type_t mp_type_vfs_sdcard_fileio;
 
 typedef struct _sdcard_file_obj_t {
     mp_obj_base_t base;
+    vfs_file_buffer_t fbuf;
     FIL   fp;
 } sdcard_file_obj_t;
 
@@ -94,13 +96,6 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
     return (mp_uint_t)total;
 }
 
-//----------------------------------------------------------------------
-STATIC mp_obj_t file_obj___exit__(size_t n_args, const mp_obj_t *args) {
-    (void)n_args;
-    return mp_stream_close(args[0]);
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(file_obj___exit___obj, 4, 4, file_obj___exit__);
-
 //--------------------------------------------------------------------------------------------
 STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, int *errcode)
 {
@@ -152,11 +147,19 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
     return MP_STREAM_ERROR;
 }
 
+// Unbuffered file functions, used by the buffered stream layer
+STATIC const mp_stream_p_t raw_stream_p = {
+    .read = file_obj_read,
+    .write = file_obj_write,
+    .ioctl = file_obj_ioctl,
+};
+
 //----------------------------------------
 STATIC const mp_arg_t file_open_args[] = {
     { MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
     { MP_QSTR_mode, MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_QSTR(MP_QSTR_r)} },
-    { MP_QSTR_encoding, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
+    { MP_QSTR_buffering, MP_ARG_INT,                   {.u_int     = -1} },
+    { MP_QSTR_encoding,  MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
 };
 #define FILE_OPEN_NUM_ARGS MP_ARRAY_SIZE(file_open_args)
 
@@ -198,11 +201,14 @@ STATIC mp_obj_t file_open(sdcard_user_mount_t *vfs, const mp_obj_type_t *type, m
         }
     }
 
-    sdcard_file_obj_t *o = m_new_obj_with_finaliser(sdcard_file_obj_t);
+    // the stream buffer is allocated together with the file object
+    size_t buf_size = vfs_buffered_size(args[2].u_int);
+    sdcard_file_obj_t *o = m_new_obj_var_with_finaliser(sdcard_file_obj_t, byte, buf_size);
     o->base.type = type;
+    vfs_buffered_init((vfs_buffered_obj_t *)o, &raw_stream_p, (byte *)(o + 1), buf_size, args[2].u_int);
     FRESULT res = f_open(&o->fp, lpath, mode);
     if (res != FR_OK) {
-        m_del_obj(sdcard_file_obj_t, o);
+        m_del_var(sdcard_file_obj_t, byte, buf_size, o);
         if (raise) mp_raise_OSError(fresult_to_errno_table[res]);
         return mp_const_none;
     }
@@ -223,83 +229,52 @@ STATIC mp_obj_t file_obj_make_new(const mp_obj_type_t *type, size_t n_args, size
     return file_open(NULL, type, arg_vals, true);
 }
 
-// TODO gc hook to close the file if not already closed
-
-STATIC const mp_rom_map_elem_t rawfile_locals_dict_table[] = {
-    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
-    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
-    { MP_ROM_QSTR(MP_QSTR_readline), MP_ROM_PTR(&mp_stream_unbuffered_readline_obj) },
-    { MP_ROM_QSTR(MP_QSTR_readlines), MP_ROM_PTR(&mp_stream_unbuffered_readlines_obj) },
-    { MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&mp_stream_write_obj) },
-    { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_stream_flush_obj) },
-    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
-    { MP_ROM_QSTR(MP_QSTR_seek), MP_ROM_PTR(&mp_stream_seek_obj) },
-    { MP_ROM_QSTR(MP_QSTR_tell), MP_ROM_PTR(&mp_stream_tell_obj) },
-    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mp_stream_close_obj) },
-    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
-    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&file_obj___exit___obj) },
-};
-
-STATIC MP_DEFINE_CONST_DICT(rawfile_locals_dict, rawfile_locals_dict_table);
 #if MICROPY_PY_IO_FILEIO
-STATIC const mp_stream_p_t fileio_stream_p = {
-    .read = file_obj_read,
-    .write = file_obj_write,
-    .ioctl = file_obj_ioctl,
-};
-
 const mp_obj_type_t mp_type_vfs_sdcard_fileio = {
     { &mp_type_type },
     .name = MP_QSTR_FileIO,
     .print = file_obj_print,
     .make_new = file_obj_make_new,
     .getiter = mp_identity_getiter,
-    .iternext = mp_stream_unbuffered_iter,
-    .protocol = &fileio_stream_p,
-    .locals_dict = (mp_obj_dict_t*)&rawfile_locals_dict,
+    .iternext = vfs_buffered_iternext,
+    .protocol = &vfs_buffered_fileio_stream_p,
+    .locals_dict = (mp_obj_dict_t*)&vfs_buffered_locals_dict,
 };
 #endif
 
-STATIC const mp_stream_p_t textio_stream_p = {
-    .read = file_obj_read,
-    .write = file_obj_write,
-    .ioctl = file_obj_ioctl,
-    .is_text = true,
-};
-
 const mp_obj_type_t mp_type_vfs_sdcard_textio = {
     { &mp_type_type },
     .name = MP_QSTR_TextIOWrapper,
     .print = file_obj_print,
     .make_new = file_obj_make_new,
     .getiter = mp_identity_getiter,
-    .iternext = mp_stream_unbuffered_iter,
-    .protocol = &textio_stream_p,
-    .locals_dict = (mp_obj_dict_t*)&rawfile_locals_dict,
+    .iternext = vfs_buffered_iternext,
+    .protocol = &vfs_buffered_textio_stream_p,
+    .locals_dict = (mp_obj_dict_t*)&vfs_buffered_locals_dict,
 };
 
 
 // Factory function for I/O stream classes
-STATIC mp_obj_t sdcard_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode) {
-    // TODO: analyze buffering args and instantiate appropriate type
-    sdcard_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
+STATIC mp_obj_t sdcard_builtin_open_self(size_t n_args, const mp_obj_t *args) {
+    sdcard_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
     mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
-    arg_vals[0].u_obj = path;
-    arg_vals[1].u_obj = mode;
-    arg_vals[2].u_obj = mp_const_none;
+    arg_vals[0].u_obj = args[1];
+    arg_vals[1].u_obj = args[2];
+    arg_vals[2].u_int = (n_args > 3) ? mp_obj_get_int(args[3]) : -1;
+    arg_vals[3].u_obj = mp_const_none;
     return file_open(self, &mp_type_vfs_sdcard_textio, arg_vals, true);
 }
-MP_DEFINE_CONST_FUN_OBJ_3(sdcard_vfs_open_obj, sdcard_builtin_open_self);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(sdcard_vfs_open_obj, 3, 4, sdcard_builtin_open_self);
 
-STATIC mp_obj_t sdcard_builtin_open_ex_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode) {
-    // TODO: analyze buffering args and instantiate appropriate type
-    sdcard_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
+STATIC mp_obj_t sdcard_builtin_open_ex_self(size_t n_args, const mp_obj_t *args) {
+    sdcard_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
     mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
-    arg_vals[0].u_obj = path;
-    arg_vals[1].u_obj = mode;
-    arg_vals[2].u_obj = mp_const_none;
+    arg_vals[0].u_obj = args[1];
+    arg_vals[1].u_obj = args[2];
+    arg_vals[2].u_int = (n_args > 3) ? mp_obj_get_int(args[3]) : -1;
+    arg_vals[3].u_obj = mp_const_none;
     return file_open(self, &mp_type_vfs_sdcard_textio, arg_vals, false);
 }
-MP_DEFINE_CONST_FUN_OBJ_3(sdcard_vfs_open_ex_obj, sdcard_builtin_open_ex_self);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(sdcard_vfs_open_ex_obj, 3, 4, sdcard_builtin_open_ex_self);
 
 #endif // MICROPY_VFS && MICROPY_VFS_SDCARD
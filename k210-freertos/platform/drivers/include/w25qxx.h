@@ -116,6 +116,20 @@ enum w25qxx_status_t
     W25QXX_ERROR,
 };
 
+/**
+ * @brief      flash lock hook events
+ */
+enum w25qxx_hook_event_t
+{
+    W25QXX_HOOK_WAIT_START = 0, // the flash is used by another task, the caller will block
+    W25QXX_HOOK_WAIT_END,       // the caller got the flash
+    W25QXX_HOOK_XIP_OFF,        // the mapped flash is about to become unreadable
+    W25QXX_HOOK_XIP_ON,         // the mapped flash is readable again
+};
+
+// The value returned on WAIT_START/XIP_OFF is passed as 'arg' on the matching WAIT_END/XIP_ON
+typedef int (*w25qxx_lock_hook_t)(int event, int arg);
+
 extern bool w25qxx_spi_check;
 extern bool w25qxx_debug;
 extern uint32_t w25qxx_max_speed;
@@ -127,6 +141,8 @@ extern uint8_t *w25qxx_flash_ptr;
 extern uint16_t *w25qxx_flash_ptr16;
 extern uint32_t *w25qxx_flash_ptr32;
 extern bool w25qxx_swap_dat;
+extern bool w25qxx_xip_mapped;
+extern w25qxx_lock_hook_t w25qxx_lock_hook;
 
 void w25qxx_clear_counters();
 void w25qxx_get_counters(uint32_t *r, uint32_t *w, uint32_t *e, uint64_t *time);
@@ -140,6 +156,7 @@ enum w25qxx_status_t w25qxx_read_jedec_id(uint8_t *jedec_id);
 enum w25qxx_status_t w25qxx_read_unique(uint8_t *unique_id);
 enum w25qxx_status_t w25qxx_enable_xip_mode(void);
 enum w25qxx_status_t w25qxx_disable_xip_mode(void);
+enum w25qxx_status_t w25qxx_xip_map(void);
 
 #endif
 
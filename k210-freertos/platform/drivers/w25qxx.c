@@ -47,6 +47,7 @@
 #include "sysctl.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 
 #define CYCLES_PER_US   (uint64_t)(sysctl_clock_get_freq(SYSCTL_CLOCK_CPU)/1000000)
 
@@ -67,12 +68,69 @@ bool w25qxx_swap_dat = true;
 uint8_t *w25qxx_flash_ptr = (uint8_t *)SPI3_BASE_ADDR;
 uint16_t *w25qxx_flash_ptr16 = (uint16_t *)SPI3_BASE_ADDR;
 uint32_t *w25qxx_flash_ptr32 = (uint32_t *)SPI3_BASE_ADDR;
+// If set, XIP mode stays enabled, it is only suspended during flash operations
+bool w25qxx_xip_mapped = false;
+// Called on flash lock wait and XIP suspend/resume, set by the MicroPython port
+w25qxx_lock_hook_t w25qxx_lock_hook = NULL;
+// Serializes the flash operations from all tasks on both processors, also protects 'xip_suspended'
+static SemaphoreHandle_t w25qxx_mutex = NULL;
+static StaticSemaphore_t w25qxx_mutex_buffer;
+static uint32_t xip_suspended = 0;
+static uint32_t xip_enabled = 0;
+static int xip_hook_arg = 0;
 
 static uint32_t rd_count;
 static uint32_t wr_count;
 static uint32_t er_count;
 static uint64_t op_time;
 
+// Take the flash mutex, calls can be nested.
+// If the mutex is not free, the hook can release the resources the owner may need while waiting.
+//---------------------------
+static void flash_lock(void)
+{
+    if (w25qxx_mutex == NULL) return;
+    if (xSemaphoreTakeRecursive(w25qxx_mutex, 0) != pdTRUE) {
+        int arg = (w25qxx_lock_hook) ? w25qxx_lock_hook(W25QXX_HOOK_WAIT_START, 0) : 0;
+        xSemaphoreTakeRecursive(w25qxx_mutex, portMAX_DELAY);
+        if (w25qxx_lock_hook) w25qxx_lock_hook(W25QXX_HOOK_WAIT_END, arg);
+    }
+}
+
+//-----------------------------
+static void flash_unlock(void)
+{
+    if (w25qxx_mutex) xSemaphoreGiveRecursive(w25qxx_mutex);
+}
+
+// Flash commands can't be executed while in XIP mode.
+// The flash mutex is held until the matching 'xip_resume()'.
+//-----------------------------
+static void xip_suspend(void)
+{
+    flash_lock();
+    if ((xip_suspended++ == 0) && ((w25qxx_xip_mapped) || (xip_enabled))) {
+        // nothing may read the mapped flash while the XIP mode is disabled
+        if ((w25qxx_xip_mapped) && (w25qxx_lock_hook)) xip_hook_arg = w25qxx_lock_hook(W25QXX_HOOK_XIP_OFF, 0);
+        spi_dev_set_xip_mode(spi_adapter, false);
+    }
+}
+
+//----------------------------
+static void xip_resume(void)
+{
+    bool mapped = w25qxx_xip_mapped;
+    if ((--xip_suspended == 0) && ((mapped) || (xip_enabled))) {
+        if (!spi_dev_set_xip_mode(spi_adapter, true)) {
+            // not possible if the flash was re-initialized in non QUAD mode
+            w25qxx_xip_mapped = false;
+            spi_dev_set_xip_mode(spi_adapter, false);
+        }
+        if ((mapped) && (w25qxx_lock_hook)) w25qxx_lock_hook(W25QXX_HOOK_XIP_ON, xip_hook_arg);
+    }
+    flash_unlock();
+}
+
 //--------------------------------------------------------------------------------------------------------------------
 static enum w25qxx_status_t w25qxx_receive_data(uint8_t* cmd_buff, uint8_t cmd_len, uint8_t* rx_buff, uint32_t rx_len)
 {
@@ -283,6 +341,7 @@ enum w25qxx_status_t w25qxx_read_data(uint32_t addr, uint8_t* data_buf, uint32_t
     uint8_t *read_buf = NULL;
     int retry = 0;
     if (w25qxx_spi_check) read_buf = pvPortMalloc(length);
+    xip_suspend();
 start:
     _w25qxx_read_data(addr, data_buf, length);
 
@@ -291,10 +350,12 @@ start:
         if (memcmp(data_buf, read_buf, length) != 0) {
             retry++;
             if (retry < 3) goto start;
+            xip_resume();
             vPortFree(read_buf);
             return W25QXX_ERROR;
         }
     }
+    xip_resume();
 
     if (read_buf) vPortFree(read_buf);
     return W25QXX_OK;
@@ -315,10 +376,12 @@ enum w25qxx_status_t w25qxx_sector_erase(uint32_t addr)
     cmd[1] = (uint8_t)(addr >> 16);
     cmd[2] = (uint8_t)(addr >> 8);
     cmd[3] = (uint8_t)(addr);
+    xip_suspend();
     w25qxx_write_enable();
     w25qxx_send_data(spi_stand, cmd, 4, 0, 0);
     er_count++;
     enum w25qxx_status_t res = w25qxx_wait_busy();
+    xip_resume();
     return res;
 }
 
@@ -386,9 +449,8 @@ static enum w25qxx_status_t w25qxx_sector_program(uint32_t addr, uint8_t* data_b
     return W25QXX_OK;
 }
 
-// Write data buffer of arbitrary length to flash address 'addr'
-//=======================================================================================
-enum w25qxx_status_t w25qxx_write_data(uint32_t addr, uint8_t* data_buf, uint32_t length)
+//----------------------------------------------------------------------------------------------
+static enum w25qxx_status_t _w25qxx_write_data(uint32_t addr, uint8_t* data_buf, uint32_t length)
 {
     uint32_t sector_addr, sector_offset, sector_remain, write_len, index;
     uint8_t *pread, *pwrite;
@@ -456,10 +518,23 @@ enum w25qxx_status_t w25qxx_write_data(uint32_t addr, uint8_t* data_buf, uint32_
     return W25QXX_OK;
 }
 
+// Write data buffer of arbitrary length to flash address 'addr'
+//=======================================================================================
+enum w25qxx_status_t w25qxx_write_data(uint32_t addr, uint8_t* data_buf, uint32_t length)
+{
+    xip_suspend();
+    enum w25qxx_status_t res = _w25qxx_write_data(addr, data_buf, length);
+    xip_resume();
+    return res;
+}
+
 //=====================================================================
 uint32_t w25qxx_init(uintptr_t spi_in, uint8_t mode, double clock_rate)
 {
     configASSERT(mode < 3);
+    if (w25qxx_mutex == NULL) w25qxx_mutex = xSemaphoreCreateRecursiveMutexStatic(&w25qxx_mutex_buffer);
+    // no other flash operation can run while the SPI devices are reconfigured
+    xip_suspend();
     work_trans_mode = mode;
 
     uint8_t manuf_id, device_id;
@@ -480,6 +555,7 @@ uint32_t w25qxx_init(uintptr_t spi_in, uint8_t mode, double clock_rate)
     w25qxx_read_id(&manuf_id, &device_id);
     if ((manuf_id != 0xEF && manuf_id != 0xC8) || (device_id != 0x17 && device_id != 0x16)) {
         if (w25qxx_debug) LOGE("w25qxx_init", "Unsupported manuf_id: 0x%02x, device_id:0x%02x", manuf_id, device_id);
+        xip_resume();
         return 0;
     }
     if (w25qxx_debug) LOGD("w25qxx_init", "manuf_id:0x%02x, device_id:0x%02x", manuf_id, device_id);
@@ -499,25 +575,31 @@ uint32_t w25qxx_init(uintptr_t spi_in, uint8_t mode, double clock_rate)
             spi_dev_config_non_standard(spi_adapter_wr, INSTRUCTION_LENGTH, ADDRESS_LENGTH, 0, SPI_AITM_STANDARD);
             spi_dev_set_clock_rate(spi_adapter_wr, clock_rate);
 
-            if (w25qxx_enable_quad_mode() != W25QXX_OK) return 0;
+            if (w25qxx_enable_quad_mode() != W25QXX_OK) {
+                xip_resume();
+                return 0;
+            }
             break;
         case SPI_FF_STANDARD:
         default:
             spi_adapter = spi_stand;
             break;
     }
-    spi_dev_set_xip_mode(spi_adapter, false);
+    // re-enables the XIP mode if the flash was mapped
+    xip_resume();
     return w25qxx_actual_speed;
 }
 
 
 // ==== Flash special functions ==================================================================
 
+// Enable the XIP mode temporary, the flash mutex is held until 'w25qxx_disable_xip_mode()'
 //===============================================
 enum w25qxx_status_t w25qxx_enable_xip_mode(void)
 {
     if (!spi_adapter) return W25QXX_ERROR;
-    spi_dev_set_xip_mode(spi_adapter, true);
+    flash_lock();
+    if (xip_enabled++ == 0) spi_dev_set_xip_mode(spi_adapter, true);
     return W25QXX_OK;
 }
 
@@ -525,17 +607,37 @@ enum w25qxx_status_t w25qxx_enable_xip_mode(void)
 enum w25qxx_status_t w25qxx_disable_xip_mode(void)
 {
     if (!spi_adapter) return W25QXX_ERROR;
-    spi_dev_set_xip_mode(spi_adapter, false);
+    // keep the XIP mode if the flash is mapped
+    if ((--xip_enabled == 0) && (!w25qxx_xip_mapped)) spi_dev_set_xip_mode(spi_adapter, false);
+    flash_unlock();
     return W25QXX_OK;
 }
 
+// Keep the XIP mode enabled permanently, so that the flash data can be accessed
+// at any time through the XIP window (only possible in QUAD mode)
+//=======================================
+enum w25qxx_status_t w25qxx_xip_map(void)
+{
+    if (!spi_adapter) return W25QXX_ERROR;
+    enum w25qxx_status_t res = W25QXX_OK;
+    flash_lock();
+    if (!w25qxx_xip_mapped) {
+        if (spi_dev_set_xip_mode(spi_adapter, true)) w25qxx_xip_mapped = true;
+        else res = W25QXX_ERROR;
+    }
+    flash_unlock();
+    return res;
+}
+
 //========================================================================
 enum w25qxx_status_t w25qxx_read_id(uint8_t *manuf_id, uint8_t *device_id)
 {
     uint8_t cmd[4] = {READ_ID, 0x00, 0x00, 0x00};
     uint8_t data[2] = {0};
 
+    xip_suspend();
     w25qxx_receive_data(cmd, 4, data, 2);
+    xip_resume();
     *manuf_id = data[0];
     *device_id = data[1];
     return W25QXX_OK;
@@ -546,7 +648,9 @@ enum w25qxx_status_t w25qxx_read_jedec_id(uint8_t *jedec_id)
 {
     uint8_t cmd[1] = {READ_JEDEC_ID};
 
+    xip_suspend();
     w25qxx_receive_data(cmd, 1, jedec_id, 3);
+    xip_resume();
     return W25QXX_OK;
 }
 
@@ -555,7 +659,9 @@ enum w25qxx_status_t w25qxx_read_unique(uint8_t *unique_id)
 {
     uint8_t cmd[5] = {READ_UNIQUE, 0x00, 0x00, 0x00, 0x00};
 
+    xip_suspend();
     w25qxx_receive_data(cmd, 5, unique_id, 8);
+    xip_resume();
     return W25QXX_OK;
 }
 
@@ -99,6 +99,8 @@ void dump_core(const char *reason, uintptr_t *regs, uintptr_t cause)
     if (CONFIG_LOG_LEVEL >= LOG_ERROR)
     {
         corelock_lock(&s_dump_lock);
+        // LoBo: send the deferred log entries recorded before the crash
+        syslog_deferred_dump();
 
         const char unknown_reason[] = "unknown";
 
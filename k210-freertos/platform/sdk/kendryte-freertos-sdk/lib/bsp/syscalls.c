@@ -104,6 +104,7 @@ char *_ioheap_line = &_heap_end[0]-0x40000000;
 void __attribute__((noreturn)) sys_exit(int code)
 {
     /* First print some diagnostic information. */
+    syslog_deferred_dump();
     LOGW(TAG, "sys_exit called with 0x%lx\n", (uint64_t)code);
     while (1)
         ;
@@ -0,0 +1,475 @@
+/*
+ * LoBo: deferred (binary) logging for the syslog LOGx macros
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Log entry format (little endian, the entry size is multiple of 4):
+ *   uint16_t   size        entry size in bytes
+ *   uint8_t    core        processor which recorded the entry
+ *   uint8_t    flags       SYSLOG_ENTRY_TRUNCATED if not all arguments fit into the entry
+ *   uint32_t   format      address of the format string (LOG_FORMAT_NC)
+ *   arguments, in format string order, without padding:
+ *     int, '*' width/precision     4 bytes
+ *     long, size_t, pointer        8 bytes
+ *     double                       8 bytes
+ *     string                       1 byte length + characters (max SYSLOG_DEFERRED_STRING_MAX_SIZE)
+ * The first two arguments are the time stamp (%lu) and the tag (%s)
+ *
+ * Each core's ring buffer has one producer (the core) and one consumer (syslog_task, or the
+ * fatal error dump); 'head' is only written by the producer, 'tail' only by the consumer.
+ * In SYSLOG_DEFERRED_BUFFER mode the producer overwrites the oldest entries when the buffer is full,
+ * it advances its own 'drop' position; the oldest valid entry is at the later of 'tail' and 'drop'.
+ * The readers re-check 'drop' after copying an entry, the entry is discarded if it was overwritten.
+ */
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <encoding.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <uarths.h>
+
+#define SYSLOG_ENTRY_HEADER_SIZE    8
+#define SYSLOG_ENTRY_TRUNCATED      0x01
+#define SYSLOG_TASK_PRIORITY        1
+#define SYSLOG_TASK_STACK_SIZE      (configMINIMAL_STACK_SIZE + 256)
+// base64 encoded entry with marker and line end
+#define SYSLOG_LINE_SIZE            (((SYSLOG_DEFERRED_ENTRY_MAX_SIZE + 2) / 3) * 4 + sizeof(SYSLOG_DEFERRED_MARKER) + 3)
+
+typedef struct _syslog_ring
+{
+    volatile uint32_t   head;
+    volatile uint32_t   tail;
+    volatile uint32_t   drop;       // the entries before this position were overwritten (written by the producer)
+    volatile uint32_t   dropped;
+    uint8_t             buf[SYSLOG_DEFERRED_BUFFER_SIZE];
+} syslog_ring_t;
+
+uint32_t user_log_deferred = SYSLOG_DEFERRED_OFF;
+
+static syslog_ring_t syslog_ring[2];
+static TaskHandle_t syslog_task_handle = NULL;
+static volatile int syslog_dumped = 0;
+
+static const char base64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//-----------------------------------------------------------------------------------------
+static int syslog_put(uint8_t *entry, size_t *pos, const void *data, size_t size, size_t n)
+{
+    if ((*pos + n + size) > SYSLOG_DEFERRED_ENTRY_MAX_SIZE)
+        return 0;
+    if (n)
+    {
+        // string length
+        entry[*pos] = (uint8_t)size;
+        *pos += 1;
+    }
+    memcpy(entry + *pos, data, size);
+    *pos += size;
+    return 1;
+}
+
+// Record the arguments used by the format string into the entry, returns the entry size
+//-----------------------------------------------------------------------------
+static size_t syslog_encode(uint8_t *entry, const char *format, va_list ap)
+{
+    size_t pos = SYSLOG_ENTRY_HEADER_SIZE;
+    const char *p = format;
+    int ok = 1;
+
+    entry[3] = 0;
+    memcpy(entry + 4, &(uint32_t){(uint32_t)(uintptr_t)format}, 4);
+
+    while ((*p) && (ok))
+    {
+        if (*p++ != '%')
+            continue;
+        if (*p == '%')
+        {
+            p++;
+            continue;
+        }
+        // flags
+        while ((*p == '-') || (*p == '+') || (*p == ' ') || (*p == '#') || (*p == '0'))
+            p++;
+        // width
+        if (*p == '*')
+        {
+            int v = va_arg(ap, int);
+            ok = syslog_put(entry, &pos, &v, 4, 0);
+            p++;
+        }
+        while ((*p >= '0') && (*p <= '9'))
+            p++;
+        // precision
+        if (*p == '.')
+        {
+            p++;
+            if (*p == '*')
+            {
+                int v = va_arg(ap, int);
+                ok &= syslog_put(entry, &pos, &v, 4, 0);
+                p++;
+            }
+            while ((*p >= '0') && (*p <= '9'))
+                p++;
+        }
+        // length modifier
+        int is_long = 0, is_ldouble = 0;
+        while ((*p == 'h') || (*p == 'l') || (*p == 'L') || (*p == 'z') || (*p == 'j') || (*p == 't') || (*p == 'q'))
+        {
+            if (*p == 'L')
+                is_ldouble = 1;
+            if (*p != 'h')
+                is_long = 1;
+            p++;
+        }
+        if (!ok)
+            break;
+
+        switch (*p)
+        {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            if (is_long)
+            {
+                uint64_t v = va_arg(ap, unsigned long);
+                ok = syslog_put(entry, &pos, &v, 8, 0);
+            }
+            else
+            {
+                uint32_t v = va_arg(ap, unsigned int);
+                ok = syslog_put(entry, &pos, &v, 4, 0);
+            }
+            break;
+        case 'p':
+        {
+            uint64_t v = (uintptr_t)va_arg(ap, void *);
+            ok = syslog_put(entry, &pos, &v, 8, 0);
+            break;
+        }
+        case 's':
+        {
+            const char *s = va_arg(ap, const char *);
+            if (s == NULL)
+                s = "(null)";
+            ok = syslog_put(entry, &pos, s, strnlen(s, SYSLOG_DEFERRED_STRING_MAX_SIZE), 1);
+            break;
+        }
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        {
+            double v = (is_ldouble) ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            ok = syslog_put(entry, &pos, &v, 8, 0);
+            break;
+        }
+        case 'n':
+            (void)va_arg(ap, void *);
+            break;
+        default:
+            // unknown conversion, the following arguments can't be recorded
+            ok = 0;
+            break;
+        }
+        if (*p)
+            p++;
+    }
+    if ((!ok) || (*p))
+        entry[3] |= SYSLOG_ENTRY_TRUNCATED;
+
+    pos = (pos + 3) & ~3;
+    entry[0] = pos & 0xff;
+    entry[1] = pos >> 8;
+    return pos;
+}
+
+// Position of the oldest valid entry
+//-----------------------------------------------------------
+static inline uint32_t syslog_ring_start(syslog_ring_t *ring)
+{
+    uint32_t tail = ring->tail;
+    uint32_t drop = ring->drop;
+    return ((int32_t)(drop - tail) > 0) ? drop : tail;
+}
+
+//=============================================
+void syslog_deferred(const char *format, ...)
+{
+    uint8_t entry[SYSLOG_DEFERRED_ENTRY_MAX_SIZE];
+    va_list ap;
+
+    va_start(ap, format);
+    uint32_t size = syslog_encode(entry, format, ap);
+    va_end(ap);
+
+    // The entry is added with interrupts disabled, only the tasks running on this core write to the buffer
+    uintptr_t mie = read_csr(mstatus) & MSTATUS_MIE;
+    clear_csr(mstatus, MSTATUS_MIE);
+    uint32_t core = read_csr(mhartid) & 1;
+    syslog_ring_t *ring = &syslog_ring[core];
+    entry[2] = core;
+
+    uint32_t drop = syslog_ring_start(ring);
+    uint32_t free = SYSLOG_DEFERRED_BUFFER_SIZE - (ring->head - drop);
+    if (free < size)
+    {
+        if (user_log_deferred != SYSLOG_DEFERRED_BUFFER)
+        {
+            ring->dropped++;
+            set_csr(mstatus, mie);
+            return;
+        }
+        // drop the oldest entries, 'tail' belongs to the consumer and is not changed
+        while (free < size)
+        {
+            uint32_t idx = drop & (SYSLOG_DEFERRED_BUFFER_SIZE - 1);
+            uint32_t esize = ring->buf[idx] | (ring->buf[idx + 1] << 8);
+            if ((esize < SYSLOG_ENTRY_HEADER_SIZE) || (esize > SYSLOG_DEFERRED_ENTRY_MAX_SIZE))
+            {
+                // should not happen, discard the buffer content
+                drop = ring->head;
+                free = SYSLOG_DEFERRED_BUFFER_SIZE;
+                break;
+            }
+            drop += esize;
+            free += esize;
+            ring->dropped++;
+        }
+        ring->drop = drop;
+        // the readers must see the entries as dropped before they are overwritten
+        __sync_synchronize();
+    }
+    uint32_t idx = ring->head & (SYSLOG_DEFERRED_BUFFER_SIZE - 1);
+    uint32_t n = SYSLOG_DEFERRED_BUFFER_SIZE - idx;
+    if (n > size)
+        n = size;
+    memcpy(ring->buf + idx, entry, n);
+    if (n < size)
+        memcpy(ring->buf, entry + n, size - n);
+    // the entry must be complete before the other core can see it
+    __sync_synchronize();
+    ring->head += size;
+    set_csr(mstatus, mie);
+}
+
+// Copy the entry at the buffer position, returns the entry size
+//------------------------------------------------------------------------------
+static uint32_t syslog_read_entry(syslog_ring_t *ring, uint32_t pos, uint8_t *entry)
+{
+    uint32_t idx = pos & (SYSLOG_DEFERRED_BUFFER_SIZE - 1);
+    uint32_t size = ring->buf[idx] | (ring->buf[idx + 1] << 8);
+    if ((size < SYSLOG_ENTRY_HEADER_SIZE) || (size > SYSLOG_DEFERRED_ENTRY_MAX_SIZE))
+        return 0;
+    uint32_t n = SYSLOG_DEFERRED_BUFFER_SIZE - idx;
+    if (n > size)
+        n = size;
+    memcpy(entry, ring->buf + idx, n);
+    if (n < size)
+        memcpy(entry + n, ring->buf, size - n);
+    return size;
+}
+
+// Copy the oldest valid entry at or after the position '*pos', '*pos' is set to the entry's position
+// Returns the entry size, 0 if there are no more entries
+// Not valid buffer content (should not happen) is discarded, '*pos' is set to the head position
+//----------------------------------------------------------------------------------
+static uint32_t syslog_read_next(syslog_ring_t *ring, uint32_t *pos, uint8_t *entry)
+{
+    while (1)
+    {
+        uint32_t drop = ring->drop;
+        if ((int32_t)(drop - *pos) > 0)
+            *pos = drop;
+        if (*pos == ring->head)
+            return 0;
+        __sync_synchronize();
+        uint32_t size = syslog_read_entry(ring, *pos, entry);
+        __sync_synchronize();
+        // overwritten by the producer while it was copied, continue with the oldest valid entry
+        if ((int32_t)(ring->drop - *pos) > 0)
+            continue;
+        if (size == 0)
+            *pos = ring->head;
+        return size;
+    }
+}
+
+// Encode the entry as text line
+//---------------------------------------------------------------------
+static size_t syslog_entry_line(const uint8_t *entry, size_t size, char *line)
+{
+    size_t len = 0;
+    memcpy(line, SYSLOG_DEFERRED_MARKER, sizeof(SYSLOG_DEFERRED_MARKER) - 1);
+    len += sizeof(SYSLOG_DEFERRED_MARKER) - 1;
+    for (size_t i = 0; i < size; i += 3)
+    {
+        uint32_t v = entry[i] << 16;
+        if ((i + 1) < size)
+            v |= entry[i + 1] << 8;
+        if ((i + 2) < size)
+            v |= entry[i + 2];
+        line[len++] = base64_table[(v >> 18) & 0x3f];
+        line[len++] = base64_table[(v >> 12) & 0x3f];
+        line[len++] = ((i + 1) < size) ? base64_table[(v >> 6) & 0x3f] : '=';
+        line[len++] = ((i + 2) < size) ? base64_table[v & 0x3f] : '=';
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+    line[len] = '\0';
+    return len;
+}
+
+//------------------------------------------------
+static void syslog_write(const char *data, size_t len)
+{
+    while (len)
+    {
+        size_t n = uarths_write((const uint8_t *)data, len);
+        data += n;
+        len -= n;
+    }
+}
+
+// Low priority task sending the log entries to stdout
+//==============================================
+static void syslog_task(void *pvParameter)
+{
+    uint8_t entry[SYSLOG_DEFERRED_ENTRY_MAX_SIZE];
+    char line[SYSLOG_LINE_SIZE];
+
+    while (1)
+    {
+        int sent = 0;
+        if (user_log_deferred == SYSLOG_DEFERRED_STREAM)
+        {
+            for (int core = 0; core < 2; core++)
+            {
+                syslog_ring_t *ring = &syslog_ring[core];
+                // the mode can change to SYSLOG_DEFERRED_BUFFER while the entries are sent
+                uint32_t pos = ring->tail;
+                while (1)
+                {
+                    uint32_t size = syslog_read_next(ring, &pos, entry);
+                    if (size == 0)
+                    {
+                        ring->tail = pos;
+                        break;
+                    }
+                    syslog_entry_line(entry, size, line);
+                    pos += size;
+                    ring->tail = pos;
+                    printk("%s", line);
+                    sent++;
+                }
+                if (ring->dropped)
+                {
+                    uint32_t dropped = ring->dropped;
+                    ring->dropped = 0;
+                    printk("W (%lu) syslog: %u entries dropped on core %d\r\n", sys_ticks_us(), dropped, core);
+                }
+            }
+        }
+        if (sent == 0)
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+}
+
+// Set the deferred logging mode, returns the current mode
+//================================
+int syslog_deferred_mode(int mode)
+{
+    if ((mode >= SYSLOG_DEFERRED_OFF) && (mode <= SYSLOG_DEFERRED_BUFFER))
+    {
+        if ((mode == SYSLOG_DEFERRED_STREAM) && (syslog_task_handle == NULL))
+        {
+            xTaskCreate(syslog_task, "syslog_task", SYSLOG_TASK_STACK_SIZE, NULL, SYSLOG_TASK_PRIORITY, &syslog_task_handle);
+            if (syslog_task_handle == NULL)
+                return user_log_deferred;
+        }
+        user_log_deferred = mode;
+    }
+    return user_log_deferred;
+}
+
+// Copy the buffered entries of the core to the buffer, the entries are not removed
+// Returns the number of bytes copied
+//=================================================================
+size_t syslog_deferred_get(int core, uint8_t *buffer, size_t size)
+{
+    syslog_ring_t *ring = &syslog_ring[core & 1];
+    uint32_t pos = ring->tail;
+    size_t len = 0;
+
+    while (1)
+    {
+        // every entry is checked after it is copied, the entries overwritten meanwhile are skipped
+        uint8_t entry[SYSLOG_DEFERRED_ENTRY_MAX_SIZE];
+        uint32_t esize = syslog_read_next(ring, &pos, entry);
+        if ((esize == 0) || ((len + esize) > size))
+            break;
+        memcpy(buffer + len, entry, esize);
+        len += esize;
+        pos += esize;
+    }
+    return len;
+}
+
+//=====================================
+uint32_t syslog_deferred_dropped(int core)
+{
+    return syslog_ring[core & 1].dropped;
+}
+
+// Send all buffered entries to stdout and switch to direct logging
+// Used on fatal error, can be called with interrupts disabled
+//===========================
+void syslog_deferred_dump(void)
+{
+    uint8_t entry[SYSLOG_DEFERRED_ENTRY_MAX_SIZE];
+    char line[SYSLOG_LINE_SIZE];
+
+    if ((user_log_deferred == SYSLOG_DEFERRED_OFF) || (syslog_dumped))
+        return;
+    syslog_dumped = 1;
+    user_log_deferred = SYSLOG_DEFERRED_OFF;
+
+    for (int core = 0; core < 2; core++)
+    {
+        syslog_ring_t *ring = &syslog_ring[core];
+        uint32_t pos = ring->tail;
+        while (1)
+        {
+            uint32_t size = syslog_read_next(ring, &pos, entry);
+            if (size == 0)
+            {
+                ring->tail = pos;
+                break;
+            }
+            pos += size;
+            ring->tail = pos;
+            syslog_write(line, syslog_entry_line(entry, size, line));
+        }
+    }
+}
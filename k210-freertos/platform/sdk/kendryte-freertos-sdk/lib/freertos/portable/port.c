@@ -212,6 +212,8 @@ void vPortFatal(const char *file, int line, const char *message)
 {
     portDISABLE_INTERRUPTS();
     corelock_lock(&xCoreLock);
+    // LoBo: send the deferred log entries, the following messages are printed directly
+    syslog_deferred_dump();
     LOGE("FreeRTOS", "(%s:%d) %s", file, line, message);
     while (1)
         ;
@@ -170,7 +170,22 @@ typedef struct _uarths
     uarths_div_t div;
 } __attribute__((packed, aligned(4))) uarths_t;
 
+/**
+ * LoBo
+ * @brief       Policy used when the transmit buffer is full
+ */
+typedef enum _uarths_tx_policy
+{
+    /* Wait until there is room in the buffer */
+    UARTHS_TX_BLOCK,
+    /* Drop the data which does not fit into the buffer */
+    UARTHS_TX_DROP,
+} uarths_tx_policy_t;
+
 extern uint32_t uarths_baudrate;
+extern uarths_tx_policy_t uarths_tx_policy;
+extern volatile uint32_t uarths_tx_dropped;
+extern volatile uint32_t uarths_tx_max_used;
 
 /**
  * LoBo
@@ -206,6 +221,55 @@ void uarths_puts(const char *s);
 
 size_t uarths_read(uint8_t* buffer, size_t len);
 
+/**
+ * LoBo
+ * @brief       Set the buffer used for interrupt driven transmit
+ *              The buffered data are sent before the buffer is changed
+ *              uarths_tx_irq() must be called from the UARTHS interrupt handler
+ *
+ * @param[in]   buffer      The transmit buffer, NULL disables the buffered transmit
+ * @param[in]   size        The buffer size, must be power of 2
+ */
+void uarths_set_tx_buffer(uint8_t *buffer, size_t size);
+
+/**
+ * LoBo
+ * @brief       Put the data into the transmit buffer
+ *              If the buffered transmit is not used or the interrupts are disabled
+ *              (critical section, exception), all data are sent directly
+ *
+ * @param[in]   buffer      The data to send
+ * @param[in]   len         The data length
+ *
+ * @return      number of bytes accepted, less than len if the buffer is full
+ */
+size_t uarths_write(const uint8_t *buffer, size_t len);
+
+/**
+ * LoBo
+ * @brief       Wait until all buffered data are sent
+ *              If called with interrupts disabled, the data are sent directly
+ */
+void uarths_flush(void);
+
+/**
+ * LoBo
+ * @brief       Get the number of bytes waiting in the transmit buffer
+ */
+size_t uarths_tx_pending(void);
+
+/**
+ * LoBo
+ * @brief       Transmit interrupt handler, moves the buffered data to the TX FIFO
+ */
+void uarths_tx_irq(void);
+
+/**
+ * LoBo
+ * @brief       Enable or disable the receive interrupt
+ */
+void uarths_set_rx_irq(int enable);
+
 #ifdef __cplusplus
 }
 #endif
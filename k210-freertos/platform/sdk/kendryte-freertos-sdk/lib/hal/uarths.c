@@ -15,12 +15,61 @@
 #include <encoding.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "atomic.h"
 #include "sysctl.h"
 #include "uarths.h"
 
+/* TX FIFO level below which the transmit interrupt is raised (FIFO depth is 8) */
+#define UARTHS_TX_IRQ_LEVEL 4
+/* Maximal number of attempts to get the buffer lock on fatal error */
+#define UARTHS_TX_LOCK_TRIES 100000
+
 volatile uarths_t *const uarths = (volatile uarths_t *)UARTHS_BASE_ADDR;
 // LoBo: added
 uint32_t uarths_baudrate = 115200;
+uarths_tx_policy_t uarths_tx_policy = UARTHS_TX_BLOCK;
+volatile uint32_t uarths_tx_dropped = 0;
+volatile uint32_t uarths_tx_max_used = 0;
+
+// LoBo: interrupt driven transmit
+// The buffer indexes are free running, the buffer is accessed only with tx_lock held
+static uint8_t *tx_buf = NULL;
+static size_t tx_mask = 0;
+static volatile size_t tx_head = 0;
+static volatile size_t tx_tail = 0;
+static spinlock_t tx_lock = SPINLOCK_INIT;
+
+static inline uintptr_t tx_lock_take(void)
+{
+    uintptr_t mie = read_csr(mstatus) & MSTATUS_MIE;
+    clear_csr(mstatus, MSTATUS_MIE);
+    spinlock_lock(&tx_lock);
+    return mie;
+}
+
+static inline void tx_lock_give(uintptr_t mie)
+{
+    spinlock_unlock(&tx_lock);
+    set_csr(mstatus, mie);
+}
+
+/* Move the buffered data to the TX FIFO, tx_lock must be held */
+static void uarths_tx_fill(void)
+{
+    while ((tx_tail != tx_head) && (!uarths->txdata.full))
+    {
+        uarths->txdata.data = tx_buf[tx_tail & tx_mask];
+        tx_tail++;
+    }
+    uarths->ie.txwm = (tx_tail != tx_head);
+}
+
+static void uarths_write_direct(uint8_t c)
+{
+    while (uarths->txdata.full)
+        continue;
+    uarths->txdata.data = c;
+}
 
 uint8_t uarths_read_byte()
 {
@@ -34,9 +83,116 @@ uint8_t uarths_read_byte()
 
 void uarths_write_byte(uint8_t c)
 {
-    while (uarths->txdata.full)
+    while (uarths_write(&c, 1) == 0)
+    {
+        if (uarths_tx_policy == UARTHS_TX_DROP)
+        {
+            uarths_tx_dropped++;
+            return;
+        }
+        /* the transmit interrupt makes room in the buffer */
+    }
+}
+
+size_t uarths_write(const uint8_t *buffer, size_t len)
+{
+    size_t i;
+
+    if ((tx_buf == NULL) || (!(read_csr(mstatus) & MSTATUS_MIE)))
+    {
+        /* Send the buffered data first, then write directly */
+        uarths_flush();
+        for (i = 0; i < len; i++)
+            uarths_write_direct(buffer[i]);
+        return len;
+    }
+
+    uintptr_t mie = tx_lock_take();
+    size_t n = (tx_mask + 1) - (tx_head - tx_tail);
+    if (n > len)
+        n = len;
+    for (i = 0; i < n; i++)
+        tx_buf[(tx_head + i) & tx_mask] = buffer[i];
+    tx_head += n;
+    if ((tx_head - tx_tail) > uarths_tx_max_used)
+        uarths_tx_max_used = tx_head - tx_tail;
+    uarths_tx_fill();
+    tx_lock_give(mie);
+
+    return n;
+}
+
+void uarths_flush(void)
+{
+    if (tx_buf == NULL)
+        return;
+
+    if (read_csr(mstatus) & MSTATUS_MIE)
+    {
+        /* wait for the transmit interrupt to send the data */
+        while (tx_tail != tx_head)
+            continue;
+        return;
+    }
+
+    /* Interrupts disabled (critical section, exception, fatal error), send the data directly
+     * On fatal error the lock may be held by the interrupted code, don't wait for it forever */
+    int tries = UARTHS_TX_LOCK_TRIES;
+    while ((spinlock_trylock(&tx_lock)) && (--tries > 0))
         continue;
-    uarths->txdata.data = c;
+    while (tx_tail != tx_head)
+    {
+        uarths_write_direct(tx_buf[tx_tail & tx_mask]);
+        tx_tail++;
+    }
+    uarths->ie.txwm = 0;
+    if (tries > 0)
+        spinlock_unlock(&tx_lock);
+}
+
+size_t uarths_tx_pending(void)
+{
+    return tx_head - tx_tail;
+}
+
+void uarths_tx_irq(void)
+{
+    if (tx_buf == NULL)
+        return;
+    spinlock_lock(&tx_lock);
+    uarths_tx_fill();
+    spinlock_unlock(&tx_lock);
+}
+
+void uarths_set_tx_buffer(uint8_t *buffer, size_t size)
+{
+    uarths_flush();
+
+    uintptr_t mie = tx_lock_take();
+    uarths->ie.txwm = 0;
+    if ((buffer != NULL) && (size > 0) && ((size & (size - 1)) == 0))
+    {
+        tx_buf = buffer;
+        tx_mask = size - 1;
+        uarths->txctrl.txcnt = UARTHS_TX_IRQ_LEVEL;
+    }
+    else
+    {
+        tx_buf = NULL;
+        tx_mask = 0;
+        uarths->txctrl.txcnt = 0;
+    }
+    tx_head = 0;
+    tx_tail = 0;
+    tx_lock_give(mie);
+}
+
+void uarths_set_rx_irq(int enable)
+{
+    /* the interrupt enable register is shared with the transmit interrupt */
+    uintptr_t mie = tx_lock_take();
+    uarths->ie.rxwm = (enable) ? 1 : 0;
+    tx_lock_give(mie);
 }
 
 void uarths_puts(const char *s)
@@ -75,11 +231,14 @@ uint32_t uarths_init(uint32_t baudrate)
     uint32_t freq = sysctl_clock_get_freq(SYSCTL_CLOCK_CPU);
     uint16_t div = freq / baudrate - 1;
 
+    /* Send the buffered data with the old baudrate */
+    uarths_flush();
+
     /* Set UART registers */
     uarths->div.div = div;
     uarths->txctrl.txen = 1;
     uarths->rxctrl.rxen = 1;
-    uarths->txctrl.txcnt = 0;
+    uarths->txctrl.txcnt = (tx_buf) ? UARTHS_TX_IRQ_LEVEL : 0;
     uarths->rxctrl.rxcnt = 0;
     uarths->ip.txwm = 1;
     uarths->ip.rxwm = 1;
@@ -136,6 +136,7 @@ extern QueueHandle_t syslog_mutex;
 extern int kprint_filter_nonprint;
 extern char kprint_nonprint_char;
 extern uint8_t kprint_cr_lf;
+extern uint32_t user_log_deferred;
 #ifdef configSYSLOG_EXTERNAL_SYS_TICKS
 extern uint64_t sys_ticks_us(void);
 #else
@@ -146,6 +147,34 @@ extern uint64_t sys_ticks_us(void);
 #define LOG_FORMAT(letter, format)  LOG_COLOR_ ## letter #letter " (%lu) %s: " format LOG_RESET_COLOR "\r\n"
 #define LOG_FORMAT_NC(letter, format)  #letter " (%lu) %s: " format "\r\n"
 
+/*
+ * LoBo: deferred (binary) logging
+ *
+ *   Instead of formatting the message, the log macros record the address of the
+ *   (non colored) format string and the raw arguments into the per core buffer.
+ *   The entries are decoded on the host using the firmware ELF file (logdecode.py).
+ *   SYSLOG_DEFERRED_STREAM: the entries are sent to stdout by a low priority task,
+ *                           as lines starting with SYSLOG_DEFERRED_MARKER (base64 encoded)
+ *   SYSLOG_DEFERRED_BUFFER: the entries are kept in RAM, the oldest entries are overwritten,
+ *                           the buffer is sent to stdout on fatal error
+ */
+#define SYSLOG_DEFERRED_OFF             0
+#define SYSLOG_DEFERRED_STREAM          1
+#define SYSLOG_DEFERRED_BUFFER          2
+
+#ifndef SYSLOG_DEFERRED_BUFFER_SIZE
+#define SYSLOG_DEFERRED_BUFFER_SIZE     8192    // per core, must be power of 2
+#endif
+#define SYSLOG_DEFERRED_ENTRY_MAX_SIZE  256
+#define SYSLOG_DEFERRED_STRING_MAX_SIZE 64
+#define SYSLOG_DEFERRED_MARKER          "#L"
+
+void syslog_deferred(const char *format, ...) _TFP_SPECIFY_PRINTF_FMT(1, 2);
+int syslog_deferred_mode(int mode);
+size_t syslog_deferred_get(int core, uint8_t *buffer, size_t size);
+uint32_t syslog_deferred_dropped(int core);
+void syslog_deferred_dump(void);
+
 #ifdef LOG_LEVEL
 #undef CONFIG_LOG_LEVEL
 #define CONFIG_LOG_LEVEL LOG_LEVEL
@@ -158,15 +187,15 @@ extern uint64_t sys_ticks_us(void);
 #endif
 
 #ifdef CONFIG_LOG_ENABLE
-#define LOGE(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_color) LOG_PRINTF(LOG_FORMAT(E, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(E, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGe(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_color) LOG_PRINTF(LOG_FORMAT(e, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(e, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGW(tag, format, ...)  do {if (user_log_level >= LOG_WARN)    {if (user_log_color) LOG_PRINTF(LOG_FORMAT(W, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(W, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGI(tag, format, ...)  do {if (user_log_level >= LOG_INFO)    {if (user_log_color) LOG_PRINTF(LOG_FORMAT(I, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(I, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGD(tag, format, ...)  do {if (user_log_level >= LOG_DEBUG)   {if (user_log_color) LOG_PRINTF(LOG_FORMAT(D, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(D, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGV(tag, format, ...)  do {if (user_log_level >= LOG_VERBOSE) {if (user_log_color) LOG_PRINTF(LOG_FORMAT(V, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(V, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGM(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_color) LOG_PRINTF(LOG_FORMAT(M, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(M, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGQ(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_color) LOG_PRINTF(LOG_FORMAT(Q, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(Q, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
-#define LOGY(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_color) LOG_PRINTF(LOG_FORMAT(Y, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(Y, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGE(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(E, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(E, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(E, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGe(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(e, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(e, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(e, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGW(tag, format, ...)  do {if (user_log_level >= LOG_WARN)    {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(W, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(W, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(W, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGI(tag, format, ...)  do {if (user_log_level >= LOG_INFO)    {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(I, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(I, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(I, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGD(tag, format, ...)  do {if (user_log_level >= LOG_DEBUG)   {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(D, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(D, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(D, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGV(tag, format, ...)  do {if (user_log_level >= LOG_VERBOSE) {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(V, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(V, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(V, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGM(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(M, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(M, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(M, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGQ(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(Q, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(Q, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(Q, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
+#define LOGY(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   {if (user_log_deferred) syslog_deferred(LOG_FORMAT_NC(Y, format), sys_ticks_us(), tag, ##__VA_ARGS__); else if (user_log_color) LOG_PRINTF(LOG_FORMAT(Y, format), sys_ticks_us(), tag, ##__VA_ARGS__); else LOG_PRINTF(LOG_FORMAT_NC(Y, format), sys_ticks_us(), tag, ##__VA_ARGS__);} } while (0)
 /*
 #define LOGE(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   LOG_PRINTF(LOG_FORMAT(E, format), sys_ticks_us(), tag, ##__VA_ARGS__); } while (0)
 #define LOGe(tag, format, ...)  do {if (user_log_level >= LOG_ERROR)   LOG_PRINTF(LOG_FORMAT(e, format), sys_ticks_us(), tag, ##__VA_ARGS__); } while (0)
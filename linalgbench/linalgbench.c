@@ -0,0 +1,360 @@
+/*
+ * Host microbenchmark of the ulab.linalg matrix kernels
+ *
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// The firmware is built with double precision floats
+typedef double mp_float_t;
+#define MICROPY_FLOAT_C_FUN(x)  x
+#define epsilon                 2.3e-16
+
+// The kernels used by the firmware
+#include "linalg_kernels.h"
+
+#define MIN_TIME_NS     200000000ULL    // minimal measurement time for each test
+#define MAX_SIZE        200
+
+static mp_float_t *mat_a, *mat_b, *mat_c, *mat_d, *mat_e;
+static volatile mp_float_t sink;
+
+// ==== Kernels of the previous ulab.linalg implementation ===========================
+
+// Element access as done by ndarray_get_float_value()
+//----------------------------------------------------------------------------------------------
+static __attribute__((noinline)) mp_float_t old_get_float_value(void *data, uint8_t typecode, size_t index)
+{
+    if (typecode == 'B') return (mp_float_t)((uint8_t *)data)[index];
+    else if (typecode == 'b') return (mp_float_t)((int8_t *)data)[index];
+    else if (typecode == 'H') return (mp_float_t)((uint16_t *)data)[index];
+    else if (typecode == 'h') return (mp_float_t)((int16_t *)data)[index];
+    return ((mp_float_t *)data)[index];
+}
+
+// linalg_dot, the result is stored in column-major order
+//--------------------------------------------------------------------------------------------------------
+static void old_dot(const mp_float_t *a, const mp_float_t *b, mp_float_t *c, size_t M, size_t K, size_t N)
+{
+    for (size_t i=0; i < M; i++) {
+        for (size_t j=0; j < N; j++) {
+            mp_float_t sum = 0.0;
+            for (size_t k=0; k < K; k++) {
+                mp_float_t v1 = old_get_float_value((void *)a, 'd', i*K+k);
+                mp_float_t v2 = old_get_float_value((void *)b, 'd', k*N+j);
+                sum += v1 * v2;
+            }
+            c[j*M+i] = sum;
+        }
+    }
+}
+
+// linalg_invert_matrix, Gauss-Jordan elimination without pivoting
+//------------------------------------------------------
+static bool old_invert_matrix(mp_float_t *data, size_t N)
+{
+    mp_float_t *unit = malloc(sizeof(mp_float_t)*N*N);
+    mp_float_t elem = 1.0;
+    memset(unit, 0, sizeof(mp_float_t)*N*N);
+    for (size_t m=0; m < N; m++) {
+        memcpy(&unit[m*(N+1)], &elem, sizeof(mp_float_t));
+    }
+    for (size_t m=0; m < N; m++) {
+        if (fabs(data[m*(N+1)]) < epsilon) {
+            free(unit);
+            return false;
+        }
+        for (size_t n=0; n < N; n++) {
+            if (m != n) {
+                elem = data[N*n+m] / data[m*(N+1)];
+                for (size_t k=0; k < N; k++) {
+                    data[N*n+k] -= elem * data[N*m+k];
+                    unit[N*n+k] -= elem * unit[N*m+k];
+                }
+            }
+        }
+    }
+    for (size_t m=0; m < N; m++) {
+        elem = data[m*(N+1)];
+        for (size_t n=0; n < N; n++) {
+            data[N*m+n] /= elem;
+            unit[N*m+n] /= elem;
+        }
+    }
+    memcpy(data, unit, sizeof(mp_float_t)*N*N);
+    free(unit);
+    return true;
+}
+
+// linalg_det
+//----------------------------------------------------
+static mp_float_t old_det(const mp_float_t *in, size_t N)
+{
+    mp_float_t *tmp = malloc(sizeof(mp_float_t)*N*N);
+    for (size_t i=0; i < N*N; i++) {
+        tmp[i] = old_get_float_value((void *)in, 'd', i);
+    }
+    for (size_t m=0; m < N-1; m++) {
+        if (fabs(tmp[m*(N+1)]) < epsilon) {
+            free(tmp);
+            return 0.0;
+        }
+        for (size_t n=0; n < N; n++) {
+            if (m != n) {
+                mp_float_t c = tmp[N*n+m] / tmp[m*(N+1)];
+                for (size_t k=0; k < N; k++) {
+                    tmp[N*n+k] -= c * tmp[N*m+k];
+                }
+            }
+        }
+    }
+    mp_float_t det = 1.0;
+    for (size_t m=0; m < N; m++) {
+        det *= tmp[m*(N+1)];
+    }
+    free(tmp);
+    return det;
+}
+
+// ==== Current implementation, as used by linalg.c =================================
+
+//------------------------------------------------------
+static bool new_invert_matrix(mp_float_t *data, size_t N)
+{
+    uint16_t *perm = malloc(sizeof(uint16_t)*N);
+    mp_float_t *inverse = malloc(sizeof(mp_float_t)*N*N);
+    int8_t parity;
+    bool success = linalg_lu_decompose(data, N, perm, &parity);
+    if (success) {
+        linalg_lu_solve(data, N, perm, NULL, inverse, N);
+        memcpy(data, inverse, sizeof(mp_float_t)*N*N);
+    }
+    free(inverse);
+    free(perm);
+    return success;
+}
+
+//----------------------------------------------------
+static mp_float_t new_det(const mp_float_t *in, size_t N)
+{
+    mp_float_t *tmp = malloc(sizeof(mp_float_t)*N*N);
+    uint16_t *perm = malloc(sizeof(uint16_t)*N);
+    int8_t parity;
+    mp_float_t det = 0.0;
+    memcpy(tmp, in, sizeof(mp_float_t)*N*N);
+    if (linalg_lu_decompose(tmp, N, perm, &parity)) {
+        det = parity;
+        for (size_t m=0; m < N; m++) {
+            det *= tmp[m*(N+1)];
+        }
+    }
+    free(perm);
+    free(tmp);
+    return det;
+}
+
+// ==== Benchmark ====================================================================
+
+//----------------------------
+static uint64_t time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Random, diagonally dominant (well conditioned) N x N matrix
+//------------------------------------------------
+static void random_matrix(mp_float_t *m, size_t N)
+{
+    for (size_t i=0; i < N; i++) {
+        for (size_t j=0; j < N; j++) {
+            m[i*N+j] = (mp_float_t)rand() / RAND_MAX - 0.5;
+        }
+        m[i*(N+1)] += N;
+    }
+}
+
+typedef enum { OP_DOT_OLD, OP_DOT_NEW, OP_INV_OLD, OP_INV_NEW, OP_DET_OLD, OP_DET_NEW } bench_op_t;
+
+//------------------------------------------
+static void run_op(bench_op_t op, size_t N)
+{
+    switch (op) {
+        case OP_DOT_OLD: old_dot(mat_a, mat_b, mat_c, N, N, N); break;
+        case OP_DOT_NEW: linalg_gemm(mat_a, mat_b, mat_c, N, N, N); break;
+        case OP_INV_OLD:
+            memcpy(mat_c, mat_a, sizeof(mp_float_t)*N*N);
+            old_invert_matrix(mat_c, N);
+            break;
+        case OP_INV_NEW:
+            memcpy(mat_c, mat_a, sizeof(mp_float_t)*N*N);
+            new_invert_matrix(mat_c, N);
+            break;
+        case OP_DET_OLD: sink = old_det(mat_a, N); break;
+        case OP_DET_NEW: sink = new_det(mat_a, N); break;
+    }
+    sink = mat_c[0];
+}
+
+// Returns the time of one operation in microseconds
+//---------------------------------------------
+static double bench(bench_op_t op, size_t N)
+{
+    uint64_t count = 0;
+    uint64_t start = time_ns();
+    uint64_t elapsed;
+    do {
+        for (int i=0; i < 64; i++) run_op(op, N);
+        count += 64;
+        elapsed = time_ns() - start;
+    } while (elapsed < MIN_TIME_NS);
+    return (double)elapsed / count / 1000.0;
+}
+
+//-------------------------------------------------------------------------------------
+static void report(const char *name, bench_op_t old_op, bench_op_t new_op, size_t N)
+{
+    double t_old = bench(old_op, N);
+    double t_new = bench(new_op, N);
+    printf("%-5s %3zux%-3zu %12.3f %12.3f %8.2f\n", name, N, N, t_old, t_new, t_old / t_new);
+}
+
+// Largest absolute difference of the old and new results
+//-------------------------------------------
+static double check(size_t N, double *det_err)
+{
+    double err = 0.0;
+    // product, the old result is column-major
+    old_dot(mat_a, mat_b, mat_d, N, N, N);
+    linalg_gemm(mat_a, mat_b, mat_c, N, N, N);
+    for (size_t i=0; i < N; i++) {
+        for (size_t j=0; j < N; j++) {
+            double e = fabs(mat_c[i*N+j] - mat_d[j*N+i]) / (fabs(mat_d[j*N+i]) + 1.0);
+            if (e > err) err = e;
+        }
+    }
+    // inverse
+    memcpy(mat_c, mat_a, sizeof(mp_float_t)*N*N);
+    memcpy(mat_d, mat_a, sizeof(mp_float_t)*N*N);
+    old_invert_matrix(mat_d, N);
+    new_invert_matrix(mat_c, N);
+    for (size_t i=0; i < N*N; i++) {
+        double e = fabs(mat_c[i] - mat_d[i]) / (fabs(mat_d[i]) + 1.0);
+        if (e > err) err = e;
+    }
+    double d_old = old_det(mat_a, N);
+    *det_err = fabs(new_det(mat_a, N) - d_old) / fabs(d_old);
+    return err;
+}
+
+// Relative residual |A*x - b| / |b| of solve(A, b), x is computed without the inverse
+//-------------------------------------
+static double solve_residual(size_t N)
+{
+    uint16_t perm[MAX_SIZE];
+    int8_t parity;
+    for (size_t i=0; i < N; i++) mat_b[i] = (mp_float_t)rand() / RAND_MAX - 0.5;
+    memcpy(mat_d, mat_a, sizeof(mp_float_t)*N*N);
+    if (!linalg_lu_decompose(mat_d, N, perm, &parity)) return INFINITY;
+    linalg_lu_solve(mat_d, N, perm, mat_b, mat_e, 1);
+    double res = 0.0, norm = 0.0;
+    for (size_t i=0; i < N; i++) {
+        double s = 0.0;
+        for (size_t j=0; j < N; j++) s += mat_a[i*N+j] * mat_e[j];
+        res += (s - mat_b[i]) * (s - mat_b[i]);
+        norm += mat_b[i] * mat_b[i];
+    }
+    return sqrt(res / norm);
+}
+
+//================================
+int main(int argc, char *argv[])
+{
+    (void)argv;
+    static const size_t sizes[] = { 3, 4, 6, 8, 16, 32, 64, 128 };
+    bool quick = (argc > 1);
+
+    mat_a = malloc(sizeof(mp_float_t)*MAX_SIZE*MAX_SIZE);
+    mat_b = malloc(sizeof(mp_float_t)*MAX_SIZE*MAX_SIZE);
+    mat_c = malloc(sizeof(mp_float_t)*MAX_SIZE*MAX_SIZE);
+    mat_d = malloc(sizeof(mp_float_t)*MAX_SIZE*MAX_SIZE);
+    mat_e = malloc(sizeof(mp_float_t)*MAX_SIZE*MAX_SIZE);
+    if (!mat_a || !mat_b || !mat_c || !mat_d || !mat_e) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    srand(1);
+
+    printf("ulab.linalg kernels, previous vs. current implementation\n");
+    printf("========================================================\n");
+    printf("Results:\n");
+    for (size_t s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        size_t N = sizes[s];
+        double det_err;
+        random_matrix(mat_a, N);
+        random_matrix(mat_b, N);
+        double err = check(N, &det_err);
+        printf("  %3zux%-3zu dot/inv max. rel. difference: %.2e, det: %.2e\n", N, N, err, det_err);
+    }
+    for (size_t N=10; N <= MAX_SIZE; N *= 2) {
+        random_matrix(mat_a, N);
+        printf("  %3zux%-3zu solve() residual: %.2e\n", N, N, solve_residual(N));
+    }
+    if (quick) return 0;
+
+    printf("\nTime per call in microseconds:\n");
+    printf("op       size          old          new  speedup\n");
+    for (size_t s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        size_t N = sizes[s];
+        random_matrix(mat_a, N);
+        random_matrix(mat_b, N);
+        report("dot", OP_DOT_OLD, OP_DOT_NEW, N);
+    }
+    for (size_t s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        size_t N = sizes[s];
+        random_matrix(mat_a, N);
+        report("inv", OP_INV_OLD, OP_INV_NEW, N);
+    }
+    for (size_t s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        size_t N = sizes[s];
+        random_matrix(mat_a, N);
+        report("det", OP_DET_OLD, OP_DET_NEW, N);
+    }
+
+    free(mat_a);
+    free(mat_b);
+    free(mat_c);
+    free(mat_d);
+    free(mat_e);
+    return 0;
+}
@@ -48,7 +48,7 @@
 
 // For mp_vfs_proxy_call, the maximum number of additional args that can be passed.
 // A fixed maximum size is used to avoid the need for a costly variable array.
-#define PROXY_MAX_ARGS (2)
+#define PROXY_MAX_ARGS (3)
 
 // path is the path to lookup and *path_out holds the path within the VFS
 // object (starts with / if an absolute path).
@@ -293,9 +293,9 @@ mp_obj_t mp_vfs_umount(mp_obj_t mnt_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_umount_obj, mp_vfs_umount);
 
-// Note: buffering and encoding args are currently ignored
+// Note: the encoding arg is currently ignored, buffering is passed to the file system if given
 mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_file, ARG_mode, ARG_encoding };
+    enum { ARG_file, ARG_mode, ARG_buffering, ARG_encoding };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
         { MP_QSTR_mode, MP_ARG_OBJ, {.u_rom_obj = MP_ROM_QSTR(MP_QSTR_r)} },
@@ -315,6 +315,11 @@ mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
     #endif
 
     mp_vfs_mount_t *vfs = lookup_path(args[ARG_file].u_obj, &args[ARG_file].u_obj);
+    if (args[ARG_buffering].u_int != -1) {
+        // pass the buffer size to the file system, only if it was requested
+        args[ARG_buffering].u_obj = MP_OBJ_NEW_SMALL_INT(args[ARG_buffering].u_int);
+        return mp_vfs_proxy_call(vfs, MP_QSTR_open, 3, (mp_obj_t*)&args);
+    }
     return mp_vfs_proxy_call(vfs, MP_QSTR_open, 2, (mp_obj_t*)&args);
 }
 MP_DEFINE_CONST_FUN_OBJ_KW(mp_vfs_open_obj, 0, mp_vfs_open);
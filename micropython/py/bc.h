@@ -212,6 +212,8 @@ typedef struct _mp_code_state_t {
     #if MICROPY_PY_SYS_SETTRACE
     struct _mp_code_state_t *prev_state;
     struct _mp_obj_frame_t *frame;
+    #elif MICROPY_PY_PROFILER
+    struct _mp_code_state_t *prev_state;
     #endif
     // Variable-length
     mp_obj_t state[0];
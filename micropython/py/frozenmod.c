@@ -82,18 +82,31 @@ STATIC mp_lexer_t *mp_lexer_frozen_str(const char *str, size_t len) {
 extern const char mp_frozen_mpy_names[];
 extern const mp_raw_code_t *const mp_frozen_mpy_content[];
 
-STATIC const mp_raw_code_t *mp_find_frozen_mpy(const char *str, size_t len) {
-    const char *name = mp_frozen_mpy_names;
+STATIC const mp_raw_code_t *mp_find_frozen_mpy_in(const char *name, const mp_raw_code_t *const *content, const char *str, size_t len) {
     for (size_t i = 0; *name != 0; i++) {
         size_t l = strlen(name);
         if (l == len && !memcmp(str, name, l)) {
-            return mp_frozen_mpy_content[i];
+            return content[i];
         }
         name += l + 1;
     }
     return NULL;
 }
 
+STATIC const mp_raw_code_t *mp_find_frozen_mpy(const char *str, size_t len) {
+    const mp_raw_code_t *rc = mp_find_frozen_mpy_in(mp_frozen_mpy_names, mp_frozen_mpy_content, str, len);
+    #if MICROPY_MODULE_FROZEN_MPY_EXTRA
+    if (rc == NULL) {
+        const mp_raw_code_t *const *content;
+        const char *names = mp_frozen_mpy_extra(&content);
+        if (names != NULL) {
+            rc = mp_find_frozen_mpy_in(names, content, str, len);
+        }
+    }
+    #endif
+    return rc;
+}
+
 #endif
 
 #if MICROPY_MODULE_FROZEN
@@ -130,6 +143,16 @@ mp_import_stat_t mp_frozen_stat(const char *str) {
     if (stat != MP_IMPORT_STAT_NO_EXIST) {
         return stat;
     }
+    #if MICROPY_MODULE_FROZEN_MPY_EXTRA
+    const mp_raw_code_t *const *content;
+    const char *names = mp_frozen_mpy_extra(&content);
+    if (names != NULL) {
+        stat = mp_frozen_stat_helper(names, str);
+        if (stat != MP_IMPORT_STAT_NO_EXIST) {
+            return stat;
+        }
+    }
+    #endif
     #endif
 
     return MP_IMPORT_STAT_NO_EXIST;
@@ -39,4 +39,11 @@ int mp_find_frozen_module(const char *str, size_t len, void **data);
 const char *mp_find_frozen_str(const char *str, size_t *len);
 mp_import_stat_t mp_frozen_stat(const char *str);
 
+#if MICROPY_MODULE_FROZEN_MPY_EXTRA
+// Implemented by the port: returns the names of the extra frozen modules (in the
+// same format as mp_frozen_mpy_names) and sets *content, or NULL if there are none
+struct _mp_raw_code_t;
+const char *mp_frozen_mpy_extra(const struct _mp_raw_code_t *const **content);
+#endif
+
 #endif // MICROPY_INCLUDED_PY_FROZENMOD_H
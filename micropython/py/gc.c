@@ -546,6 +546,11 @@ found:
     MP_STATE_MEM(gc_alloc_amount) += n_blocks;
     #endif
 
+    #if MICROPY_PY_THREAD_STATS
+    MP_STATE_THREAD(stats.alloc_bytes) += n_bytes;
+    MP_STATE_THREAD(stats.alloc_count)++;
+    #endif
+
     GC_EXIT();
 
     #if MICROPY_GC_CONSERVATIVE_CLEAR
@@ -38,6 +38,7 @@
 #include "modmachine.h"
 #include "mphalport.h"
 #include "gccollect.h"
+#include "ipcjob.h"
 
 
 /****************************************************************/
@@ -95,6 +96,13 @@ void mp_thread_entry(void *args_in)
         memcpy(&th_state.mem, &mp_state_ctx.mem, sizeof(mp_state_mem_t));
     }
 
+    #if MICROPY_PY_THREAD_STATS
+    memset(&th_state.thread.stats, 0, sizeof(mp_thread_stats_t));
+    #endif
+    #if MICROPY_PY_PROFILER && !MICROPY_PY_SYS_SETTRACE
+    th_state.thread.current_code_state = NULL;
+    #endif
+
     // Save thread state in local storage pointer #0
     vTaskSetThreadLocalStoragePointer(NULL, THREAD_LSP_STATE, &th_state);
 
@@ -577,7 +585,7 @@ STATIC mp_obj_t mod_thread_list(mp_uint_t n_args, const mp_obj_t *args) {
         }
 
         for (n=0; n<num; n++) {
-			thr = list.threads + (sizeof(threadlistitem_t) * n);
+			thr = list.threads + n;
 			char th_type[8] = {'\0'};
 			if (thr->type == THREAD_TYPE_MAIN) sprintf(th_type, "MAIN");
 			else if (thr->type == THREAD_TYPE_PYTHON) sprintf(th_type, "PYTHON");
@@ -661,7 +669,7 @@ STATIC mp_obj_t mod_thread_list(mp_uint_t n_args, const mp_obj_t *args) {
 		mp_obj_t thr_info[7];
 		mp_obj_t tuple[num+services];
 		for (n=0; n<num; n++) {
-			thr = list.threads + (sizeof(threadlistitem_t) * n);
+			thr = list.threads + n;
 			thr_info[0] = mp_obj_new_int(thr->id);
 			thr_info[1] = mp_obj_new_int(thr->type);
 			thr_info[2] = mp_obj_new_str(thr->name, strlen(thr->name));
@@ -681,6 +689,137 @@ STATIC mp_obj_t mod_thread_list(mp_uint_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_thread_list_obj, 0, 1, mod_thread_list);
 
+#if MICROPY_PY_THREAD_STATS
+//-------------------------------------------------------------------------------
+static mp_obj_t _stats_hist(const uint32_t *hist)
+{
+    mp_obj_t items[THREAD_STATS_HIST_SIZE];
+    for (int i = 0; i < THREAD_STATS_HIST_SIZE; i++) {
+        items[i] = mp_obj_new_int_from_uint(hist[i]);
+    }
+    return mp_obj_new_tuple(THREAD_STATS_HIST_SIZE, items);
+}
+
+STATIC const qstr thread_stats_fields[] = {
+    MP_QSTR_id, MP_QSTR_name, MP_QSTR_cpu_us, MP_QSTR_stack_max,
+    MP_QSTR_gil_count, MP_QSTR_gil_wait_us, MP_QSTR_gil_hold_us, MP_QSTR_gil_wait_hist, MP_QSTR_gil_hold_hist,
+    MP_QSTR_alloc_bytes, MP_QSTR_alloc_count, MP_QSTR_gc_count, MP_QSTR_gc_us
+};
+
+STATIC const qstr task_stats_fields[] = {
+    MP_QSTR_id, MP_QSTR_name, MP_QSTR_proc, MP_QSTR_cpu_us, MP_QSTR_stack_free
+};
+
+// Returns the tuple of per-thread statistics of this MicroPython instance
+// and the tuple of CPU usage and minimal free stack of all FreeRTOS tasks
+//------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_thread_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_reset };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_reset, MP_ARG_BOOL, { .u_bool = false } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    thread_list_t list = {0, NULL};
+    int num = mp_thread_list(&list);
+    if ((num == 0) || (list.threads == NULL)) return mp_const_none;
+
+    // FreeRTOS run time statistics
+    UBaseType_t ntasks = uxTaskGetNumberOfTasksAllProc();
+    uint64_t total_run_time = 0;
+    TaskStatus_t *task_status = pvPortMalloc(ntasks * sizeof(TaskStatus_t) + 8);
+    if (task_status) {
+        memset(task_status, 0, ntasks * sizeof(TaskStatus_t) + 8);
+        ntasks = uxTaskGetSystemState(task_status, ntasks, &total_run_time);
+    }
+    else ntasks = 0;
+
+    mp_obj_t thread_tuple = mp_obj_new_tuple(num, NULL);
+    mp_obj_tuple_t *threads = MP_OBJ_TO_PTR(thread_tuple);
+    mp_obj_t items[13];
+    for (int n = 0; n < num; n++) {
+        threadlistitem_t *thr = list.threads + n;
+        uint64_t cpu_us = 0;
+        for (UBaseType_t x = 0; x < ntasks; x++) {
+            if (task_status[x].xHandle == (TaskHandle_t)thr->id) {
+                cpu_us = task_status[x].ulRunTimeCounter;
+                break;
+            }
+        }
+        items[0] = mp_obj_new_int_from_ull(thr->id);
+        items[1] = mp_obj_new_str(thr->name, strlen(thr->name));
+        items[2] = mp_obj_new_int_from_ull(cpu_us);
+        items[3] = mp_obj_new_int(thr->stack_max);
+        items[4] = mp_obj_new_int_from_uint(thr->stats.gil_count);
+        items[5] = mp_obj_new_int_from_ull(thr->stats.gil_wait_us);
+        items[6] = mp_obj_new_int_from_ull(thr->stats.gil_hold_us);
+        items[7] = _stats_hist(thr->stats.gil_wait_hist);
+        items[8] = _stats_hist(thr->stats.gil_hold_hist);
+        items[9] = mp_obj_new_int_from_ull(thr->stats.alloc_bytes);
+        items[10] = mp_obj_new_int_from_uint(thr->stats.alloc_count);
+        items[11] = mp_obj_new_int_from_uint(thr->stats.gc_count);
+        items[12] = mp_obj_new_int_from_ull(thr->stats.gc_us);
+        threads->items[n] = mp_obj_new_attrtuple(thread_stats_fields, 13, items);
+    }
+    vPortFree(list.threads);
+
+    mp_obj_t task_tuple = mp_obj_new_tuple(ntasks, NULL);
+    mp_obj_tuple_t *tasks = MP_OBJ_TO_PTR(task_tuple);
+    for (UBaseType_t x = 0; x < ntasks; x++) {
+        size_t len = strnlen(task_status[x].pcTaskName, configMAX_TASK_NAME_LEN);
+        items[0] = mp_obj_new_int_from_ull((uint64_t)task_status[x].xHandle);
+        items[1] = mp_obj_new_str(task_status[x].pcTaskName, len);
+        items[2] = mp_obj_new_int(task_status[x].xProcessor);
+        items[3] = mp_obj_new_int_from_ull(task_status[x].ulRunTimeCounter);
+        items[4] = mp_obj_new_int(task_status[x].usStackHighWaterMark * sizeof(StackType_t));
+        tasks->items[x] = mp_obj_new_attrtuple(task_stats_fields, 5, items);
+    }
+    if (task_status) vPortFree(task_status);
+
+    if (args[ARG_reset].u_bool) mp_thread_stats_reset();
+
+    mp_obj_t res[2] = { thread_tuple, task_tuple };
+    return mp_obj_new_tuple(2, res);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_thread_stats_obj, 0, mod_thread_stats);
+#endif
+
+#if MICROPY_PY_THREAD_GIL_HANDOFF
+// Set the GIL hand-off policy, returns the tuple (hold_us, inherit)
+// hold_us: maximal time in us the thread holds the GIL while other threads of the same priority are waiting
+// inherit: the GIL owner inherits the priority of the highest priority waiting thread
+//----------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_thread_gil_policy(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_hold_us, ARG_inherit };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_hold_us, MP_ARG_INT, { .u_int = -1 } },
+        { MP_QSTR_inherit, MP_ARG_OBJ, { .u_obj = mp_const_none } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    int32_t hold_us = -1;
+    if (args[ARG_hold_us].u_int >= 0) {
+        if ((args[ARG_hold_us].u_int < 100) || (args[ARG_hold_us].u_int > 1000000)) {
+            mp_raise_ValueError("hold time range: 100 ~ 1000000 us");
+        }
+        hold_us = args[ARG_hold_us].u_int;
+    }
+    int inherit = -1;
+    if (args[ARG_inherit].u_obj != mp_const_none) inherit = mp_obj_is_true(args[ARG_inherit].u_obj);
+
+    bool inherit_now;
+    uint32_t hold_now = mp_thread_gil_policy(hold_us, inherit, &inherit_now);
+
+    mp_obj_t res[2] = { mp_obj_new_int_from_uint(hold_now), mp_obj_new_bool(inherit_now) };
+    return mp_obj_new_tuple(2, res);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_thread_gil_policy_obj, 0, mod_thread_gil_policy);
+#endif
+
 //--------------------------------------------------------------------------------
 STATIC mp_obj_t mod_thread_mainAcceptMsg(mp_uint_t n_args, const mp_obj_t *args) {
 	int res = 0;
@@ -1054,6 +1193,12 @@ STATIC const mp_rom_map_elem_t mp_module_thread_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_sendmsg),				MP_ROM_PTR(&mod_thread_sendmsg_obj) },
     { MP_ROM_QSTR(MP_QSTR_getmsg),				MP_ROM_PTR(&mod_thread_getmsg_obj) },
     { MP_ROM_QSTR(MP_QSTR_list),				MP_ROM_PTR(&mod_thread_list_obj) },
+    #if MICROPY_PY_THREAD_STATS
+    { MP_ROM_QSTR(MP_QSTR_stats),				MP_ROM_PTR(&mod_thread_stats_obj) },
+    #endif
+    #if MICROPY_PY_THREAD_GIL_HANDOFF
+    { MP_ROM_QSTR(MP_QSTR_gil_policy),			MP_ROM_PTR(&mod_thread_gil_policy_obj) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_getThreadName),		MP_ROM_PTR(&mod_thread_getname_obj) },
     { MP_ROM_QSTR(MP_QSTR_getSelfName),			MP_ROM_PTR(&mod_thread_getSelfname_obj) },
     { MP_ROM_QSTR(MP_QSTR_status),				MP_ROM_PTR(&mod_thread_status_obj) },
@@ -1075,6 +1220,8 @@ STATIC const mp_rom_map_elem_t mp_module_thread_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_ipc_busy),            MP_ROM_PTR(&mod_thread_get_ipc_state_obj) },
     { MP_ROM_QSTR(MP_QSTR_ipc_break),           MP_ROM_PTR(&mod_thread_get_ipc_setexception_obj) },
     { MP_ROM_QSTR(MP_QSTR_ipc_notify),          MP_ROM_PTR(&mod_thread_ipc_notify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ipc_submit),          MP_ROM_PTR(&ipcjob_submit_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ipc_worker),          MP_ROM_PTR(&ipcjob_worker_obj) },
 
     { MP_ROM_QSTR(MP_QSTR_IPC_EXEC),            MP_ROM_INT(THREAD_IPC_TYPE_EXECUTE) },
 
@@ -716,6 +716,12 @@ typedef double mp_float_t;
 #define MICROPY_MODULE_FROZEN_MPY (0)
 #endif
 
+// Whether the port provides additional frozen .mpy modules at run time
+// (via mp_frozen_mpy_extra(), eg. modules linked into memory-mapped flash)
+#ifndef MICROPY_MODULE_FROZEN_MPY_EXTRA
+#define MICROPY_MODULE_FROZEN_MPY_EXTRA (0)
+#endif
+
 // Convenience macro for whether frozen modules are supported
 #ifndef MICROPY_MODULE_FROZEN
 #define MICROPY_MODULE_FROZEN (MICROPY_MODULE_FROZEN_STR || MICROPY_MODULE_FROZEN_MPY)
@@ -248,6 +248,15 @@ typedef struct _mp_state_thread_t {
     uint8_t *pystack_end;
     uint8_t *pystack_cur;
 
+    #if MICROPY_PY_THREAD_STATS
+    mp_thread_stats_t stats;
+    #endif
+
+    #if MICROPY_PY_PROFILER && !MICROPY_PY_SYS_SETTRACE
+    // innermost active bytecode frame, used by the sampling profiler
+    struct _mp_code_state_t *current_code_state;
+    #endif
+
     ////////////////////////////////////////////////////////////
     // START ROOT POINTER SECTION
     // Everything that needs GC scanning must start here, and
@@ -46,8 +46,13 @@ void mp_thread_remove_thread();
 #if MICROPY_PY_THREAD && MICROPY_PY_THREAD_GIL
 #include "py/mpstate.h"
 
+#if MICROPY_PY_THREAD_STATS || MICROPY_PY_THREAD_GIL_HANDOFF
+#define MP_THREAD_GIL_ENTER() mp_thread_gil_enter()
+#define MP_THREAD_GIL_EXIT() mp_thread_gil_exit()
+#else
 #define MP_THREAD_GIL_ENTER() mp_thread_mutex_lock(&MP_STATE_VM(gil_mutex), 1)
 #define MP_THREAD_GIL_EXIT() mp_thread_mutex_unlock(&MP_STATE_VM(gil_mutex))
+#endif
 #else
 #define MP_THREAD_GIL_ENTER()
 #define MP_THREAD_GIL_EXIT()
@@ -139,8 +139,12 @@ void mp_init(void) {
     #endif
 
     #if MICROPY_PY_THREAD_GIL
+    #if MICROPY_PY_THREAD_GIL_HANDOFF
+    mp_thread_gil_init(&MP_STATE_VM(gil_mutex));
+    #else
     mp_thread_mutex_init(&MP_STATE_VM(gil_mutex));
     #endif
+    #endif
 
     MP_THREAD_GIL_ENTER();
 }
@@ -166,6 +166,15 @@
     } \
 } while(0)
 
+#elif MICROPY_PY_PROFILER
+
+// only the chain of active frames is maintained for the sampling profiler
+#define FRAME_SETUP() MP_STATE_THREAD(current_code_state) = code_state
+#define FRAME_ENTER() code_state->prev_state = MP_STATE_THREAD(current_code_state)
+#define FRAME_LEAVE() MP_STATE_THREAD(current_code_state) = code_state->prev_state
+#define FRAME_UPDATE()
+#define TRACE_TICK(current_ip, current_sp, is_exception)
+
 #else // MICROPY_PY_SYS_SETTRACE
 #define FRAME_SETUP()
 #define FRAME_ENTER()
@@ -1431,8 +1440,12 @@ pending_exception_check:
                     if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE)
                     #endif
                     {
+                    #if MICROPY_PY_THREAD_GIL_HANDOFF
+                    mp_thread_gil_yield();
+                    #else
                     MP_THREAD_GIL_EXIT();
                     MP_THREAD_GIL_ENTER();
+                    #endif
                     }
                 }
                 #endif
@@ -0,0 +1,275 @@
+/*
+ * Image creator for the read-only Flash image partition (uos.mmap)
+ *
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define FLASH_IMAGE_HOST
+#include "flash_image.h"
+
+#define MAX_FILES   1024
+
+typedef struct _image_file_t {
+    char path[512];
+    char name[FLASH_IMAGE_NAME_LEN];
+    uint32_t size;
+} image_file_t;
+
+static image_file_t files[MAX_FILES];
+static int file_count = 0;
+static uint32_t partition_size = 1024*1024;
+static char image_name[256] = {0};
+static char image_dir[256] = {0};
+
+
+//--------------------------------------------------------------
+static int add_dir(const char *dirpath, const char *prefix)
+{
+    DIR *dir = opendir(dirpath);
+    if (!dir) {
+        printf("error: can't read directory '%s'\r\n", dirpath);
+        return -1;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        char path[512], name[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dirpath, ent->d_name);
+        snprintf(name, sizeof(name), "%s%s", prefix, ent->d_name);
+        if (stat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            char sub_prefix[520];
+            snprintf(sub_prefix, sizeof(sub_prefix), "%s/", name);
+            if (add_dir(path, sub_prefix) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        }
+        else if (S_ISREG(st.st_mode)) {
+            if (strlen(name) >= FLASH_IMAGE_NAME_LEN) {
+                printf("error: name too long '%s' (max %d characters)\r\n", name, FLASH_IMAGE_NAME_LEN-1);
+                closedir(dir);
+                return -1;
+            }
+            if (file_count >= MAX_FILES) {
+                printf("error: too many files (max %d)\r\n", MAX_FILES);
+                closedir(dir);
+                return -1;
+            }
+            snprintf(files[file_count].path, sizeof(files[file_count].path), "%s", path);
+            memset(files[file_count].name, 0, FLASH_IMAGE_NAME_LEN);
+            strcpy(files[file_count].name, name);
+            files[file_count].size = (uint32_t)st.st_size;
+            file_count++;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+//-------------------------------------------------------
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const image_file_t *)a)->name, ((const image_file_t *)b)->name);
+}
+
+// Create the image, directory is sorted by name so that the image is reproducible
+//-----------------------------
+static int create_image(void)
+{
+    if (add_dir(image_dir, "") != 0) return 1;
+    qsort(files, file_count, sizeof(image_file_t), compare_files);
+
+    uint32_t dir_size = sizeof(flash_image_header_t) + file_count * sizeof(flash_image_entry_t);
+    uint32_t size = (dir_size + FLASH_IMAGE_ALIGN - 1) & ~(FLASH_IMAGE_ALIGN - 1);
+    for (int i=0; i<file_count; i++) {
+        size += (files[i].size + FLASH_IMAGE_ALIGN - 1) & ~(FLASH_IMAGE_ALIGN - 1);
+    }
+    if (size > partition_size) {
+        printf("error: image size %u > partition size %u\r\n", size, partition_size);
+        return 1;
+    }
+
+    // unused bytes are set to 0xFF (erased flash state)
+    uint8_t *image = malloc(size);
+    if (!image) {
+        printf("error: memory allocation\r\n");
+        return 1;
+    }
+    memset(image, 0xFF, size);
+
+    flash_image_header_t *hdr = (flash_image_header_t *)image;
+    flash_image_entry_t *entry = (flash_image_entry_t *)(image + sizeof(flash_image_header_t));
+    uint32_t offset = (dir_size + FLASH_IMAGE_ALIGN - 1) & ~(FLASH_IMAGE_ALIGN - 1);
+    for (int i=0; i<file_count; i++, entry++) {
+        FILE *f = fopen(files[i].path, "rb");
+        if ((!f) || (fread(image + offset, 1, files[i].size, f) != files[i].size)) {
+            printf("error: failed to read '%s'\r\n", files[i].path);
+            if (f) fclose(f);
+            free(image);
+            return 1;
+        }
+        fclose(f);
+        memcpy(entry->name, files[i].name, FLASH_IMAGE_NAME_LEN);
+        entry->offset = offset;
+        entry->size = files[i].size;
+        entry->crc32 = flash_image_crc32(0, image + offset, files[i].size);
+        entry->flags = 0;
+        printf("  %08X %8u  %s\r\n", offset, files[i].size, files[i].name);
+        offset += (files[i].size + FLASH_IMAGE_ALIGN - 1) & ~(FLASH_IMAGE_ALIGN - 1);
+    }
+    hdr->magic = FLASH_IMAGE_MAGIC;
+    hdr->version = FLASH_IMAGE_VERSION;
+    hdr->count = (uint16_t)file_count;
+    hdr->size = size;
+    hdr->crc32 = flash_image_crc32(0, image + sizeof(flash_image_header_t), file_count * sizeof(flash_image_entry_t));
+
+    printf("Image size: %u (%d files)\r\n", size, file_count);
+    printf("Saving image to '%s'\r\n", image_name);
+    FILE *f = fopen(image_name, "wb");
+    if ((!f) || (fwrite(image, 1, size, f) != size)) {
+        printf("error: failed to write '%s'\r\n", image_name);
+        if (f) fclose(f);
+        free(image);
+        return 1;
+    }
+    fclose(f);
+    free(image);
+    return 0;
+}
+
+// Check the image the same way the firmware does it ('uos.mmap_list()' and 'uos.mmap()')
+//----------------------------
+static int check_image(void)
+{
+    FILE *f = fopen(image_name, "rb");
+    if (!f) {
+        printf("error: failed to open '%s'\r\n", image_name);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    // the image is loaded into the emulated, erased, partition
+    uint8_t *partition = malloc(partition_size);
+    if (!partition) {
+        fclose(f);
+        return 1;
+    }
+    memset(partition, 0xFF, partition_size);
+    if ((fsize > (long)partition_size) || (fread(partition, 1, fsize, f) != (size_t)fsize)) {
+        printf("error: image does not fit into the partition\r\n");
+        fclose(f);
+        free(partition);
+        return 1;
+    }
+    fclose(f);
+
+    int err = 0;
+    int count = flash_image_check(partition, partition_size);
+    if (count < 0) {
+        printf("error: not a valid image\r\n");
+        err = 1;
+    }
+    const flash_image_entry_t *entry = (const flash_image_entry_t *)(partition + sizeof(flash_image_header_t));
+    for (int i=0; i<count; i++, entry++) {
+        char name[FLASH_IMAGE_NAME_LEN+2];
+        snprintf(name, sizeof(name), "/%.*s", FLASH_IMAGE_NAME_LEN, entry->name);
+        bool ok = (flash_image_find(partition, name) == entry) &&
+                  ((entry->offset % FLASH_IMAGE_ALIGN) == 0) &&
+                  ((entry->offset + entry->size) <= ((const flash_image_header_t *)partition)->size) &&
+                  (flash_image_crc32(0, partition + entry->offset, entry->size) == entry->crc32);
+        printf("  %08X %8u  %-40s %s\r\n", entry->offset, entry->size, name, (ok) ? "ok" : "ERROR");
+        if (!ok) err = 1;
+    }
+    free(partition);
+    return err;
+}
+
+//===============================
+int main(int argc, char **argv) {
+    int c;
+    char *ptr;
+    bool help = false;
+    bool check = false;
+
+    printf("\r\n");
+    while ( (c = getopt(argc, argv, "s:lh")) != -1) {
+        switch (c) {
+        case 's':
+            partition_size = (uint32_t)strtol(optarg, &ptr, 10) * 1024;
+            break;
+        case 'l':
+            check = true;
+            break;
+        case 'h':
+            help = true;
+            break;
+        default:
+            help = true;
+        }
+    }
+
+    if ((check) && (argc - optind < 1)) help = true;
+    if ((!check) && (argc - optind < 2)) help = true;
+    if (help) {
+        printf("Usage:\r\n");
+        printf("  mkflashimg [-s partition_size] image_dir image_name\r\n");
+        printf("  mkflashimg [-s partition_size] -l image_name\r\n");
+        printf("  partition_size: in KB, default=1024 (CONFIG_MICRO_PY_FLASH_IMAGE_SIZE)\r\n");
+        printf("              -l: list and verify the image\r\n");
+        printf("\r\n");
+        return 0;
+    }
+
+    int err;
+    if (check) {
+        sprintf(image_name, "%s", argv[optind]);
+        printf("Checking Flash image '%s'\r\n", image_name);
+        printf("=======================\r\n");
+        err = check_image();
+    }
+    else {
+        sprintf(image_dir, "%s", argv[optind]);
+        sprintf(image_name, "%s", argv[optind+1]);
+        printf("Creating Flash image\r\n");
+        printf("=======================\r\n");
+        printf("Image directory:\r\n  '%s'\r\n", image_dir);
+        err = create_image();
+    }
+    printf("=======================\r\n");
+    printf("\r\n");
+    return err;
+}
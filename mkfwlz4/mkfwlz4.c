@@ -0,0 +1,357 @@
+/*
+ * LZ4 compressed firmware image creator (Kboot)
+ *
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lz4_image.h"
+
+#define MIN_MATCH       4
+#define MAX_OFFSET      65535
+#define HASH_BITS       16
+#define MAX_CHAIN       256     // match candidates checked for every position
+#define LAST_LITERALS   5       // LZ4 block rules: the last 5 bytes are literals
+#define MFLIMIT         12      //   and the last match starts at least 12 bytes before the block end
+
+static uint8_t *in_data = NULL;
+static uint32_t in_size = 0;
+static int32_t *head = NULL;
+static int32_t *chain = NULL;
+static uint32_t inserted = 0;
+static char in_name[256] = {0};
+static char out_name[256] = {0};
+
+
+//--------------------------------------------------------------------
+static uint8_t *load_file(const char *fname, uint32_t *size)
+{
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
+        printf("error: failed to open '%s'\r\n", fname);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc((fsize > 0) ? fsize : 1);
+    if ((!data) || (fsize <= 0) || (fread(data, 1, fsize, f) != (size_t)fsize)) {
+        printf("error: failed to read '%s'\r\n", fname);
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    *size = (uint32_t)fsize;
+    return data;
+}
+
+//-----------------------------------------
+static uint32_t hash4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// Add all positions up to 'pos' to the match index
+//----------------------------------------
+static void insert_until(uint32_t pos)
+{
+    while ((inserted < pos) && ((inserted + 4) <= in_size)) {
+        uint32_t h = hash4(in_data + inserted);
+        chain[inserted] = head[h];
+        head[h] = inserted;
+        inserted++;
+    }
+}
+
+// Find the longest match at 'pos' not extending past 'limit'
+//--------------------------------------------------------------------------------
+static uint32_t find_match(uint32_t pos, uint32_t limit, uint32_t *offset)
+{
+    uint32_t best = 0;
+    if ((pos + MIN_MATCH) > limit) return 0;
+    insert_until(pos);
+    int32_t c = head[hash4(in_data + pos)];
+    for (int n=0; (n < MAX_CHAIN) && (c >= 0) && ((pos - c) <= MAX_OFFSET); n++, c = chain[c]) {
+        if (in_data[c + best] != in_data[pos + best]) continue;
+        uint32_t len = 0;
+        while (((pos + len) < limit) && (in_data[c + len] == in_data[pos + len])) len++;
+        if (len > best) {
+            best = len;
+            *offset = pos - c;
+            if ((pos + best) >= limit) break;
+        }
+    }
+    return (best >= MIN_MATCH) ? best : 0;
+}
+
+//-----------------------------------------------------------
+static uint8_t *put_length(uint8_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+//---------------------------------------------------------------------------------------------------------------
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, uint32_t lit_len, uint32_t offset, uint32_t match_len)
+{
+    uint8_t *token = op++;
+    *token = (lit_len >= 15) ? 0xF0 : (uint8_t)(lit_len << 4);
+    if (lit_len >= 15) op = put_length(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) return op; // last literals
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    match_len -= MIN_MATCH;
+    *token |= (match_len >= 15) ? 0x0F : (uint8_t)match_len;
+    if (match_len >= 15) op = put_length(op, match_len - 15);
+    return op;
+}
+
+/*
+ * Compress one block [start, end) to 'out', the data before 'start' is used as dictionary
+ * Greedy parsing with one step lazy evaluation
+ */
+//-------------------------------------------------------------------------
+static uint32_t compress_block(uint32_t start, uint32_t end, uint8_t *out)
+{
+    uint8_t *op = out;
+    uint32_t pos = start, anchor = start;
+    uint32_t match_limit = (end >= LAST_LITERALS) ? end - LAST_LITERALS : 0;
+    uint32_t offset = 0, offset2 = 0, len, len2;
+
+    while ((pos + MFLIMIT) <= end) {
+        len = find_match(pos, match_limit, &offset);
+        if (len == 0) {
+            pos++;
+            continue;
+        }
+        if ((pos + 1 + MFLIMIT) <= end) {
+            len2 = find_match(pos + 1, match_limit, &offset2);
+            if (len2 > (len + 1)) {
+                // better match at the next position
+                pos++;
+                len = len2;
+                offset = offset2;
+            }
+        }
+        op = put_sequence(op, in_data + anchor, pos - anchor, offset, len);
+        pos += len;
+        anchor = pos;
+    }
+    op = put_sequence(op, in_data + anchor, end - anchor, 0, 0);
+    return op - out;
+}
+
+//---------------------------------
+static int create_image(void)
+{
+    FILE *f;
+    uint8_t block[LZ4_IMAGE_BLOCK_MAX + LZ4_IMAGE_BLOCK_SIZE];
+    uint32_t out_size = LZ4_IMAGE_HDR_SIZE;
+    uint32_t n_raw = 0, n_blocks = 0;
+
+    head = malloc(sizeof(int32_t) << HASH_BITS);
+    chain = malloc(sizeof(int32_t) * in_size);
+    if ((!head) || (!chain)) {
+        printf("error: memory allocation\r\n");
+        return 1;
+    }
+    memset(head, 0xFF, sizeof(int32_t) << HASH_BITS);
+
+    f = fopen(out_name, "wb");
+    if (!f) {
+        printf("error: failed to create '%s'\r\n", out_name);
+        return 1;
+    }
+    uint8_t hdr[LZ4_IMAGE_HDR_SIZE] = {0};
+    uint32_t magic = LZ4_IMAGE_MAGIC;
+    memcpy(hdr, &magic, 4);
+    memcpy(hdr+4, &in_size, 4);
+    hdr[8] = LZ4_IMAGE_BLOCK_LOG2;
+    fwrite(hdr, 1, LZ4_IMAGE_HDR_SIZE, f);
+
+    for (uint32_t start=0; start<in_size; start+=LZ4_IMAGE_BLOCK_SIZE) {
+        uint32_t end = start + LZ4_IMAGE_BLOCK_SIZE;
+        if (end > in_size) end = in_size;
+        uint32_t len = compress_block(start, end, block+4);
+        uint32_t blk_hdr = len;
+        if (len >= (end - start)) {
+            // not compressible, store
+            len = end - start;
+            memcpy(block+4, in_data+start, len);
+            blk_hdr = len | LZ4_IMAGE_BLOCK_RAW;
+            n_raw++;
+        }
+        memcpy(block, &blk_hdr, 4);
+        uint32_t padded = LZ4_IMAGE_BLOCK_PADDED(blk_hdr);
+        memset(block + 4 + len, 0, padded - 4 - len);
+        if (fwrite(block, 1, padded, f) != padded) {
+            printf("error: failed to write '%s'\r\n", out_name);
+            fclose(f);
+            return 1;
+        }
+        out_size += padded;
+        n_blocks++;
+    }
+    fclose(f);
+    printf("Blocks: %u (%u stored uncompressed)\r\n", n_blocks, n_raw);
+    printf("Compressed size: %u (%.1f%%)\r\n", out_size, (double)out_size * 100.0 / in_size);
+    free(head);
+    free(chain);
+    return 0;
+}
+
+// Decompress the image with the Kboot decompressor and compare it with the original
+//--------------------------------------------------------------------------------------
+static int check_image(const char *fname, const uint8_t *orig, uint32_t orig_size)
+{
+    uint32_t size, magic, out_size;
+    uint8_t *img = load_file(fname, &size);
+    if (!img) return 1;
+
+    int err = 1;
+    uint8_t *out = NULL;
+    memcpy(&magic, img, 4);
+    memcpy(&out_size, img+4, 4);
+    if ((size < LZ4_IMAGE_HDR_SIZE) || (magic != LZ4_IMAGE_MAGIC) || (img[8] != LZ4_IMAGE_BLOCK_LOG2)) {
+        printf("error: not a compressed image\r\n");
+        goto exit;
+    }
+    out = malloc(out_size ? out_size : 1);
+    if (!out) {
+        printf("error: memory allocation\r\n");
+        goto exit;
+    }
+    uint32_t idx = LZ4_IMAGE_HDR_SIZE, pos = 0, blk_hdr, n, n_blocks = 0;
+    while (idx < size) {
+        if ((idx + 4) > size) break;
+        memcpy(&blk_hdr, img+idx, 4);
+        uint32_t padded = LZ4_IMAGE_BLOCK_PADDED(blk_hdr);
+        if ((padded > LZ4_IMAGE_BLOCK_MAX) || ((idx + padded) > size)) break;
+        n = out_size - pos;
+        if (n > LZ4_IMAGE_BLOCK_SIZE) n = LZ4_IMAGE_BLOCK_SIZE;
+        if (blk_hdr & LZ4_IMAGE_BLOCK_RAW) {
+            if ((blk_hdr & LZ4_IMAGE_BLOCK_LEN) != n) break;
+            memcpy(out+pos, img+idx+4, n);
+        }
+        else if (lz4_image_block_decode(img+idx+4, blk_hdr & LZ4_IMAGE_BLOCK_LEN, out+pos, n, out) != 0) break;
+        pos += n;
+        idx += padded;
+        n_blocks++;
+    }
+    if ((idx != size) || (pos != out_size)) {
+        printf("error: decompression failed in block %u\r\n", n_blocks);
+        goto exit;
+    }
+    printf("Decompressed %u blocks, %u bytes\r\n", n_blocks, out_size);
+    if (orig) {
+        if ((out_size != orig_size) || (memcmp(out, orig, orig_size) != 0)) {
+            printf("error: decompressed data differs from '%s'\r\n", in_name);
+            goto exit;
+        }
+        printf("Decompressed data verified\r\n");
+    }
+    err = 0;
+exit:
+    free(out);
+    free(img);
+    return err;
+}
+
+//--------------------------------
+int main(int argc, char **argv) {
+    int c;
+    bool help = false;
+    bool check = false;
+
+    printf("\r\n");
+    while ( (c = getopt(argc, argv, "th")) != -1) {
+        switch (c) {
+        case 't':
+            check = true;
+            break;
+        case 'h':
+            help = true;
+            break;
+        default:
+            help = true;
+        }
+    }
+
+    if ((check) && (argc - optind < 1)) help = true;
+    if ((!check) && (argc - optind < 2)) help = true;
+    if (help) {
+        printf("Usage:\r\n");
+        printf("  mkfwlz4 firmware compressed_firmware\r\n");
+        printf("  mkfwlz4 -t compressed_firmware [firmware]\r\n");
+        printf("  firmware: MicroPython.bin file\r\n");
+        printf("        -t: test the compressed image, compare with the original firmware if given\r\n");
+        printf("\r\n");
+        return 0;
+    }
+
+    int err;
+    if (check) {
+        snprintf(out_name, sizeof(out_name), "%s", argv[optind]);
+        if (argc - optind > 1) {
+            snprintf(in_name, sizeof(in_name), "%s", argv[optind+1]);
+            in_data = load_file(in_name, &in_size);
+            if (!in_data) return 1;
+        }
+        printf("Checking compressed firmware '%s'\r\n", out_name);
+        printf("=======================\r\n");
+        err = check_image(out_name, in_data, in_size);
+    }
+    else {
+        snprintf(in_name, sizeof(in_name), "%s", argv[optind]);
+        snprintf(out_name, sizeof(out_name), "%s", argv[optind+1]);
+        printf("Creating compressed firmware\r\n");
+        printf("=======================\r\n");
+        in_data = load_file(in_name, &in_size);
+        if (!in_data) return 1;
+        printf("Firmware: '%s' (%u bytes)\r\n", in_name, in_size);
+        err = create_image();
+        if (err == 0) err = check_image(out_name, in_data, in_size);
+        if (err == 0) printf("Saved to '%s'\r\n", out_name);
+    }
+    printf("=======================\r\n");
+    printf("\r\n");
+    free(in_data);
+    return err;
+}
@@ -0,0 +1,516 @@
+/*
+ * Delta firmware update (ota.patch) creator
+ *
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sha256.h"
+#include "ota_patch.h"
+
+#define SECTOR_SIZE     4096
+#define MIN_MATCH       12      // minimal exact match length starting a copy
+#define HASH_LEN        8       // bytes hashed for the match index
+#define HASH_BITS       20
+#define MAX_CHAIN       128     // candidates checked for every position
+#define EXTEND_STOP     64      // approximate extension stops when the score drops by this much
+#define ADD_GAP         4       // equal bytes merged into an add run (cheaper than a new segment)
+#define PROBE_LEN       32      // bytes compared when probing the last copy offset
+
+typedef struct _image_t {
+    uint8_t  *data;     // prefix + code
+    uint32_t size;      // prefix + code size
+    uint32_t code_size;
+    uint8_t  sha[SHA256_HASH_LEN];
+} image_t;
+
+typedef struct _outbuf_t {
+    uint8_t  *data;
+    uint32_t size;
+    uint32_t alloc;
+} outbuf_t;
+
+static image_t old_img = {0};
+static image_t new_img = {0};
+static char old_name[256] = {0};
+static char new_name[256] = {0};
+static char patch_name[256] = {0};
+
+
+//-----------------------------------------------------
+static int load_image(const char *fname, image_t *img)
+{
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
+        printf("error: failed to open '%s'\r\n", fname);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0) {
+        printf("error: empty file '%s'\r\n", fname);
+        fclose(f);
+        return -1;
+    }
+    img->code_size = (uint32_t)size;
+    img->size = img->code_size + OTA_PATCH_PREFIX_SIZE;
+    img->data = malloc(img->size);
+    if (!img->data) {
+        printf("error: memory allocation\r\n");
+        fclose(f);
+        return -1;
+    }
+    // The firmware is stored in Flash with 5-byte prefix: AES flag, code size
+    img->data[0] = 0;
+    memcpy(img->data+1, &img->code_size, 4);
+    if (fread(img->data + OTA_PATCH_PREFIX_SIZE, 1, img->code_size, f) != img->code_size) {
+        printf("error: failed to read '%s'\r\n", fname);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    sha256_hash(img->data, img->size, img->sha);
+    return 0;
+}
+
+//---------------------------------------------------------------
+static void out_put(outbuf_t *out, const uint8_t *data, uint32_t len)
+{
+    if ((out->size + len) > out->alloc) {
+        out->alloc = (out->size + len) * 2;
+        out->data = realloc(out->data, out->alloc);
+        if (!out->data) {
+            printf("error: memory allocation\r\n");
+            exit(1);
+        }
+    }
+    memcpy(out->data + out->size, data, len);
+    out->size += len;
+}
+
+//-----------------------------------------------------
+static void out_varint(outbuf_t *out, uint32_t val)
+{
+    uint8_t b;
+    do {
+        b = val & 0x7F;
+        val >>= 7;
+        if (val) b |= 0x80;
+        out_put(out, &b, 1);
+    } while (val);
+}
+
+//-----------------------------------------------------------------------
+static void emit_data(outbuf_t *out, const uint8_t *data, uint32_t len)
+{
+    if (len == 0) return;
+    uint8_t op = OTA_PATCH_OP_DATA;
+    out_put(out, &op, 1);
+    out_varint(out, len);
+    out_put(out, data, len);
+}
+
+// Copy with the sparse add data: only the runs of differing bytes are stored
+//---------------------------------------------------------------------------------
+static void emit_copy(outbuf_t *out, uint32_t old_pos, uint32_t new_pos, uint32_t len)
+{
+    const uint8_t *o = old_img.data + old_pos;
+    const uint8_t *n = new_img.data + new_pos;
+    uint8_t op = OTA_PATCH_OP_COPY;
+    uint32_t pos = 0;
+
+    out_put(out, &op, 1);
+    out_varint(out, old_pos);
+    out_varint(out, len);
+    while (pos < len) {
+        uint32_t start = pos;
+        while ((start < len) && (o[start] == n[start])) start++;
+        uint32_t end = start;
+        while (end < len) {
+            if (o[end] != n[end]) {
+                end++;
+                continue;
+            }
+            uint32_t next = end;
+            while ((next < len) && (next < (end + ADD_GAP)) && (o[next] == n[next])) next++;
+            if ((next < len) && (next < (end + ADD_GAP))) end = next;
+            else break;
+        }
+        out_varint(out, start - pos);
+        out_varint(out, end - start);
+        for (uint32_t i=start; i<end; i++) {
+            uint8_t b = n[i] - o[i];
+            out_put(out, &b, 1);
+        }
+        pos = end;
+    }
+}
+
+//-------------------------------------------
+static uint32_t hash_at(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+//-------------------------------------------------------------------------------
+static uint32_t match_len(uint32_t old_pos, uint32_t new_pos)
+{
+    uint32_t n = 0;
+    while (((old_pos + n) < old_img.size) && ((new_pos + n) < new_img.size) &&
+           (old_img.data[old_pos + n] == new_img.data[new_pos + n])) n++;
+    return n;
+}
+
+// Extend the match while at least a half of the bytes are equal (bsdiff style)
+//-------------------------------------------------------------------------------------
+static uint32_t extend_match(uint32_t old_pos, uint32_t new_pos, uint32_t len)
+{
+    int score = 0, best_score = 0;
+    uint32_t best = len;
+    for (uint32_t i=len; ((old_pos + i) < old_img.size) && ((new_pos + i) < new_img.size); i++) {
+        score += (old_img.data[old_pos + i] == new_img.data[new_pos + i]) ? 1 : -1;
+        if (score > best_score) {
+            best_score = score;
+            best = i + 1;
+        }
+        else if (score < (best_score - EXTEND_STOP)) break;
+    }
+    return best;
+}
+
+// Relocated code: most bytes are equal at the previous copy offset
+//---------------------------------------------------------------
+static bool probe_offset(uint32_t old_pos, uint32_t new_pos)
+{
+    if (((old_pos + PROBE_LEN) > old_img.size) || ((new_pos + PROBE_LEN) > new_img.size)) return false;
+    int eq = 0;
+    for (int i=0; i<PROBE_LEN; i++) {
+        if (old_img.data[old_pos + i] == new_img.data[new_pos + i]) eq++;
+    }
+    return (eq >= ((PROBE_LEN * 3) / 4));
+}
+
+//------------------------------------
+static int create_patch(outbuf_t *out)
+{
+    uint32_t *head = malloc(sizeof(uint32_t) << HASH_BITS);
+    uint32_t *chain = malloc(sizeof(uint32_t) * old_img.size);
+    if ((!head) || (!chain)) {
+        printf("error: memory allocation\r\n");
+        return -1;
+    }
+    memset(head, 0xFF, sizeof(uint32_t) << HASH_BITS);
+    for (uint32_t i=0; (i + HASH_LEN) <= old_img.size; i++) {
+        uint32_t h = hash_at(old_img.data + i);
+        chain[i] = head[h];
+        head[h] = i;
+    }
+
+    ota_patch_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = OTA_PATCH_MAGIC;
+    hdr.version = OTA_PATCH_VERSION;
+    hdr.old_size = old_img.code_size;
+    hdr.new_size = new_img.code_size;
+    memcpy(hdr.old_sha, old_img.sha, SHA256_HASH_LEN);
+    memcpy(hdr.new_sha, new_img.sha, SHA256_HASH_LEN);
+    out_put(out, (uint8_t *)&hdr, sizeof(hdr));
+
+    uint32_t pos = 0, lit_start = 0, n_copy = 0, copied = 0;
+    int64_t last_delta = 0;
+    while (pos < new_img.size) {
+        uint32_t best_len = 0, best_old = 0;
+        int64_t cand = (int64_t)pos + last_delta;
+
+        if ((cand >= 0) && (cand < old_img.size)) {
+            best_len = match_len((uint32_t)cand, pos);
+            best_old = (uint32_t)cand;
+        }
+        if ((best_len < MIN_MATCH) && ((pos + HASH_LEN) <= new_img.size)) {
+            uint32_t c = head[hash_at(new_img.data + pos)];
+            for (int n=0; (n < MAX_CHAIN) && (c != 0xFFFFFFFF); n++, c = chain[c]) {
+                uint32_t l = match_len(c, pos);
+                if (l > best_len) {
+                    best_len = l;
+                    best_old = c;
+                }
+            }
+        }
+        if ((best_len < MIN_MATCH) && (cand >= 0) && probe_offset((uint32_t)cand, pos)) {
+            best_len = 1;
+            best_old = (uint32_t)cand;
+        }
+        else if (best_len < MIN_MATCH) {
+            pos++;
+            continue;
+        }
+
+        uint32_t len = extend_match(best_old, pos, best_len);
+        emit_data(out, new_img.data + lit_start, pos - lit_start);
+        emit_copy(out, best_old, pos, len);
+        last_delta = (int64_t)best_old - pos;
+        n_copy++;
+        copied += len;
+        pos += len;
+        lit_start = pos;
+    }
+    emit_data(out, new_img.data + lit_start, pos - lit_start);
+    uint8_t op = OTA_PATCH_OP_END;
+    out_put(out, &op, 1);
+
+    printf("Copy operations: %u, %u bytes copied, %u new bytes\r\n", n_copy, copied, new_img.size - copied);
+    free(head);
+    free(chain);
+    return 0;
+}
+
+
+// ==== Patch verification on simulated Flash ====
+// The old firmware is placed at 'SIM_OLD_ADDRESS', the new one is created at 'SIM_NEW_ADDRESS',
+// which initially holds the old firmware, so the number of sectors which actually have to be programmed is known
+
+#define SIM_OLD_ADDRESS     0x00000000
+
+typedef struct _sim_t {
+    uint8_t  *flash;
+    uint32_t flash_size;
+    uint32_t new_address;
+    const uint8_t *patch;
+    uint32_t patch_size;
+    uint32_t patch_pos;
+    sha256_context_t sha;
+    uint32_t written;
+    uint32_t unchanged;
+} sim_t;
+
+//------------------------------------------------------------------
+static int sim_read_patch(void *ctx, uint8_t *buf, uint32_t len)
+{
+    sim_t *sim = (sim_t *)ctx;
+    if (len > (sim->patch_size - sim->patch_pos)) len = sim->patch_size - sim->patch_pos;
+    memcpy(buf, sim->patch + sim->patch_pos, len);
+    sim->patch_pos += len;
+    return len;
+}
+
+//--------------------------------------------------------------------------------
+static int sim_read_old(void *ctx, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    sim_t *sim = (sim_t *)ctx;
+    if ((SIM_OLD_ADDRESS + offset + len) > sim->new_address) return -1;
+    memcpy(buf, sim->flash + SIM_OLD_ADDRESS + offset, len);
+    return 0;
+}
+
+// Like 'w25qxx_write_data()', sectors with unchanged content are not programmed
+//----------------------------------------------------------------------------------------
+static int sim_write_sector(void *ctx, uint32_t offset, const uint8_t *buf, uint32_t len)
+{
+    sim_t *sim = (sim_t *)ctx;
+    if ((sim->new_address + offset + len) > sim->flash_size) return -1;
+    if (memcmp(sim->flash + sim->new_address + offset, buf, len) == 0) sim->unchanged++;
+    else {
+        memcpy(sim->flash + sim->new_address + offset, buf, len);
+        sim->written++;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------
+static void sim_hash_update(void *ctx, const uint8_t *buf, uint32_t len)
+{
+    sim_t *sim = (sim_t *)ctx;
+    sha256_update(&sim->sha, buf, len);
+}
+
+//--------------------------------------------------------------
+static int verify_patch(const uint8_t *patch, uint32_t patch_size)
+{
+    sim_t sim;
+    uint8_t sector[SECTOR_SIZE];
+    uint8_t hash[SHA256_HASH_LEN];
+    ota_patch_header_t hdr;
+    ota_patch_t p;
+    int res;
+
+    memset(&sim, 0, sizeof(sim));
+    uint32_t old_flash = old_img.size + SHA256_HASH_LEN;
+    uint32_t new_flash = new_img.size + SHA256_HASH_LEN;
+    sim.new_address = ((old_flash + SECTOR_SIZE - 1) / SECTOR_SIZE) * SECTOR_SIZE;
+    sim.flash_size = sim.new_address + (((((old_flash > new_flash) ? old_flash : new_flash) + SECTOR_SIZE - 1) / SECTOR_SIZE) * SECTOR_SIZE);
+    sim.flash = malloc(sim.flash_size);
+    if (!sim.flash) {
+        printf("error: memory allocation\r\n");
+        return 1;
+    }
+    memset(sim.flash, 0xFF, sim.flash_size);
+    memcpy(sim.flash + SIM_OLD_ADDRESS, old_img.data, old_img.size);
+    memcpy(sim.flash + SIM_OLD_ADDRESS + old_img.size, old_img.sha, SHA256_HASH_LEN);
+    memcpy(sim.flash + sim.new_address, sim.flash + SIM_OLD_ADDRESS, sim.new_address - SIM_OLD_ADDRESS);
+    sim.patch = patch;
+    sim.patch_size = patch_size;
+
+    ota_patch_io_t io = {
+        .read_patch = sim_read_patch,
+        .read_old = sim_read_old,
+        .write_sector = sim_write_sector,
+        .hash_update = sim_hash_update,
+        .ctx = &sim,
+    };
+
+    res = ota_patch_read_header(&io, &hdr);
+    if (res == OTA_PATCH_OK) {
+        if ((hdr.old_size != old_img.code_size) || (memcmp(hdr.old_sha, old_img.sha, SHA256_HASH_LEN) != 0)) {
+            printf("error: patch was not created from '%s'\r\n", old_name);
+            free(sim.flash);
+            return 1;
+        }
+        if ((hdr.new_size != new_img.code_size) || (memcmp(hdr.new_sha, new_img.sha, SHA256_HASH_LEN) != 0)) {
+            printf("error: patch does not create '%s'\r\n", new_name);
+            free(sim.flash);
+            return 1;
+        }
+        sha256_init(&sim.sha);
+        ota_patch_init(&p, &io, &hdr, sector, SECTOR_SIZE);
+        res = ota_patch_apply(&p);
+        if (res == OTA_PATCH_OK) {
+            sha256_final(&sim.sha, hash);
+            res = ota_patch_finish(&p, &hdr, hash);
+        }
+    }
+    if (res != OTA_PATCH_OK) {
+        printf("error: applying the patch failed (%d)\r\n", res);
+        free(sim.flash);
+        return 1;
+    }
+
+    // Check the created firmware as it would be checked by Kboot
+    uint8_t *fw = sim.flash + sim.new_address;
+    uint32_t fw_size;
+    memcpy(&fw_size, fw+1, 4);
+    bool ok = (fw_size == new_img.code_size) && (memcmp(fw, new_img.data, new_img.size) == 0);
+    if (ok) {
+        sha256_hash(fw, fw_size + OTA_PATCH_PREFIX_SIZE, hash);
+        ok = (memcmp(hash, fw + fw_size + OTA_PATCH_PREFIX_SIZE, SHA256_HASH_LEN) == 0) &&
+             (memcmp(hash, new_img.sha, SHA256_HASH_LEN) == 0);
+    }
+    printf("Applied on simulated Flash: %u sectors programmed, %u sectors unchanged\r\n", sim.written, sim.unchanged);
+    printf("New firmware %s\r\n", (ok) ? "verified" : "VERIFICATION FAILED");
+    free(sim.flash);
+    return (ok) ? 0 : 1;
+}
+
+//-----------------------------------------
+static int read_patch_file(outbuf_t *out)
+{
+    FILE *f = fopen(patch_name, "rb");
+    if (!f) {
+        printf("error: failed to open '%s'\r\n", patch_name);
+        return -1;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out_put(out, buf, n);
+    fclose(f);
+    return 0;
+}
+
+//--------------------------------
+int main(int argc, char **argv) {
+    int c;
+    bool help = false;
+    bool apply = false;
+    outbuf_t patch = {0};
+    int err = 0;
+
+    printf("\r\n");
+    while ( (c = getopt(argc, argv, "ah")) != -1) {
+        switch (c) {
+        case 'a':
+            apply = true;
+            break;
+        case 'h':
+            help = true;
+            break;
+        default:
+            help = true;
+        }
+    }
+
+    if (argc - optind < 3) help = true;
+    if (help) {
+        printf("Usage:\r\n");
+        printf("  mkotapatch old_firmware new_firmware patch_name\r\n");
+        printf("  mkotapatch -a old_firmware new_firmware patch_name\r\n");
+        printf("  firmware: MicroPython.bin files\r\n");
+        printf("        -a: apply the existing patch on simulated Flash and verify it\r\n");
+        printf("\r\n");
+        return 0;
+    }
+    snprintf(old_name, sizeof(old_name), "%s", argv[optind]);
+    snprintf(new_name, sizeof(new_name), "%s", argv[optind+1]);
+    snprintf(patch_name, sizeof(patch_name), "%s", argv[optind+2]);
+
+    if ((load_image(old_name, &old_img) != 0) || (load_image(new_name, &new_img) != 0)) return 1;
+
+    if (apply) {
+        printf("Checking firmware patch '%s'\r\n", patch_name);
+        printf("=======================\r\n");
+        if (read_patch_file(&patch) != 0) err = 1;
+        else err = verify_patch(patch.data, patch.size);
+    }
+    else {
+        printf("Creating firmware patch\r\n");
+        printf("=======================\r\n");
+        printf("Old firmware: '%s' (%u bytes)\r\n", old_name, old_img.code_size);
+        printf("New firmware: '%s' (%u bytes)\r\n", new_name, new_img.code_size);
+        err = create_patch(&patch);
+        if (err == 0) {
+            printf("Patch size: %u bytes (%.1f%% of the new firmware)\r\n", patch.size, (double)patch.size * 100.0 / new_img.code_size);
+            err = verify_patch(patch.data, patch.size);
+        }
+        if (err == 0) {
+            printf("Saving patch to '%s'\r\n", patch_name);
+            FILE *f = fopen(patch_name, "wb");
+            if ((!f) || (fwrite(patch.data, 1, patch.size, f) != patch.size)) {
+                printf("error: failed to write '%s'\r\n", patch_name);
+                err = 1;
+            }
+            if (f) fclose(f);
+        }
+    }
+    printf("=======================\r\n");
+    printf("\r\n");
+    return err;
+}
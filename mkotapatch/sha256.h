@@ -0,0 +1,49 @@
+/*
+ * Software SHA256 for the host utilities
+ *
+ * This file is part of the MicroPython K210 project, https://github.com/loboris/MicroPython_K210_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_HASH_LEN 32
+
+typedef struct _sha256_context_t {
+    uint32_t state[8];
+    uint64_t total_len;
+    uint8_t  buffer[64];
+    uint32_t buffer_len;
+} sha256_context_t;
+
+void sha256_init(sha256_context_t *ctx);
+void sha256_update(sha256_context_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_context_t *ctx, uint8_t *hash);
+void sha256_hash(const void *data, size_t len, uint8_t *hash);
+
+#endif